@@ -1,10 +1,9 @@
 #version 450
 
-layout (location = 0) in vec3 vertex_position;
-// layout (location = 1) in vec3 vertex_normal;
+// core::packed_vertex_t or core::packed_float_vertex_t, the position is decoded with the push constant
+// normal and tangent (octahedral) are bound but not read until the gbuffer gets a normal target
+layout (location = 0) in vec4 vertex_position;
 layout (location = 2) in vec2 vertex_uv;
-// layout (location = 3) in vec3 vertex_tangent;
-// layout (location = 4) in vec3 vertex_bitangent;
 
 layout (location = 0) out vec2 fragment_uv;
 // layout (location = 1) out vec3 fragment_T;
@@ -21,8 +20,13 @@ layout (set = 0, binding = 0) uniform camera_uniform_t {
     // maybe add priv ?
 };
 
+layout (push_constant) uniform mesh_push_constant_t {
+    vec4 position_offset;
+    vec4 position_scale;
+};
+
 void main() {
     fragment_uv = vertex_uv;
-    vec4 world_position = vec4(vertex_position, 1);
+    vec4 world_position = vec4(position_offset.xyz + vertex_position.xyz * position_scale.xyz, 1);
     gl_Position = projection_view * world_position;
 }
\ No newline at end of file
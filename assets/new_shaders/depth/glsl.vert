@@ -1,6 +1,7 @@
 #version 450
 
-layout (location = 0) in vec3 vertex_position;
+// core::packed_vertex_t or core::packed_float_vertex_t, decoded with the push constant
+layout (location = 0) in vec4 vertex_position;
 
 layout (set = 0, binding = 0) uniform camera_uniform_t {
     // current
@@ -12,6 +13,11 @@ layout (set = 0, binding = 0) uniform camera_uniform_t {
     // maybe add priv ?
 };
 
+layout (push_constant) uniform mesh_push_constant_t {
+    vec4 position_offset;
+    vec4 position_scale;
+};
+
 // not in this renderer
 // layout (set = 1, binding = 0) uniform model_uniform_t {
 //     mat4 model;
@@ -20,6 +26,6 @@ layout (set = 0, binding = 0) uniform camera_uniform_t {
 
 void main() {
     // vec4 world_position = model * vec4(vertex_position, 1);
-    vec4 world_position = vec4(vertex_position, 1);
+    vec4 world_position = vec4(position_offset.xyz + vertex_position.xyz * position_scale.xyz, 1);
     gl_Position = projection_view * world_position;
 }
\ No newline at end of file
@@ -22,6 +22,18 @@ struct node_t {
     uint first_index;
 };
 
+// 4 wide node quantized to one cache line, matches compressed_node_t in projects/bvh_my/compressed_bvh.hpp
+// child bound plane = origin + q * exp2(exponent), byte i of every packed uint belongs to child i
+struct compressed_node_t {
+    vec3 origin;
+    uint exponents_and_child_mask;  // 3 signed 8 bit exponents, child mask in the top byte
+    uint qmin[3];
+    uint qmax[3];
+    uint child[4];
+    uint primitive_counts;
+    uint padding;
+};
+
 struct hit_t {
     uint primitive_id;
 };
@@ -38,6 +50,10 @@ layout (set = 0, binding = 2, scalar) readonly buffer indices_ssbo {
     uint indices[];
 };
 
+layout (set = 0, binding = 4, scalar) readonly buffer compressed_nodes_ssbo {
+    compressed_node_t compressed_nodes[];
+};
+
 layout (set = 0, binding = 3, scalar) uniform ubo {
     mat4 view;
     mat4 projection;
@@ -51,9 +67,13 @@ layout (set = 0, binding = 3, scalar) uniform ubo {
     vec3 dir;
     vec3 up;
     vec3 right;
+
+    int use_compressed_bvh;
 };
 
 hit_t closest_hit(in vec3 origin, in vec3 direction, inout float tmin, inout float tmax);
+hit_t closest_hit_compressed(in vec3 origin, in vec3 direction, inout float tmin, inout float tmax);
+vec2 aabb_intersect(in aabb_t aabb, in vec3 origin, in vec3 direction, in float tmin, in float tmax);
 vec2 node_intersect(in node_t node, in vec3 origin, in vec3 direction, in float tmin, in float tmax);
 bool node_is_leaf(in node_t node);
 bool triangle_intersect(in triangle_t triangle, in vec3 origin, in vec3 direction, inout float tmin, inout float tmax);
@@ -77,7 +97,10 @@ void main() {
     hit_t hit;
     hit.primitive_id = invalid_hit_id;
     #if 1
-    hit = closest_hit(origin.xyz, direction.xyz, tmin, tmax);
+    if (use_compressed_bvh != 0)
+        hit = closest_hit_compressed(origin.xyz, direction.xyz, tmin, tmax);
+    else
+        hit = closest_hit(origin.xyz, direction.xyz, tmin, tmax);
     #else
     for (int i = 0; i < num_tris; i++) {
         if (triangle_intersect(triangles[i], origin.xyz, direction.xyz, tmin, tmax)) {
@@ -100,10 +123,14 @@ bool is_hit(in hit_t hit) {
 }
 
 vec2 node_intersect(in node_t node, in vec3 origin, in vec3 direction, in float tmin, in float tmax) {
+    return aabb_intersect(node.aabb, origin, direction, tmin, tmax);
+}
+
+vec2 aabb_intersect(in aabb_t aabb, in vec3 origin, in vec3 direction, in float tmin, in float tmax) {
     vec3 inverse_direction = 1.0 / direction;
 
-    vec3 tmin_vec = (node.aabb.min - origin) * inverse_direction;
-    vec3 tmax_vec = (node.aabb.max - origin) * inverse_direction;
+    vec3 tmin_vec = (aabb.min - origin) * inverse_direction;
+    vec3 tmax_vec = (aabb.max - origin) * inverse_direction;
 
     vec3 t0 = min(tmin_vec, tmax_vec);
     vec3 t1 = max(tmin_vec, tmax_vec);
@@ -230,4 +257,60 @@ hit_t closest_hit(in vec3 origin, in vec3 direction, inout float tmin, inout flo
 
     #endif
     return hit;
+}
+
+hit_t closest_hit_compressed(in vec3 origin, in vec3 direction, inout float tmin, inout float tmax) {
+    hit_t hit;
+    hit.primitive_id = invalid_hit_id;
+
+    // compressed_bvh_t::max_gpu_depth, the host does not enable this path for deeper trees
+    const uint COMPRESSED_MAX_DEPTH = 32;
+    // every visited node pushes at most 3 entries on top of the one it popped
+    const uint MAX_STACK_SIZE = 3 * COMPRESSED_MAX_DEPTH + 1;
+    // x: compressed node index or first primitive index, y: leaf primitive count, 0 for nodes, z: entry distance bits
+    uvec3 stack[MAX_STACK_SIZE];
+    uint stack_size = 0;
+    stack[stack_size++] = uvec3(0, 0, floatBitsToUint(tmin));
+
+    while (stack_size != 0) {
+        uvec3 entry = stack[--stack_size];
+        // the closest hit might have moved past this entry since it was pushed
+        if (uintBitsToFloat(entry.z) > tmax)
+            continue;
+
+        if (entry.y != 0) {
+            for (uint i = 0; i < entry.y; i++) {
+                uint primitive_id = indices[entry.x + i];
+                if (triangle_intersect(triangles[primitive_id], origin, direction, tmin, tmax))
+                    hit.primitive_id = primitive_id;
+            }
+            continue;
+        }
+
+        compressed_node_t node = compressed_nodes[entry.x];
+        ivec3 exponent = ivec3(bitfieldExtract(int(node.exponents_and_child_mask), 0, 8),
+                               bitfieldExtract(int(node.exponents_and_child_mask), 8, 8),
+                               bitfieldExtract(int(node.exponents_and_child_mask), 16, 8));
+        vec3 scale = exp2(vec3(exponent));
+        uint child_mask = node.exponents_and_child_mask >> 24;
+
+        // push hit children far to near so the nearest one is popped first
+        uint first = stack_size;
+        for (uint i = 0; i < 4; i++) {
+            if ((child_mask & (1u << i)) == 0)
+                continue;
+            uint shift = 8 * i;
+            aabb_t aabb;
+            aabb.min = node.origin + vec3((node.qmin[0] >> shift) & 0xff, (node.qmin[1] >> shift) & 0xff, (node.qmin[2] >> shift) & 0xff) * scale;
+            aabb.max = node.origin + vec3((node.qmax[0] >> shift) & 0xff, (node.qmax[1] >> shift) & 0xff, (node.qmax[2] >> shift) & 0xff) * scale;
+            vec2 intr = aabb_intersect(aabb, origin, direction, tmin, tmax);
+            if (intr.y < intr.x)
+                continue;
+            uint j = stack_size++;
+            for (; j > first && uintBitsToFloat(stack[j - 1].z) < intr.x; j--)
+                stack[j] = stack[j - 1];
+            stack[j] = uvec3(node.child[i], (node.primitive_counts >> shift) & 0xff, floatBitsToUint(intr.x));
+        }
+    }
+    return hit;
 }
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "asset_pack.hpp"
+
+#include <cstring>
+#include <limits>
+
+namespace core {
+
+namespace {
+
+// count elements of element_size at offset lie inside size bytes, checked without overflowing
+bool fits(uint64_t size, uint64_t offset, uint64_t count, uint64_t element_size, uint64_t alignment) {
+    return offset % alignment == 0 && offset <= size && count <= (size - offset) / element_size;
+}
+
+template <typename T>
+std::span<const T> span_at(const std::byte *data, uint64_t offset, uint64_t count) {
+    return { reinterpret_cast<const T *>(data + offset), static_cast<size_t>(count) };
+}
+
+// meshlets index into the local buffers of their mesh and draw ranges of its index buffer, a meshlet pointing past any of
+// them would read out of bounds in the culling and drawing that trusts the pack, the blobs are known to be in the file
+bool valid_meshlets(const std::byte *data, const pack_mesh_t& mesh) {
+    const auto meshlet_vertices = span_at<uint32_t>(data, mesh.meshlet_vertices_offset, mesh.meshlet_vertex_count);
+    const auto meshlet_triangles = span_at<uint8_t>(data, mesh.meshlet_triangles_offset, mesh.meshlet_triangle_count * 3);
+    for (const meshlet_t& meshlet : span_at<meshlet_t>(data, mesh.meshlets_offset, mesh.meshlet_count)) {
+        if (uint64_t(meshlet.vertex_offset) + meshlet.vertex_count > mesh.meshlet_vertex_count ||
+            uint64_t(meshlet.triangle_offset) + meshlet.triangle_count > mesh.meshlet_triangle_count ||
+            (uint64_t(meshlet.triangle_offset) + meshlet.triangle_count) * 3 > mesh.index_count) {
+            return false;
+        }
+        for (uint32_t i = 0; i < meshlet.vertex_count; i++) {
+            if (meshlet_vertices[meshlet.vertex_offset + i] >= mesh.vertex_count) {
+                return false;
+            }
+        }
+        for (uint32_t i = 0; i < meshlet.triangle_count * 3; i++) {
+            if (meshlet_triangles[meshlet.triangle_offset * 3 + i] >= meshlet.vertex_count) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::optional<asset_pack_t> asset_pack_t::open(const std::filesystem::path& file_path) {
+    auto mapped_file = mapped_file_t::open(file_path);
+    if (!mapped_file || mapped_file->size() < sizeof(pack_header_t)) {
+        return std::nullopt;
+    }
+
+    pack_header_t header;
+    std::memcpy(&header, mapped_file->data(), sizeof(header));
+    if (std::memcmp(header.magic, pack_header_t::magic_value, sizeof(header.magic)) != 0 ||
+        header.version != pack_header_t::current_version ||
+        header.vertex_size != sizeof(vertex_t)) {
+        return std::nullopt;
+    }
+
+    const uint64_t size = mapped_file->size();
+    const std::byte *data = mapped_file->data();
+    if (!fits(size, header.section_table_offset, header.section_count, sizeof(pack_section_t), pack_header_t::table_alignment)) {
+        return std::nullopt;
+    }
+
+    asset_pack_t asset_pack{ std::move(*mapped_file) };
+    bool has_blobs = false;
+    uint64_t blobs_begin = 0, blobs_end = 0;
+    for (const pack_section_t& section : span_at<pack_section_t>(data, header.section_table_offset, header.section_count)) {
+        switch (section.type) {
+            case pack_section_type_t::e_meshes:
+                if (section.element_size != sizeof(pack_mesh_t) || !fits(size, section.offset, section.count, sizeof(pack_mesh_t), pack_header_t::table_alignment)) {
+                    return std::nullopt;
+                }
+                asset_pack._meshes = span_at<pack_mesh_t>(data, section.offset, section.count);
+                break;
+            case pack_section_type_t::e_materials:
+                if (section.element_size != sizeof(pack_material_t) || !fits(size, section.offset, section.count, sizeof(pack_material_t), pack_header_t::table_alignment)) {
+                    return std::nullopt;
+                }
+                asset_pack._materials = span_at<pack_material_t>(data, section.offset, section.count);
+                break;
+            case pack_section_type_t::e_textures:
+                if (section.element_size != sizeof(pack_texture_t) || !fits(size, section.offset, section.count, sizeof(pack_texture_t), pack_header_t::table_alignment)) {
+                    return std::nullopt;
+                }
+                asset_pack._textures = span_at<pack_texture_t>(data, section.offset, section.count);
+                break;
+            case pack_section_type_t::e_blobs:
+                if (section.element_size != 1 || !fits(size, section.offset, section.count, 1, pack_header_t::blob_alignment)) {
+                    return std::nullopt;
+                }
+                has_blobs = true;
+                blobs_begin = section.offset;
+                blobs_end = section.offset + section.count;
+                break;
+            default:
+                // sections from a newer writer that this reader does not know about are skipped
+                break;
+        }
+    }
+
+    // every record has to point into the blob section, so the spans handed out later need no checks
+    auto in_blobs = [&](uint64_t offset, uint64_t count, uint64_t element_size) {
+        return has_blobs && offset >= blobs_begin && fits(blobs_end, offset, count, element_size, pack_header_t::blob_alignment);
+    };
+    for (const pack_mesh_t& mesh : asset_pack._meshes) {
+        if (!in_blobs(mesh.vertices_offset, mesh.vertex_count, sizeof(vertex_t)) ||
+            !in_blobs(mesh.indices_offset, mesh.index_count, sizeof(uint32_t)) ||
+            !in_blobs(mesh.meshlets_offset, mesh.meshlet_count, sizeof(meshlet_t)) ||
+            !in_blobs(mesh.meshlet_bounds_offset, mesh.meshlet_count, sizeof(meshlet_bounds_t)) ||
+            !in_blobs(mesh.meshlet_vertices_offset, mesh.meshlet_vertex_count, sizeof(uint32_t)) ||
+            mesh.meshlet_triangle_count > std::numeric_limits<uint64_t>::max() / 3 ||
+            !in_blobs(mesh.meshlet_triangles_offset, mesh.meshlet_triangle_count * 3, 1) ||
+            mesh.material_index >= asset_pack._materials.size() ||
+            !valid_meshlets(data, mesh)) {
+            return std::nullopt;
+        }
+    }
+    for (const pack_texture_t& texture : asset_pack._textures) {
+        if (texture.pixels_size != 4ull * texture.width * texture.height || !in_blobs(texture.pixels_offset, texture.pixels_size, 1)) {
+            return std::nullopt;
+        }
+    }
+    for (const pack_material_t& material : asset_pack._materials) {
+        for (uint32_t texture_index : { material.diffuse_map, material.normal_map, material.specular_map }) {
+            if (texture_index != pack_material_t::no_texture && texture_index >= asset_pack._textures.size()) {
+                return std::nullopt;
+            }
+        }
+    }
+    return asset_pack;
+}
+
+std::span<const vertex_t> asset_pack_t::vertices(const pack_mesh_t& mesh) const {
+    return span_at<vertex_t>(_file.data(), mesh.vertices_offset, mesh.vertex_count);
+}
+
+std::span<const uint32_t> asset_pack_t::indices(const pack_mesh_t& mesh) const {
+    return span_at<uint32_t>(_file.data(), mesh.indices_offset, mesh.index_count);
+}
+
+std::span<const meshlet_t> asset_pack_t::meshlets(const pack_mesh_t& mesh) const {
+    return span_at<meshlet_t>(_file.data(), mesh.meshlets_offset, mesh.meshlet_count);
+}
+
+std::span<const meshlet_bounds_t> asset_pack_t::meshlet_bounds(const pack_mesh_t& mesh) const {
+    return span_at<meshlet_bounds_t>(_file.data(), mesh.meshlet_bounds_offset, mesh.meshlet_count);
+}
+
+std::span<const uint32_t> asset_pack_t::meshlet_vertices(const pack_mesh_t& mesh) const {
+    return span_at<uint32_t>(_file.data(), mesh.meshlet_vertices_offset, mesh.meshlet_vertex_count);
+}
+
+std::span<const uint8_t> asset_pack_t::meshlet_triangles(const pack_mesh_t& mesh) const {
+    return span_at<uint8_t>(_file.data(), mesh.meshlet_triangles_offset, mesh.meshlet_triangle_count * 3);
+}
+
+std::span<const std::byte> asset_pack_t::pixels(const pack_texture_t& texture) const {
+    return span_at<std::byte>(_file.data(), texture.pixels_offset, texture.pixels_size);
+}
+
+} // namespace core
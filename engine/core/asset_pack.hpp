@@ -0,0 +1,122 @@
+#ifndef CORE_ASSET_PACK_HPP
+#define CORE_ASSET_PACK_HPP
+
+#include "core/mapped_file.hpp"
+#include "core/meshlet.hpp"
+#include "core/model.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+namespace core {
+
+// on disk layout of an asset pack, written by asset_pack_cli
+// header, section table, then the sections, every record table is 16 byte aligned and every vertex, index and pixel blob
+// 64 byte aligned, all offsets are bytes from the start of the file so nothing has to be fixed up after mapping
+// little endian, the vertex size guards against a changed vertex_t that forgot to bump the version
+struct pack_header_t {
+    static constexpr char magic_value[8] = { 'A', 'S', 'S', 'E', 'T', 'P', 'A', 'K' };
+    static constexpr uint32_t current_version = 2;
+    static constexpr uint64_t table_alignment = 16;
+    static constexpr uint64_t blob_alignment = 64;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t vertex_size;
+    uint32_t section_count;
+    uint32_t padding;
+    uint64_t section_table_offset;
+};
+
+enum class pack_section_type_t : uint32_t {
+    // pack_mesh_t records
+    e_meshes,
+    // pack_material_t records
+    e_materials,
+    // pack_texture_t records
+    e_textures,
+    // the vertex, index, meshlet and pixel blobs the records point into
+    e_blobs,
+};
+
+struct pack_section_t {
+    pack_section_type_t type;
+    // size of one record, 1 for e_blobs
+    uint32_t element_size;
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct pack_mesh_t {
+    uint64_t vertices_offset;
+    uint64_t vertex_count;
+    uint64_t indices_offset;
+    uint64_t index_count;
+    aabb_t aabb;
+    // index into the materials
+    uint32_t material_index;
+    uint32_t padding;
+    // build_meshlets of the mesh, meshlet_t and meshlet_bounds_t records, one of each per meshlet
+    uint64_t meshlets_offset;
+    uint64_t meshlet_bounds_offset;
+    uint64_t meshlet_count;
+    uint64_t meshlet_vertices_offset;
+    uint64_t meshlet_vertex_count;
+    // 3 bytes per triangle
+    uint64_t meshlet_triangles_offset;
+    uint64_t meshlet_triangle_count;
+};
+
+struct pack_material_t {
+    static constexpr uint32_t no_texture = static_cast<uint32_t>(-1);
+
+    glm::vec4 diffuse_color;
+    // indices into the textures, no_texture when the material has none of that type
+    uint32_t diffuse_map;
+    uint32_t normal_map;
+    uint32_t specular_map;
+    uint32_t padding;
+};
+
+// rgba8, rows bottom up like image_builder_t::loadFromPath loads them
+struct pack_texture_t {
+    uint32_t width;
+    uint32_t height;
+    uint64_t pixels_offset;
+    uint64_t pixels_size;
+};
+
+// a pack mapped read only, every span points straight into the mapping and is valid as long as the object is
+// vertices and indices have the layout of vertex_t and uint32_t, so they go into staging buffers with a single memcpy
+class asset_pack_t {
+public:
+    // nullopt when the file is missing, truncated, from another version, has a section pointing outside the file or a
+    // meshlet pointing outside its mesh
+    static std::optional<asset_pack_t> open(const std::filesystem::path& file_path);
+
+    std::span<const pack_mesh_t> meshes() const { return _meshes; }
+    std::span<const pack_material_t> materials() const { return _materials; }
+    std::span<const pack_texture_t> textures() const { return _textures; }
+
+    std::span<const vertex_t> vertices(const pack_mesh_t& mesh) const;
+    std::span<const uint32_t> indices(const pack_mesh_t& mesh) const;
+    std::span<const meshlet_t> meshlets(const pack_mesh_t& mesh) const;
+    std::span<const meshlet_bounds_t> meshlet_bounds(const pack_mesh_t& mesh) const;
+    std::span<const uint32_t> meshlet_vertices(const pack_mesh_t& mesh) const;
+    std::span<const uint8_t> meshlet_triangles(const pack_mesh_t& mesh) const;
+    std::span<const std::byte> pixels(const pack_texture_t& texture) const;
+
+private:
+    asset_pack_t(mapped_file_t&& file) : _file(std::move(file)) {}
+
+    mapped_file_t _file;
+    std::span<const pack_mesh_t> _meshes;
+    std::span<const pack_material_t> _materials;
+    std::span<const pack_texture_t> _textures;
+};
+
+} // namespace core
+
+#endif
@@ -0,0 +1,101 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace core {
+
+std::optional<mapped_file_t> mapped_file_t::open(const std::filesystem::path& file_path) {
+    mapped_file_t mapped_file{};
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileW(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return std::nullopt;
+    }
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return std::nullopt;
+    }
+    mapped_file._size = static_cast<size_t>(size.QuadPart);
+    // mapping an empty file fails, an empty span is all there is to return
+    if (mapped_file._size != 0) {
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            mapped_file._data = static_cast<const std::byte *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            // the view keeps the mapping alive
+            CloseHandle(mapping);
+        }
+        if (!mapped_file._data) {
+            CloseHandle(file);
+            return std::nullopt;
+        }
+    }
+    CloseHandle(file);
+#else
+    int file = ::open(file_path.c_str(), O_RDONLY);
+    if (file == -1) {
+        return std::nullopt;
+    }
+    struct stat stat{};
+    if (fstat(file, &stat) == -1) {
+        ::close(file);
+        return std::nullopt;
+    }
+    mapped_file._size = static_cast<size_t>(stat.st_size);
+    // mapping an empty file fails, an empty span is all there is to return
+    if (mapped_file._size != 0) {
+        void *data = mmap(nullptr, mapped_file._size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED) {
+            ::close(file);
+            return std::nullopt;
+        }
+        mapped_file._data = static_cast<const std::byte *>(data);
+    }
+    // the mapping keeps its own reference to the file
+    ::close(file);
+#endif
+
+    return mapped_file;
+}
+
+mapped_file_t::mapped_file_t(mapped_file_t&& other) noexcept
+  : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)) {}
+
+mapped_file_t& mapped_file_t::operator = (mapped_file_t&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+    }
+    return *this;
+}
+
+mapped_file_t::~mapped_file_t() {
+    unmap();
+}
+
+void mapped_file_t::unmap() {
+    if (!_data) {
+        return;
+    }
+#if defined(_WIN32)
+    UnmapViewOfFile(_data);
+#else
+    munmap(const_cast<std::byte *>(_data), _size);
+#endif
+    _data = nullptr;
+    _size = 0;
+}
+
+} // namespace core
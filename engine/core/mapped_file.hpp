@@ -0,0 +1,39 @@
+#ifndef CORE_MAPPED_FILE_HPP
+#define CORE_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+namespace core {
+
+// read only mapping of a whole file, pages are only read from disk (or the os cache) when they are touched
+class mapped_file_t {
+public:
+    // nullopt when the file does not exist or cannot be mapped
+    static std::optional<mapped_file_t> open(const std::filesystem::path& file_path);
+
+    mapped_file_t(mapped_file_t&& other) noexcept;
+    mapped_file_t& operator = (mapped_file_t&& other) noexcept;
+    ~mapped_file_t();
+
+    mapped_file_t(const mapped_file_t&) = delete;
+    mapped_file_t& operator = (const mapped_file_t&) = delete;
+
+    std::span<const std::byte> bytes() const { return { _data, _size }; }
+    const std::byte *data() const { return _data; }
+    size_t size() const { return _size; }
+
+private:
+    mapped_file_t() = default;
+    void unmap();
+
+    const std::byte *_data{ nullptr };
+    size_t _size{ 0 };
+};
+
+} // namespace core
+
+#endif
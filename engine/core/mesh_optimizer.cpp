@@ -0,0 +1,326 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <numeric>
+
+namespace core {
+
+namespace {
+
+constexpr uint32_t invalid_index = static_cast<uint32_t>(-1);
+
+// member by member, the alignas padding of vertex_t is never written and must not be compared
+template <typename fn_t>
+void for_each_member(const vertex_t& vertex, const fn_t& fn) {
+    fn(&vertex.position, sizeof(vertex.position));
+    fn(&vertex.normal, sizeof(vertex.normal));
+    fn(&vertex.uv, sizeof(vertex.uv));
+    fn(&vertex.tangent, sizeof(vertex.tangent));
+    fn(&vertex.bi_tangent, sizeof(vertex.bi_tangent));
+}
+
+uint32_t hash_vertex(const vertex_t& vertex) {
+    // fnv-1a
+    uint32_t hash = 2166136261u;
+    for_each_member(vertex, [&](const void *data, size_t size) {
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+    });
+    return hash;
+}
+
+bool vertex_equal(const vertex_t& a, const vertex_t& b) {
+    return std::memcmp(&a.position, &b.position, sizeof(a.position)) == 0 &&
+           std::memcmp(&a.normal, &b.normal, sizeof(a.normal)) == 0 &&
+           std::memcmp(&a.uv, &b.uv, sizeof(a.uv)) == 0 &&
+           std::memcmp(&a.tangent, &b.tangent, sizeof(a.tangent)) == 0 &&
+           std::memcmp(&a.bi_tangent, &b.bi_tangent, sizeof(a.bi_tangent)) == 0;
+}
+
+// fifo cache where only misses advance time, a vertex is cached while fewer than cache_size misses happened since its own
+struct vertex_cache_t {
+    vertex_cache_t(uint32_t vertex_count, uint32_t cache_size) : timestamps(vertex_count, 0), cache_size(cache_size), time(cache_size + 1) {}
+
+    // true on a miss
+    bool access(uint32_t index) {
+        if (time - timestamps[index] <= cache_size) {
+            return false;
+        }
+        timestamps[index] = time++;
+        return true;
+    }
+
+    uint32_t triangle_misses(const uint32_t *triangle) {
+        return access(triangle[0]) + access(triangle[1]) + access(triangle[2]);
+    }
+
+    void flush() { time += cache_size + 1; }
+
+    std::vector<uint32_t> timestamps;
+    uint32_t cache_size;
+    uint32_t time;
+};
+
+// triangles of every vertex, triangles[offsets[v]] to triangles[offsets[v + 1]]
+struct adjacency_t {
+    adjacency_t(std::span<const uint32_t> indices, uint32_t vertex_count) : offsets(vertex_count + 1, 0), triangles(indices.size()) {
+        for (uint32_t index : indices) {
+            offsets[index + 1]++;
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+        for (uint32_t i = 0; i < indices.size(); i++) {
+            triangles[cursors[indices[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+};
+
+} // namespace
+
+vertex_cache_stats_t analyze_vertex_cache(std::span<const uint32_t> indices, uint32_t vertex_count, uint32_t cache_size) {
+    vertex_cache_t cache{ vertex_count, cache_size };
+    uint32_t misses = 0;
+    for (uint32_t index : indices) {
+        misses += cache.access(index);
+    }
+    const uint32_t referenced = std::count_if(cache.timestamps.begin(), cache.timestamps.end(), [](uint32_t timestamp) { return timestamp != 0; });
+    return {
+        .acmr = indices.size() < 3 ? 0.0f : static_cast<float>(misses) / (indices.size() / 3),
+        .atvr = referenced == 0 ? 0.0f : static_cast<float>(misses) / referenced,
+    };
+}
+
+void deduplicate_vertices(mesh_t& mesh) {
+    const uint32_t vertex_count = mesh.vertices.size();
+    // open addressing over the indices of the unique vertices, at most half full
+    const uint32_t table_size = std::bit_ceil(std::max(2 * vertex_count, 16u));
+    std::vector<uint32_t> table(table_size, invalid_index);
+    std::vector<uint32_t> remap(vertex_count);
+    std::vector<vertex_t> unique_vertices;
+    unique_vertices.reserve(vertex_count);
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        const vertex_t& vertex = mesh.vertices[i];
+        uint32_t slot = hash_vertex(vertex) & (table_size - 1);
+        while (table[slot] != invalid_index && !vertex_equal(unique_vertices[table[slot]], vertex)) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] == invalid_index) {
+            table[slot] = unique_vertices.size();
+            unique_vertices.push_back(vertex);
+        }
+        remap[i] = table[slot];
+    }
+    if (unique_vertices.size() == vertex_count) {
+        return;
+    }
+    for (uint32_t& index : mesh.indices) {
+        index = remap[index];
+    }
+    mesh.vertices = std::move(unique_vertices);
+}
+
+void optimize_vertex_cache(std::span<uint32_t> indices, uint32_t vertex_count, uint32_t cache_size) {
+    const uint32_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+    const adjacency_t adjacency{ indices, vertex_count };
+    // triangles not emitted yet per vertex
+    std::vector<uint32_t> live(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint32_t> timestamps(vertex_count, 0);
+    uint32_t time = cache_size + 1;
+    std::vector<uint32_t> dead_ends;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    // next vertex to look at once the fan and the dead end stack run dry
+    uint32_t cursor = 0;
+
+    uint32_t fan = 0;
+    while (fan != invalid_index) {
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (uint32_t i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; i++) {
+            const uint32_t triangle = adjacency.triangles[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            emitted[triangle] = true;
+            for (uint32_t k = 0; k < 3; k++) {
+                const uint32_t v = indices[3 * triangle + k];
+                result.push_back(v);
+                dead_ends.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - timestamps[v] > cache_size) {
+                    timestamps[v] = time++;
+                }
+            }
+        }
+
+        // the candidate that stays in the cache the longest while its remaining triangles are emitted, the oldest one wins
+        // so it is used before it gets evicted
+        fan = invalid_index;
+        int32_t best_priority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int32_t priority = 0;
+            if (time - timestamps[v] + 2 * live[v] <= cache_size) {
+                priority = time - timestamps[v];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                fan = v;
+            }
+        }
+        if (fan != invalid_index) {
+            continue;
+        }
+        // dead end, a recently used vertex that still has triangles, else the next one in input order
+        while (!dead_ends.empty() && fan == invalid_index) {
+            const uint32_t v = dead_ends.back();
+            dead_ends.pop_back();
+            if (live[v] != 0) {
+                fan = v;
+            }
+        }
+        while (cursor < vertex_count && fan == invalid_index) {
+            if (live[cursor] != 0) {
+                fan = cursor;
+            }
+            cursor++;
+        }
+    }
+    std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void optimize_overdraw(std::span<uint32_t> indices, std::span<const vertex_t> vertices, uint32_t cache_size, float threshold) {
+    const uint32_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // hard boundaries where a triangle misses with all of its vertices, the cache order starts over there anyway
+    std::vector<uint32_t> hard_boundaries{ 0 };
+    {
+        vertex_cache_t cache{ static_cast<uint32_t>(vertices.size()), cache_size };
+        cache.triangle_misses(&indices[0]);
+        for (uint32_t t = 1; t < triangle_count; t++) {
+            if (cache.triangle_misses(&indices[3 * t]) == 3) {
+                hard_boundaries.push_back(t);
+            }
+        }
+    }
+    hard_boundaries.push_back(triangle_count);
+
+    // soft boundaries split the hard clusters further wherever starting over with an empty cache keeps the acmr of the
+    // part so far under threshold times the acmr of the whole cluster
+    std::vector<uint32_t> clusters;
+    vertex_cache_t cache{ static_cast<uint32_t>(vertices.size()), cache_size };
+    for (uint32_t c = 0; c + 1 < hard_boundaries.size(); c++) {
+        const uint32_t begin = hard_boundaries[c], end = hard_boundaries[c + 1];
+        cache.flush();
+        uint32_t cluster_misses = 0;
+        for (uint32_t t = begin; t < end; t++) {
+            cluster_misses += cache.triangle_misses(&indices[3 * t]);
+        }
+        const float cluster_threshold = threshold * cluster_misses / (end - begin);
+
+        cache.flush();
+        clusters.push_back(begin);
+        uint32_t cluster_begin = begin, misses = 0;
+        for (uint32_t t = begin; t < end; t++) {
+            misses += cache.triangle_misses(&indices[3 * t]);
+            if (t + 1 < end && misses <= cluster_threshold * (t + 1 - cluster_begin)) {
+                clusters.push_back(t + 1);
+                cluster_begin = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+    }
+    clusters.push_back(triangle_count);
+
+    // area weighted centroids and normals
+    auto triangle_cross = [&](uint32_t t, glm::vec3& centroid) {
+        const glm::vec3& p0 = vertices[indices[3 * t + 0]].position;
+        const glm::vec3& p1 = vertices[indices[3 * t + 1]].position;
+        const glm::vec3& p2 = vertices[indices[3 * t + 2]].position;
+        centroid = (p0 + p1 + p2) / 3.0f;
+        return glm::cross(p1 - p0, p2 - p0);
+    };
+    glm::vec3 mesh_centroid{ 0.0f };
+    float mesh_area = 0.0f;
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        glm::vec3 centroid;
+        const float area = glm::length(triangle_cross(t, centroid));
+        mesh_centroid += centroid * area;
+        mesh_area += area;
+    }
+    mesh_centroid = mesh_area > 0.0f ? mesh_centroid / mesh_area : mesh_centroid;
+
+    const uint32_t cluster_count = clusters.size() - 1;
+    std::vector<float> sort_keys(cluster_count);
+    for (uint32_t c = 0; c < cluster_count; c++) {
+        glm::vec3 cluster_centroid{ 0.0f }, cluster_normal{ 0.0f };
+        float cluster_area = 0.0f;
+        for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            glm::vec3 centroid;
+            const glm::vec3 cross = triangle_cross(t, centroid);
+            const float area = glm::length(cross);
+            cluster_centroid += centroid * area;
+            cluster_normal += cross;
+            cluster_area += area;
+        }
+        const float normal_length = glm::length(cluster_normal);
+        sort_keys[c] = cluster_area > 0.0f && normal_length > 0.0f ? glm::dot(cluster_centroid / cluster_area - mesh_centroid, cluster_normal / normal_length) : 0.0f;
+    }
+
+    std::vector<uint32_t> order(cluster_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sort_keys[a] > sort_keys[b]; });
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (uint32_t c : order) {
+        result.insert(result.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+    }
+    std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void optimize_vertex_fetch(mesh_t& mesh) {
+    std::vector<uint32_t> remap(mesh.vertices.size(), invalid_index);
+    std::vector<vertex_t> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == invalid_index) {
+            remap[index] = vertices.size();
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices = std::move(vertices);
+}
+
+void optimize_mesh(mesh_t& mesh, const mesh_optimizer_config_t& config) {
+    deduplicate_vertices(mesh);
+    if (mesh.indices.size() % 3 == 0) {
+        optimize_vertex_cache(mesh.indices, mesh.vertices.size(), config.cache_size);
+        optimize_overdraw(mesh.indices, mesh.vertices, config.cache_size, config.overdraw_threshold);
+    }
+    optimize_vertex_fetch(mesh);
+}
+
+} // namespace core
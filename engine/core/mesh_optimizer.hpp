@@ -0,0 +1,47 @@
+#ifndef CORE_MESH_OPTIMIZER_HPP
+#define CORE_MESH_OPTIMIZER_HPP
+
+#include "core/model.hpp"
+
+#include <cstdint>
+#include <span>
+
+namespace core {
+
+// post transform cache efficiency of an index buffer under a fifo cache
+struct vertex_cache_stats_t {
+    // average cache miss ratio, vertices transformed per triangle, 0.5 is the best a big regular grid gets and 3 the worst
+    float acmr;
+    // average transform to vertex ratio, vertices transformed per referenced vertex, 1 is optimal
+    float atvr;
+};
+
+struct mesh_optimizer_config_t {
+    // entries of the simulated fifo post transform cache the orders are tuned for
+    uint32_t cache_size = 16;
+    // the overdraw order may raise the acmr by at most this factor over the vertex cache order
+    float overdraw_threshold = 1.05f;
+};
+
+vertex_cache_stats_t analyze_vertex_cache(std::span<const uint32_t> indices, uint32_t vertex_count, uint32_t cache_size = 16);
+
+// merges bitwise identical vertices and rewrites the indices to them, unreferenced vertices stay until optimize_vertex_fetch
+void deduplicate_vertices(mesh_t& mesh);
+
+// tipsify, Sander et al. 2007, reorders the triangles of a triangle list so they reuse the post transform cache
+void optimize_vertex_cache(std::span<uint32_t> indices, uint32_t vertex_count, uint32_t cache_size = 16);
+
+// cuts a vertex cache optimized triangle list into clusters and draws the ones facing away from the center of the mesh
+// first, so occluders tend to come before what they occlude, the clusters keep their triangle order so the cache efficiency
+// only drops by the threshold
+void optimize_overdraw(std::span<uint32_t> indices, std::span<const vertex_t> vertices, uint32_t cache_size = 16, float threshold = 1.05f);
+
+// reorders the vertices into the order the indices first reference them and drops the unreferenced ones
+void optimize_vertex_fetch(mesh_t& mesh);
+
+// all of the above in order, the cache and overdraw steps only run on triangle lists
+void optimize_mesh(mesh_t& mesh, const mesh_optimizer_config_t& config = {});
+
+} // namespace core
+
+#endif
@@ -0,0 +1,137 @@
+#include "meshlet.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace core {
+
+namespace {
+
+constexpr uint32_t invalid_index = static_cast<uint32_t>(-1);
+
+// ritter's sphere, grown from the widest pair of axis extreme points, then widened to the farthest point so rounding
+// never leaves a vertex outside
+void bounding_sphere(const std::vector<glm::vec3>& points, glm::vec3& center, float& radius) {
+    uint32_t min_point[3] = { 0, 0, 0 }, max_point[3] = { 0, 0, 0 };
+    for (uint32_t i = 0; i < points.size(); i++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            if (points[i][k] < points[min_point[k]][k]) min_point[k] = i;
+            if (points[i][k] > points[max_point[k]][k]) max_point[k] = i;
+        }
+    }
+    uint32_t axis = 0;
+    for (uint32_t k = 1; k < 3; k++) {
+        if (glm::distance(points[min_point[k]], points[max_point[k]]) > glm::distance(points[min_point[axis]], points[max_point[axis]])) {
+            axis = k;
+        }
+    }
+    center = (points[min_point[axis]] + points[max_point[axis]]) * 0.5f;
+    radius = glm::distance(points[min_point[axis]], points[max_point[axis]]) * 0.5f;
+
+    for (const glm::vec3& point : points) {
+        const float distance = glm::distance(center, point);
+        if (distance > radius) {
+            const float grown_radius = (radius + distance) * 0.5f;
+            center += (point - center) * ((distance - grown_radius) / distance);
+            radius = grown_radius;
+        }
+    }
+    for (const glm::vec3& point : points) {
+        radius = std::max(radius, glm::distance(center, point));
+    }
+}
+
+meshlet_bounds_t compute_bounds(const meshlet_mesh_t& meshlet_mesh, const meshlet_t& meshlet, const mesh_t& mesh) {
+    meshlet_bounds_t bounds{};
+    std::vector<glm::vec3> points(meshlet.vertex_count);
+    for (uint32_t i = 0; i < meshlet.vertex_count; i++) {
+        points[i] = mesh.vertices[meshlet_mesh.vertices[meshlet.vertex_offset + i]].position;
+    }
+    bounds.aabb = { points[0], points[0] };
+    for (const glm::vec3& point : points) {
+        bounds.aabb.min = glm::min(bounds.aabb.min, point);
+        bounds.aabb.max = glm::max(bounds.aabb.max, point);
+    }
+    bounding_sphere(points, bounds.center, bounds.radius);
+
+    // the face normals decide what is backfacing, the vertex normals may be smoothed across the silhouette
+    std::vector<glm::vec3> normals;
+    normals.reserve(meshlet.triangle_count);
+    glm::vec3 axis{ 0.0f };
+    for (uint32_t i = 0; i < meshlet.triangle_count; i++) {
+        const uint8_t *triangle = &meshlet_mesh.triangles[(meshlet.triangle_offset + i) * 3];
+        const glm::vec3 normal = glm::cross(points[triangle[1]] - points[triangle[0]], points[triangle[2]] - points[triangle[0]]);
+        const float length = glm::length(normal);
+        // degenerate triangles are never rasterized and do not widen the cone
+        if (length > 0.0f) {
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+    }
+
+    float min_dot = -1.0f;
+    if (glm::length(axis) > 0.0f) {
+        axis = glm::normalize(axis);
+        min_dot = 1.0f;
+        for (const glm::vec3& normal : normals) {
+            min_dot = std::min(min_dot, glm::dot(normal, axis));
+        }
+    }
+    if (min_dot <= 0.0f) {
+        bounds.cone_axis = glm::vec3{ 0.0f };
+        bounds.cone_cutoff = 1.0f;
+    } else {
+        bounds.cone_axis = axis;
+        bounds.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    }
+    return bounds;
+}
+
+} // namespace
+
+meshlet_mesh_t build_meshlets(const mesh_t& mesh, const meshlet_config_t& config) {
+    // local indices are bytes and a meshlet has to fit at least one triangle
+    const uint32_t max_vertices = std::clamp(config.max_vertices, 3u, 256u);
+    const uint32_t max_triangles = std::max(config.max_triangles, 1u);
+
+    meshlet_mesh_t meshlet_mesh{};
+    const uint32_t triangle_count = mesh.indices.size() / 3;
+    meshlet_mesh.triangles.reserve(triangle_count * 3);
+
+    // meshlet local index of every mesh vertex, only valid for the vertices of the open meshlet
+    std::vector<uint32_t> local_indices(mesh.vertices.size(), invalid_index);
+    meshlet_t meshlet{};
+    auto close_meshlet = [&]() {
+        for (uint32_t i = 0; i < meshlet.vertex_count; i++) {
+            local_indices[meshlet_mesh.vertices[meshlet.vertex_offset + i]] = invalid_index;
+        }
+        meshlet_mesh.meshlets.push_back(meshlet);
+        meshlet_mesh.bounds.push_back(compute_bounds(meshlet_mesh, meshlet, mesh));
+        meshlet = { static_cast<uint32_t>(meshlet_mesh.vertices.size()), 0, meshlet.triangle_offset + meshlet.triangle_count, 0 };
+    };
+
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        const uint32_t *triangle = &mesh.indices[t * 3];
+        const uint32_t a = triangle[0], b = triangle[1], c = triangle[2];
+        const uint32_t new_vertices = (local_indices[a] == invalid_index) +
+                                      (local_indices[b] == invalid_index && b != a) +
+                                      (local_indices[c] == invalid_index && c != a && c != b);
+        if (meshlet.vertex_count + new_vertices > max_vertices || meshlet.triangle_count == max_triangles) {
+            close_meshlet();
+        }
+        for (uint32_t index : { a, b, c }) {
+            if (local_indices[index] == invalid_index) {
+                local_indices[index] = meshlet.vertex_count++;
+                meshlet_mesh.vertices.push_back(index);
+            }
+            meshlet_mesh.triangles.push_back(static_cast<uint8_t>(local_indices[index]));
+        }
+        meshlet.triangle_count++;
+    }
+    if (meshlet.triangle_count != 0) {
+        close_meshlet();
+    }
+    return meshlet_mesh;
+}
+
+} // namespace core
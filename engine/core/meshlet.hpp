@@ -0,0 +1,55 @@
+#ifndef CORE_MESHLET_HPP
+#define CORE_MESHLET_HPP
+
+#include "core/model.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace core {
+
+struct meshlet_config_t {
+    // 64 and 124 keep a meshlet inside one mesh shader workgroup and its local indices in a byte
+    uint32_t max_vertices = 64;
+    uint32_t max_triangles = 124;
+};
+
+// meshlets cover the triangles of the index buffer they were built from in order, so meshlet i is also the draw of
+// indices [3 * triangle_offset, 3 * (triangle_offset + triangle_count)) of that buffer
+struct meshlet_t {
+    // into meshlet_mesh_t::vertices
+    uint32_t vertex_offset;
+    uint32_t vertex_count;
+    // in triangles, into meshlet_mesh_t::triangles and the source index buffer
+    uint32_t triangle_offset;
+    uint32_t triangle_count;
+};
+
+// 56 bytes, laid out for a scalar storage buffer
+// the meshlet faces away from a camera at eye when dot(center - eye, cone_axis) >= cone_cutoff * length(center - eye) + radius,
+// meshlets whose normals spread over more than a hemisphere get cone_axis 0 and cone_cutoff 1, which never passes
+struct meshlet_bounds_t {
+    glm::vec3 center;
+    float radius;
+    aabb_t aabb;
+    glm::vec3 cone_axis;
+    // sin of the half angle of the cone of triangle normals
+    float cone_cutoff;
+};
+
+struct meshlet_mesh_t {
+    std::vector<meshlet_t> meshlets;
+    std::vector<meshlet_bounds_t> bounds;
+    // mesh vertex index of every meshlet vertex
+    std::vector<uint32_t> vertices;
+    // 3 meshlet local vertex indices per triangle
+    std::vector<uint8_t> triangles;
+};
+
+// cuts a triangle list into meshlets front to back, a meshlet is closed once the next triangle would not fit, so run it
+// after optimize_mesh for meshlets made of neighbouring triangles
+meshlet_mesh_t build_meshlets(const mesh_t& mesh, const meshlet_config_t& config = {});
+
+} // namespace core
+
+#endif
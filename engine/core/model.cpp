@@ -1,4 +1,5 @@
 #include "model.hpp"
+#include "mesh_optimizer.hpp"
 
 namespace core {    
 
@@ -48,49 +49,41 @@ material_description_t process_material(model_loading_info_t& model_loading_info
     return loaded_material_description;
 }
 
-mesh_t process_mesh(model_loading_info_t& model_loading_info, aiMesh *mesh, const aiScene *scene) {
-    mesh_t loaded_mesh;
-    loaded_mesh.vertices.reserve(mesh->mNumVertices);
+void process_mesh(aiMesh *mesh, mesh_t& loaded_mesh) {
+    loaded_mesh.vertices.resize(mesh->mNumVertices);
+    const bool has_uvs = mesh->mTextureCoords[0] != nullptr;
+    const bool has_tangents = mesh->HasTangentsAndBitangents();
     for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
-        vertex_t vertex{};
+        vertex_t& vertex = loaded_mesh.vertices[i];
 
         vertex.position = { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z };
         vertex.normal = { mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z };
 
-        if (mesh->mTextureCoords[0]) {
+        if (has_uvs) {
             vertex.uv = { mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y };
-        } else {
-            vertex.uv = { 0, 0 };
         }
 
-        if (mesh->HasTangentsAndBitangents()) {
+        if (has_tangents) {
             vertex.tangent = { mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z };
             vertex.bi_tangent = { mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z };
-        } else {
-
         }
 
-        loaded_mesh.aabb.min.x = std::min(loaded_mesh.aabb.min.x, vertex.position.x);
-        loaded_mesh.aabb.min.y = std::min(loaded_mesh.aabb.min.y, vertex.position.y);
-        loaded_mesh.aabb.min.z = std::min(loaded_mesh.aabb.min.z, vertex.position.z);
-
-        loaded_mesh.aabb.max.x = std::max(loaded_mesh.aabb.max.x, vertex.position.x);
-        loaded_mesh.aabb.max.y = std::max(loaded_mesh.aabb.max.y, vertex.position.y);
-        loaded_mesh.aabb.max.z = std::max(loaded_mesh.aabb.max.z, vertex.position.z);
+        loaded_mesh.aabb.min = glm::min(loaded_mesh.aabb.min, vertex.position);
+        loaded_mesh.aabb.max = glm::max(loaded_mesh.aabb.max, vertex.position);
+    }
 
-        loaded_mesh.vertices.push_back(vertex);
+    // faces are triangles after aiProcess_Triangulate except for points and lines, so count before copying
+    uint32_t index_count = 0;
+    for (uint32_t i = 0; i < mesh->mNumFaces; i++) {
+        index_count += mesh->mFaces[i].mNumIndices;
     }
-    
+    loaded_mesh.indices.resize(index_count);
+    uint32_t *indices = loaded_mesh.indices.data();
     for (uint32_t i = 0; i < mesh->mNumFaces; i++) {
-        aiFace& face = mesh->mFaces[i];
-        // model_loading_info.model.primitive_count += face.mNumIndices;
-        for (uint32_t j = 0; j < face.mNumIndices; j++) {
-            loaded_mesh.indices.push_back(face.mIndices[j]);
-        }
+        const aiFace& face = mesh->mFaces[i];
+        std::copy_n(face.mIndices, face.mNumIndices, indices);
+        indices += face.mNumIndices;
     }
-
-    loaded_mesh.material_description = process_material(model_loading_info, scene->mMaterials[mesh->mMaterialIndex]);
-    return loaded_mesh;
 }
 
 void process_node(model_loading_info_t& model_loading_info, aiNode *node, const aiScene *scene) {
@@ -98,11 +91,11 @@ void process_node(model_loading_info_t& model_loading_info, aiNode *node, const
         process_node(model_loading_info, node->mChildren[i], scene);
     }
     for (uint32_t i = 0; i < node->mNumMeshes; i++) {
-        model_loading_info.model.meshes.push_back(process_mesh(model_loading_info, scene->mMeshes[node->mMeshes[i]], scene));
+        model_loading_info.meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
 }
 
-model_t load_model_from_path(const std::filesystem::path& file_path) {
+model_t load_model_from_path(const std::filesystem::path& file_path, uint32_t thread_count, bool optimize_meshes) {
     Assimp::Importer importer{};
     const aiScene *scene = importer.ReadFile(file_path.string(),
                                              aiProcess_Triangulate          |
@@ -117,7 +110,31 @@ model_t load_model_from_path(const std::filesystem::path& file_path) {
     model_loading_info_t model_loading_info{};
     model_loading_info.file_path = file_path;
     process_node(model_loading_info, scene->mRootNode, scene);
-    return model_loading_info.model;
+
+    // every material once, however many meshes share it
+    std::vector<std::optional<material_description_t>> material_descriptions(scene->mNumMaterials);
+    for (aiMesh *mesh : model_loading_info.meshes) {
+        auto& material_description = material_descriptions[mesh->mMaterialIndex];
+        if (!material_description) {
+            material_description = process_material(model_loading_info, scene->mMaterials[mesh->mMaterialIndex]);
+        }
+    }
+
+    // every mesh converts into its own slot, so the order stays the one of the node walk whatever thread runs it
+    std::vector<mesh_t>& meshes = model_loading_info.model.meshes;
+    meshes.resize(model_loading_info.meshes.size());
+    thread_pool_t thread_pool{ std::max(1u, std::min<uint32_t>(thread_count, meshes.size())) };
+    thread_pool.parallel_for(0, meshes.size(), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            aiMesh *mesh = model_loading_info.meshes[i];
+            process_mesh(mesh, meshes[i]);
+            meshes[i].material_description = *material_descriptions[mesh->mMaterialIndex];
+            if (optimize_meshes) {
+                optimize_mesh(meshes[i]);
+            }
+        }
+    });
+    return std::move(model_loading_info.model);
 }
 
 Model::Model(core::ref<gfx::vulkan::context_t> context) 
@@ -5,6 +5,7 @@
 #include "core/components.hpp"
 #include "core/mesh.hpp"
 #include "core/material.hpp"
+#include "core/thread_pool.hpp"
 
 #include "gfx/vulkan/context.hpp"
 #include "gfx/vulkan/image.hpp"
@@ -62,6 +63,8 @@ struct model_t {
 
 struct model_loading_info_t {
     std::filesystem::path file_path;
+    // in node walk order, converted after the walk
+    std::vector<aiMesh *> meshes;
     model_t model;
 };
 
@@ -69,11 +72,14 @@ std::optional<texture_info_t> process_texture(model_loading_info_t& model_loadin
 
 material_description_t process_material(model_loading_info_t& model_loading_info, aiMaterial *material);
 
-mesh_t process_mesh(model_loading_info_t& model_loading_info, aiMesh *mesh, const aiScene *scene);
+// fills everything but the material description, touches nothing shared so meshes convert in parallel
+void process_mesh(aiMesh *mesh, mesh_t& loaded_mesh);
 
 void process_node(model_loading_info_t& model_loading_info, aiNode *node, const aiScene *scene);
 
-model_t load_model_from_path(const std::filesystem::path& file_path);
+// meshes are converted on thread_count threads, in the same order as a sequential load
+// optimize_meshes runs optimize_mesh on every mesh as part of the conversion
+model_t load_model_from_path(const std::filesystem::path& file_path, uint32_t thread_count = std::thread::hardware_concurrency(), bool optimize_meshes = false);
 
 class Model {
 public:
@@ -0,0 +1,174 @@
+#include "packed_vertex.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace core {
+
+namespace {
+
+// sign that treats 0 as positive, so the folded half of the octahedron has no seam at the axes
+glm::vec2 sign_not_zero(const glm::vec2& v) {
+    return { v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f };
+}
+
+void pack_snorm2(const glm::vec2& value, int16_t *packed) {
+    packed[0] = static_cast<int16_t>(glm::packSnorm1x16(value.x));
+    packed[1] = static_cast<int16_t>(glm::packSnorm1x16(value.y));
+}
+
+glm::vec2 unpack_snorm2(const int16_t *packed) {
+    return { glm::unpackSnorm1x16(static_cast<uint16_t>(packed[0])), glm::unpackSnorm1x16(static_cast<uint16_t>(packed[1])) };
+}
+
+// everything but the position, which is the only part that differs between the formats
+template <typename packed_t>
+void pack_attributes(const vertex_t& vertex, packed_t& packed) {
+    pack_snorm2(octahedral_encode(vertex.normal), packed.normal);
+    pack_snorm2(octahedral_encode(vertex.tangent), packed.tangent);
+    packed.uv[0] = glm::packHalf1x16(vertex.uv.x);
+    packed.uv[1] = glm::packHalf1x16(vertex.uv.y);
+}
+
+template <typename packed_t>
+void unpack_attributes(const packed_t& packed, float bitangent_sign, vertex_t& vertex) {
+    vertex.normal = octahedral_decode(unpack_snorm2(packed.normal));
+    vertex.tangent = octahedral_decode(unpack_snorm2(packed.tangent));
+    vertex.bi_tangent = glm::cross(vertex.normal, vertex.tangent) * bitangent_sign;
+    vertex.uv = { glm::unpackHalf1x16(packed.uv[0]), glm::unpackHalf1x16(packed.uv[1]) };
+}
+
+// 1 when the bitangent is cross(normal, tangent), 0 when the tangent frame is mirrored
+float bitangent_flag(const vertex_t& vertex) {
+    return glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.bi_tangent) < 0.0f ? 0.0f : 1.0f;
+}
+
+} // namespace
+
+glm::vec2 octahedral_encode(const glm::vec3& direction) {
+    const float l1 = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+    if (l1 == 0.0f) {
+        return { 0.0f, 0.0f };
+    }
+    const glm::vec3 n = direction / l1;
+    if (n.z >= 0.0f) {
+        return { n.x, n.y };
+    }
+    return (1.0f - glm::abs(glm::vec2{ n.y, n.x })) * sign_not_zero({ n.x, n.y });
+}
+
+glm::vec3 octahedral_decode(const glm::vec2& encoded) {
+    glm::vec3 n{ encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y) };
+    const float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+packed_mesh_t pack_mesh(const mesh_t& mesh, vertex_position_format_t position_format) {
+    packed_mesh_t packed_mesh{};
+    packed_mesh.position_format = position_format;
+    packed_mesh.vertex_count = mesh.vertices.size();
+    packed_mesh.index_count = mesh.indices.size();
+
+    if (position_format == vertex_position_format_t::e_unorm16) {
+        // the bounds of the vertices themselves, mesh.aabb may be looser
+        glm::vec3 min{ std::numeric_limits<float>::max() }, max{ -std::numeric_limits<float>::max() };
+        for (const vertex_t& vertex : mesh.vertices) {
+            min = glm::min(min, vertex.position);
+            max = glm::max(max, vertex.position);
+        }
+        if (mesh.vertices.empty()) {
+            min = max = glm::vec3{ 0.0f };
+        }
+        packed_mesh.position_offset = min;
+        packed_mesh.position_scale = max - min;
+
+        std::vector<packed_vertex_t> vertices(mesh.vertices.size());
+        for (uint32_t i = 0; i < mesh.vertices.size(); i++) {
+            const vertex_t& vertex = mesh.vertices[i];
+            // a flat axis has a scale of 0 and every position on it decodes to the offset
+            const glm::vec3 normalized = glm::clamp((vertex.position - min) / glm::max(packed_mesh.position_scale, glm::vec3{ std::numeric_limits<float>::min() }), 0.0f, 1.0f);
+            for (uint32_t k = 0; k < 3; k++) {
+                vertices[i].position[k] = glm::packUnorm1x16(normalized[k]);
+            }
+            vertices[i].position[3] = glm::packUnorm1x16(bitangent_flag(vertex));
+            pack_attributes(vertex, vertices[i]);
+        }
+        packed_mesh.vertex_stride = sizeof(packed_vertex_t);
+        packed_mesh.vertices.resize(vertices.size() * sizeof(packed_vertex_t));
+        std::memcpy(packed_mesh.vertices.data(), vertices.data(), packed_mesh.vertices.size());
+    } else {
+        packed_mesh.position_offset = glm::vec3{ 0.0f };
+        packed_mesh.position_scale = glm::vec3{ 1.0f };
+
+        std::vector<packed_float_vertex_t> vertices(mesh.vertices.size());
+        for (uint32_t i = 0; i < mesh.vertices.size(); i++) {
+            const vertex_t& vertex = mesh.vertices[i];
+            vertices[i].position[0] = vertex.position.x;
+            vertices[i].position[1] = vertex.position.y;
+            vertices[i].position[2] = vertex.position.z;
+            vertices[i].position[3] = bitangent_flag(vertex);
+            pack_attributes(vertex, vertices[i]);
+        }
+        packed_mesh.vertex_stride = sizeof(packed_float_vertex_t);
+        packed_mesh.vertices.resize(vertices.size() * sizeof(packed_float_vertex_t));
+        std::memcpy(packed_mesh.vertices.data(), vertices.data(), packed_mesh.vertices.size());
+    }
+
+    // 16 bit indices without primitive restart can address all 65536 vertices
+    if (mesh.vertices.size() <= 65536) {
+        packed_mesh.index_size = sizeof(uint16_t);
+        packed_mesh.indices.resize(mesh.indices.size() * sizeof(uint16_t));
+        uint16_t *indices = reinterpret_cast<uint16_t *>(packed_mesh.indices.data());
+        for (uint32_t i = 0; i < mesh.indices.size(); i++) {
+            indices[i] = static_cast<uint16_t>(mesh.indices[i]);
+        }
+    } else {
+        packed_mesh.index_size = sizeof(uint32_t);
+        packed_mesh.indices.resize(mesh.indices.size() * sizeof(uint32_t));
+        std::memcpy(packed_mesh.indices.data(), mesh.indices.data(), packed_mesh.indices.size());
+    }
+    return packed_mesh;
+}
+
+mesh_t unpack_mesh(const packed_mesh_t& packed_mesh) {
+    mesh_t mesh{};
+    mesh.vertices.resize(packed_mesh.vertex_count);
+    if (packed_mesh.vertex_count != 0) {
+        mesh.aabb = { glm::vec3{ std::numeric_limits<float>::max() }, glm::vec3{ -std::numeric_limits<float>::max() } };
+    }
+    for (uint32_t i = 0; i < packed_mesh.vertex_count; i++) {
+        vertex_t& vertex = mesh.vertices[i];
+        const std::byte *data = packed_mesh.vertices.data() + i * packed_mesh.vertex_stride;
+        if (packed_mesh.position_format == vertex_position_format_t::e_unorm16) {
+            packed_vertex_t packed;
+            std::memcpy(&packed, data, sizeof(packed));
+            const glm::vec3 normalized{ glm::unpackUnorm1x16(packed.position[0]), glm::unpackUnorm1x16(packed.position[1]), glm::unpackUnorm1x16(packed.position[2]) };
+            vertex.position = packed_mesh.position_offset + normalized * packed_mesh.position_scale;
+            unpack_attributes(packed, glm::unpackUnorm1x16(packed.position[3]) * 2.0f - 1.0f, vertex);
+        } else {
+            packed_float_vertex_t packed;
+            std::memcpy(&packed, data, sizeof(packed));
+            vertex.position = glm::vec3{ packed.position[0], packed.position[1], packed.position[2] } * packed_mesh.position_scale + packed_mesh.position_offset;
+            unpack_attributes(packed, packed.position[3] * 2.0f - 1.0f, vertex);
+        }
+        mesh.aabb.min = glm::min(mesh.aabb.min, vertex.position);
+        mesh.aabb.max = glm::max(mesh.aabb.max, vertex.position);
+    }
+
+    mesh.indices.resize(packed_mesh.index_count);
+    if (packed_mesh.index_size == sizeof(uint16_t)) {
+        const uint16_t *indices = reinterpret_cast<const uint16_t *>(packed_mesh.indices.data());
+        std::copy(indices, indices + packed_mesh.index_count, mesh.indices.begin());
+    } else {
+        std::memcpy(mesh.indices.data(), packed_mesh.indices.data(), packed_mesh.indices.size());
+    }
+    return mesh;
+}
+
+} // namespace core
@@ -0,0 +1,67 @@
+#ifndef CORE_PACKED_VERTEX_HPP
+#define CORE_PACKED_VERTEX_HPP
+
+#include "core/model.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace core {
+
+enum class vertex_position_format_t {
+    // 16 bit normalized inside the mesh bounds, packed_vertex_t
+    // every mesh is quantized on a grid of its own bounds, so an edge two meshes share can land on different positions
+    // and show a crack, keep those meshes e_float or quantize them in common bounds
+    e_unorm16,
+    // kept as float, packed_float_vertex_t
+    e_float,
+};
+
+// 20 bytes instead of the 80 of vertex_t, to bind as
+// position R16G16B16A16_UNORM, normal R16G16_SNORM, tangent R16G16_SNORM, uv R16G16_SFLOAT
+// normals and tangents are octahedral, the bitangent is cross(normal, tangent) scaled by position.w * 2 - 1
+struct packed_vertex_t {
+    uint16_t position[4];
+    int16_t normal[2];
+    int16_t tangent[2];
+    uint16_t uv[2];
+};
+
+// 28 bytes, the same as packed_vertex_t with position R32G32B32A32_SFLOAT
+struct packed_float_vertex_t {
+    float position[4];
+    int16_t normal[2];
+    int16_t tangent[2];
+    uint16_t uv[2];
+};
+
+// vertices and indices ready to be copied into gpu buffers
+// the position of a vertex is position_offset + position.xyz * position_scale for either format, the float format stores
+// offset 0 and scale 1 so shaders decode both the same way
+struct packed_mesh_t {
+    vertex_position_format_t position_format;
+    // sizeof(packed_vertex_t) or sizeof(packed_float_vertex_t)
+    uint32_t vertex_stride;
+    uint32_t vertex_count;
+    std::vector<std::byte> vertices;
+    // 2 when every index fits in uint16_t, 4 otherwise
+    uint32_t index_size;
+    uint32_t index_count;
+    std::vector<std::byte> indices;
+    glm::vec3 position_offset;
+    glm::vec3 position_scale;
+};
+
+// octahedral mapping of a unit vector onto [-1, 1]^2, a zero vector maps to 0, 0
+glm::vec2 octahedral_encode(const glm::vec3& direction);
+glm::vec3 octahedral_decode(const glm::vec2& encoded);
+
+packed_mesh_t pack_mesh(const mesh_t& mesh, vertex_position_format_t position_format = vertex_position_format_t::e_unorm16);
+
+// the vertex_t the gpu sees after decoding, for tools and to measure the quantization error
+mesh_t unpack_mesh(const packed_mesh_t& packed_mesh);
+
+} // namespace core
+
+#endif
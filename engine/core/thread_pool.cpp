@@ -0,0 +1,131 @@
+#include "thread_pool.hpp"
+
+namespace core {
+
+namespace {
+
+// which pool the current thread works for and its queue there
+thread_local const thread_pool_t *current_pool = nullptr;
+thread_local uint32_t current_index = 0;
+// the pool a thread outside of it last used and the queue it was given there
+thread_local uint64_t external_pool_id = 0;
+thread_local uint32_t external_index = 0;
+
+std::atomic<uint64_t> next_pool_id{ 1 };
+
+} // namespace
+
+thread_pool_t::thread_pool_t(uint32_t thread_count) {
+    thread_count = std::max(thread_count, 1u);
+    _queue_count = thread_count + external_queue_count - 1;
+    _queues = std::make_unique<task_queue_t[]>(_queue_count);
+    _id = next_pool_id.fetch_add(1, std::memory_order_relaxed);
+    _workers.reserve(thread_count - 1);
+    for (uint32_t i = 1; i < thread_count; i++) {
+        _workers.emplace_back([this, i]() { worker_loop(i); });
+    }
+}
+
+thread_pool_t::~thread_pool_t() {
+    {
+        std::unique_lock<std::mutex> lock{ _mutex };
+        _stop = true;
+    }
+    _condition_variable.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+uint32_t thread_pool_t::current_thread_index() const {
+    return current_pool == this ? current_index : 0;
+}
+
+std::vector<thread_pool_t::thread_stats_t> thread_pool_t::thread_stats() const {
+    std::vector<thread_stats_t> thread_stats(thread_count(), thread_stats_t{});
+    for (uint32_t i = 0; i < _queue_count; i++) {
+        thread_stats_t& stats = thread_stats[i < thread_count() ? i : 0];
+        stats.executed += _queues[i].executed.load(std::memory_order_relaxed);
+        stats.stolen += _queues[i].stolen.load(std::memory_order_relaxed);
+    }
+    return thread_stats;
+}
+
+uint32_t thread_pool_t::queue_index() {
+    if (current_pool == this) return current_index;
+    if (external_pool_id != _id) {
+        external_pool_id = _id;
+        uint32_t slot = _next_external_queue.fetch_add(1, std::memory_order_relaxed) % external_queue_count;
+        external_index = slot == 0 ? 0 : thread_count() + slot - 1;
+    }
+    return external_index;
+}
+
+void thread_pool_t::run(task_group_t& task_group, task_t task) {
+    task_group._pending.fetch_add(1, std::memory_order_relaxed);
+    task_queue_t& queue = _queues[queue_index()];
+    {
+        std::unique_lock<std::mutex> lock{ queue.mutex };
+        queue.tasks.push_back({ std::move(task), &task_group });
+    }
+    _queued.fetch_add(1, std::memory_order_release);
+    // taking the lock orders the increment before a worker that is about to sleep checks it
+    { std::unique_lock<std::mutex> lock{ _mutex }; }
+    _condition_variable.notify_one();
+}
+
+void thread_pool_t::wait(task_group_t& task_group) {
+    const uint32_t index = queue_index();
+    while (!task_group.done()) {
+        if (!try_execute_one(index)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool thread_pool_t::try_execute_one(uint32_t queue_index) {
+    queued_task_t queued_task;
+    bool found = false, stolen = false;
+    {
+        // newest first, keeps recursive task trees depth first and their data warm in cache
+        task_queue_t& queue = _queues[queue_index];
+        std::unique_lock<std::mutex> lock{ queue.mutex };
+        if (!queue.tasks.empty()) {
+            queued_task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            found = true;
+        }
+    }
+    for (uint32_t i = 1; !found && i < _queue_count; i++) {
+        // oldest first, the oldest tasks of a recursive split are the largest ones
+        task_queue_t& victim = _queues[(queue_index + i) % _queue_count];
+        std::unique_lock<std::mutex> lock{ victim.mutex };
+        if (!victim.tasks.empty()) {
+            queued_task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            found = stolen = true;
+        }
+    }
+    if (!found) return false;
+
+    _queued.fetch_sub(1, std::memory_order_relaxed);
+    queued_task.task();
+    queued_task.task_group->_pending.fetch_sub(1, std::memory_order_release);
+    _queues[queue_index].executed.fetch_add(1, std::memory_order_relaxed);
+    if (stolen) _queues[queue_index].stolen.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void thread_pool_t::worker_loop(uint32_t thread_index) {
+    current_pool = this;
+    current_index = thread_index;
+    while (true) {
+        if (try_execute_one(thread_index)) continue;
+
+        std::unique_lock<std::mutex> lock{ _mutex };
+        _condition_variable.wait(lock, [this]() { return _stop || _queued.load(std::memory_order_acquire) != 0; });
+        if (_stop && _queued.load(std::memory_order_acquire) == 0) return;
+    }
+}
+
+} // namespace core
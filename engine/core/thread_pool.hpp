@@ -0,0 +1,107 @@
+#ifndef CORE_THREAD_POOL_HPP
+#define CORE_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace core {
+
+// counts the tasks submitted through thread_pool_t::run that have not finished yet
+class task_group_t {
+public:
+    bool done() const { return _pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class thread_pool_t;
+    std::atomic<uint32_t> _pending{ 0 };
+};
+
+// thread_count includes the calling thread, the pool only spawns thread_count - 1 workers
+// the calling thread executes queued tasks while it waits, so a pool of 1 runs everything inline on wait
+// tasks are allowed to run and wait on nested task groups
+// work stealing, every thread has its own queue that it runs newest first and idle threads steal the oldest task of another
+// queue, threads outside the pool are spread round robin over external_queue_count queues on their first run or wait, so
+// several submitting threads do not all contend on one queue
+class thread_pool_t {
+public:
+    using task_t = std::function<void()>;
+
+    static constexpr uint32_t external_queue_count = 4;
+
+    // counted since construction, per thread index, index 0 sums every thread outside the pool
+    struct thread_stats_t {
+        uint64_t executed;
+        // executed tasks that were taken from another thread's queue
+        uint64_t stolen;
+    };
+
+    thread_pool_t(uint32_t thread_count = std::thread::hardware_concurrency());
+    ~thread_pool_t();
+
+    thread_pool_t(const thread_pool_t&) = delete;
+    thread_pool_t& operator = (const thread_pool_t&) = delete;
+
+    uint32_t thread_count() const { return static_cast<uint32_t>(_workers.size()) + 1; }
+
+    void run(task_group_t& task_group, task_t task);
+    void wait(task_group_t& task_group);
+
+    // in [0, thread_count), the workers are 1 and up, every thread outside the pool is 0
+    uint32_t current_thread_index() const;
+    std::vector<thread_stats_t> thread_stats() const;
+
+    // splits [begin, end) into chunks of at most grain_size and calls fn(chunk_begin, chunk_end) for each, blocks until all are done
+    template <typename fn_t>
+    void parallel_for(uint32_t begin, uint32_t end, uint32_t grain_size, const fn_t& fn) {
+        task_group_t task_group{};
+        for (uint32_t chunk_begin = begin; chunk_begin < end; chunk_begin += grain_size) {
+            uint32_t chunk_end = chunk_begin + std::min(grain_size, end - chunk_begin);
+            run(task_group, [&fn, chunk_begin, chunk_end]() { fn(chunk_begin, chunk_end); });
+        }
+        wait(task_group);
+    }
+
+private:
+    struct queued_task_t {
+        task_t task;
+        task_group_t *task_group;
+    };
+
+    // own cache line each, so threads pushing to their own queue do not contend
+    struct alignas(64) task_queue_t {
+        std::mutex mutex;
+        std::deque<queued_task_t> tasks;
+        std::atomic<uint64_t> executed{ 0 };
+        std::atomic<uint64_t> stolen{ 0 };
+    };
+
+    // the thread index for workers, external threads get queue 0 or one of the queues after the workers'
+    uint32_t queue_index();
+    bool try_execute_one(uint32_t queue_index);
+    void worker_loop(uint32_t thread_index);
+
+    std::vector<std::thread> _workers;
+    // thread_count + external_queue_count - 1
+    uint32_t _queue_count;
+    std::unique_ptr<task_queue_t[]> _queues;
+    // tells pools apart in the thread local queue assignment of external threads, an address can be reused
+    uint64_t _id;
+    std::atomic<uint32_t> _next_external_queue{ 0 };
+    // tasks sitting in any queue, idle workers sleep while it is 0
+    std::atomic<uint32_t> _queued{ 0 };
+    std::mutex _mutex;
+    std::condition_variable _condition_variable;
+    bool _stop{ false };
+};
+
+} // namespace core
+
+#endif
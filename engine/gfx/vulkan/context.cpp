@@ -552,6 +552,7 @@ void context_t::pick_physical_device() {
     vkGetPhysicalDeviceFeatures(_physical_device, &device_features);
 
     _physical_device_properties = device_properties;
+    _physical_device_features = device_features;
 
     VkPhysicalDeviceRayTracingPipelinePropertiesKHR physical_device_raytracing_pipeline_properties_KHR{};
     physical_device_raytracing_pipeline_properties_KHR.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
@@ -631,7 +632,7 @@ void context_t::create_logical_device() {
         .pNext = &physical_device_raytracing_pipeline_features,
         .rayQuery = VK_TRUE};
 
-    VkPhysicalDeviceFeatures device_features = {.geometryShader = VK_TRUE, .fragmentStoresAndAtomics = VK_TRUE};
+    VkPhysicalDeviceFeatures device_features = {.geometryShader = VK_TRUE, .multiDrawIndirect = _physical_device_features.multiDrawIndirect, .fragmentStoresAndAtomics = VK_TRUE};
 
     VkDeviceCreateInfo device_create_info{};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
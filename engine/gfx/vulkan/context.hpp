@@ -167,6 +167,8 @@ public:
     uint32_t& current_frame() { return _current_frame; }
 
     VkPhysicalDeviceProperties& physical_device_properties() { return _physical_device_properties; }
+    // what the device supports, optional features like multiDrawIndirect are only enabled when set here
+    VkPhysicalDeviceFeatures& physical_device_features() { return _physical_device_features; }
 
     // NOTE: maybe change this
     std::vector<VkImageView>& swapchain_image_views() { return _swapchain_image_views; }
@@ -232,6 +234,7 @@ private:
     const bool _raytracing;
     const bool _validation;
     VkPhysicalDeviceProperties _physical_device_properties{};
+    VkPhysicalDeviceFeatures _physical_device_features{};
 
     std::vector<const char *> _instance_layers{};
     std::vector<const char *> _instance_extensions{};
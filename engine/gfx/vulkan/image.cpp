@@ -203,14 +203,20 @@ core::ref<image_t> image_builder_t::loadFromPath(core::ref<context_t> context, c
     stbi_set_flip_vertically_on_load(true);  
     stbi_uc *pixels = stbi_load(file_path.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
 
-    VkDeviceSize image_size = width * height * 4;
-
     if (!pixels) {
         ERROR("Failed to read file {}", file_path.string());
         ERROR("{}", stbi_failure_reason());
         std::terminate();
     }
 
+    auto image = loadFromPixels(context, pixels, width, height, format);
+    stbi_image_free(pixels);
+    return image;
+}
+
+core::ref<image_t> image_builder_t::loadFromPixels(core::ref<context_t> context, const void *pixels, uint32_t width, uint32_t height, VkFormat format) {
+    VkDeviceSize image_size = static_cast<VkDeviceSize>(width) * height * 4;
+
     auto staging_buffer = buffer_builder_t{}
         .build(context, image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
@@ -218,8 +224,6 @@ core::ref<image_t> image_builder_t::loadFromPath(core::ref<context_t> context, c
     std::memcpy(map, pixels, image_size);
     staging_buffer->unmap();
 
-    stbi_image_free(pixels);
-    
     mip_maps();
     auto image = build2D(context, width, height, format, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     image->transition_layout(initial_layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
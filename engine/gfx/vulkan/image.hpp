@@ -23,6 +23,8 @@ struct image_builder_t {
     core::ref<image_t> build2D(core::ref<context_t> context, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags image_usage_flags, VkMemoryPropertyFlags memory_type_index);
     core::ref<image_t> build3D(core::ref<context_t> context, uint32_t width, uint32_t height, uint32_t depth, VkFormat format, VkImageUsageFlags image_usage_flags, VkMemoryPropertyFlags memory_type_index);
     core::ref<image_t> loadFromPath(core::ref<context_t> context, const std::filesystem::path& file_path, VkFormat format = VK_FORMAT_R8G8B8A8_SRGB);
+    // width * height rgba8 pixels already decoded, e.g. the textures of an asset pack
+    core::ref<image_t> loadFromPixels(core::ref<context_t> context, const void *pixels, uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_SRGB);
 
     bool enable_mip_maps{false};
     bool enable_compare_op{false};
@@ -0,0 +1,85 @@
+#include "benchmark.hpp"
+
+#include "core/model.hpp"
+
+#include <random>
+
+scene_t load_scene(const std::filesystem::path& file_path) {
+    scene_t scene{};
+    scene.name = file_path.filename().string();
+    scene.file_path = file_path;
+
+    auto model = core::load_model_from_path(file_path);
+    for (auto& mesh : model.meshes) {
+        assert(mesh.indices.size() % 3 == 0);
+        for (uint32_t i = 0; i < mesh.indices.size(); i += 3) {
+            triangle_t triangle{};
+            triangle.p0 = mesh.vertices[mesh.indices[i + 0]].position;
+            triangle.p1 = mesh.vertices[mesh.indices[i + 1]].position;
+            triangle.p2 = mesh.vertices[mesh.indices[i + 2]].position;
+            scene.triangles.push_back(triangle);
+        }
+    }
+
+    scene.aabbs.resize(scene.triangles.size());
+    scene.centers.resize(scene.triangles.size());
+    for (uint32_t i = 0; i < scene.triangles.size(); i++) {
+        auto& triangle = scene.triangles[i];
+        scene.aabbs[i] = aabb_t::empty();
+        scene.aabbs[i].extend(triangle.p0).extend(triangle.p1).extend(triangle.p2);
+        scene.centers[i] = (triangle.p0 + triangle.p1 + triangle.p2) / 3.0f;
+    }
+    return scene;
+}
+
+static aabb_t scene_bounds(const scene_t& scene) {
+    aabb_t bounds = aabb_t::empty();
+    for (auto& aabb : scene.aabbs) 
+        bounds.extend(aabb);
+    return bounds;
+}
+
+std::vector<ray_t> generate_primary_rays(const scene_t& scene, uint32_t width, uint32_t height) {
+    aabb_t bounds = scene_bounds(scene);
+    int axis = bounds.largest_axis();
+
+    glm::vec3 eye = (bounds.min + bounds.max) * 0.5f;
+    glm::vec3 dir{ 0, 0, 0 };
+    dir[axis] = -1;
+    glm::vec3 up = axis == 1 ? glm::vec3{ 0, 0, 1 } : glm::vec3{ 0, 1, 0 };
+    glm::vec3 right = glm::normalize(glm::cross(dir, up));
+    up = glm::cross(right, dir);
+
+    std::vector<ray_t> rays(width * height);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            auto u = 2.0f * static_cast<float>(x) / static_cast<float>(width) - 1.0f;
+            auto v = 2.0f * static_cast<float>(y) / static_cast<float>(height) - 1.0f;
+            ray_t& ray = rays[y * width + x];
+            ray.origin = eye;
+            ray.direction = dir + u * right + v * up;
+            ray.tmin = 0;
+            ray.tmax = std::numeric_limits<float>::max();
+        }
+    }
+    return rays;
+}
+
+std::vector<ray_t> generate_random_rays(const scene_t& scene, uint32_t count, uint32_t seed) {
+    aabb_t bounds = scene_bounds(scene);
+
+    std::mt19937 rng{ seed };
+    std::uniform_real_distribution<float> distribution{ 0, 1 };
+
+    std::vector<ray_t> rays(count);
+    for (auto& ray : rays) {
+        ray.origin = bounds.min + glm::vec3{ distribution(rng), distribution(rng), distribution(rng) } * bounds.diagonal();
+        float z = 2.0f * distribution(rng) - 1.0f;
+        float phi = 2.0f * 3.14159265f * distribution(rng);
+        float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        ray.direction = { r * std::cos(phi), r * std::sin(phi), z };
+        ray.tmin = 0;
+        ray.tmax = std::numeric_limits<float>::max();
+    }
+    return rays;
+}
@@ -0,0 +1,71 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include "bvh.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct scene_t {
+    std::string name;
+    std::filesystem::path file_path;
+    std::vector<triangle_t> triangles;
+    std::vector<aabb_t> aabbs;
+    std::vector<glm::vec3> centers;
+};
+
+// flattens every mesh of the model into one triangle soup, same as bvh_my
+scene_t load_scene(const std::filesystem::path& file_path);
+
+// camera placed at the center of the scene bounds looking down the longest axis, 90 degree fov
+std::vector<ray_t> generate_primary_rays(const scene_t& scene, uint32_t width, uint32_t height);
+
+// origins uniform inside the scene bounds, directions uniform on the sphere
+std::vector<ray_t> generate_random_rays(const scene_t& scene, uint32_t count, uint32_t seed = 0);
+
+// runs fn iterations times and returns the fastest run in milliseconds
+template <typename fn_t>
+double time_ms(uint32_t iterations, const fn_t& fn) {
+    double best = std::numeric_limits<double>::max();
+    for (uint32_t i = 0; i < iterations; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+// traces every ray once (on a copy, traversal shrinks tmax) and returns million rays per second
+template <typename fn_t>
+double mrays_per_second(const std::vector<ray_t>& rays, const fn_t& trace) {
+    double time = time_ms(3, [&]() {
+        for (auto ray : rays) 
+            trace(ray);
+    });
+    return rays.size() / (time * 1000.0);
+}
+
+void build_benchmark(const std::vector<scene_t>& scenes);
+void wide_benchmark(const std::vector<scene_t>& scenes);
+void packet_benchmark(const std::vector<scene_t>& scenes);
+void ordered_benchmark(const std::vector<scene_t>& scenes);
+void compressed_benchmark(const std::vector<scene_t>& scenes);
+void sbvh_benchmark(const std::vector<scene_t>& scenes);
+void lbvh_benchmark(const std::vector<scene_t>& scenes);
+void refit_benchmark(const std::vector<scene_t>& scenes);
+void instancing_benchmark(const std::vector<scene_t>& scenes);
+void cache_benchmark(const std::vector<scene_t>& scenes);
+void leaf_benchmark(const std::vector<scene_t>& scenes);
+void render_benchmark(const std::vector<scene_t>& scenes);
+void sort_benchmark(const std::vector<scene_t>& scenes);
+void treelet_benchmark(const std::vector<scene_t>& scenes);
+void layout_benchmark(const std::vector<scene_t>& scenes);
+void config_benchmark(const std::vector<scene_t>& scenes);
+void query_benchmark(const std::vector<scene_t>& scenes);
+void out_of_core_benchmark(const std::vector<scene_t>& scenes);
+void out_of_core_large_benchmark(const std::vector<scene_t>& scenes);
+
+#endif
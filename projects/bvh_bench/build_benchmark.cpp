@@ -0,0 +1,34 @@
+#include "benchmark.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <cstring>
+#include <thread>
+
+// build time of bvh_t::build for 1..N threads, checks that every thread count reproduces the serial tree
+void build_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t max_thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (auto& scene : scenes) {
+        std::cout << "build: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+
+        bvh_t reference = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size());
+        double serial_time = time_ms(5, [&]() {
+            bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size());
+        });
+
+        for (uint32_t thread_count = 1; thread_count <= max_thread_count; thread_count++) {
+            // spawning the workers is not part of the build
+            core::thread_pool_t thread_pool{ thread_count };
+            bvh_t bvh;
+            double time = time_ms(5, [&]() {
+                bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), thread_pool);
+            });
+            bool identical = bvh.nodes.size() == reference.nodes.size() &&
+                             std::memcmp(bvh.nodes.data(), reference.nodes.data(), bvh.nodes.size() * sizeof(node_t)) == 0 &&
+                             bvh.primitive_indices == reference.primitive_indices;
+            std::cout << "    " << thread_count << " thread(s): " << time << "ms, speedup " << serial_time / time << "x" 
+                      << (identical ? "" : ", OUTPUT DIFFERS FROM SERIAL BUILD") << '\n';
+        }
+    }
+}
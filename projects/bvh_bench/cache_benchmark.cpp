@@ -0,0 +1,82 @@
+#include "benchmark.hpp"
+
+#include "bvh_cache.hpp"
+
+#include <thread>
+
+// startup of bvh_my, parsing and building from scratch against hashing the sources and mapping a cache file
+void cache_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    const std::filesystem::path cache_directory = std::filesystem::temp_directory_path() / "bvh_bench_cache";
+
+    for (auto& scene : scenes) {
+        std::cout << "cache: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+
+        const build_config_t build_config{};
+        scene_t loaded;
+        bvh_t bvh;
+        double cold_time = time_ms(1, [&]() {
+            loaded = load_scene(scene.file_path);
+            bvh = bvh_t::build(loaded.aabbs.data(), loaded.centers.data(), loaded.triangles.size(), thread_count, build_config);
+        });
+
+        uint64_t key = 0;
+        double key_time = time_ms(1, [&]() { key = bvh_cache_key(bvh_cache_sources(scene.file_path), bvh_build_settings(build_config)); });
+        if (key == 0) {
+            std::cout << "    cannot read " << scene.file_path << ", skipped\n";
+            continue;
+        }
+        const std::filesystem::path cache_path = cache_directory / (scene.name + ".bvh");
+        bool written = false;
+        double write_time = time_ms(1, [&]() { written = write_bvh_cache(cache_path, key, bvh, loaded.triangles); });
+        if (!written) {
+            std::cout << "    cannot write " << cache_path << ", skipped\n";
+            continue;
+        }
+
+        std::optional<mapped_bvh_cache_t> cache;
+        double open_time = time_ms(1, [&]() { cache = mapped_bvh_cache_t::open(cache_path, key); });
+        if (!cache) {
+            std::cout << "    cannot open " << cache_path << ", skipped\n";
+            continue;
+        }
+
+        // the mapping is lazy, the first rays pay for paging the file in
+        std::vector<ray_t> rays = generate_random_rays(loaded, 16384);
+        uint32_t mismatches = 0;
+        double first_trace_time = time_ms(1, [&]() {
+            for (auto ray : rays) {
+                ray_t reference_ray = ray;
+                hit_t hit = bvh.closest_hit(reference_ray, loaded.triangles);
+                hit_t mapped_hit = cache->bvh.closest_hit<triangle_t>(ray, cache->triangles);
+                // same tree and triangles, the hits have to be identical
+                if (hit.primitive_index != mapped_hit.primitive_index || reference_ray.tmax != ray.tmax)
+                    mismatches++;
+            }
+        });
+
+        bool rejected = !mapped_bvh_cache_t::open(cache_path, key + 1);
+
+        // a child index past the end has to turn the file into a miss instead of a crash in the traversal
+        bool corrupt_rejected = false;
+        {
+            bvh_t corrupt = bvh;
+            corrupt.nodes[0].first_index = corrupt.nodes.size();
+            const std::filesystem::path corrupt_path = cache_directory / (scene.name + ".corrupt.bvh");
+            corrupt_rejected = write_bvh_cache(corrupt_path, key, corrupt, loaded.triangles) && !mapped_bvh_cache_t::open(corrupt_path, key);
+            std::error_code error;
+            std::filesystem::remove(corrupt_path, error);
+        }
+
+        std::cout << "    cold load + build " << cold_time << " ms | key " << key_time << " ms, mmap open " << open_time
+                  << " ms, first " << rays.size() << " rays (both trees) " << first_trace_time << " ms | write " << write_time << " ms, "
+                  << std::filesystem::file_size(cache_path) / 1024 << " KiB"
+                  << (rejected ? "" : ", STALE KEY ACCEPTED")
+                  << (corrupt_rejected ? "" : ", CORRUPT FILE ACCEPTED")
+                  << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+
+        cache.reset();
+        std::error_code error;
+        std::filesystem::remove(cache_path, error);
+    }
+}
@@ -0,0 +1,37 @@
+#include "benchmark.hpp"
+
+#include "compressed_bvh.hpp"
+
+// memory footprint and Mrays/s of the binary node_t tree, the float 4 wide tree and the quantized 4 wide tree
+void compressed_benchmark(const std::vector<scene_t>& scenes) {
+    for (auto& scene : scenes) {
+        bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size());
+        bvh4_t bvh4 = bvh4_t::collapse(bvh);
+        compressed_bvh_t compressed_bvh = compressed_bvh_t::compress(bvh4);
+
+        std::cout << "compressed: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+        std::cout << "    node_t:            " << bvh.nodes.size() << " node(s), " << bvh.nodes.size() * sizeof(node_t) / 1024.0 << "KiB\n";
+        std::cout << "    bvh4_t:            " << bvh4.nodes.size() << " node(s), " << bvh4.nodes.size() * sizeof(bvh4_t::node_t) / 1024.0 << "KiB\n";
+        std::cout << "    compressed_bvh_t:  " << compressed_bvh.nodes.size() << " node(s), " << compressed_bvh.nodes.size() * sizeof(compressed_node_t) / 1024.0 << "KiB ("
+                  << static_cast<double>(compressed_bvh.nodes.size() * sizeof(compressed_node_t)) / (bvh.nodes.size() * sizeof(node_t)) << "x of node_t)\n";
+
+        const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+            { "primary", generate_primary_rays(scene, 512, 512) },
+            { "random", generate_random_rays(scene, 512 * 512) },
+        };
+        for (auto& [ray_set_name, rays] : ray_sets) {
+            uint32_t mismatches = 0;
+            for (auto ray : rays) {
+                ray_t compressed_ray = ray;
+                hit_t hit = bvh.closest_hit(ray, scene.triangles);
+                if (compressed_bvh.traverse(compressed_ray, scene.triangles).primitive_index != hit.primitive_index && compressed_ray.tmax != ray.tmax) 
+                    mismatches++;
+            }
+            double binary = mrays_per_second(rays, [&](ray_t& ray) { return bvh.closest_hit(ray, scene.triangles); });
+            double wide4 = mrays_per_second(rays, [&](ray_t& ray) { return bvh4.traverse(ray, scene.triangles); });
+            double compressed = mrays_per_second(rays, [&](ray_t& ray) { return compressed_bvh.traverse(ray, scene.triangles); });
+            std::cout << "    " << ray_set_name << ": node_t " << binary << " Mrays/s, bvh4_t " << wide4 << " Mrays/s, compressed_bvh_t " << compressed << " Mrays/s"
+                      << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#include "benchmark.hpp"
+
+#include "bvh_builder.hpp"
+
+#include <cstring>
+#include <thread>
+
+namespace {
+
+template <uint32_t bin_count>
+void compare_build(const scene_t& scene, core::thread_pool_t& thread_pool) {
+    build_config_t runtime_config{};
+    runtime_config.bin_count = bin_count;
+    const static_build_config_t<bin_count> static_config{};
+
+    bvh_t runtime_bvh, static_bvh;
+    const uint32_t primitive_count = scene.triangles.size();
+    double runtime_serial = time_ms(3, [&]() { runtime_bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), primitive_count, 1, runtime_config); });
+    double static_serial = time_ms(3, [&]() { static_bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), primitive_count, 1, static_config); });
+    double runtime_parallel = time_ms(3, [&]() { bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), primitive_count, thread_pool, runtime_config); });
+    double static_parallel = time_ms(3, [&]() { bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), primitive_count, thread_pool, static_config); });
+
+    // the same values have to give the same tree, only the code generated for them differs
+    bool identical = runtime_bvh.nodes.size() == static_bvh.nodes.size() &&
+                     std::memcmp(runtime_bvh.nodes.data(), static_bvh.nodes.data(), runtime_bvh.nodes.size() * sizeof(node_t)) == 0 &&
+                     runtime_bvh.primitive_indices == static_bvh.primitive_indices;
+    std::cout << "    " << bin_count << " bin(s): sah cost " << static_bvh.sah_cost() << ", serial " << runtime_serial << " -> " << static_serial
+              << " ms (" << runtime_serial / static_serial << "x), " << thread_pool.thread_count() << " thread(s) " << runtime_parallel << " -> " << static_parallel
+              << " ms (" << runtime_parallel / static_parallel << "x)" << (identical ? "" : ", OUTPUT DIFFERS FROM RUNTIME CONFIG") << '\n';
+}
+
+} // namespace
+
+// build time of bvh_t::build with a build_config_t against a static_build_config_t holding the same values
+void config_benchmark(const std::vector<scene_t>& scenes) {
+    core::thread_pool_t thread_pool{ std::max(1u, std::thread::hardware_concurrency()) };
+
+    for (auto& scene : scenes) {
+        std::cout << "config: " << scene.name << " (" << scene.triangles.size() << " triangle(s)), runtime -> static\n";
+        compare_build<8>(scene, thread_pool);
+        compare_build<16>(scene, thread_pool);
+        compare_build<32>(scene, thread_pool);
+    }
+}
@@ -0,0 +1,104 @@
+#include "benchmark.hpp"
+
+#include "tlas.hpp"
+
+#include <thread>
+
+template <typename T>
+static double megabytes(const std::vector<T>& v) { return v.size() * sizeof(T) / (1024.0 * 1024.0); }
+
+static double megabytes(const bvh_t& bvh) { return megabytes(bvh.nodes) + megabytes(bvh.primitive_indices); }
+
+// the scene instanced on a grid with a different rotation per instance, flattened into one bvh against blas + tlas
+void instancing_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (auto& scene : scenes) {
+        // about a million triangles in total, at least 2x2 instances
+        const uint32_t grid_size = std::max(2u, static_cast<uint32_t>(std::sqrt(1000000.0 / scene.triangles.size())));
+        std::cout << "instancing: " << scene.name << " (" << scene.triangles.size() << " triangle(s), " << grid_size * grid_size << " instance(s))\n";
+
+        aabb_t bounds = aabb_t::empty();
+        for (auto& aabb : scene.aabbs)
+            bounds.extend(aabb);
+        const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        const float spacing = glm::length(bounds.diagonal()) * 1.1f;
+
+        std::vector<instance_t> instances;
+        for (uint32_t z = 0; z < grid_size; z++) {
+            for (uint32_t x = 0; x < grid_size; x++) {
+                glm::mat4 transform{ 1.0f };
+                transform[3] = glm::vec4{ x * spacing, 0.0f, z * spacing, 1.0f };
+                float angle = (x * grid_size + z) * 0.7f;
+                glm::mat4 rotation{ 1.0f };
+                rotation[0] = glm::vec4{ std::cos(angle), 0.0f, -std::sin(angle), 0.0f };
+                rotation[2] = glm::vec4{ std::sin(angle), 0.0f, std::cos(angle), 0.0f };
+                glm::mat4 recenter{ 1.0f };
+                recenter[3] = glm::vec4{ -center, 1.0f };
+                instances.push_back({ transform * rotation * recenter, 0, static_cast<uint32_t>(instances.size()) });
+            }
+        }
+
+        // flattened, what PreTransformVertices gives for instanced meshes
+        scene_t flat{};
+        for (auto& instance : instances) {
+            for (auto& triangle : scene.triangles) {
+                triangle_t t{ glm::vec3{ instance.transform * glm::vec4{ triangle.p0, 1.0f } },
+                              glm::vec3{ instance.transform * glm::vec4{ triangle.p1, 1.0f } },
+                              glm::vec3{ instance.transform * glm::vec4{ triangle.p2, 1.0f } } };
+                aabb_t aabb = aabb_t::empty();
+                aabb.extend(t.p0).extend(t.p1).extend(t.p2);
+                flat.triangles.push_back(t);
+                flat.aabbs.push_back(aabb);
+                flat.centers.push_back((t.p0 + t.p1 + t.p2) / 3.0f);
+            }
+        }
+
+        bvh_t flat_bvh;
+        double flat_build = time_ms(1, [&]() { flat_bvh = bvh_t::build(flat.aabbs.data(), flat.centers.data(), flat.triangles.size(), thread_count); });
+        std::vector<blas_t> blases;
+        double blas_build = time_ms(1, [&]() { blases = { blas_t::build(scene.triangles, thread_count) }; });
+        tlas_t tlas;
+        double tlas_build = time_ms(1, [&]() { tlas = tlas_t::build(blases, instances, thread_count); });
+
+        // moving one instance, the flattened scene has to rebuild everything
+        double tlas_move = time_ms(5, [&]() {
+            glm::mat4 transform = instances[0].transform;
+            transform[3].y += spacing * 0.1f;
+            tlas.set_transform(0, transform);
+            tlas.rebuild(thread_count);
+        });
+        tlas.set_transform(0, instances[0].transform);
+        tlas.rebuild(thread_count);
+
+        std::cout << "    flat: " << megabytes(flat.triangles) + megabytes(flat_bvh) << " MiB, build " << flat_build << " ms\n"
+                  << "    two level: " << megabytes(blases[0].triangles) + megabytes(blases[0].bvh) + megabytes(tlas.bvh) + megabytes(tlas.instances) + megabytes(tlas.inverse_transforms)
+                  << " MiB, blas build " << blas_build << " ms, tlas build " << tlas_build << " ms, move an instance " << tlas_move << " ms\n";
+
+        const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+            { "primary", generate_primary_rays(flat, 512, 512) },
+            { "random", generate_random_rays(flat, 512 * 512) },
+        };
+        // the flattened triangles are stored far from the origin and lose precision that the mesh space ones keep,
+        // a handful of rays through shared edges can still slip through the cracks in one of the two
+        aabb_t world_bounds = aabb_t::empty();
+        for (auto& aabb : flat.aabbs)
+            world_bounds.extend(aabb);
+        const float tolerance = 1e-5f * glm::length(world_bounds.diagonal());
+
+        for (auto& [ray_set_name, rays] : ray_sets) {
+            uint32_t mismatches = 0;
+            for (auto ray : rays) {
+                ray_t instance_ray = ray;
+                hit_t hit = flat_bvh.closest_hit(ray, flat.triangles);
+                instance_hit_t instance_hit = tlas.closest_hit(instance_ray);
+                if (static_cast<bool>(hit) != static_cast<bool>(instance_hit) || (hit && std::abs(ray.tmax - instance_ray.tmax) > tolerance))
+                    mismatches++;
+            }
+            double flat_mrays = mrays_per_second(rays, [&](ray_t& ray) { return flat_bvh.closest_hit(ray, flat.triangles); });
+            double tlas_mrays = mrays_per_second(rays, [&](ray_t& ray) { return tlas.closest_hit(ray); });
+            std::cout << "    " << ray_set_name << ": flat " << flat_mrays << " Mrays/s, two level " << tlas_mrays << " Mrays/s (" << tlas_mrays / flat_mrays << "x)"
+                      << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+        }
+    }
+}
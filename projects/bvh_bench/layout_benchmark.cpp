@@ -0,0 +1,52 @@
+#include "benchmark.hpp"
+
+#include <thread>
+
+// traversal speed of the node layouts of bvh_t::relayout, the gpu side is compared with the node layout combo in bvh_my
+void layout_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (auto& scene : scenes) {
+        std::cout << "layout: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+
+        const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+            { "primary", generate_primary_rays(scene, 512, 512) },
+            { "random", generate_random_rays(scene, 512 * 512) },
+        };
+
+        const std::pair<const char *, node_layout_t> layouts[] = {
+            { "depth first", node_layout_t::depth_first },
+            { "breadth first", node_layout_t::breadth_first },
+            { "van emde boas", node_layout_t::van_emde_boas },
+        };
+
+        const bvh_t reference = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), thread_count);
+        for (auto& [name, layout] : layouts) {
+            bvh_t bvh = reference;
+            double relayout_time = time_ms(1, [&]() { bvh.relayout(layout); });
+
+            // average index distance from a node to its children, a rough measure of how far apart a traversal step jumps
+            double child_distance = 0;
+            for (uint32_t i = 0; i < bvh.nodes.size(); i++)
+                if (!bvh.nodes[i].is_leaf())
+                    child_distance += bvh.nodes[i].first_index - i;
+            child_distance /= std::max<size_t>(1, bvh.nodes.size() / 2);
+
+            std::cout << "    " << name << ": " << relayout_time << " ms, sah cost " << bvh.sah_cost() << ", child distance " << child_distance << " node(s)\n";
+            for (auto& [ray_set_name, rays] : ray_sets) {
+                // only the node order changes, every ray has to hit exactly what it hits in the build order
+                uint32_t mismatches = 0;
+                for (auto ray : rays) {
+                    ray_t reference_ray = ray;
+                    hit_t hit = bvh.closest_hit(ray, scene.triangles);
+                    hit_t reference_hit = reference.closest_hit(reference_ray, scene.triangles);
+                    if (hit.primitive_index != reference_hit.primitive_index || ray.tmax != reference_ray.tmax)
+                        mismatches++;
+                }
+                double mrays = mrays_per_second(rays, [&](ray_t& ray) { return bvh.closest_hit(ray, scene.triangles); });
+                std::cout << "        " << ray_set_name << ": " << mrays << " Mrays/s"
+                          << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+            }
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#include "benchmark.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <thread>
+
+// binned SAH build against the morton builders, build time at 1 and N threads and what the faster build costs in traversal
+void lbvh_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    core::thread_pool_t thread_pool{ thread_count };
+
+    for (auto& scene : scenes) {
+        std::cout << "lbvh: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+
+        const std::pair<const char *, linear_build_config_t> linear_configs[] = {
+            { "lbvh 30 bit", { .morton_bits = 30 } },
+            { "lbvh 63 bit", { .morton_bits = 63 } },
+            { "hlbvh", { .sah_cluster_size = 256 } },
+        };
+
+        const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+            { "primary", generate_primary_rays(scene, 512, 512) },
+            { "random", generate_random_rays(scene, 512 * 512) },
+        };
+
+        bvh_t reference = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size());
+        auto report = [&](const char *name, const bvh_t& bvh, double serial_time, double parallel_time) {
+            std::cout << "    " << name << ": " << serial_time << " ms, " << parallel_time << " ms at " << thread_count << " thread(s), "
+                      << bvh.nodes.size() << " node(s), sah cost " << bvh.sah_cost() << '\n';
+            for (auto& [ray_set_name, rays] : ray_sets) {
+                // compare distances, ties between coplanar triangles may resolve to a different primitive
+                uint32_t mismatches = 0;
+                for (auto ray : rays) {
+                    ray_t reference_ray = ray;
+                    hit_t hit = bvh.closest_hit(ray, scene.triangles);
+                    hit_t reference_hit = reference.closest_hit(reference_ray, scene.triangles);
+                    if (static_cast<bool>(hit) != static_cast<bool>(reference_hit) || (hit && std::abs(ray.tmax - reference_ray.tmax) > 1e-4f * std::max(1.0f, ray.tmax)))
+                        mismatches++;
+                }
+                double mrays = mrays_per_second(rays, [&](ray_t& ray) { return bvh.closest_hit(ray, scene.triangles); });
+                std::cout << "        " << ray_set_name << ": " << mrays << " Mrays/s"
+                          << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+            }
+        };
+
+        double serial_time = time_ms(3, [&]() { bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size()); });
+        double parallel_time = time_ms(3, [&]() { bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), thread_pool); });
+        report("binned sah", reference, serial_time, parallel_time);
+
+        for (auto& [name, config] : linear_configs) {
+            bvh_t bvh;
+            serial_time = time_ms(5, [&]() { bvh = bvh_t::build_linear(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), 1, config); });
+            parallel_time = time_ms(5, [&]() { bvh = bvh_t::build_linear(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), thread_pool, config); });
+            report(name, bvh, serial_time, parallel_time);
+        }
+    }
+}
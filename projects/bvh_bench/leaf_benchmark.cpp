@@ -0,0 +1,122 @@
+#include "benchmark.hpp"
+
+#include "triangle_block.hpp"
+
+struct leaf_test_t {
+    uint32_t ray_index;
+    uint32_t node_index;
+};
+
+// every leaf the ordered traversal of the rays reaches, in the order it reaches them
+static std::vector<leaf_test_t> record_leaf_tests(const bvh_t& bvh, const scene_t& scene, const std::vector<ray_t>& rays) {
+    std::vector<leaf_test_t> leaf_tests;
+    for (uint32_t ray_index = 0; ray_index < rays.size(); ray_index++) {
+        ray_t ray = rays[ray_index];
+        bvh.view().traverse_leaves<false>(ray, [&](uint32_t node_index, const node_t& leaf, ray_t& ray) {
+            leaf_tests.push_back({ ray_index, node_index });
+            hit_t hit = hit_t::none();
+            for (uint32_t i = 0; i < leaf.primitive_count; i++) {
+                uint32_t primitive_index = bvh.primitive_indices[leaf.first_index + i];
+                if (scene.triangles[primitive_index].intersect(ray))
+                    hit.primitive_index = primitive_index;
+            }
+            return hit;
+        });
+    }
+    return leaf_tests;
+}
+
+template <uint32_t width>
+static double fill(const leaf_triangles_t<width>& leaf_triangles, const bvh_t& bvh) {
+    return static_cast<double>(bvh.primitive_indices.size()) / (leaf_triangles.blocks.size() * width);
+}
+
+// leaf kernels on their own over the recorded leaf tests of real traversals, then whole closest hit traversals
+// scalar is triangle_t::intersect through primitive_indices, block4 and block8 the SoA kernels over leaf_triangles_t
+void leaf_benchmark(const std::vector<scene_t>& scenes) {
+    for (auto& scene : scenes) {
+        bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size());
+        leaf_triangles4_t leaf_triangles4 = leaf_triangles4_t::build(bvh.view(), scene.triangles);
+        leaf_triangles8_t leaf_triangles8 = leaf_triangles8_t::build(bvh.view(), scene.triangles);
+
+        std::cout << "leaf: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+        std::cout << "    scalar: " << (scene.triangles.size() * sizeof(triangle_t) + bvh.primitive_indices.size() * sizeof(uint32_t)) / 1024.0 << "KiB\n";
+        std::cout << "    block4: " << leaf_triangles4.blocks.size() << " block(s), " << leaf_triangles4.blocks.size() * sizeof(triangle_block_t<4>) / 1024.0
+                  << "KiB, " << fill(leaf_triangles4, bvh) * 100.0 << "% lanes used\n";
+        std::cout << "    block8: " << leaf_triangles8.blocks.size() << " block(s), " << leaf_triangles8.blocks.size() * sizeof(triangle_block_t<8>) / 1024.0
+                  << "KiB, " << fill(leaf_triangles8, bvh) * 100.0 << "% lanes used\n";
+
+        const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+            { "primary", generate_primary_rays(scene, 512, 512) },
+            { "random", generate_random_rays(scene, 512 * 512) },
+        };
+        for (auto& [ray_set_name, rays] : ray_sets) {
+            std::vector<leaf_test_t> leaf_tests = record_leaf_tests(bvh, scene, rays);
+
+            // every leaf test starts from the untouched ray, the kernels only differ in how they find the hit
+            uint32_t hits[3] = {};
+            double kernel_times[3] = {
+                time_ms(3, [&]() {
+                    hits[0] = 0;
+                    for (auto [ray_index, node_index] : leaf_tests) {
+                        ray_t ray = rays[ray_index];
+                        const node_t& leaf = bvh.nodes[node_index];
+                        bool hit = false;
+                        for (uint32_t i = 0; i < leaf.primitive_count; i++)
+                            hit |= scene.triangles[bvh.primitive_indices[leaf.first_index + i]].intersect(ray);
+                        hits[0] += hit;
+                    }
+                }),
+                time_ms(3, [&]() {
+                    hits[1] = 0;
+                    for (auto [ray_index, node_index] : leaf_tests) {
+                        ray_t ray = rays[ray_index];
+                        const node_t& leaf = bvh.nodes[node_index];
+                        const triangle_block_t<4> *block = &leaf_triangles4.blocks[leaf_triangles4.first_block[node_index]];
+                        bool hit = false;
+                        for (uint32_t first = 0; first < leaf.primitive_count; first += 4, block++)
+                            hit |= intersect(*block, std::min(leaf.primitive_count - first, 4u), ray) != triangle_block_t<4>::invalid_lane;
+                        hits[1] += hit;
+                    }
+                }),
+                time_ms(3, [&]() {
+                    hits[2] = 0;
+                    for (auto [ray_index, node_index] : leaf_tests) {
+                        ray_t ray = rays[ray_index];
+                        const node_t& leaf = bvh.nodes[node_index];
+                        const triangle_block_t<8> *block = &leaf_triangles8.blocks[leaf_triangles8.first_block[node_index]];
+                        bool hit = false;
+                        for (uint32_t first = 0; first < leaf.primitive_count; first += 8, block++)
+                            hit |= intersect(*block, std::min(leaf.primitive_count - first, 8u), ray) != triangle_block_t<8>::invalid_lane;
+                        hits[2] += hit;
+                    }
+                }),
+            };
+            std::cout << "    " << ray_set_name << " kernels (" << leaf_tests.size() << " leaf test(s)): scalar " << leaf_tests.size() / (kernel_times[0] * 1000.0)
+                      << " Mleaves/s, block4 " << leaf_tests.size() / (kernel_times[1] * 1000.0) << " Mleaves/s (" << kernel_times[0] / kernel_times[1]
+                      << "x), block8 " << leaf_tests.size() / (kernel_times[2] * 1000.0) << " Mleaves/s (" << kernel_times[0] / kernel_times[2] << "x)"
+                      << (hits[0] != hits[1] || hits[0] != hits[2] ? ", LEAF HIT COUNTS DIFFER" : "") << '\n';
+
+            // same math, but -march=native lets the compiler fuse the scalar multiply adds and not the intrinsics, so the odd ray
+            // through a shared edge can hit on one side only, exact ties inside a leaf may also resolve to another triangle
+            uint32_t mismatches = 0;
+            for (auto ray : rays) {
+                ray_t ray4 = ray, ray8 = ray;
+                hit_t hit = bvh.closest_hit(ray, scene.triangles);
+                hit_t hit4 = leaf_triangles4.closest_hit(bvh.view(), ray4);
+                hit_t hit8 = leaf_triangles8.closest_hit(bvh.view(), ray8);
+                if (static_cast<bool>(hit) != static_cast<bool>(hit4) || (hit && std::abs(ray.tmax - ray4.tmax) > 1e-5f * std::max(1.0f, ray.tmax)))
+                    mismatches++;
+                if (static_cast<bool>(hit) != static_cast<bool>(hit8) || (hit && std::abs(ray.tmax - ray8.tmax) > 1e-5f * std::max(1.0f, ray.tmax)))
+                    mismatches++;
+            }
+
+            double scalar = mrays_per_second(rays, [&](ray_t& ray) { return bvh.closest_hit(ray, scene.triangles); });
+            double block4 = mrays_per_second(rays, [&](ray_t& ray) { return leaf_triangles4.closest_hit(bvh.view(), ray); });
+            double block8 = mrays_per_second(rays, [&](ray_t& ray) { return leaf_triangles8.closest_hit(bvh.view(), ray); });
+            std::cout << "    " << ray_set_name << " closest_hit: scalar " << scalar << " Mrays/s, block4 " << block4 << " Mrays/s (" << block4 / scalar
+                      << "x), block8 " << block8 << " Mrays/s (" << block8 / scalar << "x)"
+                      << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+        }
+    }
+}
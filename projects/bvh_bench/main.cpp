@@ -0,0 +1,62 @@
+#include "benchmark.hpp"
+
+#include <functional>
+#include <iostream>
+#include <map>
+
+int main(int argc, char **argv) {
+    const std::map<std::string, std::function<void(const std::vector<scene_t>&)>> benchmarks{
+        { "build", build_benchmark },
+        { "wide", wide_benchmark },
+        { "packet", packet_benchmark },
+        { "ordered", ordered_benchmark },
+        { "compressed", compressed_benchmark },
+        { "sbvh", sbvh_benchmark },
+        { "lbvh", lbvh_benchmark },
+        { "refit", refit_benchmark },
+        { "instancing", instancing_benchmark },
+        { "cache", cache_benchmark },
+        { "leaf", leaf_benchmark },
+        { "render", render_benchmark },
+        { "sort", sort_benchmark },
+        { "treelet", treelet_benchmark },
+        { "layout", layout_benchmark },
+        { "config", config_benchmark },
+        { "query", query_benchmark },
+        { "out_of_core", out_of_core_benchmark },
+    };
+    // too slow or too heavy on disk for every run, only run when named
+    const std::map<std::string, std::function<void(const std::vector<scene_t>&)>> opt_in_benchmarks{
+        { "out_of_core_large", out_of_core_large_benchmark },
+    };
+
+    std::vector<scene_t> scenes;
+    scenes.push_back(load_scene("../../assets/models/cornell_box.obj"));
+    scenes.push_back(load_scene("../../assets/models/Sponza/glTF/Sponza.gltf"));
+
+    // bvh_bench [benchmark...], runs everything but the opt in benchmarks when no benchmark is named
+    if (argc == 1) {
+        for (auto& [name, benchmark] : benchmarks) 
+            benchmark(scenes);
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const std::function<void(const std::vector<scene_t>&)> *benchmark = nullptr;
+        if (auto it = benchmarks.find(argv[i]); it != benchmarks.end())
+            benchmark = &it->second;
+        else if (auto it = opt_in_benchmarks.find(argv[i]); it != opt_in_benchmarks.end())
+            benchmark = &it->second;
+        if (!benchmark) {
+            std::cerr << "unknown benchmark " << argv[i] << ", available:";
+            for (auto& [name, benchmark] : benchmarks) 
+                std::cerr << ' ' << name;
+            for (auto& [name, benchmark] : opt_in_benchmarks) 
+                std::cerr << ' ' << name;
+            std::cerr << std::endl;
+            return 1;
+        }
+        (*benchmark)(scenes);
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include "benchmark.hpp"
+
+// rays from every primary hit point towards a point light above the scene center, tmax stops at the light
+static std::vector<ray_t> generate_shadow_rays(const scene_t& scene, const bvh_t& bvh, const std::vector<ray_t>& primary_rays) {
+    aabb_t bounds = aabb_t::empty();
+    for (auto& aabb : scene.aabbs) 
+        bounds.extend(aabb);
+    glm::vec3 light = (bounds.min + bounds.max) * 0.5f;
+    light.y = bounds.min.y + bounds.diagonal().y * 0.9f;
+
+    std::vector<ray_t> shadow_rays;
+    for (auto ray : primary_rays) {
+        if (!bvh.closest_hit(ray, scene.triangles))
+            continue;
+        ray_t shadow_ray{};
+        shadow_ray.origin = ray.origin + ray.direction * ray.tmax;
+        shadow_ray.direction = light - shadow_ray.origin;
+        shadow_ray.tmin = 1e-3f;
+        shadow_ray.tmax = 1.0f;
+        shadow_rays.push_back(shadow_ray);
+    }
+    return shadow_rays;
+}
+
+// std::stack traverse against the ordered fixed stack closest hit, and closest hit against any hit on shadow rays
+void ordered_benchmark(const std::vector<scene_t>& scenes) {
+    for (auto& scene : scenes) {
+        bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size());
+        std::cout << "ordered: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+
+        std::vector<ray_t> primary_rays = generate_primary_rays(scene, 512, 512);
+        const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+            { "primary", primary_rays },
+            { "random", generate_random_rays(scene, 512 * 512) },
+        };
+        for (auto& [ray_set_name, rays] : ray_sets) {
+            uint32_t mismatches = 0;
+            for (auto ray : rays) {
+                ray_t ordered_ray = ray;
+                hit_t hit = bvh.traverse(ray, scene.triangles);
+                if (bvh.closest_hit(ordered_ray, scene.triangles).primitive_index != hit.primitive_index && ordered_ray.tmax != ray.tmax) 
+                    mismatches++;
+            }
+            double traverse = mrays_per_second(rays, [&](ray_t& ray) { return bvh.traverse(ray, scene.triangles); });
+            double closest = mrays_per_second(rays, [&](ray_t& ray) { return bvh.closest_hit(ray, scene.triangles); });
+            std::cout << "    " << ray_set_name << ": traverse " << traverse << " Mrays/s, closest_hit " << closest << " Mrays/s (" << closest / traverse << "x)"
+                      << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+        }
+
+        std::vector<ray_t> shadow_rays = generate_shadow_rays(scene, bvh, primary_rays);
+        uint32_t mismatches = 0;
+        for (auto ray : shadow_rays) {
+            ray_t any_ray = ray;
+            if (static_cast<bool>(bvh.closest_hit(ray, scene.triangles)) != static_cast<bool>(bvh.any_hit(any_ray, scene.triangles))) 
+                mismatches++;
+        }
+        double closest = mrays_per_second(shadow_rays, [&](ray_t& ray) { return bvh.closest_hit(ray, scene.triangles); });
+        double any = mrays_per_second(shadow_rays, [&](ray_t& ray) { return bvh.any_hit(ray, scene.triangles); });
+        std::cout << "    shadow: closest_hit " << closest << " Mrays/s, any_hit " << any << " Mrays/s (" << any / closest << "x)"
+                  << (mismatches ? ", " + std::to_string(mismatches) + " OCCLUSION MISMATCH(ES)" : "") << '\n';
+    }
+}
@@ -0,0 +1,224 @@
+#include "benchmark.hpp"
+
+#include "out_of_core_bvh.hpp"
+#include "core/thread_pool.hpp"
+
+#include <thread>
+
+namespace {
+
+// a terrain of side * side quads, every triangle computed from its index so the mesh never has to exist in memory
+struct terrain_t {
+    uint32_t side;
+
+    uint64_t triangle_count() const { return 2ull * side * side; }
+
+    glm::vec3 vertex(uint32_t x, uint32_t z) const {
+        float height = 8.0f * std::sin(x * 0.031f) * std::cos(z * 0.027f) + 2.0f * std::sin(x * 0.23f + z * 0.19f);
+        return { static_cast<float>(x), height, static_cast<float>(z) };
+    }
+
+    uint32_t read(uint64_t first, std::span<triangle_t> triangles) const {
+        uint32_t count = std::min<uint64_t>(triangles.size(), triangle_count() - std::min(first, triangle_count()));
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t index = first + i;
+            uint32_t x = (index / 2) % side, z = (index / 2) / side;
+            triangles[i] = index % 2 == 0 ? triangle_t{ vertex(x, z), vertex(x + 1, z), vertex(x + 1, z + 1) }
+                                          : triangle_t{ vertex(x, z), vertex(x + 1, z + 1), vertex(x, z + 1) };
+        }
+        return count;
+    }
+};
+
+#if defined(__linux__)
+// peak resident set size since the last reset, 0 where it is not available
+void reset_peak_rss() {
+    std::ofstream{ "/proc/self/clear_refs" } << "5";
+}
+
+uint64_t peak_rss_bytes() {
+    std::ifstream status{ "/proc/self/status" };
+    std::string line;
+    while (std::getline(status, line))
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stoull(line.substr(6)) * 1024;
+    return 0;
+}
+#else
+void reset_peak_rss() {}
+uint64_t peak_rss_bytes() { return 0; }
+#endif
+
+// looking down at the terrain from above one corner, every pixel lands on it
+std::vector<ray_t> terrain_rays(const terrain_t& terrain, uint32_t width, uint32_t height) {
+    const float side = static_cast<float>(terrain.side);
+    const glm::vec3 origin{ -0.1f * side, 0.3f * side, -0.1f * side };
+    const glm::vec3 forward = glm::normalize(glm::vec3{ 0.6f * side, 0, 0.6f * side } - origin);
+    const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3{ 0, 1, 0 }));
+    const glm::vec3 up = glm::cross(right, forward);
+    std::vector<ray_t> rays;
+    rays.reserve(width * height);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            float u = 2.0f * (x + 0.5f) / width - 1.0f, v = 2.0f * (y + 0.5f) / height - 1.0f;
+            rays.push_back({ origin, glm::normalize(forward + 0.5f * u * right + 0.5f * v * up), 0.0f, std::numeric_limits<float>::max() });
+        }
+    }
+    return rays;
+}
+
+// one ray at a time over the pool, or the whole batch through out_of_core_bvh_t::trace
+double trace_mrays(const out_of_core_bvh_t& bvh, const std::vector<ray_t>& rays, uint32_t thread_count, bool batched, uint32_t& hit_count) {
+    core::thread_pool_t thread_pool{ thread_count };
+    std::vector<ray_t> traced = rays;
+    std::vector<hit_t> hits(rays.size());
+    double time = time_ms(1, [&]() {
+        if (batched) {
+            bvh.trace(traced, hits.data());
+            return;
+        }
+        thread_pool.parallel_for(0, rays.size(), 1024, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+                hits[i] = bvh.closest_hit(traced[i]);
+        });
+    });
+    hit_count = std::count_if(hits.begin(), hits.end(), [](const hit_t& hit) { return static_cast<bool>(hit); });
+    return rays.size() / (time * 1000.0);
+}
+
+constexpr uint64_t megabyte = 1024 * 1024;
+
+std::filesystem::path temp_directory() {
+    return std::filesystem::temp_directory_path() / "bvh_bench_out_of_core";
+}
+
+// the build leaves its records and partitions behind on failure, so the whole directory goes
+void remove_temp_directory() {
+    std::error_code error;
+    std::filesystem::remove_all(temp_directory(), error);
+}
+
+// out_of_core_bvh_t against bvh_t on a terrain that fits in memory, every hit has to match
+bool compare_with_bvh(uint32_t thread_count) {
+    const terrain_t terrain{ 512 };
+    std::cout << "out of core: terrain (" << terrain.triangle_count() << " triangle(s)), against bvh_t\n";
+    const std::filesystem::path file_path = temp_directory() / "small.bvh";
+    auto source = [&](uint64_t first, std::span<triangle_t> triangles) { return terrain.read(first, triangles); };
+    if (!out_of_core_bvh_t::build(file_path, source, { .partition_triangles = 32 * 1024, .thread_count = thread_count })) {
+        std::cout << "    cannot write " << file_path << ", skipped\n";
+        return false;
+    }
+    {
+        auto bvh = out_of_core_bvh_t::open(file_path, 16 * megabyte);
+
+        std::vector<triangle_t> triangles(terrain.triangle_count());
+        terrain.read(0, triangles);
+        std::vector<aabb_t> aabbs(triangles.size());
+        std::vector<glm::vec3> centers(triangles.size());
+        for (uint32_t i = 0; i < triangles.size(); i++) {
+            aabbs[i] = aabb_t::empty();
+            aabbs[i].extend(triangles[i].p0).extend(triangles[i].p1).extend(triangles[i].p2);
+            centers[i] = (triangles[i].p0 + triangles[i].p1 + triangles[i].p2) / 3.0f;
+        }
+        bvh_t reference = bvh_t::build(aabbs.data(), centers.data(), triangles.size(), thread_count);
+
+        // one ray at a time and batched, both have to find the distance of the in memory bvh
+        std::vector<ray_t> rays = terrain_rays(terrain, 256, 256);
+        std::vector<ray_t> batch = rays;
+        std::vector<hit_t> batch_hits(rays.size());
+        bvh->trace(batch, batch_hits.data());
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < rays.size(); i++) {
+            ray_t ray = rays[i], reference_ray = rays[i];
+            hit_t hit = bvh->closest_hit(ray);
+            hit_t reference_hit = reference.closest_hit(reference_ray, triangles);
+            if (static_cast<bool>(hit) != static_cast<bool>(reference_hit) || ray.tmax != reference_ray.tmax)
+                mismatches++;
+            if (static_cast<bool>(batch_hits[i]) != static_cast<bool>(reference_hit) || batch[i].tmax != reference_ray.tmax)
+                mismatches++;
+        }
+        out_of_core_stats_t stats = bvh->stats();
+        std::cout << "    " << stats.loads << " load(s), " << stats.evictions << " eviction(s), "
+                  << (mismatches ? std::to_string(mismatches) + " HIT MISMATCH(ES)" : "hits match") << '\n';
+    }
+    std::filesystem::remove(file_path);
+    return true;
+}
+
+// build time, peak rss and traversal throughput of a terrain of side * side quads under memory_budget, partitions have
+// to be a fraction of the budget or one ray at a time reloads a partition for almost every ray
+void run_under_budget(uint32_t side, uint64_t memory_budget, uint32_t partition_triangles, uint32_t thread_count) {
+    const terrain_t terrain{ side };
+    std::cout << "out of core: terrain (" << terrain.triangle_count() << " triangle(s)), " << memory_budget / megabyte << " MB budget\n";
+    const std::filesystem::path file_path = temp_directory() / "large.bvh";
+    auto source = [&](uint64_t first, std::span<triangle_t> triangles) { return terrain.read(first, triangles); };
+
+    reset_peak_rss();
+    bool built = false;
+    double build_time = time_ms(1, [&]() { built = out_of_core_bvh_t::build(file_path, source, { .partition_triangles = partition_triangles, .thread_count = thread_count }); });
+    if (!built) {
+        std::cout << "    cannot write " << file_path << ", skipped\n";
+        return;
+    }
+    std::cout << "    build: " << build_time / 1000.0 << " s, " << std::filesystem::file_size(file_path) / megabyte << " MB file, peak rss "
+              << peak_rss_bytes() / megabyte << " MB\n";
+
+    reset_peak_rss();
+    auto bvh = out_of_core_bvh_t::open(file_path, memory_budget);
+    const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+        { "view", terrain_rays(terrain, 512, 512) },
+        { "random", [&]() {
+            // origins above the terrain heading down at random, every ray can land anywhere
+            std::vector<ray_t> rays = terrain_rays(terrain, 256, 256);
+            uint32_t state = 1;
+            auto random = [&]() { state = state * 1664525u + 1013904223u; return (state >> 8) * (1.0f / 16777216.0f); };
+            for (auto& ray : rays) {
+                ray.origin = { random() * terrain.side, 32.0f, random() * terrain.side };
+                ray.direction = glm::normalize(glm::vec3{ random() - 0.5f, -0.2f, random() - 0.5f });
+            }
+            return rays;
+        }() },
+    };
+    for (auto& [name, rays] : ray_sets) {
+        out_of_core_stats_t before = bvh->stats();
+        uint32_t hit_count = 0;
+        double mrays = trace_mrays(*bvh, rays, thread_count, true, hit_count);
+        out_of_core_stats_t after = bvh->stats();
+        std::cout << "    " << name << " batched: " << mrays << " Mrays/s, " << hit_count << " hit(s), " << after.loads - before.loads << " load(s) of "
+                  << (after.loaded_bytes - before.loaded_bytes) / megabyte << " MB, peak resident " << after.peak_resident_bytes / megabyte
+                  << " MB, peak rss " << peak_rss_bytes() / megabyte << " MB\n";
+    }
+
+    // one ray at a time rereads a partition for almost every ray once the partitions a row of pixels crosses exceed the
+    // budget, so only a small view goes through closest_hit
+    {
+        const std::vector<ray_t> rays = terrain_rays(terrain, 64, 64);
+        out_of_core_stats_t before = bvh->stats();
+        uint32_t hit_count = 0, batched_hit_count = 0;
+        double mrays = trace_mrays(*bvh, rays, thread_count, false, hit_count);
+        out_of_core_stats_t after = bvh->stats();
+        double batched_mrays = trace_mrays(*bvh, rays, thread_count, true, batched_hit_count);
+        std::cout << "    small view: " << mrays << " Mrays/s one at a time with " << after.loads - before.loads << " load(s), "
+                  << batched_mrays << " Mrays/s batched" << (hit_count == batched_hit_count ? "" : ", HIT COUNT MISMATCH") << '\n';
+    }
+    bvh.reset();
+    std::filesystem::remove(file_path);
+}
+
+} // namespace
+
+// out_of_core_bvh_t against bvh_t on a small terrain, then a 2M triangle terrain under a 16 MB budget, the scenes are
+// not used
+void out_of_core_benchmark(const std::vector<scene_t>&) {
+    const uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    if (compare_with_bvh(thread_count))
+        run_under_budget(1024, 16 * megabyte, 32 * 1024, thread_count);
+    remove_temp_directory();
+}
+
+// 268M triangles under a 512 MB budget, about 10 GB of triangle records and 19 GB of bvh on disk while building and
+// minutes to run, so it only runs when named
+void out_of_core_large_benchmark(const std::vector<scene_t>&) {
+    run_under_budget(11586, 512 * megabyte, out_of_core_config_t{}.partition_triangles, std::max(1u, std::thread::hardware_concurrency()));
+    remove_temp_directory();
+}
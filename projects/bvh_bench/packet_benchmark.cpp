@@ -0,0 +1,73 @@
+#include "benchmark.hpp"
+
+#include "ray_packet.hpp"
+
+// reorders row major primary rays into tile_width x tile_height tiles so each packet covers a screen tile
+static std::vector<ray_t> tile_order(const std::vector<ray_t>& rays, uint32_t width, uint32_t height, uint32_t tile_width, uint32_t tile_height) {
+    std::vector<ray_t> tiled;
+    tiled.reserve(rays.size());
+    for (uint32_t ty = 0; ty < height; ty += tile_height) 
+        for (uint32_t tx = 0; tx < width; tx += tile_width) 
+            for (uint32_t y = ty; y < std::min(height, ty + tile_height); y++) 
+                for (uint32_t x = tx; x < std::min(width, tx + tile_width); x++) 
+                    tiled.push_back(rays[y * width + x]);
+    return tiled;
+}
+
+// Mrays/s of single ray, 8 and 16 ray packet and stream traversal on camera rays
+void packet_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t width = 1024, height = 1024;
+
+    for (auto& scene : scenes) {
+        bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size());
+        std::vector<ray_t> primary_rays = generate_primary_rays(scene, width, height);
+        std::vector<ray_t> rays8 = tile_order(primary_rays, width, height, 4, 2);
+        std::vector<ray_t> rays16 = tile_order(primary_rays, width, height, 4, 4);
+        std::vector<hit_t> hits(primary_rays.size());
+
+        std::cout << "packet: " << scene.name << " (" << scene.triangles.size() << " triangle(s)), " << width << "x" << height << " primary rays\n";
+
+        // hits of every mode against single ray traversal, rays that hit different triangles at the same distance are fine
+        auto count_mismatches = [&](const std::vector<ray_t>& rays, auto&& trace) {
+            std::vector<ray_t> traced = rays;
+            trace(traced);
+            uint32_t mismatches = 0;
+            for (uint32_t i = 0; i < rays.size(); i++) {
+                ray_t ray = rays[i];
+                hit_t hit = bvh.traverse(ray, scene.triangles);
+                if (hit.primitive_index != hits[i].primitive_index && std::abs(ray.tmax - traced[i].tmax) > 1e-4f * ray.tmax) 
+                    mismatches++;
+            }
+            return mismatches;
+        };
+
+        auto time_batch = [&](const std::vector<ray_t>& rays, auto&& trace) {
+            double time = time_ms(3, [&]() {
+                std::vector<ray_t> batch = rays;
+                trace(batch);
+            });
+            return rays.size() / (time * 1000.0);
+        };
+
+        auto single = [&](std::vector<ray_t>& rays) { 
+            for (uint32_t i = 0; i < rays.size(); i++) 
+                hits[i] = bvh.traverse(rays[i], scene.triangles); 
+        };
+        auto packet8 = [&](std::vector<ray_t>& rays) { traverse_packets<8>(bvh, rays.data(), hits.data(), rays.size(), scene.triangles); };
+        auto packet16 = [&](std::vector<ray_t>& rays) { traverse_packets<16>(bvh, rays.data(), hits.data(), rays.size(), scene.triangles); };
+        auto stream = [&](std::vector<ray_t>& rays) { traverse_stream(bvh, rays.data(), hits.data(), rays.size(), scene.triangles); };
+
+        double single_mrays = time_batch(primary_rays, single);
+        std::cout << "    single:    " << single_mrays << " Mrays/s\n";
+
+        auto report = [&](const char *name, const std::vector<ray_t>& rays, auto&& trace) {
+            double mrays = time_batch(rays, trace);
+            uint32_t mismatches = count_mismatches(rays, trace);
+            std::cout << "    " << name << mrays << " Mrays/s (" << mrays / single_mrays << "x)"
+                      << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+        };
+        report("packet8:   ", rays8, packet8);
+        report("packet16:  ", rays16, packet16);
+        report("stream:    ", primary_rays, stream);
+    }
+}
@@ -0,0 +1,81 @@
+#include "benchmark.hpp"
+
+#include "scene_query.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <thread>
+
+// throughput of batched mixed queries through scene_query_t against issuing them one by one, and the results of a
+// few of them against a brute force loop over every triangle
+void query_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    const uint32_t query_count = 64 * 1024;
+
+    for (auto& scene : scenes) {
+        std::cout << "query: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+
+        bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), thread_count);
+        const glm::vec3 extent = bvh.nodes[0].aabb.max - bvh.nodes[0].aabb.min;
+        // probes about the size of a character in a level
+        const float size = 0.01f * glm::length(extent);
+
+        // the five query types interleaved, as a frame of gameplay code would issue them
+        std::vector<ray_t> rays = generate_random_rays(scene, query_count);
+        std::vector<query_t> queries(query_count);
+        for (uint32_t i = 0; i < query_count; i++) {
+            const glm::vec3 origin = rays[i].origin;
+            switch (i % 5) {
+            case 0: queries[i] = query_t::closest_hit(rays[i]); break;
+            case 1: queries[i] = query_t::any_hit(rays[i]); break;
+            case 2: queries[i] = query_t::aabb_overlap({ origin - size, origin + size }); break;
+            case 3: queries[i] = query_t::sphere_overlap(origin, size); break;
+            case 4: queries[i] = query_t::closest_point(origin); break;
+            }
+        }
+
+        std::vector<query_result_t> results(query_count);
+        std::vector<uint32_t> overlaps(16 * query_count);
+        std::vector<uint32_t> single_overlaps(overlaps.size());
+        for (uint32_t threads = 1; threads <= thread_count; threads = threads == thread_count ? threads + 1 : thread_count) {
+            core::thread_pool_t thread_pool{ threads };
+            scene_query_t service{ bvh.view(), scene.triangles, thread_pool };
+            uint32_t overlap_count = 0;
+            double single_time = time_ms(3, [&]() {
+                overlap_count = 0;
+                for (uint32_t i = 0; i < query_count; i++) {
+                    query_result_t result = service.execute(queries[i], std::span(single_overlaps).subspan(overlap_count));
+                    overlap_count += result.overlap_count;
+                }
+            });
+            double batch_time = time_ms(3, [&]() { overlap_count = service.execute(queries, results, overlaps); });
+            std::cout << "    " << threads << " thread(s): one by one " << query_count / (single_time * 1000.0) << " Mqueries/s, batched "
+                      << query_count / (batch_time * 1000.0) << " Mqueries/s (" << single_time / batch_time << "x), " << overlap_count << " overlap(s)"
+                      << (std::any_of(results.begin(), results.end(), [](const query_result_t& result) { return result.truncated; }) ? ", TRUNCATED" : "") << '\n';
+        }
+
+        // a single leaf over every triangle makes the same queries a brute force loop, only the pruning of the traversal can differ
+        bvh_t flat{};
+        flat.nodes.push_back({ .aabb = bvh.nodes[0].aabb, .primitive_count = static_cast<uint32_t>(scene.triangles.size()), .first_index = 0 });
+        flat.primitive_indices.resize(scene.triangles.size());
+        std::iota(flat.primitive_indices.begin(), flat.primitive_indices.end(), 0);
+        core::thread_pool_t serial_pool{ 1 };
+        const scene_query_t brute_force{ flat.view(), scene.triangles, serial_pool };
+        std::vector<uint32_t> expected_overlaps(scene.triangles.size());
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < std::min(query_count, 1000u); i++) {
+            query_result_t expected = brute_force.execute(queries[i], expected_overlaps);
+            const query_result_t& result = results[i];
+            if (queries[i].type == query_type_t::aabb_overlap || queries[i].type == query_type_t::sphere_overlap) {
+                std::vector<uint32_t> found(overlaps.begin() + result.first_overlap, overlaps.begin() + result.first_overlap + result.overlap_count);
+                std::vector<uint32_t> reference(expected_overlaps.begin(), expected_overlaps.begin() + expected.overlap_count);
+                std::sort(found.begin(), found.end());
+                if (found != reference)
+                    mismatches++;
+            } else if (static_cast<bool>(result.hit) != static_cast<bool>(expected.hit) || (queries[i].type != query_type_t::any_hit && result.distance != expected.distance)) {
+                mismatches++;
+            }
+        }
+        std::cout << "    brute force check: " << (mismatches ? std::to_string(mismatches) + " MISMATCH(ES)" : "ok") << '\n';
+    }
+}
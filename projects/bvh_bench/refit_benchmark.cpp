@@ -0,0 +1,107 @@
+#include "benchmark.hpp"
+
+#include "dynamic_bvh.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <cmath>
+#include <thread>
+
+// swirls every triangle around the vertical axis through the scene center, outer ones further, more with every frame
+static void deform(const scene_t& scene, scene_t& deformed, float time) {
+    aabb_t bounds = aabb_t::empty();
+    for (auto& aabb : scene.aabbs)
+        bounds.extend(aabb);
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const float extent = glm::length(bounds.diagonal());
+
+    for (uint32_t i = 0; i < scene.triangles.size(); i++) {
+        glm::vec3 offset = scene.centers[i] - center;
+        float angle = 4.0f * time * glm::length(offset) / extent;
+        glm::vec3 swirl{ offset.x * std::cos(angle) - offset.z * std::sin(angle), offset.y, offset.x * std::sin(angle) + offset.z * std::cos(angle) };
+        glm::vec3 translation = swirl - offset;
+
+        triangle_t& triangle = deformed.triangles[i];
+        triangle.p0 = scene.triangles[i].p0 + translation;
+        triangle.p1 = scene.triangles[i].p1 + translation;
+        triangle.p2 = scene.triangles[i].p2 + translation;
+        deformed.aabbs[i] = aabb_t::empty();
+        deformed.aabbs[i].extend(triangle.p0).extend(triangle.p1).extend(triangle.p2);
+        deformed.centers[i] = scene.centers[i] + translation;
+    }
+}
+
+// half the triangles collapsed onto the scene center, the leaves of those points have no area, the cost ratios of
+// dynamic_bvh_t have to stay finite and the swirled other half still has to get rebuilt
+static void degenerate_check(const scene_t& scene, core::thread_pool_t& thread_pool) {
+    aabb_t bounds = aabb_t::empty();
+    for (auto& aabb : scene.aabbs)
+        bounds.extend(aabb);
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+
+    scene_t degenerate = scene;
+    for (uint32_t i = 0; i < degenerate.triangles.size() / 2; i++) {
+        degenerate.triangles[i] = { center, center, center };
+        degenerate.aabbs[i] = { center, center };
+        degenerate.centers[i] = center;
+    }
+    scene_t deformed = degenerate;
+    dynamic_bvh_t dynamic_bvh{ degenerate.aabbs.data(), degenerate.centers.data(), static_cast<uint32_t>(degenerate.triangles.size()), thread_pool, { .subtree_primitives = 64 } };
+    uint32_t non_finite = 0, rebuilding_updates = 0;
+    for (uint32_t frame = 1; frame <= 8; frame++) {
+        deform(degenerate, deformed, frame * 0.25f);
+        dynamic_bvh_t::update_stats_t stats = dynamic_bvh.update(deformed.aabbs.data(), deformed.centers.data());
+        if (!std::isfinite(stats.cost_growth))
+            non_finite++;
+        if (stats.rebuilt_subtrees != 0)
+            rebuilding_updates++;
+    }
+    std::cout << "    degenerate: half collapsed to a point, " << rebuilding_updates << " of 8 update(s) rebuilt"
+              << (non_finite ? ", " + std::to_string(non_finite) + " NON FINITE COST GROWTH(S)" : "") << '\n';
+}
+
+// refit and dynamic_bvh_t updates over an animation against rebuilding every frame
+void refit_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (auto& scene : scenes) {
+        std::cout << "refit: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+
+        scene_t deformed = scene;
+        bvh_t refitted = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), thread_count);
+        core::thread_pool_t thread_pool{ thread_count };
+        dynamic_bvh_t dynamic_bvh{ scene.aabbs.data(), scene.centers.data(), static_cast<uint32_t>(scene.triangles.size()), thread_pool };
+        const float reference_cost = refitted.sah_cost();
+        // sah_cost is relative to the root, the deformation changes the root so refit and rebuild are only comparable to each other
+
+        for (uint32_t frame = 1; frame <= 8; frame++) {
+            deform(scene, deformed, frame * 0.25f);
+
+            double refit_time = time_ms(1, [&]() { refitted.refit(deformed.aabbs.data(), thread_pool); });
+            dynamic_bvh_t::update_stats_t stats{};
+            double update_time = time_ms(1, [&]() { stats = dynamic_bvh.update(deformed.aabbs.data(), deformed.centers.data()); });
+            bvh_t rebuilt;
+            double rebuild_time = time_ms(1, [&]() { rebuilt = bvh_t::build(deformed.aabbs.data(), deformed.centers.data(), deformed.triangles.size(), thread_count); });
+
+            // refitting never changes what is hit, only how fast, compare distances as coplanar triangles may tie
+            uint32_t mismatches = 0;
+            for (auto ray : generate_random_rays(deformed, 16384, frame)) {
+                ray_t reference_ray = ray;
+                hit_t hit = rebuilt.closest_hit(reference_ray, deformed.triangles);
+                for (const bvh_t *bvh : { &refitted, &dynamic_bvh.bvh }) {
+                    ray_t other_ray = ray;
+                    hit_t other_hit = bvh->closest_hit(other_ray, deformed.triangles);
+                    if (static_cast<bool>(hit) != static_cast<bool>(other_hit) || (hit && std::abs(reference_ray.tmax - other_ray.tmax) > 1e-4f * std::max(1.0f, reference_ray.tmax)))
+                        mismatches++;
+                }
+            }
+
+            std::cout << "    frame " << frame << ": refit " << refit_time << " ms, cost " << refitted.sah_cost() / reference_cost
+                      << " | update " << update_time << " ms, cost growth " << stats.cost_growth << ", " << stats.rebuilt_subtrees << " subtree(s) / "
+                      << stats.rebuilt_primitives << " primitive(s) rebuilt" << (stats.rebuilt_tree ? " (full)" : "")
+                      << " | rebuild " << rebuild_time << " ms, cost " << rebuilt.sah_cost() / reference_cost
+                      << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+        }
+        degenerate_check(scene, thread_pool);
+    }
+}
@@ -0,0 +1,68 @@
+#include "benchmark.hpp"
+
+#include "cpu_renderer.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <thread>
+
+// cpu_renderer_t sample time for 1..N threads with the per thread utilization of the work stealing tile split
+// checks that every thread count accumulates the same image as a single thread
+void render_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t max_thread_count = std::max(1u, std::thread::hardware_concurrency());
+    const uint32_t width = 512, height = 512, sample_count = 4;
+
+    for (auto& scene : scenes) {
+        std::cout << "render: " << scene.name << " (" << scene.triangles.size() << " triangle(s)), " << width << "x" << height << ", "
+                  << sample_count << " sample(s)\n";
+
+        bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), max_thread_count);
+
+        // same placement as generate_primary_rays
+        aabb_t bounds = aabb_t::empty();
+        for (auto& aabb : scene.aabbs)
+            bounds.extend(aabb);
+        int axis = bounds.largest_axis();
+        glm::vec3 eye = (bounds.min + bounds.max) * 0.5f;
+        glm::vec3 dir{ 0, 0, 0 };
+        dir[axis] = -1;
+        glm::vec3 up = axis == 1 ? glm::vec3{ 0, 0, 1 } : glm::vec3{ 0, 1, 0 };
+        glm::mat4 inverse_view = glm::inverse(glm::lookAt(eye, eye + dir, up));
+        glm::mat4 inverse_projection = glm::inverse(glm::perspective(glm::radians(90.0f), static_cast<float>(width) / height, 0.01f, 1000.0f));
+
+        std::vector<glm::vec3> reference;
+        double serial_time = 0;
+        for (uint32_t thread_count = 1; thread_count <= max_thread_count; thread_count++) {
+            core::thread_pool_t thread_pool{ thread_count };
+            cpu_renderer_t renderer{ bvh.view(), scene.triangles, thread_pool };
+            renderer.resize(width, height);
+
+            double time = 0, utilization = 0;
+            std::vector<cpu_renderer_t::thread_stats_t> threads(thread_count, cpu_renderer_t::thread_stats_t{});
+            for (uint32_t sample = 0; sample < sample_count; sample++) {
+                cpu_renderer_t::render_stats_t stats = renderer.render(inverse_view, inverse_projection);
+                time += stats.render_ms;
+                utilization += stats.utilization() / sample_count;
+                for (uint32_t i = 0; i < thread_count; i++) {
+                    threads[i].busy_ms += stats.threads[i].busy_ms;
+                    threads[i].tiles += stats.threads[i].tiles;
+                    threads[i].stolen += stats.threads[i].stolen;
+                }
+            }
+            if (thread_count == 1) {
+                reference = renderer.accumulation();
+                serial_time = time;
+            }
+
+            std::cout << "    " << thread_count << " thread(s): " << time / sample_count << " ms/sample, speedup " << serial_time / time
+                      << "x, utilization " << utilization * 100.0 << "%" << (renderer.accumulation() == reference ? "" : ", IMAGE DIFFERS FROM SINGLE THREAD") << '\n';
+            if (thread_count == max_thread_count && thread_count > 1) {
+                for (uint32_t i = 0; i < thread_count; i++)
+                    std::cout << "        thread " << i << ": " << threads[i].busy_ms / time * 100.0 << "% busy, " << threads[i].tiles << " tile(s), "
+                              << threads[i].stolen << " steal(s)\n";
+            }
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#include "benchmark.hpp"
+
+// binned object split build against the spatial split build, same closest_hit traversal on both
+void sbvh_benchmark(const std::vector<scene_t>& scenes) {
+    for (auto& scene : scenes) {
+        std::cout << "sbvh: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+
+        bvh_t bvh{}, sbvh{};
+        double binned_build = time_ms(3, [&]() { bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size()); });
+        double spatial_build = time_ms(3, [&]() { sbvh = bvh_t::build_spatial(scene.triangles.data(), scene.triangles.size()); });
+        double duplication = 100.0 * (static_cast<double>(sbvh.primitive_indices.size()) / scene.triangles.size() - 1.0);
+        std::cout << "    build: binned " << binned_build << " ms, " << bvh.nodes.size() << " node(s), depth " << bvh.depth()
+                  << " | spatial " << spatial_build << " ms, " << sbvh.nodes.size() << " node(s), depth " << sbvh.depth()
+                  << ", " << duplication << "% duplicated reference(s)\n";
+
+        const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+            { "primary", generate_primary_rays(scene, 512, 512) },
+            { "random", generate_random_rays(scene, 512 * 512) },
+        };
+        for (auto& [ray_set_name, rays] : ray_sets) {
+            // compare distances, ties between coplanar triangles may resolve to a different primitive
+            uint32_t mismatches = 0;
+            for (auto ray : rays) {
+                ray_t spatial_ray = ray;
+                hit_t hit = bvh.closest_hit(ray, scene.triangles);
+                hit_t spatial_hit = sbvh.closest_hit(spatial_ray, scene.triangles);
+                if (static_cast<bool>(hit) != static_cast<bool>(spatial_hit) || (hit && std::abs(ray.tmax - spatial_ray.tmax) > 1e-4f * std::max(1.0f, ray.tmax)))
+                    mismatches++;
+            }
+            double binned = mrays_per_second(rays, [&](ray_t& ray) { return bvh.closest_hit(ray, scene.triangles); });
+            double spatial = mrays_per_second(rays, [&](ray_t& ray) { return sbvh.closest_hit(ray, scene.triangles); });
+            std::cout << "    " << ray_set_name << ": binned " << binned << " Mrays/s, spatial " << spatial << " Mrays/s (" << spatial / binned << "x)"
+                      << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#include "benchmark.hpp"
+
+#include "ray_packet.hpp"
+#include "ray_sort.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <random>
+#include <thread>
+
+// Mrays/s of one bounce diffuse and ambient occlusion rays traced as generated (pixel order), presorted, and end to end
+// through ray_sorter_t::trace with the sort, gather and scatter, for single ray and 8 ray packet traversal
+// on one thread and on every hardware thread, where the radix sort and the traces are split across the pool
+void sort_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t width = 1024, height = 1024;
+    const uint32_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (auto& scene : scenes) {
+        bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size());
+        aabb_t bounds = bvh.nodes[0].aabb;
+        const float epsilon = 1e-5f * glm::length(bounds.diagonal());
+
+        // secondary rays start where the primary rays hit, every pixel gets one cosine weighted direction
+        std::vector<ray_t> diffuse_rays, ao_rays;
+        std::mt19937 rng{ 0 };
+        std::uniform_real_distribution<float> distribution{ 0, 1 };
+        for (ray_t ray : generate_primary_rays(scene, width, height)) {
+            hit_t hit = bvh.closest_hit(ray, scene.triangles);
+            if (!hit)
+                continue;
+            const triangle_t& triangle = scene.triangles[hit.primitive_index];
+            glm::vec3 normal = glm::normalize(glm::cross(triangle.p1 - triangle.p0, triangle.p2 - triangle.p0));
+            if (glm::dot(normal, ray.direction) > 0)
+                normal = -normal;
+
+            float phi = 2.0f * 3.14159265f * distribution(rng);
+            float r2 = distribution(rng);
+            glm::vec3 tangent = glm::normalize(glm::cross(std::abs(normal.x) > 0.5f ? glm::vec3{ 0, 1, 0 } : glm::vec3{ 1, 0, 0 }, normal));
+            glm::vec3 bitangent = glm::cross(normal, tangent);
+            ray_t secondary{};
+            secondary.origin = ray.origin + ray.direction * ray.tmax + normal * epsilon;
+            secondary.direction = std::sqrt(r2) * (std::cos(phi) * tangent + std::sin(phi) * bitangent) + std::sqrt(1.0f - r2) * normal;
+            secondary.tmin = 0;
+            secondary.tmax = std::numeric_limits<float>::max();
+            diffuse_rays.push_back(secondary);
+            // occlusion only looks a short way around the hit
+            secondary.tmax = 0.05f * glm::length(bounds.diagonal());
+            ao_rays.push_back(secondary);
+        }
+
+        std::cout << "sort: " << scene.name << " (" << scene.triangles.size() << " triangle(s)), " << diffuse_rays.size() << " secondary ray(s)\n";
+
+        std::vector<uint32_t> thread_counts{ 1 };
+        if (hardware_threads > 1)
+            thread_counts.push_back(hardware_threads);
+        for (uint32_t thread_count : thread_counts) {
+            core::thread_pool_t thread_pool{ thread_count };
+            ray_sorter_t sorter{ thread_pool };
+            std::vector<hit_t> hits(diffuse_rays.size()), reference(diffuse_rays.size());
+            // chunks of whole packets over the pool, a pool of one runs them inline
+            auto parallel = [&](auto trace) {
+                return [&thread_pool, trace](ray_t *rays, hit_t *hits, uint32_t count) {
+                    thread_pool.parallel_for(0, count, 4096, [&](uint32_t begin, uint32_t end) { trace(rays + begin, hits + begin, end - begin); });
+                };
+            };
+            auto single = parallel([&](ray_t *rays, hit_t *hits, uint32_t count) {
+                for (uint32_t i = 0; i < count; i++)
+                    hits[i] = bvh.closest_hit(rays[i], scene.triangles);
+            });
+            auto packet8 = parallel([&](ray_t *rays, hit_t *hits, uint32_t count) { traverse_packets<8>(bvh, rays, hits, count, scene.triangles); });
+            auto occlusion = parallel([&](ray_t *rays, hit_t *hits, uint32_t count) {
+                for (uint32_t i = 0; i < count; i++)
+                    hits[i] = bvh.any_hit(rays[i], scene.triangles);
+            });
+
+            auto report = [&](const char *name, const std::vector<ray_t>& rays, auto&& trace) {
+                std::vector<ray_t> reference_rays = rays;
+                double unsorted_time = time_ms(3, [&]() {
+                    reference_rays = rays;
+                    trace(reference_rays.data(), reference.data(), reference_rays.size());
+                });
+
+                double sort_time = time_ms(3, [&]() { sorter.sort(rays, bounds); });
+                std::vector<ray_t> sorted_rays(rays.size());
+                for (uint32_t i = 0; i < rays.size(); i++)
+                    sorted_rays[i] = rays[sorter.order()[i]];
+                double sorted_time = time_ms(3, [&]() {
+                    std::vector<ray_t> batch = sorted_rays;
+                    trace(batch.data(), hits.data(), batch.size());
+                });
+                // what a caller pays, sort, gather, trace and scatter of the hits back into the order of the batch
+                std::vector<ray_t> batch;
+                double pipeline_time = time_ms(3, [&]() {
+                    batch = rays;
+                    sorter.trace(batch, hits.data(), bounds, trace);
+                });
+
+                // the round trip through the sorter has to give every ray its unsorted hit and tmax
+                uint32_t mismatches = 0;
+                for (uint32_t i = 0; i < rays.size(); i++)
+                    if (hits[i].primitive_index != reference[i].primitive_index || batch[i].tmax != reference_rays[i].tmax)
+                        mismatches++;
+
+                double unsorted_mrays = rays.size() / (unsorted_time * 1000.0);
+                double sorted_mrays = rays.size() / (sorted_time * 1000.0);
+                double pipeline_mrays = rays.size() / (pipeline_time * 1000.0);
+                std::cout << "    " << name << unsorted_mrays << " Mrays/s unsorted, " << sorted_mrays << " Mrays/s presorted trace only (" << sorted_mrays / unsorted_mrays
+                          << "x), " << pipeline_mrays << " Mrays/s through ray_sorter_t::trace (" << pipeline_mrays / unsorted_mrays << "x, of which " << sort_time
+                          << " ms sort)" << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+            };
+            std::cout << "    " << thread_count << " thread(s)\n";
+            report("diffuse single:  ", diffuse_rays, single);
+            report("diffuse packet8: ", diffuse_rays, packet8);
+            report("ao single:       ", ao_rays, occlusion);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#include "benchmark.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <thread>
+
+// sah cost and traversal speed of the binned SAH and morton builds before and after bvh_t::optimize
+void treelet_benchmark(const std::vector<scene_t>& scenes) {
+    const uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    core::thread_pool_t thread_pool{ thread_count };
+
+    for (auto& scene : scenes) {
+        std::cout << "treelet: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+
+        const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+            { "primary", generate_primary_rays(scene, 512, 512) },
+            { "random", generate_random_rays(scene, 512 * 512) },
+        };
+
+        const std::pair<const char *, bvh_t> builds[] = {
+            { "binned sah", bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), thread_count) },
+            { "lbvh", bvh_t::build_linear(scene.aabbs.data(), scene.centers.data(), scene.triangles.size(), thread_count) },
+        };
+
+        for (auto& [name, bvh] : builds) {
+            bvh_t optimized = bvh;
+            uint32_t passes = 0;
+            double optimize_time = time_ms(1, [&]() { passes = optimized.optimize(thread_pool); });
+            std::cout << "    " << name << ": " << optimize_time << " ms at " << thread_count << " thread(s), " << passes << " pass(es), sah cost "
+                      << bvh.sah_cost() << " -> " << optimized.sah_cost() << ", depth " << bvh.depth() << " -> " << optimized.depth() << '\n';
+
+            for (auto& [ray_set_name, rays] : ray_sets) {
+                // the same primitives in different leaves, every ray has to find the same distance
+                uint32_t mismatches = 0;
+                for (auto ray : rays) {
+                    ray_t reference_ray = ray;
+                    hit_t hit = optimized.closest_hit(ray, scene.triangles);
+                    hit_t reference_hit = bvh.closest_hit(reference_ray, scene.triangles);
+                    if (static_cast<bool>(hit) != static_cast<bool>(reference_hit) || (hit && ray.tmax != reference_ray.tmax))
+                        mismatches++;
+                }
+                double before = mrays_per_second(rays, [&](ray_t& ray) { return bvh.closest_hit(ray, scene.triangles); });
+                double after = mrays_per_second(rays, [&](ray_t& ray) { return optimized.closest_hit(ray, scene.triangles); });
+                std::cout << "        " << ray_set_name << ": " << before << " -> " << after << " Mrays/s (" << after / before << "x)"
+                          << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+            }
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#include "benchmark.hpp"
+
+#include "wide_bvh.hpp"
+
+// rays per second of the binary bvh_t against the collapsed 4 and 8 wide bvhs
+void wide_benchmark(const std::vector<scene_t>& scenes) {
+    for (auto& scene : scenes) {
+        bvh_t bvh = bvh_t::build(scene.aabbs.data(), scene.centers.data(), scene.triangles.size());
+        bvh4_t bvh4 = bvh4_t::collapse(bvh);
+        bvh8_t bvh8 = bvh8_t::collapse(bvh);
+
+        std::cout << "wide: " << scene.name << " (" << scene.triangles.size() << " triangle(s))\n";
+        std::cout << "    binary: " << bvh.nodes.size() << " node(s), depth " << bvh.depth() << '\n';
+        std::cout << "    bvh4:   " << bvh4.nodes.size() << " node(s), depth " << bvh4.depth() << '\n';
+        std::cout << "    bvh8:   " << bvh8.nodes.size() << " node(s), depth " << bvh8.depth() << '\n';
+
+        const std::pair<const char *, std::vector<ray_t>> ray_sets[] = {
+            { "primary", generate_primary_rays(scene, 512, 512) },
+            { "random", generate_random_rays(scene, 512 * 512) },
+        };
+        for (auto& [ray_set_name, rays] : ray_sets) {
+            uint32_t mismatches = 0;
+            for (auto ray : rays) {
+                ray_t ray4 = ray, ray8 = ray;
+                hit_t hit = bvh.traverse(ray, scene.triangles);
+                if (bvh4.traverse(ray4, scene.triangles).primitive_index != hit.primitive_index && ray4.tmax != ray.tmax) mismatches++;
+                if (bvh8.traverse(ray8, scene.triangles).primitive_index != hit.primitive_index && ray8.tmax != ray.tmax) mismatches++;
+            }
+
+            double binary = mrays_per_second(rays, [&](ray_t& ray) { return bvh.traverse(ray, scene.triangles); });
+            double wide4 = mrays_per_second(rays, [&](ray_t& ray) { return bvh4.traverse(ray, scene.triangles); });
+            double wide8 = mrays_per_second(rays, [&](ray_t& ray) { return bvh8.traverse(ray, scene.triangles); });
+            std::cout << "    " << ray_set_name << ": binary " << binary << " Mrays/s, bvh4 " << wide4 << " Mrays/s (" << wide4 / binary << "x), bvh8 " 
+                      << wide8 << " Mrays/s (" << wide8 / binary << "x)"
+                      << (mismatches ? ", " + std::to_string(mismatches) + " HIT MISMATCH(ES)" : "") << '\n';
+        }
+    }
+}
@@ -1,13 +1,8 @@
-#include "bvh.hpp"
+#include "bvh_builder.hpp"
 
+#include <bit>
 
-float robust_min(float a, float b) { return a < b ? a : b; }
-float robust_max(float a, float b) { return a > b ? a : b; }
-float safe_inverse(float x) {
-    return std::fabs(x) <= std::numeric_limits<float>::epsilon()
-        ? std::copysign(1.0f / std::numeric_limits<float>::epsilon(), x)
-        : 1.0f / x;
-}
+#include "core/thread_pool.hpp"
 
 
 int aabb_t::largest_axis() const {
@@ -85,123 +80,115 @@ bool node_t::intersect(const ray_t& ray) const {
 }
 
 
-bvh_t bvh_t::build(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count) {
-    bvh_t bvh{};
-
-    bvh.primitive_indices.resize(primitive_count);
-    std::iota(bvh.primitive_indices.begin(), bvh.primitive_indices.end(), 0);
-
-    bvh.nodes.resize(2 * primitive_count - 1);
-    bvh.nodes[0].primitive_count = primitive_count;
-    bvh.nodes[0].first_index = 0;
-
-    uint32_t node_count = 1;
-    build_recursive(bvh, 0, node_count, aabbs, centers);
-    bvh.nodes.resize(node_count);
-    return bvh;
-}
-
 uint32_t bvh_t::depth(uint32_t node_index) const {
     auto& node = nodes[node_index];
     return node.is_leaf() ? 1 : 1 + glm::max(depth(node.first_index), depth(node.first_index + 1));
 }
 
-
-bvh_t::bin_t& bvh_t::bin_t::extend(const bin_t& other) {
-    aabb.extend(other.aabb);
-    primitive_count += other.primitive_count;
-    return *this;
+float bvh_t::sah_cost(uint32_t node_index, float traversal_cost) const {
+    double cost = 0;
+    std::stack<uint32_t> stack;
+    stack.push(node_index);
+    while (!stack.empty()) {
+        const node_t& node = nodes[stack.top()];
+        stack.pop();
+        if (node.is_leaf()) {
+            cost += static_cast<double>(node.aabb.half_area()) * node.primitive_count;
+        } else {
+            cost += static_cast<double>(node.aabb.half_area()) * traversal_cost;
+            stack.push(node.first_index);
+            stack.push(node.first_index + 1);
+        }
+    }
+    return cost / nodes[node_index].aabb.half_area();
 }
 
-uint32_t bvh_t::bin_t::bin_index(int axis, const aabb_t& aabb, const glm::vec3& center) {
-    int index = (center[axis] - aabb.min[axis]) * (build_config.bin_count / (aabb.max[axis] - aabb.min[axis]));
-    return std::min(build_config.bin_count - 1, static_cast<uint32_t>(std::max(0, index)));
+void bvh_t::refit(const aabb_t *aabbs) {
+    // a pool of one spawns no workers, parallel_for runs inline
+    core::thread_pool_t thread_pool{ 1 };
+    refit(aabbs, thread_pool);
 }
 
-bvh_t::split_t bvh_t::split_t::find_best_split(int axis, const bvh_t& bvh, const node_t& node, const aabb_t *aabbs, const glm::vec3 *centers) {
-    // todo: change this to alloca
-    // bin_t bins[build_config.bin_count] = {};
-    bin_t *bins = reinterpret_cast<bin_t *>(alloca(build_config.bin_count * sizeof(bin_t)));
-    for (uint32_t i = 0; i < build_config.bin_count; i++) {
-        bins[i] = {};
-    }
-
-    for (uint32_t i = 0; i < node.primitive_count; i++) {
-        uint32_t primitive_index = bvh.primitive_indices[node.first_index + i];
-        bin_t& bin = bins[bin_t::bin_index(axis, node.aabb, centers[primitive_index])];
-        bin.aabb.extend(aabbs[primitive_index]);
-        bin.primitive_count++;
+void bvh_t::refit(const aabb_t *aabbs, core::thread_pool_t& thread_pool) {
+    // nearly all of the work is in the leaves, internal nodes are a single union each
+    thread_pool.parallel_for(0, nodes.size(), build_config.parallel_grain_size, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            node_t& node = nodes[i];
+            if (!node.is_leaf())
+                continue;
+            node.aabb = aabb_t::empty();
+            for (uint32_t j = 0; j < node.primitive_count; j++)
+                node.aabb.extend(aabbs[primitive_indices[node.first_index + j]]);
+        }
+    });
+    for (uint32_t i = nodes.size(); i-- > 0;) {
+        node_t& node = nodes[i];
+        if (node.is_leaf())
+            continue;
+        node.aabb = nodes[node.first_index].aabb;
+        node.aabb.extend(nodes[node.first_index + 1].aabb);
     }
+}
 
-    // todo: change this to alloca
-    // float right_cost[build_config.bin_count] = {};
-    float *right_cost = reinterpret_cast<float *>(alloca(build_config.bin_count * sizeof(float)));
-    for (uint32_t i = 0; i < build_config.bin_count; i++) {
-        right_cost[i] = {};
+void bvh_t::rebuild(const std::vector<uint32_t>& node_indices, const aabb_t *aabbs, const glm::vec3 *centers, core::thread_pool_t& thread_pool, const build_config_t& config) {
+    const build_config_t checked = checked_config(config, "bvh_t::rebuild");
+    // every builder gives each subtree a contiguous range of primitive_indices, find them from the leaves
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    uint32_t node_count = nodes.size();
+    for (uint32_t node_index : node_indices) {
+        uint32_t first = std::numeric_limits<uint32_t>::max(), last = 0;
+        std::stack<uint32_t> stack;
+        stack.push(node_index);
+        while (!stack.empty()) {
+            const node_t& node = nodes[stack.top()];
+            stack.pop();
+            if (node.is_leaf()) {
+                first = std::min(first, node.first_index);
+                last = std::max(last, node.first_index + node.primitive_count);
+            } else {
+                stack.push(node.first_index);
+                stack.push(node.first_index + 1);
+            }
+        }
+        ranges.push_back({ first, last - first });
+        node_count += 2 * (last - first) - 2;
     }
 
-    bin_t left_accumulation, right_accumulation;
-    
-    for (uint32_t i = build_config.bin_count - 1; i > 0; i--) {
-        right_accumulation.extend(bins[i]);
-        right_cost[i] = right_accumulation.cost();
+    // the new subtrees go behind the existing nodes in worst case ranges, the old ones become unreachable
+    uint32_t subtree_node_count = nodes.size();
+    nodes.resize(node_count);
+    core::task_group_t task_group{};
+    for (uint32_t i = 0; i < node_indices.size(); i++) {
+        node_t& node = nodes[node_indices[i]];
+        node.first_index = ranges[i].first;
+        node.primitive_count = ranges[i].second;
+        thread_pool.run(task_group, [this, node_index = node_indices[i], subtree_node_count, aabbs, centers, &checked]() mutable {
+            build_recursive(*this, node_index, subtree_node_count, aabbs, centers, checked);
+        });
+        subtree_node_count += 2 * ranges[i].second - 2;
     }
+    thread_pool.wait(task_group);
+    reorder_depth_first(*this);
+}
 
-    split_t split{};
-    split.axis = axis;
-    
-    for (uint32_t i = 0; i < build_config.bin_count - 1; i++) {
-        left_accumulation.extend(bins[i]);
-        float cost = left_accumulation.cost() + right_cost[i + 1];
-
-        if (cost < split.cost) {
-            split.cost = cost;
-            split.right_bin = i + 1;
-        }
-    }
-    return split;
+build_config_t bvh_t::checked_config(const build_config_t& config, const char *builder) {
+    build_config_t checked = config;
+    checked.bin_count = std::clamp(config.bin_count, 2u, build_config_t::max_bin_count);
+    if (checked.bin_count != config.bin_count)
+        std::cerr << builder << ": bin_count " << config.bin_count << " clamped to " << checked.bin_count << '\n';
+    return checked;
 }
 
+bvh_t::bin_t& bvh_t::bin_t::extend(const bin_t& other) {
+    aabb.extend(other.aabb);
+    primitive_count += other.primitive_count;
+    return *this;
+}
 
-void bvh_t::build_recursive(bvh_t& bvh, uint32_t node_index, uint32_t& node_count, const aabb_t *aabbs, const glm::vec3 *centers) {
+void bvh_t::make_children(bvh_t& bvh, uint32_t node_index, uint32_t first_child, uint32_t first_right) {
     node_t& node = bvh.nodes[node_index];
-    assert(node.is_leaf());
-
-    node.aabb = aabb_t::empty();
-    for (uint32_t i = 0; i < node.primitive_count; i++) 
-        node.aabb.extend(aabbs[bvh.primitive_indices[node.first_index + i]]);
-    
-    if (node.primitive_count <= build_config.min_primitives) 
-        return;
-    
-    split_t min_split;
-    for (int axis = 0; axis < 3; axis++) 
-        min_split = std::min(min_split, split_t::find_best_split(axis, bvh, node, aabbs, centers));
-    
-    float leaf_cost = node.aabb.half_area() * (node.primitive_count - build_config.traversal_cost);
-    uint32_t first_right;
-    if (!min_split || min_split.cost >= leaf_cost) {
-        if (node.primitive_count > build_config.max_primitives) {
-            int axis = node.aabb.largest_axis();
-            std::sort(
-                bvh.primitive_indices.begin() + node.first_index,
-                bvh.primitive_indices.begin() + node.first_index + node.primitive_count,
-                [&](uint32_t i, uint32_t j) {  return centers[i][axis] < centers[j][axis]; });
-            first_right = node.first_index + node.primitive_count / 2;
-        } else 
-            return;
-    } else {
-        first_right = std::partition(
-                bvh.primitive_indices.begin() + node.first_index,
-                bvh.primitive_indices.begin() + node.first_index + node.primitive_count,
-                [&](uint32_t i) { return bin_t::bin_index(min_split.axis, node.aabb, centers[i]) < min_split.right_bin;}) 
-                - bvh.primitive_indices.begin();
-    }
-
-    uint32_t first_child = node_count;
     node_t& left = bvh.nodes[first_child];
     node_t& right = bvh.nodes[first_child + 1];
-    node_count += 2;
 
     left.primitive_count = first_right - node.first_index;
     right.primitive_count = node.primitive_count - left.primitive_count;
@@ -211,9 +198,182 @@ void bvh_t::build_recursive(bvh_t& bvh, uint32_t node_index, uint32_t& node_coun
 
     node.first_index = first_child;
     node.primitive_count = 0;
+}
 
-    build_recursive(bvh, first_child, node_count, aabbs, centers);
-    build_recursive(bvh, first_child + 1, node_count, aabbs, centers);
+// appends the subtree below old_index depth first, nodes[new_index] has to hold the copy of its root already
+static void append_depth_first(const std::vector<node_t>& old_nodes, std::vector<node_t>& nodes, uint32_t old_index, uint32_t new_index) {
+    // (old index, new index) of nodes whose children still have to be copied
+    std::stack<std::pair<uint32_t, uint32_t>> stack;
+    stack.push({ old_index, new_index });
+    while (!stack.empty()) {
+        auto [old_index, new_index] = stack.top();
+        stack.pop();
+        const node_t& node = old_nodes[old_index];
+        if (node.is_leaf()) 
+            continue;
+
+        uint32_t first_child = nodes.size();
+        nodes[new_index].first_index = first_child;
+        nodes.push_back(old_nodes[node.first_index]);
+        nodes.push_back(old_nodes[node.first_index + 1]);
+        // the serial builder finishes the whole left subtree before allocating inside the right one
+        stack.push({ node.first_index + 1, first_child + 1 });
+        stack.push({ node.first_index, first_child });
+    }
+}
+
+// appends the child pairs of the height levels below old_index, the nodes height levels down go to frontier for the caller
+static void append_van_emde_boas(const std::vector<node_t>& old_nodes, std::vector<node_t>& nodes, uint32_t old_index, uint32_t new_index, uint32_t height,
+                                 std::vector<std::pair<uint32_t, uint32_t>>& frontier) {
+    if (height == 1) {
+        const node_t& node = old_nodes[old_index];
+        if (node.is_leaf())
+            return;
+        uint32_t first_child = nodes.size();
+        nodes[new_index].first_index = first_child;
+        nodes.push_back(old_nodes[node.first_index]);
+        nodes.push_back(old_nodes[node.first_index + 1]);
+        frontier.push_back({ node.first_index, first_child });
+        frontier.push_back({ node.first_index + 1, first_child + 1 });
+        return;
+    }
+
+    // the top levels as one block, then each subtree hanging off it as its own block
+    const uint32_t top_height = height / 2;
+    std::vector<std::pair<uint32_t, uint32_t>> middle;
+    append_van_emde_boas(old_nodes, nodes, old_index, new_index, top_height, middle);
+    for (auto [old_index, new_index] : middle)
+        append_van_emde_boas(old_nodes, nodes, old_index, new_index, height - top_height, frontier);
+}
+
+void bvh_t::reorder_depth_first(bvh_t& bvh) {
+    std::vector<node_t> nodes;
+    nodes.reserve(bvh.nodes.size());
+    nodes.push_back(bvh.nodes[0]);
+    append_depth_first(bvh.nodes, nodes, 0, 0);
+    bvh.nodes = std::move(nodes);
+}
+
+// appends a tree over leaves split at the middle leaf, nodes[node_index] becomes its root
+static void append_balanced(std::vector<node_t>& nodes, const node_t *leaves, uint32_t leaf_count, uint32_t node_index) {
+    if (leaf_count == 1) {
+        nodes[node_index] = leaves[0];
+        return;
+    }
+    uint32_t first_child = nodes.size();
+    nodes.emplace_back();
+    nodes.emplace_back();
+    append_balanced(nodes, leaves, leaf_count / 2, first_child);
+    append_balanced(nodes, leaves + leaf_count / 2, leaf_count - leaf_count / 2, first_child + 1);
+    nodes[node_index].aabb = aabb_t::empty();
+    nodes[node_index].aabb.extend(nodes[first_child].aabb).extend(nodes[first_child + 1].aabb);
+    nodes[node_index].primitive_count = 0;
+    nodes[node_index].first_index = first_child;
+}
+
+void bvh_t::limit_depth(uint32_t max_depth) {
+    // children come after their parent, so one backwards pass gives every subtree its height and leaf count
+    std::vector<uint32_t> heights(nodes.size()), leaf_counts(nodes.size());
+    for (uint32_t i = nodes.size(); i-- > 0;) {
+        const node_t& node = nodes[i];
+        if (node.is_leaf()) {
+            heights[i] = 1;
+            leaf_counts[i] = 1;
+        } else {
+            heights[i] = 1 + std::max(heights[node.first_index], heights[node.first_index + 1]);
+            leaf_counts[i] = leaf_counts[node.first_index] + leaf_counts[node.first_index + 1];
+        }
+    }
+    if (nodes.empty() || heights[0] <= max_depth)
+        return;
+
+    // a subtree at depth is fine as is or fixable by a balanced tree over its leaves, which is ceil(log2(leaves)) + 1 high
+    auto fits = [&](uint32_t node_index, uint32_t depth) {
+        return depth + heights[node_index] - 1 <= max_depth || depth + std::bit_width(leaf_counts[node_index] - 1) <= max_depth;
+    };
+
+    // (node index, depth), keep descending while both children can still be fixed on their own so the rebuilt subtrees stay small
+    std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0, 1 } };
+    std::vector<node_t> leaves;
+    while (!stack.empty()) {
+        auto [node_index, depth] = stack.back();
+        stack.pop_back();
+        if (depth + heights[node_index] - 1 <= max_depth)
+            continue;
+
+        const node_t node = nodes[node_index];
+        if (fits(node.first_index, depth + 1) && fits(node.first_index + 1, depth + 1)) {
+            stack.push_back({ node.first_index + 1, depth + 1 });
+            stack.push_back({ node.first_index, depth + 1 });
+            continue;
+        }
+
+        // the leaves in depth first order, so every balanced subtree still covers a contiguous range of primitive_indices
+        leaves.clear();
+        std::vector<uint32_t> subtree{ node_index };
+        while (!subtree.empty()) {
+            const node_t& subtree_node = nodes[subtree.back()];
+            subtree.pop_back();
+            if (subtree_node.is_leaf()) {
+                leaves.push_back(subtree_node);
+            } else {
+                subtree.push_back(subtree_node.first_index + 1);
+                subtree.push_back(subtree_node.first_index);
+            }
+        }
+        // the old internal nodes stay behind unreachable, the reorder below drops them
+        append_balanced(nodes, leaves.data(), leaves.size(), node_index);
+    }
+    reorder_depth_first(*this);
+}
+
+void bvh_t::relayout(node_layout_t layout, uint32_t breadth_first_levels) {
+    if (nodes.empty())
+        return;
+
+    std::vector<node_t> relaid_nodes;
+    relaid_nodes.reserve(nodes.size());
+    relaid_nodes.push_back(nodes[0]);
+    switch (layout) {
+    case node_layout_t::depth_first:
+        append_depth_first(nodes, relaid_nodes, 0, 0);
+        break;
+    case node_layout_t::breadth_first: {
+        // (old index, new index) of the nodes on the current level
+        std::vector<std::pair<uint32_t, uint32_t>> level{ { 0, 0 } }, next_level;
+        for (uint32_t depth = 0; depth < breadth_first_levels && !level.empty(); depth++) {
+            next_level.clear();
+            for (auto [old_index, new_index] : level) {
+                const node_t& node = nodes[old_index];
+                if (node.is_leaf())
+                    continue;
+                uint32_t first_child = relaid_nodes.size();
+                relaid_nodes[new_index].first_index = first_child;
+                relaid_nodes.push_back(nodes[node.first_index]);
+                relaid_nodes.push_back(nodes[node.first_index + 1]);
+                next_level.push_back({ node.first_index, first_child });
+                next_level.push_back({ node.first_index + 1, first_child + 1 });
+            }
+            level.swap(next_level);
+        }
+        for (auto [old_index, new_index] : level)
+            append_depth_first(nodes, relaid_nodes, old_index, new_index);
+        break;
+    }
+    case node_layout_t::van_emde_boas: {
+        // every node is within depth levels of the root, the last frontier only holds leaves
+        std::vector<std::pair<uint32_t, uint32_t>> frontier;
+        append_van_emde_boas(nodes, relaid_nodes, 0, 0, depth(), frontier);
+        break;
+    }
+    }
+    assert(relaid_nodes.size() == nodes.size());
+    nodes = std::move(relaid_nodes);
 }
 
-const bvh_t::build_config_t bvh_t::build_config;
+template bvh_t bvh_t::build<build_config_t>(const aabb_t *, const glm::vec3 *, uint32_t, core::thread_pool_t&, const build_config_t&);
+template bvh_t bvh_t::build<static_build_config_t<>>(const aabb_t *, const glm::vec3 *, uint32_t, core::thread_pool_t&, const static_build_config_t<>&);
+template bvh_t bvh_t::build<build_config_t>(const aabb_t *, const glm::vec3 *, uint32_t, uint32_t, const build_config_t&);
+template bvh_t bvh_t::build<static_build_config_t<>>(const aabb_t *, const glm::vec3 *, uint32_t, uint32_t, const static_build_config_t<>&);
+
+const build_config_t bvh_t::build_config;
@@ -19,11 +19,21 @@
 #include <optional>
 #include <fstream>
 #include <iostream>
-
-
-inline float robust_min(float a, float b);
-inline float robust_max(float a, float b);
-inline float safe_inverse(float x);
+#include <atomic>
+#include <span>
+
+namespace core {
+class thread_pool_t;
+class task_group_t;
+} // namespace core
+
+inline float robust_min(float a, float b) { return a < b ? a : b; }
+inline float robust_max(float a, float b) { return a > b ? a : b; }
+inline float safe_inverse(float x) {
+    return std::fabs(x) <= std::numeric_limits<float>::epsilon()
+        ? std::copysign(1.0f / std::numeric_limits<float>::epsilon(), x)
+        : 1.0f / x;
+}
 
 struct aabb_t {
 
@@ -44,6 +54,13 @@ struct ray_t {
     float tmin, tmax;
 };
 
+// per ray data every node test needs, computed once per traversal instead of once per node
+struct ray_data_t {
+    ray_data_t(const ray_t& ray) : origin(ray.origin), inverse_direction(ray.inverse_direction()) {}
+
+    glm::vec3 origin, inverse_direction;
+};
+
 struct hit_t {
     uint32_t primitive_index;
     operator bool() const { return primitive_index != static_cast<uint32_t>(-1); }
@@ -67,6 +84,18 @@ struct node_t {
 
     bool intersect(const ray_t& ray) const;
 
+    // entry distance of the ray, miss when it is not below tmax
+    float intersect(const ray_data_t& ray_data, float tmin, float tmax) const {
+        glm::vec3 t0 = (aabb.min - ray_data.origin) * ray_data.inverse_direction;
+        glm::vec3 t1 = (aabb.max - ray_data.origin) * ray_data.inverse_direction;
+        glm::vec3 tnear = glm::min(t0, t1), tfar = glm::max(t0, t1);
+        float _tmin = robust_max(tnear[0], robust_max(tnear[1], robust_max(tnear[2], tmin)));
+        float _tmax = robust_min(tfar[0], robust_min(tfar[1], robust_min(tfar[2], tmax)));
+        return _tmin <= _tmax ? _tmin : miss;
+    }
+
+    static constexpr float miss = std::numeric_limits<float>::infinity();
+
     bool is_leaf() const { return primitive_count != 0; }
 
     aabb_t aabb{};
@@ -76,11 +105,287 @@ struct node_t {
 
 
 
+// work done by traversals, summed over every ray traced with it
+struct traversal_stats_t {
+    // nodes whose box was tested
+    uint64_t nodes = 0;
+    // leaves the ray entered
+    uint64_t leaves = 0;
+    uint64_t primitives = 0;
+};
+
+// traversal stack, inline_capacity entries live on the call stack and cover every tree the builders produce, deeper trees
+// (a degenerate cache file, a custom builder) spill to the heap instead of overflowing
+template <typename entry_t, uint32_t inline_capacity>
+class traversal_stack_t {
+public:
+    traversal_stack_t() = default;
+    traversal_stack_t(const traversal_stack_t&) = delete;
+    traversal_stack_t& operator = (const traversal_stack_t&) = delete;
+
+    void push(const entry_t& entry) {
+        if (_size == _capacity) [[unlikely]]
+            grow();
+        _entries[_size++] = entry;
+    }
+    entry_t pop() { return _entries[--_size]; }
+    bool empty() const { return _size == 0; }
+    uint32_t size() const { return _size; }
+    entry_t& operator [] (uint32_t index) { return _entries[index]; }
+
+private:
+    void grow() {
+        _heap.resize(_capacity * 2);
+        if (_entries == _inline)
+            std::copy(_inline, _inline + _size, _heap.data());
+        _entries = _heap.data();
+        _capacity *= 2;
+    }
+
+    entry_t _inline[inline_capacity];
+    std::vector<entry_t> _heap;
+    entry_t *_entries = _inline;
+    uint32_t _capacity = inline_capacity;
+    uint32_t _size = 0;
+};
+
+// non owning bvh, the traversal works on this so a bvh_t and a bvh mapped straight from a cache file (bvh_cache.hpp) share it
+struct bvh_view_t {
+
+    // nearest hit along the ray, children are visited front to back and skipped once they start behind the current hit
+    // stats is only for profiling, the null default compiles the counting away
+    template <typename primitive>
+    hit_t closest_hit(ray_t& ray, std::span<const primitive> primitives, traversal_stats_t *stats = nullptr) const {
+        return traverse_ordered<false>(ray, [&](uint32_t primitive_index, ray_t& ray) { return primitives[primitive_index].intersect(ray); }, stats);
+    }
+
+    // returns the first hit found, for shadow and ambient occlusion rays that only need to know if anything is in the way
+    template <typename primitive>
+    hit_t any_hit(ray_t& ray, std::span<const primitive> primitives, traversal_stats_t *stats = nullptr) const {
+        return traverse_ordered<true>(ray, [&](uint32_t primitive_index, ray_t& ray) { return primitives[primitive_index].intersect(ray); }, stats);
+    }
+
+    // the traversal behind closest_hit and any_hit for primitives that are not a plain array, e.g. instances in tlas_t
+    // intersect(primitive_index, ray) has to shrink ray.tmax and return true on a hit
+    template <bool any_hit, typename intersect_t>
+    hit_t traverse_ordered(ray_t& ray, const intersect_t& intersect, traversal_stats_t *stats = nullptr) const {
+        return traverse_leaves<any_hit>(ray, [&](uint32_t, const node_t& leaf, ray_t& ray) {
+            hit_t hit = hit_t::none();
+            for (uint32_t i = 0; i < leaf.primitive_count; i++) {
+                if (stats)
+                    stats->primitives++;
+                uint32_t primitive_index = primitive_indices[leaf.first_index + i];
+                if (intersect(primitive_index, ray)) {
+                    hit.primitive_index = primitive_index;
+                    if constexpr (any_hit)
+                        break;
+                }
+            }
+            return hit;
+        }, stats);
+    }
+
+    // the same traversal handing over whole leaves, for leaf formats that test several primitives at once (triangle_block.hpp)
+    // intersect_leaf(node_index, leaf, ray) returns the closest hit in the leaf and shrinks ray.tmax, only nodes and leaves are counted in stats
+    template <bool any_hit, typename intersect_leaf_t>
+    hit_t traverse_leaves(ray_t& ray, const intersect_leaf_t& intersect_leaf, traversal_stats_t *stats = nullptr) const {
+        struct entry_t {
+            uint32_t node_index;
+            float distance;
+        };
+
+        hit_t hit = hit_t::none();
+        const ray_data_t ray_data{ ray };
+
+        traversal_stack_t<entry_t, max_stack_size> stack;
+
+        if (stats)
+            stats->nodes++;
+        if (nodes[0].intersect(ray_data, ray.tmin, ray.tmax) == node_t::miss)
+            return hit;
+        const node_t *node = &nodes[0];
+
+        while (true) {
+            if (node->is_leaf()) {
+                if (stats)
+                    stats->leaves++;
+                hit_t leaf_hit = intersect_leaf(static_cast<uint32_t>(node - nodes.data()), *node, ray);
+                if (leaf_hit) {
+                    hit = leaf_hit;
+                    if constexpr (any_hit)
+                        return hit;
+                }
+            } else {
+                const node_t *near = &nodes[node->first_index];
+                const node_t *far = &nodes[node->first_index + 1];
+                if (stats)
+                    stats->nodes += 2;
+                float near_distance = near->intersect(ray_data, ray.tmin, ray.tmax);
+                float far_distance = far->intersect(ray_data, ray.tmin, ray.tmax);
+                if (near_distance > far_distance) {
+                    std::swap(near, far);
+                    std::swap(near_distance, far_distance);
+                }
+
+                if (near_distance != node_t::miss) {
+                    if (far_distance != node_t::miss)
+                        stack.push({ static_cast<uint32_t>(far - nodes.data()), far_distance });
+                    node = near;
+                    continue;
+                }
+            }
+
+            // pop the next subtree that still starts in front of the closest hit
+            node = nullptr;
+            while (!stack.empty()) {
+                entry_t entry = stack.pop();
+                if (entry.distance <= ray.tmax) {
+                    node = &nodes[entry.node_index];
+                    break;
+                }
+            }
+            if (!node)
+                break;
+        }
+        return hit;
+    }
+
+    std::span<const node_t> nodes;
+    std::span<const uint32_t> primitive_indices;
+
+    // entries of the traversal stack that live on the call stack, a binary traversal leaves at most one sibling per level
+    // behind so trees up to this depth never touch the heap
+    static constexpr uint32_t max_stack_size = 64;
+};
+
+// tuning of bvh_t::build that can change at run time, bins live in arrays of max_bin_count, a larger bin_count is clamped
+struct build_config_t {
+    static constexpr uint32_t max_bin_count = 64;
+
+    uint32_t min_primitives = 2;
+    uint32_t max_primitives = 8;
+    float traversal_cost = 1.0f;
+    uint32_t bin_count = 16;
+    // nodes with fewer primitives are built as a single serial task
+    uint32_t parallel_task_threshold = 4096;
+    // nodes with more primitives split their aabb and bin accumulation across the pool
+    uint32_t parallel_binning_threshold = 65536;
+    uint32_t parallel_grain_size = 16384;
+};
+
+// tuning of bvh_t::build_spatial
+struct spatial_split_config_t {
+    // references allowed on top of one per primitive, as a fraction of the primitive count
+    float duplication_budget = 0.3f;
+    // spatial splits are only tried when the best object split children overlap by more than this fraction of the root area
+    float overlap_threshold = 1e-5f;
+    uint32_t bin_count = 32;
+    // leaf sizes, traversal cost and the object split bins, the same tuning as bvh_t::build
+    build_config_t build = {};
+};
+
+// tuning of bvh_t::build_linear
+struct linear_build_config_t {
+    // 30 bit codes sort in half the passes, 63 bit codes keep neighbouring primitives apart in large scenes
+    uint32_t morton_bits = 63;
+    // morton subtrees over at most this many primitives become a single leaf
+    uint32_t max_leaf_primitives = 4;
+    // HLBVH, morton subtrees over at most this many primitives become clusters and the levels above them are rebuilt
+    // with binned SAH over the cluster bounds, 0 keeps the plain morton hierarchy
+    uint32_t sah_cluster_size = 0;
+    // clustered or duplicate codes make long chains, see bvh_t::limit_depth, the default keeps traversals on their inline stack
+    uint32_t max_depth = bvh_view_t::max_stack_size;
+    // task threshold and grain size of the parallel passes, the bins of the sah_cluster_size top levels
+    build_config_t build = {};
+};
+
+// order of bvh_t::nodes in memory, every layout keeps sibling pairs adjacent, children after their parent and the root at 0
+// so the traversals, refit and the rt shader work on any of them
+enum class node_layout_t {
+    // what the builders emit, every subtree is contiguous and a left child's pair follows right behind it
+    depth_first,
+    // the top levels level by level so the nodes every ray visits share cache lines, the subtrees below them depth first
+    breadth_first,
+    // van Emde Boas, the top half of the levels first and then every subtree below them the same way recursively
+    // keeps parents near their descendants at every cache line and page size
+    van_emde_boas,
+};
+
+// the same tuning fixed at compile time, bin arrays are sized exactly and the loops over them unroll
+// a custom configuration needs the builder templates from bvh_builder.hpp, the defaults are instantiated in bvh.cpp
+template <uint32_t bins = build_config_t{}.bin_count, uint32_t min_leaf = build_config_t{}.min_primitives, uint32_t max_leaf = build_config_t{}.max_primitives>
+struct static_build_config_t {
+    static_assert(bins >= 2 && min_leaf >= 1 && min_leaf <= max_leaf);
+
+    static constexpr uint32_t max_bin_count = bins;
+    static constexpr uint32_t min_primitives = min_leaf;
+    static constexpr uint32_t max_primitives = max_leaf;
+    static constexpr float traversal_cost = build_config_t{}.traversal_cost;
+    static constexpr uint32_t bin_count = bins;
+    static constexpr uint32_t parallel_task_threshold = build_config_t{}.parallel_task_threshold;
+    static constexpr uint32_t parallel_binning_threshold = build_config_t{}.parallel_binning_threshold;
+    static constexpr uint32_t parallel_grain_size = build_config_t{}.parallel_grain_size;
+};
+
+// tuning of bvh_t::optimize
+struct treelet_config_t {
+    static constexpr uint32_t max_treelet_leaves = 8;
+
+    // leaves of every treelet, the best topology over them is found exhaustively so the cost grows with 3^n
+    // clamped to [3, max_treelet_leaves]
+    uint32_t treelet_leaves = 7;
+    // bottom up passes over the whole tree, stops early once a pass lowers the sah cost by less than min_improvement
+    uint32_t max_passes = 3;
+    float min_improvement = 0.001f;
+    // wall clock limit of the whole call, treelets that were not reached by then keep their topology
+    double time_budget_ms = 1000.0;
+    // traversal cost and task threshold, pass the config the tree was built with so it is optimized for the same sah
+    build_config_t build = {};
+};
+
 struct bvh_t {
 
-    static bvh_t build(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count);
+    // a pool of more than one thread selects the task parallel builder, its output is identical to the single threaded build
+    // config is a build_config_t to tune at run time or a static_build_config_t, both build the same tree for the same values
+    template <typename config_t = static_build_config_t<>>
+    static bvh_t build(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, core::thread_pool_t& thread_pool, const config_t& config = {});
+    // one off builds, spins up a pool of thread_count for the call, callers that build repeatedly should keep a pool
+    template <typename config_t = static_build_config_t<>>
+    static bvh_t build(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, uint32_t thread_count = 1, const config_t& config = {});
+
+    // SBVH, also considers splitting space and duplicating the references that straddle the plane
+    // slower to build, pays off for long thin triangles on static geometry, primitive_indices may hold an index more than once
+    static bvh_t build_spatial(const triangle_t *triangles, uint32_t primitive_count, const spatial_split_config_t& config = {});
+
+    // LBVH, sorts the centers along a morton curve and emits the radix tree of the codes (Karras 2012)
+    // an order of magnitude faster to build than build and meant for per frame rebuilds, trees are worse to traverse
+    static bvh_t build_linear(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, core::thread_pool_t& thread_pool, const linear_build_config_t& config = {});
+    static bvh_t build_linear(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, uint32_t thread_count = 1, const linear_build_config_t& config = {});
 
     uint32_t depth(uint32_t node_index = 0) const;
+    // expected cost of a ray that enters node_index, in primitive intersections with traversal steps weighted by traversal_cost
+    float sah_cost(uint32_t node_index = 0, float traversal_cost = build_config_t{}.traversal_cost) const;
+
+    // recomputes every aabb bottom up from moved primitive bounds, the topology and primitive_indices are left alone
+    // relies on children being stored after their parent, which every builder guarantees
+    void refit(const aabb_t *aabbs);
+    void refit(const aabb_t *aabbs, core::thread_pool_t& thread_pool);
+    // treelet restructuring (Karras and Aila 2013), replaces the topology of the treelet below every node with the lowest
+    // sah arrangement of its leaves, bottom up so every treelet sees optimized subtrees, leaves and their primitives are kept
+    // nodes and primitive_indices are laid out again depth first, returns the number of passes run
+    uint32_t optimize(core::thread_pool_t& thread_pool, const treelet_config_t& config = {});
+    // one off optimization, spins up a pool of thread_count for the call
+    uint32_t optimize(uint32_t thread_count = 1, const treelet_config_t& config = {});
+    // rebuilds the highest subtrees that reach below max_depth as balanced trees over their leaves, leaves and
+    // primitive_indices are kept and nodes are laid out again depth first, a max_depth below what the leaf count allows
+    // only gets as close as a balanced tree does
+    void limit_depth(uint32_t max_depth);
+    // renumbers nodes into layout, primitive_indices are left alone, breadth_first_levels only applies to breadth_first
+    void relayout(node_layout_t layout, uint32_t breadth_first_levels = 8);
+    // rebuilds the disjoint subtrees below node_indices with the binned builder over the primitives they already hold, then
+    // compacts nodes, the roots keep their bounds so ancestors stay valid after a refit
+    // node indices are not stable across the call, only the depth first order of untouched nodes is
+    void rebuild(const std::vector<uint32_t>& node_indices, const aabb_t *aabbs, const glm::vec3 *centers, core::thread_pool_t& thread_pool, const build_config_t& config = {});
 
     template <typename primitive>
     hit_t traverse(ray_t& ray, const std::vector<primitive>& primitives) const {
@@ -108,22 +413,39 @@ struct bvh_t {
         return hit;
     }
 
+    bvh_view_t view() const { return { nodes, primitive_indices }; }
+
+    // the ordered traversals of view(), see bvh_view_t
+    template <typename primitive>
+    hit_t closest_hit(ray_t& ray, const std::vector<primitive>& primitives, traversal_stats_t *stats = nullptr) const {
+        return view().closest_hit<primitive>(ray, primitives, stats);
+    }
+
+    template <typename primitive>
+    hit_t any_hit(ray_t& ray, const std::vector<primitive>& primitives, traversal_stats_t *stats = nullptr) const {
+        return view().any_hit<primitive>(ray, primitives, stats);
+    }
+
+    template <bool any_hit, typename intersect_t>
+    hit_t traverse_ordered(ray_t& ray, const intersect_t& intersect, traversal_stats_t *stats = nullptr) const {
+        return view().traverse_ordered<any_hit>(ray, intersect, stats);
+    }
+
     std::vector<node_t> nodes;
     std::vector<uint32_t> primitive_indices;
 
-private:
+    static constexpr uint32_t max_stack_size = bvh_view_t::max_stack_size;
 
-    struct build_config_t {
-        uint32_t min_primitives = 2;
-        uint32_t max_primitives = 8;
-        float traversal_cost = 1.0f;
-        uint32_t bin_count = 16;
-    };
+private:
 
     struct bin_t {
 
         bin_t& extend(const bin_t& other);
-        static uint32_t bin_index(int axis, const aabb_t& aabb, const glm::vec3& center);
+        // inline so a compile time bin_count folds into the division
+        static uint32_t bin_index(int axis, const aabb_t& aabb, const glm::vec3& center, uint32_t bin_count) {
+            int index = (center[axis] - aabb.min[axis]) * (bin_count / (aabb.max[axis] - aabb.min[axis]));
+            return std::min(bin_count - 1, static_cast<uint32_t>(std::max(0, index)));
+        }
 
         float cost() const { return aabb.half_area() * primitive_count; }
 
@@ -138,16 +460,42 @@ private:
             return *this && cost < other.cost;
         }
 
-        static split_t find_best_split(int axis, const bvh_t& bvh, const node_t& node, const aabb_t *aabbs, const glm::vec3 *centers);
+        template <typename config_t>
+        static split_t find_best_split(int axis, const bvh_t& bvh, const node_t& node, const aabb_t *aabbs, const glm::vec3 *centers, const config_t& config);
+        // bins holds config.bin_count bins
+        template <typename config_t>
+        static split_t find_best_split(int axis, const bin_t *bins, const config_t& config);
+        template <typename config_t>
+        static split_t find_best_split_parallel(const bvh_t& bvh, const node_t& node, const aabb_t *aabbs, const glm::vec3 *centers, core::thread_pool_t& thread_pool, const config_t& config);
 
         int axis = 0;
         float cost = std::numeric_limits<float>::max();
         uint32_t right_bin = 0;
     };
 
+    // grain size of refit, which takes no build_config_t
     static const build_config_t build_config;
+    // config with bin_count clamped to [2, max_bin_count], a clamp is reported on std::cerr
+    static build_config_t checked_config(const build_config_t& config, const char *builder);
+
+    struct spatial_builder_t;
+    struct linear_builder_t;
+    struct treelet_optimizer_t;
     
-    static void build_recursive(bvh_t& bvh, uint32_t node_index, uint32_t& node_count, const aabb_t *aabbs, const glm::vec3 *centers);
+    template <typename config_t>
+    static bool partition(bvh_t& bvh, const node_t& node, const split_t& min_split, const glm::vec3 *centers, uint32_t& first_right, const config_t& config);
+    static void make_children(bvh_t& bvh, uint32_t node_index, uint32_t first_child, uint32_t first_right);
+    template <typename config_t>
+    static void build_recursive(bvh_t& bvh, uint32_t node_index, uint32_t& node_count, const aabb_t *aabbs, const glm::vec3 *centers, const config_t& config);
+    template <typename config_t>
+    static void build_recursive_parallel(bvh_t& bvh, uint32_t node_index, std::atomic<uint32_t>& node_count, const aabb_t *aabbs, const glm::vec3 *centers, core::thread_pool_t& thread_pool, core::task_group_t& task_group, const config_t& config);
+    // renumbers nodes into the depth first order the serial builder allocates them in
+    static void reorder_depth_first(bvh_t& bvh);
 };
 
+extern template bvh_t bvh_t::build<build_config_t>(const aabb_t *, const glm::vec3 *, uint32_t, core::thread_pool_t&, const build_config_t&);
+extern template bvh_t bvh_t::build<static_build_config_t<>>(const aabb_t *, const glm::vec3 *, uint32_t, core::thread_pool_t&, const static_build_config_t<>&);
+extern template bvh_t bvh_t::build<build_config_t>(const aabb_t *, const glm::vec3 *, uint32_t, uint32_t, const build_config_t&);
+extern template bvh_t bvh_t::build<static_build_config_t<>>(const aabb_t *, const glm::vec3 *, uint32_t, uint32_t, const static_build_config_t<>&);
+
 #endif
\ No newline at end of file
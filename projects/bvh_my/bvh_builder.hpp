@@ -0,0 +1,223 @@
+#ifndef bvh_builder_hpp
+#define bvh_builder_hpp
+
+#include "bvh.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <type_traits>
+
+// definitions of the binned SAH builder templates, only needed to build with a config that bvh.cpp does not instantiate
+
+template <typename config_t>
+bvh_t bvh_t::build(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, core::thread_pool_t& thread_pool, const config_t& config) {
+    // a static_build_config_t checks its bins at compile time, a run time bin_count would overrun the bin arrays
+    if constexpr (std::is_same_v<config_t, build_config_t>) {
+        if (config.bin_count < 2 || config.bin_count > config_t::max_bin_count)
+            return build(aabbs, centers, primitive_count, thread_pool, checked_config(config, "bvh_t::build"));
+    }
+    bvh_t bvh{};
+
+    bvh.primitive_indices.resize(primitive_count);
+    std::iota(bvh.primitive_indices.begin(), bvh.primitive_indices.end(), 0);
+
+    bvh.nodes.resize(2 * primitive_count - 1);
+    bvh.nodes[0].primitive_count = primitive_count;
+    bvh.nodes[0].first_index = 0;
+
+    if (thread_pool.thread_count() <= 1) {
+        uint32_t node_count = 1;
+        build_recursive(bvh, 0, node_count, aabbs, centers, config);
+        bvh.nodes.resize(node_count);
+        return bvh;
+    }
+
+    core::task_group_t task_group{};
+    std::atomic<uint32_t> node_count = 1;
+    build_recursive_parallel(bvh, 0, node_count, aabbs, centers, thread_pool, task_group, config);
+    thread_pool.wait(task_group);
+    // subtrees reserve worst case node ranges, so the array has holes and is in task completion order
+    reorder_depth_first(bvh);
+    return bvh;
+}
+
+template <typename config_t>
+bvh_t bvh_t::build(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, uint32_t thread_count, const config_t& config) {
+    core::thread_pool_t thread_pool{ std::max(thread_count, 1u) };
+    return build(aabbs, centers, primitive_count, thread_pool, config);
+}
+
+template <typename config_t>
+bvh_t::split_t bvh_t::split_t::find_best_split(int axis, const bvh_t& bvh, const node_t& node, const aabb_t *aabbs, const glm::vec3 *centers, const config_t& config) {
+    bin_t bins[config_t::max_bin_count];
+
+    for (uint32_t i = 0; i < node.primitive_count; i++) {
+        uint32_t primitive_index = bvh.primitive_indices[node.first_index + i];
+        bin_t& bin = bins[bin_t::bin_index(axis, node.aabb, centers[primitive_index], config.bin_count)];
+        bin.aabb.extend(aabbs[primitive_index]);
+        bin.primitive_count++;
+    }
+
+    return find_best_split(axis, bins, config);
+}
+
+template <typename config_t>
+bvh_t::split_t bvh_t::split_t::find_best_split(int axis, const bin_t *bins, const config_t& config) {
+    float right_cost[config_t::max_bin_count];
+
+    bin_t left_accumulation, right_accumulation;
+
+    for (uint32_t i = config.bin_count - 1; i > 0; i--) {
+        right_accumulation.extend(bins[i]);
+        right_cost[i] = right_accumulation.cost();
+    }
+
+    split_t split{};
+    split.axis = axis;
+
+    for (uint32_t i = 0; i < config.bin_count - 1; i++) {
+        left_accumulation.extend(bins[i]);
+        float cost = left_accumulation.cost() + right_cost[i + 1];
+
+        if (cost < split.cost) {
+            split.cost = cost;
+            split.right_bin = i + 1;
+        }
+    }
+    return split;
+}
+
+template <typename config_t>
+bvh_t::split_t bvh_t::split_t::find_best_split_parallel(const bvh_t& bvh, const node_t& node, const aabb_t *aabbs, const glm::vec3 *centers, core::thread_pool_t& thread_pool, const config_t& config) {
+    const uint32_t grain_size = config.parallel_grain_size;
+    const uint32_t chunk_count = (node.primitive_count + grain_size - 1) / grain_size;
+    const uint32_t bins_per_chunk = 3 * config.bin_count;
+
+    // every chunk bins into its own slice for all 3 axes, min/max and counts merge exactly so the result does not depend on scheduling
+    std::vector<bin_t> chunk_bins(chunk_count * bins_per_chunk);
+    thread_pool.parallel_for(0, node.primitive_count, grain_size, [&](uint32_t begin, uint32_t end) {
+        bin_t *bins = chunk_bins.data() + (begin / grain_size) * bins_per_chunk;
+        for (uint32_t i = begin; i < end; i++) {
+            uint32_t primitive_index = bvh.primitive_indices[node.first_index + i];
+            for (int axis = 0; axis < 3; axis++) {
+                bin_t& bin = bins[axis * config.bin_count + bin_t::bin_index(axis, node.aabb, centers[primitive_index], config.bin_count)];
+                bin.aabb.extend(aabbs[primitive_index]);
+                bin.primitive_count++;
+            }
+        }
+    });
+
+    for (uint32_t chunk = 1; chunk < chunk_count; chunk++) {
+        for (uint32_t i = 0; i < bins_per_chunk; i++) {
+            chunk_bins[i].extend(chunk_bins[chunk * bins_per_chunk + i]);
+        }
+    }
+
+    split_t min_split;
+    for (int axis = 0; axis < 3; axis++)
+        min_split = std::min(min_split, find_best_split(axis, chunk_bins.data() + axis * config.bin_count, config));
+    return min_split;
+}
+
+
+template <typename config_t>
+bool bvh_t::partition(bvh_t& bvh, const node_t& node, const split_t& min_split, const glm::vec3 *centers, uint32_t& first_right, const config_t& config) {
+    float leaf_cost = node.aabb.half_area() * (node.primitive_count - config.traversal_cost);
+    if (!min_split || min_split.cost >= leaf_cost) {
+        if (node.primitive_count > config.max_primitives) {
+            int axis = node.aabb.largest_axis();
+            std::sort(
+                bvh.primitive_indices.begin() + node.first_index,
+                bvh.primitive_indices.begin() + node.first_index + node.primitive_count,
+                [&](uint32_t i, uint32_t j) {  return centers[i][axis] < centers[j][axis]; });
+            first_right = node.first_index + node.primitive_count / 2;
+        } else
+            return false;
+    } else {
+        first_right = std::partition(
+                bvh.primitive_indices.begin() + node.first_index,
+                bvh.primitive_indices.begin() + node.first_index + node.primitive_count,
+                [&](uint32_t i) { return bin_t::bin_index(min_split.axis, node.aabb, centers[i], config.bin_count) < min_split.right_bin;})
+                - bvh.primitive_indices.begin();
+    }
+    return true;
+}
+
+template <typename config_t>
+void bvh_t::build_recursive(bvh_t& bvh, uint32_t node_index, uint32_t& node_count, const aabb_t *aabbs, const glm::vec3 *centers, const config_t& config) {
+    node_t& node = bvh.nodes[node_index];
+    assert(node.is_leaf());
+
+    node.aabb = aabb_t::empty();
+    for (uint32_t i = 0; i < node.primitive_count; i++)
+        node.aabb.extend(aabbs[bvh.primitive_indices[node.first_index + i]]);
+
+    if (node.primitive_count <= config.min_primitives)
+        return;
+
+    split_t min_split;
+    for (int axis = 0; axis < 3; axis++)
+        min_split = std::min(min_split, split_t::find_best_split(axis, bvh, node, aabbs, centers, config));
+
+    uint32_t first_right;
+    if (!partition(bvh, node, min_split, centers, first_right, config))
+        return;
+
+    uint32_t first_child = node_count;
+    node_count += 2;
+    make_children(bvh, node_index, first_child, first_right);
+
+    build_recursive(bvh, first_child, node_count, aabbs, centers, config);
+    build_recursive(bvh, first_child + 1, node_count, aabbs, centers, config);
+}
+
+template <typename config_t>
+void bvh_t::build_recursive_parallel(bvh_t& bvh, uint32_t node_index, std::atomic<uint32_t>& node_count, const aabb_t *aabbs, const glm::vec3 *centers, core::thread_pool_t& thread_pool, core::task_group_t& task_group, const config_t& config) {
+    node_t& node = bvh.nodes[node_index];
+    assert(node.is_leaf());
+
+    if (node.primitive_count < config.parallel_task_threshold) {
+        // a subtree over n primitives never needs more than 2n - 2 nodes below its root, reserve them all at once
+        // and build it with the serial builder so the atomic is only touched once per task
+        uint32_t subtree_node_count = node_count.fetch_add(2 * node.primitive_count - 2, std::memory_order_relaxed);
+        build_recursive(bvh, node_index, subtree_node_count, aabbs, centers, config);
+        return;
+    }
+
+    node.aabb = aabb_t::empty();
+    split_t min_split;
+    if (node.primitive_count >= config.parallel_binning_threshold) {
+        const uint32_t grain_size = config.parallel_grain_size;
+        std::vector<aabb_t> chunk_aabbs((node.primitive_count + grain_size - 1) / grain_size, aabb_t::empty());
+        thread_pool.parallel_for(0, node.primitive_count, grain_size, [&](uint32_t begin, uint32_t end) {
+            aabb_t& chunk_aabb = chunk_aabbs[begin / grain_size];
+            for (uint32_t i = begin; i < end; i++)
+                chunk_aabb.extend(aabbs[bvh.primitive_indices[node.first_index + i]]);
+        });
+        for (auto& chunk_aabb : chunk_aabbs)
+            node.aabb.extend(chunk_aabb);
+
+        min_split = split_t::find_best_split_parallel(bvh, node, aabbs, centers, thread_pool, config);
+    } else {
+        for (uint32_t i = 0; i < node.primitive_count; i++)
+            node.aabb.extend(aabbs[bvh.primitive_indices[node.first_index + i]]);
+
+        for (int axis = 0; axis < 3; axis++)
+            min_split = std::min(min_split, split_t::find_best_split(axis, bvh, node, aabbs, centers, config));
+    }
+
+    uint32_t first_right;
+    if (!partition(bvh, node, min_split, centers, first_right, config))
+        return;
+
+    uint32_t first_child = node_count.fetch_add(2, std::memory_order_relaxed);
+    make_children(bvh, node_index, first_child, first_right);
+
+    // config outlives the tasks, build waits for the whole group before returning
+    thread_pool.run(task_group, [&bvh, first_child, &node_count, aabbs, centers, &thread_pool, &task_group, &config]() {
+        build_recursive_parallel(bvh, first_child + 1, node_count, aabbs, centers, thread_pool, task_group, config);
+    });
+    build_recursive_parallel(bvh, first_child, node_count, aabbs, centers, thread_pool, task_group, config);
+}
+
+#endif
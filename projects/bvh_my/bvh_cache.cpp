@@ -0,0 +1,177 @@
+#include "bvh_cache.hpp"
+
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t fnv_offset_basis = 0xcbf29ce484222325ull;
+constexpr uint64_t fnv_prime = 0x100000001b3ull;
+
+// FNV-1a over 8 byte words, a byte at a time is too slow for meshes of a few hundred MB
+uint64_t hash_bytes(uint64_t hash, std::span<const std::byte> bytes) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, sizeof(uint64_t));
+        hash = (hash ^ word) * fnv_prime;
+    }
+    for (; i < bytes.size(); i++)
+        hash = (hash ^ static_cast<uint64_t>(bytes[i])) * fnv_prime;
+    // the length keeps "ab" + "c" and "a" + "bc" apart
+    return (hash ^ bytes.size()) * fnv_prime;
+}
+
+uint64_t align_up(uint64_t offset) {
+    return (offset + bvh_cache_header_t::alignment - 1) / bvh_cache_header_t::alignment * bvh_cache_header_t::alignment;
+}
+
+void write_padded(std::ofstream& file, const void *data, uint64_t size, uint64_t offset) {
+    static constexpr char zeros[bvh_cache_header_t::alignment]{};
+    uint64_t position = static_cast<uint64_t>(file.tellp());
+    assert(position <= offset && offset - position < bvh_cache_header_t::alignment);
+    file.write(zeros, offset - position);
+    file.write(reinterpret_cast<const char *>(data), size);
+}
+
+} // namespace
+
+uint64_t bvh_cache_key(const std::vector<std::filesystem::path>& sources, std::string_view build_settings) {
+    uint64_t hash = fnv_offset_basis;
+    for (auto& source : sources) {
+        auto mapped_file = core::mapped_file_t::open(source);
+        if (!mapped_file)
+            return 0;
+        hash = hash_bytes(hash, mapped_file->bytes());
+    }
+    hash = hash_bytes(hash, std::as_bytes(std::span{ build_settings.data(), build_settings.size() }));
+    // 0 is never a valid key
+    return hash == 0 ? 1 : hash;
+}
+
+std::vector<std::filesystem::path> bvh_cache_sources(const std::filesystem::path& model_path) {
+    std::vector<std::filesystem::path> sources{ model_path };
+    if (model_path.extension() != ".gltf")
+        return sources;
+
+    std::ifstream file{ model_path };
+    const std::string json{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+    // the uris of the buffers array, enough of json for what exporters write, data uris are part of the gltf itself
+    size_t position = json.find("\"buffers\"");
+    if (position == std::string::npos || (position = json.find('[', position)) == std::string::npos)
+        return sources;
+    int nesting = 0;
+    for (; position < json.size(); position++) {
+        if (json[position] == '[' || json[position] == '{') {
+            nesting++;
+        } else if (json[position] == ']' || json[position] == '}') {
+            if (--nesting == 0)
+                break;
+        } else if (json.compare(position, 5, "\"uri\"") == 0) {
+            size_t first = json.find('"', json.find(':', position + 5));
+            size_t last = first == std::string::npos ? first : json.find('"', first + 1);
+            if (last == std::string::npos)
+                break;
+            std::string uri = json.substr(first + 1, last - first - 1);
+            if (!uri.starts_with("data:"))
+                sources.push_back(model_path.parent_path() / uri);
+            position = last;
+        } else if (json[position] == '"') {
+            // skip other strings so brackets inside them do not count
+            position = json.find('"', position + 1);
+            if (position == std::string::npos)
+                break;
+        }
+    }
+    return sources;
+}
+
+bool write_bvh_cache(const std::filesystem::path& file_path, uint64_t key, const bvh_t& bvh, std::span<const triangle_t> triangles) {
+    bvh_cache_header_t header{};
+    std::memcpy(header.magic, bvh_cache_header_t::magic_value, sizeof(header.magic));
+    header.version = bvh_cache_header_t::current_version;
+    header.node_size = sizeof(node_t);
+    header.triangle_size = sizeof(triangle_t);
+    header.key = key;
+    header.node_count = bvh.nodes.size();
+    header.primitive_index_count = bvh.primitive_indices.size();
+    header.triangle_count = triangles.size();
+    header.nodes_offset = align_up(sizeof(bvh_cache_header_t));
+    header.primitive_indices_offset = align_up(header.nodes_offset + header.node_count * sizeof(node_t));
+    header.triangles_offset = align_up(header.primitive_indices_offset + header.primitive_index_count * sizeof(uint32_t));
+
+    std::error_code error;
+    if (file_path.has_parent_path())
+        std::filesystem::create_directories(file_path.parent_path(), error);
+
+    std::filesystem::path temporary_path = file_path;
+    temporary_path += ".tmp";
+    {
+        std::ofstream file{ temporary_path, std::ios::binary | std::ios::trunc };
+        if (!file)
+            return false;
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        write_padded(file, bvh.nodes.data(), header.node_count * sizeof(node_t), header.nodes_offset);
+        write_padded(file, bvh.primitive_indices.data(), header.primitive_index_count * sizeof(uint32_t), header.primitive_indices_offset);
+        write_padded(file, triangles.data(), header.triangle_count * sizeof(triangle_t), header.triangles_offset);
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temporary_path, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporary_path, file_path, error);
+    if (error) {
+        std::filesystem::remove(temporary_path, error);
+        return false;
+    }
+    return true;
+}
+
+std::optional<mapped_bvh_cache_t> mapped_bvh_cache_t::open(const std::filesystem::path& file_path, uint64_t key) {
+    auto mapped_file = core::mapped_file_t::open(file_path);
+    if (!mapped_file || mapped_file->size() < sizeof(bvh_cache_header_t))
+        return std::nullopt;
+
+    bvh_cache_header_t header;
+    std::memcpy(&header, mapped_file->data(), sizeof(header));
+    if (std::memcmp(header.magic, bvh_cache_header_t::magic_value, sizeof(header.magic)) != 0 ||
+        header.version != bvh_cache_header_t::current_version ||
+        header.node_size != sizeof(node_t) ||
+        header.triangle_size != sizeof(triangle_t) ||
+        header.key != key ||
+        header.node_count == 0)
+        return std::nullopt;
+
+    // every array has to lie inside the file, the counts are checked first so the products below cannot overflow
+    const uint64_t size = mapped_file->size();
+    auto fits = [&](uint64_t offset, uint64_t count, uint64_t element_size) {
+        return offset % bvh_cache_header_t::alignment == 0 && offset <= size && count <= (size - offset) / element_size;
+    };
+    if (!fits(header.nodes_offset, header.node_count, sizeof(node_t)) ||
+        !fits(header.primitive_indices_offset, header.primitive_index_count, sizeof(uint32_t)) ||
+        !fits(header.triangles_offset, header.triangle_count, sizeof(triangle_t)))
+        return std::nullopt;
+
+    const std::byte *data = mapped_file->data();
+    std::span<const node_t> nodes{ reinterpret_cast<const node_t *>(data + header.nodes_offset), header.node_count };
+    std::span<const uint32_t> primitive_indices{ reinterpret_cast<const uint32_t *>(data + header.primitive_indices_offset), header.primitive_index_count };
+
+    // children after their parent keeps a corrupt file from sending the traversal round in circles
+    for (uint64_t i = 0; i < nodes.size(); i++) {
+        const node_t& node = nodes[i];
+        bool valid = node.is_leaf()
+            ? node.first_index <= primitive_indices.size() && node.primitive_count <= primitive_indices.size() - node.first_index
+            : node.first_index > i && node.first_index < nodes.size() - 1;
+        if (!valid)
+            return std::nullopt;
+    }
+    for (uint32_t primitive_index : primitive_indices) {
+        if (primitive_index >= header.triangle_count)
+            return std::nullopt;
+    }
+
+    mapped_bvh_cache_t cache{ std::move(*mapped_file) };
+    cache.bvh = { nodes, primitive_indices };
+    cache.triangles = { reinterpret_cast<const triangle_t *>(data + header.triangles_offset), header.triangle_count };
+    return cache;
+}
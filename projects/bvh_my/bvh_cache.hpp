@@ -0,0 +1,62 @@
+#ifndef bvh_cache_hpp
+#define bvh_cache_hpp
+
+#include "bvh.hpp"
+
+#include "core/mapped_file.hpp"
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+// on disk layout, every array starts on a cache line so the mapped spans are as aligned as the vectors they replace
+// little endian, the node and triangle sizes guard against layout changes that forget to bump the version
+struct bvh_cache_header_t {
+    static constexpr char magic_value[8] = { 'B', 'V', 'H', 'C', 'A', 'C', 'H', 'E' };
+    static constexpr uint32_t current_version = 1;
+    static constexpr uint64_t alignment = 64;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint32_t triangle_size;
+    uint32_t padding;
+    uint64_t key;
+    uint64_t node_count;
+    uint64_t primitive_index_count;
+    uint64_t triangle_count;
+    // byte offsets from the start of the file
+    uint64_t nodes_offset;
+    uint64_t primitive_indices_offset;
+    uint64_t triangles_offset;
+};
+
+// content hash of the source files and the build settings, anything that changes the built tree has to be part of build_settings
+// 0 when a source cannot be read
+uint64_t bvh_cache_key(const std::vector<std::filesystem::path>& sources, std::string_view build_settings);
+
+// the model and the files it loads geometry from, the buffers of a gltf, materials and textures do not change the tree
+std::vector<std::filesystem::path> bvh_cache_sources(const std::filesystem::path& model_path);
+
+// build_settings of bvh_t::build with config, the parallel thresholds are left out since every thread count builds the same tree
+template <typename config_t>
+std::string bvh_build_settings(const config_t& config) {
+    return "bvh_t::build bins " + std::to_string(config.bin_count) + " leaf " + std::to_string(config.min_primitives) + " to " +
+           std::to_string(config.max_primitives) + " traversal cost " + std::to_string(config.traversal_cost);
+}
+
+// writes to a temporary file next to file_path and renames it, so a reader never maps a half written cache
+bool write_bvh_cache(const std::filesystem::path& file_path, uint64_t key, const bvh_t& bvh, std::span<const triangle_t> triangles);
+
+// a cache file mapped read only, bvh and triangles point straight into the mapping and are valid as long as the object is
+struct mapped_bvh_cache_t {
+    // nullopt when the file is missing, truncated, from another version, built from other sources than key or holds a tree
+    // the traversal could run out of bounds or loop in, which walks every node and primitive index once
+    static std::optional<mapped_bvh_cache_t> open(const std::filesystem::path& file_path, uint64_t key);
+
+    core::mapped_file_t file;
+    bvh_view_t bvh;
+    std::span<const triangle_t> triangles;
+};
+
+#endif
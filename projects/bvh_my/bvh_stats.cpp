@@ -0,0 +1,238 @@
+#include "bvh_stats.hpp"
+
+#include "core/thread_pool.hpp"
+
+namespace {
+
+constexpr uint32_t grain_size = 1024;
+
+bool overlaps(const aabb_t& a, const aabb_t& b) {
+    return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::lessThanEqual(b.min, a.max));
+}
+
+// area of the part of the triangle inside aabb, the triangle is clipped against the six planes (Sutherland-Hodgman)
+float clipped_area(const triangle_t& triangle, const aabb_t& aabb) {
+    // every plane adds at most one vertex
+    glm::vec3 polygon[9] = { triangle.p0, triangle.p1, triangle.p2 };
+    glm::vec3 clipped[9];
+    uint32_t count = 3;
+    for (int axis = 0; axis < 3; axis++) {
+        for (int side = 0; side < 2; side++) {
+            auto distance = [&](const glm::vec3& p) { return side == 0 ? p[axis] - aabb.min[axis] : aabb.max[axis] - p[axis]; };
+            uint32_t clipped_count = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                const glm::vec3& a = polygon[i];
+                const glm::vec3& b = polygon[(i + 1) % count];
+                float da = distance(a), db = distance(b);
+                if (da >= 0)
+                    clipped[clipped_count++] = a;
+                if ((da < 0) != (db < 0))
+                    clipped[clipped_count++] = a + (b - a) * (da / (da - db));
+            }
+            count = clipped_count;
+            if (count < 3)
+                return 0;
+            std::copy(clipped, clipped + count, polygon);
+        }
+    }
+
+    glm::vec3 normal{ 0 };
+    for (uint32_t i = 1; i + 1 < count; i++)
+        normal += glm::cross(polygon[i] - polygon[0], polygon[i + 1] - polygon[0]);
+    return 0.5f * glm::length(normal);
+}
+
+// weight of a node in sah_cost, one traversal step for internal nodes and one intersection per primitive for leaves
+double cost_weight(const node_t& node) {
+    return node.is_leaf() ? node.primitive_count : 1.0;
+}
+
+float end_point_overlap(const bvh_view_t& bvh, std::span<const triangle_t> triangles, uint32_t thread_count) {
+    double triangle_area = 0;
+    for (auto& triangle : triangles)
+        triangle_area += 0.5 * glm::length(glm::cross(triangle.p1 - triangle.p0, triangle.p2 - triangle.p0));
+    if (triangle_area == 0)
+        return 0;
+
+    // per chunk sums keep the result independent of the thread count
+    const uint32_t node_count = bvh.nodes.size();
+    std::vector<double> chunk_overlaps((node_count + grain_size - 1) / grain_size, 0.0);
+    core::thread_pool_t thread_pool{ std::max(thread_count, 1u) };
+    thread_pool.parallel_for(1, node_count, grain_size, [&](uint32_t begin, uint32_t end) {
+        double& overlap = chunk_overlaps[begin / grain_size];
+        std::vector<uint32_t> stack;
+        for (uint32_t node_index = begin; node_index < end; node_index++) {
+            const aabb_t& aabb = bvh.nodes[node_index].aabb;
+            // every leaf overlapping the box except the ones below node_index
+            double area = 0;
+            stack.assign(1, 0);
+            while (!stack.empty()) {
+                uint32_t index = stack.back();
+                stack.pop_back();
+                const node_t& node = bvh.nodes[index];
+                if (index == node_index || !overlaps(node.aabb, aabb))
+                    continue;
+                if (!node.is_leaf()) {
+                    stack.push_back(node.first_index);
+                    stack.push_back(node.first_index + 1);
+                    continue;
+                }
+                for (uint32_t i = 0; i < node.primitive_count; i++)
+                    area += clipped_area(triangles[bvh.primitive_indices[node.first_index + i]], aabb);
+            }
+            overlap += cost_weight(bvh.nodes[node_index]) * area;
+        }
+    });
+
+    double overlap = 0;
+    for (double chunk_overlap : chunk_overlaps)
+        overlap += chunk_overlap;
+    return overlap / triangle_area;
+}
+
+void write_histogram(std::ostream& out, const std::vector<uint32_t>& histogram) {
+    out << '[';
+    for (uint32_t i = 0; i < histogram.size(); i++)
+        out << (i ? ", " : "") << histogram[i];
+    out << ']';
+}
+
+void write_summary(std::ostream& out, const ray_stats_t::summary_t& summary) {
+    out << "{ \"mean\": " << summary.mean << ", \"median\": " << summary.median << ", \"p95\": " << summary.p95 << ", \"max\": " << summary.max << " }";
+}
+
+// value at fraction of the sorted values, reorders values
+uint64_t percentile(std::vector<uint64_t>& values, double fraction) {
+    auto it = values.begin() + static_cast<size_t>(fraction * (values.size() - 1));
+    std::nth_element(values.begin(), it, values.end());
+    return *it;
+}
+
+template <typename member_t>
+ray_stats_t::summary_t summarize(const std::vector<traversal_stats_t>& rays, member_t member) {
+    if (rays.empty())
+        return {};
+    std::vector<uint64_t> values(rays.size());
+    double sum = 0;
+    for (uint32_t i = 0; i < rays.size(); i++) {
+        values[i] = rays[i].*member;
+        sum += values[i];
+    }
+    ray_stats_t::summary_t summary{};
+    summary.mean = sum / values.size();
+    summary.max = *std::max_element(values.begin(), values.end());
+    summary.p95 = percentile(values, 0.95);
+    summary.median = percentile(values, 0.5);
+    return summary;
+}
+
+} // namespace
+
+bvh_stats_t bvh_stats_t::compute(const bvh_view_t& bvh, std::span<const triangle_t> triangles, uint32_t thread_count) {
+    bvh_stats_t stats{};
+    if (bvh.nodes.empty())
+        return stats;
+    stats.node_count = bvh.nodes.size();
+    stats.reference_count = bvh.primitive_indices.size();
+    stats.memory_bytes = bvh.nodes.size_bytes() + bvh.primitive_indices.size_bytes();
+
+    // everything that only needs the topology in one walk, (node index, levels below the root)
+    double cost = 0, sibling_overlap = 0;
+    std::stack<std::pair<uint32_t, uint32_t>> stack;
+    stack.push({ 0, 0 });
+    while (!stack.empty()) {
+        auto [node_index, depth] = stack.top();
+        stack.pop();
+        const node_t& node = bvh.nodes[node_index];
+        cost += static_cast<double>(node.aabb.half_area()) * cost_weight(node);
+        if (node.is_leaf()) {
+            stats.leaf_count++;
+            stats.depth = std::max(stats.depth, depth + 1);
+            if (stats.leaf_sizes.size() <= node.primitive_count)
+                stats.leaf_sizes.resize(node.primitive_count + 1, 0);
+            stats.leaf_sizes[node.primitive_count]++;
+            if (stats.leaf_depths.size() <= depth)
+                stats.leaf_depths.resize(depth + 1, 0);
+            stats.leaf_depths[depth]++;
+            continue;
+        }
+
+        const aabb_t& left = bvh.nodes[node.first_index].aabb;
+        const aabb_t& right = bvh.nodes[node.first_index + 1].aabb;
+        if (overlaps(left, right) && node.aabb.half_area() > 0) {
+            aabb_t overlap{ glm::max(left.min, right.min), glm::min(left.max, right.max) };
+            sibling_overlap += overlap.half_area() / node.aabb.half_area();
+        }
+        stack.push({ node.first_index, depth + 1 });
+        stack.push({ node.first_index + 1, depth + 1 });
+    }
+    const float root_area = bvh.nodes[0].aabb.half_area();
+    stats.sah_cost = root_area > 0 ? cost / root_area : 0;
+    stats.sibling_overlap = stats.node_count > stats.leaf_count ? sibling_overlap / (stats.node_count - stats.leaf_count) : 0;
+
+    if (!triangles.empty())
+        stats.epo = end_point_overlap(bvh, triangles, thread_count);
+    return stats;
+}
+
+void bvh_stats_t::write_json(std::ostream& out) const {
+    out << "{ \"node_count\": " << node_count << ", \"leaf_count\": " << leaf_count << ", \"reference_count\": " << reference_count
+        << ", \"depth\": " << depth << ", \"memory_bytes\": " << memory_bytes << ", \"sah_cost\": " << sah_cost << ", \"epo\": " << epo
+        << ", \"sibling_overlap\": " << sibling_overlap << ", \"leaf_sizes\": ";
+    write_histogram(out, leaf_sizes);
+    out << ", \"leaf_depths\": ";
+    write_histogram(out, leaf_depths);
+    out << " }";
+}
+
+ray_stats_t ray_stats_t::trace(const bvh_view_t& bvh, std::span<const ray_t> rays, std::span<const triangle_t> triangles, bool any_hit, uint32_t thread_count) {
+    ray_stats_t stats{};
+    stats.rays.resize(rays.size(), traversal_stats_t{});
+    std::atomic<uint32_t> hit_count = 0;
+    core::thread_pool_t thread_pool{ std::max(thread_count, 1u) };
+    thread_pool.parallel_for(0, rays.size(), grain_size, [&](uint32_t begin, uint32_t end) {
+        uint32_t hits = 0;
+        for (uint32_t i = begin; i < end; i++) {
+            ray_t ray = rays[i];
+            hit_t hit = any_hit ? bvh.any_hit(ray, triangles, &stats.rays[i]) : bvh.closest_hit(ray, triangles, &stats.rays[i]);
+            hits += static_cast<bool>(hit);
+        }
+        hit_count += hits;
+    });
+    stats.hit_count = hit_count;
+    return stats;
+}
+
+ray_stats_t::summary_t ray_stats_t::nodes() const { return summarize(rays, &traversal_stats_t::nodes); }
+ray_stats_t::summary_t ray_stats_t::leaves() const { return summarize(rays, &traversal_stats_t::leaves); }
+ray_stats_t::summary_t ray_stats_t::primitives() const { return summarize(rays, &traversal_stats_t::primitives); }
+
+std::vector<uint8_t> ray_stats_t::heatmap(uint32_t width, uint32_t height) const {
+    assert(rays.size() >= static_cast<size_t>(width) * height);
+    std::vector<uint8_t> image(3 * static_cast<size_t>(width) * height, 0);
+    if (rays.empty())
+        return image;
+
+    // the 99th percentile instead of the maximum, a few pathological rays would wash out the rest
+    std::vector<uint64_t> values(static_cast<size_t>(width) * height);
+    for (uint32_t i = 0; i < values.size(); i++)
+        values[i] = rays[i].nodes;
+    const float scale = 1.0f / std::max<uint64_t>(1, percentile(values, 0.99));
+    for (uint32_t i = 0; i < values.size(); i++) {
+        float t = std::min(1.0f, rays[i].nodes * scale);
+        glm::vec3 color = t < 0.5f ? glm::vec3{ 0, 2 * t, 1 - 2 * t } : glm::vec3{ 2 * t - 1, 2 - 2 * t, 0 };
+        for (int channel = 0; channel < 3; channel++)
+            image[3 * i + channel] = static_cast<uint8_t>(color[channel] * 255.0f + 0.5f);
+    }
+    return image;
+}
+
+void ray_stats_t::write_json(std::ostream& out) const {
+    out << "{ \"rays\": " << rays.size() << ", \"hits\": " << hit_count << ", \"nodes\": ";
+    write_summary(out, nodes());
+    out << ", \"leaves\": ";
+    write_summary(out, leaves());
+    out << ", \"primitives\": ";
+    write_summary(out, primitives());
+    out << " }";
+}
@@ -0,0 +1,59 @@
+#ifndef bvh_stats_hpp
+#define bvh_stats_hpp
+
+#include "bvh.hpp"
+
+// ray independent quality measures of a bvh, for comparing build strategies
+struct bvh_stats_t {
+    uint32_t node_count = 0;
+    uint32_t leaf_count = 0;
+    // entries of primitive_indices, above the primitive count when spatial splits duplicated references
+    uint32_t reference_count = 0;
+    uint32_t depth = 0;
+    // nodes and primitive_indices
+    uint64_t memory_bytes = 0;
+    // the same weights as bvh_t::sah_cost
+    float sah_cost = 0;
+    // end point overlap (Aila et al. 2013), triangle area inside boxes of subtrees that do not hold the triangle, weighted
+    // like sah_cost and divided by the total triangle area, -1 when computed without triangles
+    float epo = -1;
+    // area of the overlap of the two children over the area of their parent, averaged over internal nodes
+    float sibling_overlap = 0;
+    // leaf_sizes[n] leaves hold n primitives, leaf_depths[d] leaves are d levels below the root
+    std::vector<uint32_t> leaf_sizes;
+    std::vector<uint32_t> leaf_depths;
+
+    // epo clips every triangle against every box it overlaps outside its own subtrees, only computed when triangles are given
+    static bvh_stats_t compute(const bvh_view_t& bvh, std::span<const triangle_t> triangles = {}, uint32_t thread_count = 1);
+
+    void write_json(std::ostream& out) const;
+};
+
+// per ray work of an instrumented traversal pass
+struct ray_stats_t {
+    struct summary_t {
+        double mean;
+        uint64_t median;
+        uint64_t p95;
+        uint64_t max;
+    };
+
+    // rays[i] is the work of the i-th ray traced
+    std::vector<traversal_stats_t> rays;
+    uint32_t hit_count = 0;
+
+    // closest hit traversal, or any hit for shadow and occlusion rays
+    static ray_stats_t trace(const bvh_view_t& bvh, std::span<const ray_t> rays, std::span<const triangle_t> triangles, bool any_hit = false, uint32_t thread_count = 1);
+
+    summary_t nodes() const;
+    summary_t leaves() const;
+    summary_t primitives() const;
+
+    // nodes visited per ray from blue over green to red at the 99th percentile, rays have to be width * height pixels in
+    // row major order, rgb8
+    std::vector<uint8_t> heatmap(uint32_t width, uint32_t height) const;
+
+    void write_json(std::ostream& out) const;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "compressed_bvh.hpp"
+
+
+namespace {
+
+// fills in the frame and the quantized child boxes of node, child_mask has to be set
+void quantize(compressed_node_t& node, const aabb_t (&bounds)[compressed_node_t::width]) {
+    // the node frame is the union of its children
+    aabb_t frame = aabb_t::empty();
+    for (uint32_t slot = 0; slot < compressed_node_t::width; slot++) {
+        if (node.child_mask & (1u << slot))
+            frame.extend(bounds[slot]);
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        const float origin = frame.min[axis];
+        node.origin[axis] = origin;
+
+        // smallest power of two step that still reaches the top of the frame in 255 steps
+        int exponent = -126;
+        if (frame.max[axis] > origin) {
+            std::frexp((frame.max[axis] - origin) / 255.0f, &exponent);
+            exponent = std::max(exponent - 1, -126);
+        }
+        while (origin + 255.0f * std::ldexp(1.0f, exponent) < frame.max[axis])
+            exponent++;
+        assert(exponent <= 127);
+        node.exponent[axis] = static_cast<int8_t>(exponent);
+        const float scale = std::ldexp(1.0f, exponent);
+
+        for (uint32_t slot = 0; slot < compressed_node_t::width; slot++) {
+            if (!(node.child_mask & (1u << slot)))
+                continue;
+            // round outwards, then fix up the cases where float rounding of the decode still lands inside the box
+            float lo = bounds[slot].min[axis], hi = bounds[slot].max[axis];
+            int qmin = std::clamp(static_cast<int>(std::floor((lo - origin) / scale)), 0, 255);
+            int qmax = std::clamp(static_cast<int>(std::ceil((hi - origin) / scale)), 0, 255);
+            while (qmin > 0 && origin + qmin * scale > lo)
+                qmin--;
+            while (qmax < 255 && origin + qmax * scale < hi)
+                qmax++;
+            node.qmin[axis][slot] = static_cast<uint8_t>(qmin);
+            node.qmax[axis][slot] = static_cast<uint8_t>(qmax);
+        }
+    }
+}
+
+// appends nodes that hand out primitive_count primitives from first in leaves of at most 255 under the leaf box, returns
+// the index of the first one, slot 3 opens another node when 4 leaves are not enough
+uint32_t split_leaf(std::vector<compressed_node_t>& nodes, const aabb_t& aabb, uint32_t first, uint32_t primitive_count) {
+    uint32_t node_index = nodes.size();
+    nodes.emplace_back();
+    compressed_node_t node{};
+    aabb_t bounds[compressed_node_t::width];
+    for (uint32_t slot = 0; slot < compressed_node_t::width && primitive_count != 0; slot++) {
+        node.child_mask |= 1u << slot;
+        bounds[slot] = aabb;
+        if (slot == compressed_node_t::width - 1 && primitive_count > 255) {
+            node.child[slot] = split_leaf(nodes, aabb, first, primitive_count);
+            node.primitive_count[slot] = 0;
+            break;
+        }
+        uint32_t count = std::min(primitive_count, 255u);
+        node.child[slot] = first;
+        node.primitive_count[slot] = static_cast<uint8_t>(count);
+        first += count;
+        primitive_count -= count;
+    }
+    quantize(node, bounds);
+    nodes[node_index] = node;
+    return node_index;
+}
+
+} // namespace
+
+compressed_bvh_t compressed_bvh_t::compress(const bvh4_t& bvh4) {
+    compressed_bvh_t compressed_bvh{};
+    compressed_bvh.primitive_indices = bvh4.primitive_indices;
+    compressed_bvh.nodes.resize(bvh4.nodes.size());
+
+    for (uint32_t node_index = 0; node_index < bvh4.nodes.size(); node_index++) {
+        const bvh4_t::node_t& node = bvh4.nodes[node_index];
+        compressed_node_t compressed_node{};
+
+        aabb_t bounds[compressed_node_t::width];
+        for (uint32_t slot = 0; slot < 4; slot++) {
+            if (node.is_empty(slot))
+                continue;
+            compressed_node.child_mask |= 1u << slot;
+            bounds[slot] = { { node.bounds[0][slot], node.bounds[1][slot], node.bounds[2][slot] },
+                             { node.bounds[3][slot], node.bounds[4][slot], node.bounds[5][slot] } };
+        }
+        quantize(compressed_node, bounds);
+
+        for (uint32_t slot = 0; slot < 4; slot++) {
+            compressed_node.child[slot] = node.child[slot];
+            // too many for the 8 bit count, the slot turns into a subtree of leaves under the same box
+            if (node.primitive_count[slot] > 255) {
+                compressed_node.child[slot] = split_leaf(compressed_bvh.nodes, bounds[slot], node.child[slot], node.primitive_count[slot]);
+                compressed_node.primitive_count[slot] = 0;
+                continue;
+            }
+            compressed_node.primitive_count[slot] = static_cast<uint8_t>(node.primitive_count[slot]);
+        }
+        compressed_bvh.nodes[node_index] = compressed_node;
+    }
+    return compressed_bvh;
+}
+
+uint32_t compressed_bvh_t::depth(uint32_t node_index) const {
+    const compressed_node_t& node = nodes[node_index];
+    uint32_t child_depth = 0;
+    for (uint32_t slot = 0; slot < compressed_node_t::width; slot++) {
+        if ((node.child_mask & (1u << slot)) && node.primitive_count[slot] == 0)
+            child_depth = std::max(child_depth, depth(node.child[slot]));
+    }
+    return 1 + child_depth;
+}
@@ -0,0 +1,102 @@
+#ifndef compressed_bvh_hpp
+#define compressed_bvh_hpp
+
+#include "wide_bvh.hpp"
+
+// 4 wide node in a single cache line, child bounds are 8 bit offsets in a per node frame
+// decoded plane = origin[axis] + q * 2^exponent[axis], q * 2^exponent is exact so cpu and gpu decode to the same floats
+// matches compressed_node_t in assets/new_shaders/rt_test/glsl.frag
+struct alignas(64) compressed_node_t {
+    static constexpr uint32_t width = 4;
+    static constexpr uint32_t invalid_child = static_cast<uint32_t>(-1);
+
+    float origin[3];
+    int8_t exponent[3];
+    // bit i set when slot i holds a child
+    uint8_t child_mask;
+    uint8_t qmin[3][width];
+    uint8_t qmax[3][width];
+    // internal child: index of the compressed node, leaf child: first index into primitive_indices
+    uint32_t child[width];
+    // 0 for internal children, compress splits leaves of more than 255 primitives into a subtree of nodes
+    uint8_t primitive_count[width];
+    uint32_t padding;
+
+    // 2^exponent built from the float bits, std::ldexp is a library call and too slow for the traversal loop
+    float scale(int axis) const { return std::bit_cast<float>(static_cast<uint32_t>(exponent[axis] + 127) << 23); }
+};
+static_assert(sizeof(compressed_node_t) == 64, "compressed_node_t has to fill exactly one cache line");
+
+struct compressed_bvh_t {
+
+    // quantizes the child bounds of a 4 wide bvh, the quantized boxes always contain the original ones
+    static compressed_bvh_t compress(const bvh4_t& bvh4);
+
+    uint32_t depth(uint32_t node_index = 0) const;
+
+    template <typename primitive>
+    hit_t traverse(ray_t& ray, const std::vector<primitive>& primitives) const {
+        struct entry_t {
+            uint32_t index;
+            uint32_t primitive_count;
+            float distance;
+        };
+
+        hit_t hit = hit_t::none();
+        wide_ray_t wide_ray{ ray };
+
+        traversal_stack_t<entry_t, bvh4_t::max_depth * 3 + 1> stack;
+        stack.push({ 0, 0, ray.tmin });
+
+        alignas(16) float planes[6][4];
+        alignas(16) float distances[4];
+        while (!stack.empty()) {
+            entry_t entry = stack.pop();
+            if (entry.distance > ray.tmax)
+                continue;
+
+            if (entry.primitive_count != 0) {
+                for (uint32_t i = 0; i < entry.primitive_count; i++) {
+                    uint32_t primitive_index = primitive_indices[entry.index + i];
+                    if (primitives[primitive_index].intersect(ray))
+                        hit.primitive_index = primitive_index;
+                }
+                continue;
+            }
+
+            const compressed_node_t& node = nodes[entry.index];
+            for (int axis = 0; axis < 3; axis++) {
+                float scale = node.scale(axis);
+                for (uint32_t i = 0; i < 4; i++) {
+                    planes[axis][i] = node.origin[axis] + node.qmin[axis][i] * scale;
+                    planes[3 + axis][i] = node.origin[axis] + node.qmax[axis][i] * scale;
+                }
+            }
+            const float *near_planes[3] = { planes[wide_ray.near[0]], planes[wide_ray.near[1]], planes[wide_ray.near[2]] };
+            const float *far_planes[3] = { planes[wide_ray.far[0]], planes[wide_ray.far[1]], planes[wide_ray.far[2]] };
+            uint32_t mask = intersect4(near_planes, far_planes, wide_ray, ray.tmin, ray.tmax, distances) & node.child_mask;
+
+            uint32_t first = stack.size();
+            while (mask) {
+                uint32_t slot = std::countr_zero(mask);
+                mask &= mask - 1;
+                entry_t child{ node.child[slot], node.primitive_count[slot], distances[slot] };
+                stack.push(child);
+                uint32_t i = stack.size() - 1;
+                for (; i > first && stack[i - 1].distance < child.distance; i--)
+                    stack[i] = stack[i - 1];
+                stack[i] = child;
+            }
+        }
+        return hit;
+    }
+
+    std::vector<compressed_node_t> nodes;
+    std::vector<uint32_t> primitive_indices;
+
+    // the traversal in assets/new_shaders/rt_test/glsl.frag keeps a fixed stack of 3 * COMPRESSED_MAX_DEPTH + 1 entries,
+    // trees deeper than this must not be handed to it
+    static constexpr uint32_t max_gpu_depth = 32;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "cpu_renderer.hpp"
+
+#include <chrono>
+
+namespace {
+
+uint32_t pcg_hash(uint32_t x) {
+    uint32_t state = x * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float random_float(uint32_t& rng_state) {
+    rng_state = pcg_hash(rng_state);
+    return static_cast<float>(rng_state >> 8) * (1.0f / 16777216.0f);
+}
+
+float srgb_encode(float x) {
+    x = std::clamp(x, 0.0f, 1.0f);
+    return x <= 0.0031308f ? 12.92f * x : 1.055f * std::pow(x, 1.0f / 2.4f) - 0.055f;
+}
+
+double elapsed_ms(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+} // namespace
+
+double cpu_renderer_t::render_stats_t::utilization() const {
+    double busy_ms = 0;
+    for (auto& thread : threads)
+        busy_ms += thread.busy_ms;
+    return render_ms > 0 ? busy_ms / (render_ms * threads.size()) : 0;
+}
+
+cpu_renderer_t::cpu_renderer_t(const bvh_view_t& bvh, std::span<const triangle_t> triangles, core::thread_pool_t& thread_pool, const cpu_renderer_config_t& config)
+  : bvh(bvh), triangles(triangles), config(config), thread_pool(thread_pool), thread_stats(thread_pool.thread_count()) {
+    // bounce rays start this far off the surface, relative to the scene so it works for any model scale
+    epsilon = bvh.nodes.empty() ? 0.0f : 1e-5f * glm::length(bvh.nodes[0].aabb.diagonal());
+}
+
+cpu_renderer_t::~cpu_renderer_t() {
+    thread_pool.wait(async_task_group);
+}
+
+void cpu_renderer_t::resize(uint32_t width, uint32_t height) {
+    framebuffer_width = width;
+    framebuffer_height = height;
+    tiles_x = (width + config.tile_size - 1) / config.tile_size;
+    tiles_y = (height + config.tile_size - 1) / config.tile_size;
+    accumulation_buffer.assign(static_cast<size_t>(width) * height, glm::vec3{ 0 });
+    samples = 0;
+}
+
+void cpu_renderer_t::reset() {
+    std::fill(accumulation_buffer.begin(), accumulation_buffer.end(), glm::vec3{ 0 });
+    samples = 0;
+}
+
+cpu_renderer_t::render_stats_t cpu_renderer_t::render(const glm::mat4& inverse_view, const glm::mat4& inverse_projection) {
+    if (inverse_view != this->inverse_view || inverse_projection != this->inverse_projection) {
+        this->inverse_view = inverse_view;
+        this->inverse_projection = inverse_projection;
+        reset();
+    }
+
+    std::vector<core::thread_pool_t::thread_stats_t> pool_stats = thread_pool.thread_stats();
+    std::fill(thread_stats.begin(), thread_stats.end(), thread_stats_t{});
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // halves of the tile range go to the own queue and the oldest, largest ranges are what other threads steal
+    core::task_group_t task_group{};
+    auto render_range = [&](auto& self, uint32_t begin, uint32_t end) -> void {
+        while (end - begin > 1) {
+            uint32_t middle = begin + (end - begin) / 2;
+            thread_pool.run(task_group, [&self, middle, end]() { self(self, middle, end); });
+            end = middle;
+        }
+        render_tile(begin);
+    };
+    if (tiles_x * tiles_y != 0 && !bvh.nodes.empty()) {
+        render_range(render_range, 0, tiles_x * tiles_y);
+        thread_pool.wait(task_group);
+        samples++;
+    }
+
+    render_stats_t render_stats{};
+    render_stats.render_ms = elapsed_ms(start);
+    render_stats.sample_count = samples;
+    render_stats.threads = thread_stats;
+    std::vector<core::thread_pool_t::thread_stats_t> new_pool_stats = thread_pool.thread_stats();
+    for (uint32_t i = 0; i < render_stats.threads.size(); i++)
+        render_stats.threads[i].stolen = new_pool_stats[i].stolen - pool_stats[i].stolen;
+    return render_stats;
+}
+
+void cpu_renderer_t::render_async(const glm::mat4& inverse_view, const glm::mat4& inverse_projection, uint8_t *rgba) {
+    assert(async_done());
+    thread_pool.run(async_task_group, [this, inverse_view, inverse_projection, rgba]() {
+        async_stats = render(inverse_view, inverse_projection);
+        resolve(rgba);
+    });
+}
+
+cpu_renderer_t::render_stats_t cpu_renderer_t::async_wait() {
+    thread_pool.wait(async_task_group);
+    return async_stats;
+}
+
+void cpu_renderer_t::resolve(uint8_t *rgba) const {
+    const float scale = samples ? 1.0f / samples : 0.0f;
+    for (size_t i = 0; i < accumulation_buffer.size(); i++) {
+        glm::vec3 color = accumulation_buffer[i] * scale;
+        for (int channel = 0; channel < 3; channel++)
+            rgba[4 * i + channel] = static_cast<uint8_t>(srgb_encode(color[channel]) * 255.0f + 0.5f);
+        rgba[4 * i + 3] = 255;
+    }
+}
+
+void cpu_renderer_t::render_tile(uint32_t tile_index) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const uint32_t x0 = (tile_index % tiles_x) * config.tile_size, y0 = (tile_index / tiles_x) * config.tile_size;
+    const uint32_t x1 = std::min(x0 + config.tile_size, framebuffer_width), y1 = std::min(y0 + config.tile_size, framebuffer_height);
+    const glm::vec3 origin = inverse_view * glm::vec4{ 0, 0, 0, 1 };
+    for (uint32_t y = y0; y < y1; y++) {
+        for (uint32_t x = x0; x < x1; x++) {
+            const uint32_t pixel = y * framebuffer_width + x;
+            // seeded by pixel and sample, so the image does not depend on which thread rendered the tile
+            uint32_t rng_state = pcg_hash(pixel ^ pcg_hash(samples));
+
+            // same ray setup as assets/new_shaders/rt_test/glsl.frag
+            float u = 2.0f * (static_cast<float>(x) + random_float(rng_state)) / static_cast<float>(framebuffer_width) - 1.0f;
+            float v = 2.0f * (static_cast<float>(y) + random_float(rng_state)) / static_cast<float>(framebuffer_height) - 1.0f;
+            glm::vec4 target = inverse_projection * glm::vec4{ u, v, 1, 1 };
+            ray_t ray{};
+            ray.origin = origin;
+            ray.direction = inverse_view * glm::vec4{ glm::normalize(glm::vec3{ target }), 0 };
+            ray.tmin = 0;
+            ray.tmax = std::numeric_limits<float>::max();
+            accumulation_buffer[pixel] += trace(ray, rng_state);
+        }
+    }
+
+    thread_stats_t& stats = thread_stats[thread_pool.current_thread_index()];
+    stats.busy_ms += elapsed_ms(start);
+    stats.tiles++;
+}
+
+glm::vec3 cpu_renderer_t::trace(ray_t ray, uint32_t& rng_state) const {
+    glm::vec3 throughput{ 1 };
+    for (uint32_t bounce = 0; bounce <= config.max_bounces; bounce++) {
+        hit_t hit = bvh.closest_hit<triangle_t>(ray, triangles);
+        if (!hit)
+            return throughput;
+        if (bounce == config.max_bounces)
+            break;
+
+        const triangle_t& triangle = triangles[hit.primitive_index];
+        glm::vec3 normal = glm::normalize(glm::cross(triangle.p1 - triangle.p0, triangle.p2 - triangle.p0));
+        if (glm::dot(normal, ray.direction) > 0)
+            normal = -normal;
+        throughput *= config.albedo;
+
+        // cosine weighted, the cosine and pdf cancel against the lambert brdf
+        float phi = 2.0f * 3.14159265f * random_float(rng_state);
+        float r2 = random_float(rng_state);
+        glm::vec3 tangent = glm::normalize(glm::cross(std::abs(normal.x) > 0.5f ? glm::vec3{ 0, 1, 0 } : glm::vec3{ 1, 0, 0 }, normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        ray.origin = ray.origin + ray.direction * ray.tmax + normal * epsilon;
+        ray.direction = std::sqrt(r2) * (std::cos(phi) * tangent + std::sin(phi) * bitangent) + std::sqrt(1.0f - r2) * normal;
+        ray.tmin = 0;
+        ray.tmax = std::numeric_limits<float>::max();
+    }
+    return glm::vec3{ 0 };
+}
@@ -0,0 +1,94 @@
+#ifndef cpu_renderer_hpp
+#define cpu_renderer_hpp
+
+#include "bvh.hpp"
+
+#include "core/thread_pool.hpp"
+
+// tuning of cpu_renderer_t
+struct cpu_renderer_config_t {
+    // tiles are square, the unit of work handed to threads
+    uint32_t tile_size = 16;
+    // diffuse bounces after the primary hit, every surface is grey and lit by a white sky
+    uint32_t max_bounces = 2;
+    float albedo = 0.7f;
+};
+
+// progressive path tracer over a bvh, every render call adds one sample per pixel to a float accumulation buffer
+// tiles are split recursively over a work stealing core::thread_pool_t, cheap sky tiles and expensive geometry tiles
+// balance themselves out as idle threads steal the largest tile ranges left
+struct cpu_renderer_t {
+    struct thread_stats_t {
+        // time spent tracing tiles during the last render
+        double busy_ms;
+        uint32_t tiles;
+        // tasks taken from other threads' queues during the last render
+        uint64_t stolen;
+    };
+
+    struct render_stats_t {
+        double render_ms;
+        uint32_t sample_count;
+        // per pool thread index, 0 is the thread that called render or, for render_async, any thread outside the pool
+        std::vector<thread_stats_t> threads;
+
+        // busy time over render_ms * thread count, 1 when no thread ever waited
+        double utilization() const;
+    };
+
+    // bvh, triangles and the pool are referenced, not copied, and have to outlive the renderer
+    cpu_renderer_t(const bvh_view_t& bvh, std::span<const triangle_t> triangles, core::thread_pool_t& thread_pool, const cpu_renderer_config_t& config = {});
+    // waits for a render_async still running
+    ~cpu_renderer_t();
+
+    // clears the accumulation
+    void resize(uint32_t width, uint32_t height);
+    void reset();
+
+    // camera as the inverse view and projection matrices the rt shader gets, the accumulation restarts when they change
+    // pixel row 0 is ndc y = -1, the same as the shader so the result can go into the same image
+    render_stats_t render(const glm::mat4& inverse_view, const glm::mat4& inverse_projection);
+
+    // render and resolve into rgba as one pool task and returns at once, so a frame loop can keep presenting the last image
+    // nothing but async_done and async_wait may be called, and rgba not touched, until async_done is true
+    // the task only starts once a worker picks it up, a pool of 1 runs it inside async_wait
+    void render_async(const glm::mat4& inverse_view, const glm::mat4& inverse_projection, uint8_t *rgba);
+    bool async_done() const { return async_task_group.done(); }
+    // stats of the last render_async, blocks until it finished
+    render_stats_t async_wait();
+
+    // average of the accumulated samples, srgb encoded rgba8, width * height * 4 bytes
+    void resolve(uint8_t *rgba) const;
+
+    uint32_t width() const { return framebuffer_width; }
+    uint32_t height() const { return framebuffer_height; }
+    uint32_t sample_count() const { return samples; }
+    // rgb sums of every sample, divide by sample_count for the image
+    const std::vector<glm::vec3>& accumulation() const { return accumulation_buffer; }
+
+private:
+    void render_tile(uint32_t tile_index);
+    glm::vec3 trace(ray_t ray, uint32_t& rng_state) const;
+
+    bvh_view_t bvh;
+    std::span<const triangle_t> triangles;
+    cpu_renderer_config_t config;
+    float epsilon;
+    core::thread_pool_t& thread_pool;
+    core::task_group_t async_task_group;
+    render_stats_t async_stats;
+
+    uint32_t framebuffer_width = 0;
+    uint32_t framebuffer_height = 0;
+    uint32_t tiles_x = 0;
+    uint32_t tiles_y = 0;
+    uint32_t samples = 0;
+    std::vector<glm::vec3> accumulation_buffer;
+
+    glm::mat4 inverse_view{ 0 };
+    glm::mat4 inverse_projection{ 0 };
+    // per thread index, only ever written by the thread with that index during a render
+    std::vector<thread_stats_t> thread_stats;
+};
+
+#endif
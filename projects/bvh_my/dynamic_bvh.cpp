@@ -0,0 +1,128 @@
+#include "dynamic_bvh.hpp"
+
+#include "core/thread_pool.hpp"
+
+
+dynamic_bvh_t::dynamic_bvh_t(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, core::thread_pool_t& thread_pool, const dynamic_bvh_config_t& config)
+  : config(config), primitive_count(primitive_count), thread_pool(thread_pool) {
+    build(aabbs, centers);
+}
+
+dynamic_bvh_t::update_stats_t dynamic_bvh_t::update(const aabb_t *aabbs, const glm::vec3 *centers) {
+    update_stats_t stats{};
+    bvh.refit(aabbs, thread_pool);
+    measure_subtrees(aabbs);
+
+    std::vector<uint32_t> degraded;
+    for (uint32_t i = 0; i < subtree_roots.size(); i++) {
+        if (relative_subtree_cost(i) > reference_costs[i] * config.rebuild_threshold)
+            degraded.push_back(i);
+    }
+    if (!degraded.empty()) {
+        std::vector<uint32_t> node_indices;
+        for (uint32_t i : degraded)
+            node_indices.push_back(subtree_roots[i]);
+        bvh.rebuild(node_indices, aabbs, centers, thread_pool, config.build);
+
+        collect_subtrees();
+        assert(subtree_roots.size() == reference_costs.size());
+        measure_subtrees(aabbs);
+        for (uint32_t i : degraded) {
+            reference_costs[i] = relative_subtree_cost(i);
+            stats.rebuilt_primitives += subtree_primitive_counts[i];
+        }
+        stats.rebuilt_subtrees = degraded.size();
+    }
+
+    // the subtrees are fine on their own but are spread out badly, only a full build fixes the levels above them
+    stats.cost_growth = relative_cost() / reference_cost;
+    if (stats.cost_growth > config.rebuild_threshold) {
+        build(aabbs, centers);
+        stats.rebuilt_tree = true;
+        stats.rebuilt_subtrees = subtree_roots.size();
+        stats.rebuilt_primitives = primitive_count;
+    }
+    return stats;
+}
+
+void dynamic_bvh_t::build(const aabb_t *aabbs, const glm::vec3 *centers) {
+    bvh = bvh_t::build(aabbs, centers, primitive_count, thread_pool, config.build);
+    collect_subtrees();
+    measure_subtrees(aabbs);
+    reference_costs.resize(subtree_roots.size());
+    for (uint32_t i = 0; i < subtree_roots.size(); i++)
+        reference_costs[i] = relative_subtree_cost(i);
+    reference_cost = relative_cost();
+}
+
+void dynamic_bvh_t::collect_subtrees() {
+    // children come after their parent, so one backwards pass gives every subtree its primitive count
+    std::vector<uint32_t> primitive_counts(bvh.nodes.size());
+    for (uint32_t i = bvh.nodes.size(); i-- > 0;) {
+        const node_t& node = bvh.nodes[i];
+        primitive_counts[i] = node.is_leaf() ? node.primitive_count : primitive_counts[node.first_index] + primitive_counts[node.first_index + 1];
+    }
+
+    subtree_roots.clear();
+    subtree_primitive_counts.clear();
+    top_nodes.clear();
+    std::stack<uint32_t> stack;
+    stack.push(0);
+    while (!stack.empty()) {
+        uint32_t node_index = stack.top();
+        stack.pop();
+        const node_t& node = bvh.nodes[node_index];
+        if (node.is_leaf() || primitive_counts[node_index] <= config.subtree_primitives) {
+            subtree_roots.push_back(node_index);
+            subtree_primitive_counts.push_back(primitive_counts[node_index]);
+            continue;
+        }
+        top_nodes.push_back(node_index);
+        stack.push(node.first_index + 1);
+        stack.push(node.first_index);
+    }
+}
+
+void dynamic_bvh_t::measure_subtrees(const aabb_t *aabbs) {
+    subtree_costs.resize(subtree_roots.size());
+    subtree_areas.resize(subtree_roots.size());
+    thread_pool.parallel_for(0, subtree_roots.size(), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            // the same weights as bvh_t::sah_cost, without the division by the root area, which is 0 for a leaf of points
+            double cost = 0, area = 0;
+            std::stack<uint32_t> stack;
+            stack.push(subtree_roots[i]);
+            while (!stack.empty()) {
+                const node_t& node = bvh.nodes[stack.top()];
+                stack.pop();
+                if (node.is_leaf()) {
+                    cost += static_cast<double>(node.aabb.half_area()) * node.primitive_count;
+                    for (uint32_t j = 0; j < node.primitive_count; j++)
+                        area += aabbs[bvh.primitive_indices[node.first_index + j]].half_area();
+                } else {
+                    cost += static_cast<double>(node.aabb.half_area()) * config.build.traversal_cost;
+                    stack.push(node.first_index);
+                    stack.push(node.first_index + 1);
+                }
+            }
+            subtree_costs[i] = cost;
+            subtree_areas[i] = area;
+        }
+    });
+}
+
+float dynamic_bvh_t::relative_subtree_cost(uint32_t i) const {
+    return subtree_areas[i] > 0 ? subtree_costs[i] / subtree_areas[i] : 1.0f;
+}
+
+float dynamic_bvh_t::relative_cost() const {
+    // nodes above the subtrees are one traversal step each, like in bvh_t::sah_cost
+    double cost = 0, area = 0;
+    for (uint32_t node_index : top_nodes)
+        cost += bvh.nodes[node_index].aabb.half_area() * config.build.traversal_cost;
+    for (uint32_t i = 0; i < subtree_roots.size(); i++) {
+        cost += subtree_costs[i];
+        area += subtree_areas[i];
+    }
+    return area > 0 ? cost / area : 1.0f;
+}
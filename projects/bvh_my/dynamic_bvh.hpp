@@ -0,0 +1,64 @@
+#ifndef dynamic_bvh_hpp
+#define dynamic_bvh_hpp
+
+#include "bvh.hpp"
+
+// tuning of dynamic_bvh_t
+struct dynamic_bvh_config_t {
+    // a subtree is rebuilt once its sah cost grew by this factor over the cost it had right after its last build
+    // costs are taken relative to the summed primitive areas, so moving or scaling everything together does not count
+    float rebuild_threshold = 1.5f;
+    // the tree is cut into subtrees of at most this many primitives, each is tracked and rebuilt on its own
+    uint32_t subtree_primitives = 4096;
+    // used for the full builds, the subtree rebuilds and the cost they are compared by
+    build_config_t build = {};
+};
+
+// bvh over primitives that move every frame, e.g. skinned or simulated meshes
+// update refits the whole tree and only rebuilds the parts whose quality fell apart, the whole tree once the levels
+// above the tracked subtrees degraded too
+struct dynamic_bvh_t {
+    struct update_stats_t {
+        // sah cost of the tree relative to its cost right after the last full build, see dynamic_bvh_config_t
+        float cost_growth;
+        uint32_t rebuilt_subtrees;
+        uint32_t rebuilt_primitives;
+        bool rebuilt_tree;
+    };
+
+    // the pool is referenced and has to outlive the tree
+    dynamic_bvh_t(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, core::thread_pool_t& thread_pool, const dynamic_bvh_config_t& config = {});
+
+    // aabbs and centers are the moved primitives, in the same order as on construction
+    update_stats_t update(const aabb_t *aabbs, const glm::vec3 *centers);
+
+    bvh_t bvh;
+
+private:
+    void build(const aabb_t *aabbs, const glm::vec3 *centers);
+    // area weighted cost and primitive area of every tracked subtree
+    void measure_subtrees(const aabb_t *aabbs);
+    // cost of subtree i over its primitive area, 1 when its primitives are points or lines and have no area to measure
+    // against, so degenerate subtrees neither turn the comparisons into nan nor count as degraded on every update
+    float relative_subtree_cost(uint32_t i) const;
+    // cost of the whole tree over its primitive area, from the subtree measurements and the nodes above them, 1 when the
+    // primitives have no area
+    float relative_cost() const;
+    // finds the roots of the largest subtrees with at most config.subtree_primitives primitives and the nodes above them
+    // the roots come in depth first order, which rebuild keeps, so reference_costs stays paired with them
+    void collect_subtrees();
+
+    dynamic_bvh_config_t config;
+    uint32_t primitive_count;
+    core::thread_pool_t& thread_pool;
+    float reference_cost;
+    std::vector<uint32_t> subtree_roots;
+    std::vector<uint32_t> subtree_primitive_counts;
+    std::vector<double> subtree_costs;
+    std::vector<double> subtree_areas;
+    // subtree cost over subtree area right after the subtree was built
+    std::vector<float> reference_costs;
+    std::vector<uint32_t> top_nodes;
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "bvh_builder.hpp"
+
+#include "morton.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <bit>
+
+struct bvh_t::linear_builder_t {
+
+    struct cluster_t {
+        uint32_t internal_index;
+        uint32_t first, last;
+        aabb_t aabb;
+        glm::vec3 center;
+        // node the cluster subtree is emitted into, set by build_top_levels
+        uint32_t node_index;
+    };
+
+    bvh_t& bvh;
+    const aabb_t *aabbs;
+    const linear_build_config_t& config;
+    core::thread_pool_t& thread_pool;
+    core::task_group_t task_group{};
+    std::atomic<uint32_t> node_count = 1;
+    // radix tree in Karras layout, internal node i splits its range into [first, splits[i]] and [splits[i] + 1, last]
+    // the left child is internal node splits[i] and the right child internal node splits[i] + 1 unless they are single primitives
+    std::vector<uint32_t> splits;
+
+    template <typename key_t>
+    void build_radix_tree(const glm::vec3 *centers, uint32_t primitive_count);
+
+    // first and last are positions in morton order, leaves point offset further into primitive_indices
+    void emit(uint32_t node_index, uint32_t internal_index, uint32_t first, uint32_t last, uint32_t offset, uint32_t& subtree_node_count);
+    void emit_parallel(uint32_t node_index, uint32_t internal_index, uint32_t first, uint32_t last, uint32_t offset);
+    void collect_clusters(uint32_t internal_index, uint32_t first, uint32_t last, std::vector<cluster_t>& clusters) const;
+    void build_top_levels(uint32_t node_index, cluster_t *begin, cluster_t *end);
+};
+
+
+bvh_t bvh_t::build_linear(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, uint32_t thread_count, const linear_build_config_t& config) {
+    core::thread_pool_t thread_pool{ std::max(thread_count, 1u) };
+    return build_linear(aabbs, centers, primitive_count, thread_pool, config);
+}
+
+bvh_t bvh_t::build_linear(const aabb_t *aabbs, const glm::vec3 *centers, uint32_t primitive_count, core::thread_pool_t& thread_pool, const linear_build_config_t& config) {
+    assert(config.morton_bits == 30 || config.morton_bits == 63);
+    bvh_t bvh{};
+    // a leaf needs at least one primitive, emit would split single primitives otherwise
+    linear_build_config_t clamped_config = config;
+    clamped_config.max_leaf_primitives = std::max(config.max_leaf_primitives, 1u);
+    clamped_config.build = checked_config(config.build, "bvh_t::build_linear");
+    linear_builder_t builder{ .bvh = bvh, .aabbs = aabbs, .config = clamped_config, .thread_pool = thread_pool };
+
+    if (config.morton_bits == 30)
+        builder.build_radix_tree<uint32_t>(centers, primitive_count);
+    else
+        builder.build_radix_tree<uint64_t>(centers, primitive_count);
+
+    bvh.nodes.resize(2 * primitive_count - 1);
+    if (config.sah_cluster_size == 0 || primitive_count <= config.sah_cluster_size) {
+        builder.emit_parallel(0, 0, 0, primitive_count - 1, 0);
+    } else {
+        std::vector<linear_builder_t::cluster_t> clusters;
+        builder.collect_clusters(0, 0, primitive_count - 1, clusters);
+        thread_pool.parallel_for(0, clusters.size(), 256, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                auto& cluster = clusters[i];
+                cluster.aabb = aabb_t::empty();
+                for (uint32_t j = cluster.first; j <= cluster.last; j++)
+                    cluster.aabb.extend(aabbs[bvh.primitive_indices[j]]);
+                cluster.center = (cluster.aabb.min + cluster.aabb.max) * 0.5f;
+            }
+        });
+        builder.build_top_levels(0, clusters.data(), clusters.data() + clusters.size());
+
+        // the sah levels reorder the clusters, lay their primitives out in the new order so every subtree stays a contiguous range
+        std::vector<uint32_t> morton_order = std::move(bvh.primitive_indices);
+        bvh.primitive_indices.clear();
+        bvh.primitive_indices.reserve(primitive_count);
+        for (auto& cluster : clusters) {
+            uint32_t offset = bvh.primitive_indices.size() - cluster.first;
+            bvh.primitive_indices.insert(bvh.primitive_indices.end(), morton_order.begin() + cluster.first, morton_order.begin() + cluster.last + 1);
+            thread_pool.run(builder.task_group, [&builder, cluster, offset]() {
+                builder.emit_parallel(cluster.node_index, cluster.internal_index, cluster.first, cluster.last, offset);
+            });
+        }
+    }
+    thread_pool.wait(builder.task_group);
+
+    // subtrees reserve worst case node ranges like the parallel builder, compacting also puts children after their parents
+    reorder_depth_first(bvh);
+    bvh.refit(aabbs, thread_pool);
+    // every bit of the codes is split on before the leaves, so clustered or equal codes give chains as deep as the code is long
+    bvh.limit_depth(config.max_depth);
+    return bvh;
+}
+
+template <typename key_t>
+void bvh_t::linear_builder_t::build_radix_tree(const glm::vec3 *centers, uint32_t primitive_count) {
+    const uint32_t grain_size = config.build.parallel_grain_size;
+    const uint32_t chunk_count = (primitive_count + grain_size - 1) / grain_size;
+
+    std::vector<aabb_t> chunk_bounds(chunk_count, aabb_t::empty());
+    thread_pool.parallel_for(0, primitive_count, grain_size, [&](uint32_t begin, uint32_t end) {
+        aabb_t& bounds = chunk_bounds[begin / grain_size];
+        for (uint32_t i = begin; i < end; i++)
+            bounds.extend(centers[i]);
+    });
+    aabb_t bounds = aabb_t::empty();
+    for (auto& chunk : chunk_bounds)
+        bounds.extend(chunk);
+    const glm::vec3 extent = bounds.max - bounds.min;
+    const glm::vec3 scale{ extent.x > 0 ? 1.0f / extent.x : 0.0f, extent.y > 0 ? 1.0f / extent.y : 0.0f, extent.z > 0 ? 1.0f / extent.z : 0.0f };
+
+    std::vector<key_t> keys(primitive_count);
+    bvh.primitive_indices.resize(primitive_count);
+    thread_pool.parallel_for(0, primitive_count, grain_size, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            keys[i] = morton_code<key_t>((centers[i] - bounds.min) * scale);
+            bvh.primitive_indices[i] = i;
+        }
+    });
+    radix_sort(thread_pool, grain_size, keys, bvh.primitive_indices);
+
+    // length of the common prefix of keys i and j, duplicate keys are told apart by their position
+    constexpr int key_bits = sizeof(key_t) * 8;
+    const int64_t n = primitive_count;
+    auto delta = [&](int64_t i, int64_t j) -> int {
+        if (j < 0 || j >= n)
+            return -1;
+        if (keys[i] == keys[j])
+            return key_bits + std::countl_zero(static_cast<uint32_t>(i ^ j));
+        return std::countl_zero(static_cast<key_t>(keys[i] ^ keys[j]));
+    };
+
+    // every internal node finds its range and split on its own, no node depends on another
+    splits.resize(primitive_count - 1);
+    thread_pool.parallel_for(0, primitive_count - 1, grain_size, [&](uint32_t begin, uint32_t end) {
+        for (int64_t i = begin; i < end; i++) {
+            // the range grows towards the neighbour sharing the longer prefix
+            const int64_t d = delta(i, i + 1) - delta(i, i - 1) > 0 ? 1 : -1;
+            const int delta_min = delta(i, i - d);
+
+            int64_t length_max = 2;
+            while (delta(i, i + length_max * d) > delta_min)
+                length_max *= 2;
+            int64_t length = 0;
+            for (int64_t t = length_max / 2; t >= 1; t /= 2)
+                if (delta(i, i + (length + t) * d) > delta_min)
+                    length += t;
+            const int64_t j = i + length * d;
+
+            // binary search for the last key sharing the node prefix plus one bit
+            const int delta_node = delta(i, j);
+            int64_t s = 0;
+            int64_t t = length;
+            do {
+                t = (t + 1) / 2;
+                if (delta(i, i + (s + t) * d) > delta_node)
+                    s += t;
+            } while (t > 1);
+            splits[i] = static_cast<uint32_t>(i + s * d + std::min<int64_t>(d, 0));
+        }
+    });
+}
+
+void bvh_t::linear_builder_t::emit(uint32_t node_index, uint32_t internal_index, uint32_t first, uint32_t last, uint32_t offset, uint32_t& subtree_node_count) {
+    node_t& node = bvh.nodes[node_index];
+    // every subtree is a contiguous range of the morton order, offset moves it to where its cluster sits in primitive_indices
+    if (last - first < config.max_leaf_primitives) {
+        node.first_index = first + offset;
+        node.primitive_count = last - first + 1;
+        return;
+    }
+
+    const uint32_t split = splits[internal_index];
+    const uint32_t first_child = subtree_node_count;
+    subtree_node_count += 2;
+    node.first_index = first_child;
+    node.primitive_count = 0;
+    emit(first_child, split, first, split, offset, subtree_node_count);
+    emit(first_child + 1, split + 1, split + 1, last, offset, subtree_node_count);
+}
+
+void bvh_t::linear_builder_t::emit_parallel(uint32_t node_index, uint32_t internal_index, uint32_t first, uint32_t last, uint32_t offset) {
+    const uint32_t primitive_count = last - first + 1;
+    if (primitive_count < config.build.parallel_task_threshold) {
+        uint32_t subtree_node_count = node_count.fetch_add(2 * primitive_count - 2, std::memory_order_relaxed);
+        emit(node_index, internal_index, first, last, offset, subtree_node_count);
+        return;
+    }
+
+    const uint32_t split = splits[internal_index];
+    const uint32_t first_child = node_count.fetch_add(2, std::memory_order_relaxed);
+    node_t& node = bvh.nodes[node_index];
+    node.first_index = first_child;
+    node.primitive_count = 0;
+    thread_pool.run(task_group, [this, first_child, split, last, offset]() {
+        emit_parallel(first_child + 1, split + 1, split + 1, last, offset);
+    });
+    emit_parallel(first_child, split, first, split, offset);
+}
+
+void bvh_t::linear_builder_t::collect_clusters(uint32_t internal_index, uint32_t first, uint32_t last, std::vector<cluster_t>& clusters) const {
+    if (last - first < config.sah_cluster_size) {
+        clusters.push_back({ internal_index, first, last });
+        return;
+    }
+    const uint32_t split = splits[internal_index];
+    collect_clusters(split, first, split, clusters);
+    collect_clusters(split + 1, split + 1, last, clusters);
+}
+
+void bvh_t::linear_builder_t::build_top_levels(uint32_t node_index, cluster_t *begin, cluster_t *end) {
+    if (end - begin == 1) {
+        begin->node_index = node_index;
+        return;
+    }
+
+    aabb_t aabb = aabb_t::empty();
+    for (cluster_t *cluster = begin; cluster != end; cluster++)
+        aabb.extend(cluster->aabb);
+
+    // same binned sweep as build, on cluster bounds instead of primitive bounds
+    split_t min_split{};
+    bin_t bins[build_config_t::max_bin_count];
+    for (int axis = 0; axis < 3; axis++) {
+        if (aabb.max[axis] <= aabb.min[axis])
+            continue;
+        std::fill(bins, bins + config.build.bin_count, bin_t{});
+        for (cluster_t *cluster = begin; cluster != end; cluster++) {
+            bin_t& bin = bins[bin_t::bin_index(axis, aabb, cluster->center, config.build.bin_count)];
+            bin.aabb.extend(cluster->aabb);
+            bin.primitive_count += cluster->last - cluster->first + 1;
+        }
+        min_split = std::min(min_split, split_t::find_best_split(axis, bins, config.build));
+    }
+
+    cluster_t *middle = begin;
+    if (min_split) {
+        middle = std::partition(begin, end, [&](const cluster_t& cluster) {
+            return bin_t::bin_index(min_split.axis, aabb, cluster.center, config.build.bin_count) < min_split.right_bin;
+        });
+    }
+    // clusters do not become leaves, so a split that leaves one side empty falls back to the median
+    if (middle == begin || middle == end) {
+        int axis = aabb.largest_axis();
+        middle = begin + (end - begin) / 2;
+        std::nth_element(begin, middle, end, [&](const cluster_t& a, const cluster_t& b) { return a.center[axis] < b.center[axis]; });
+    }
+
+    const uint32_t first_child = node_count.fetch_add(2, std::memory_order_relaxed);
+    node_t& node = bvh.nodes[node_index];
+    node.first_index = first_child;
+    node.primitive_count = 0;
+    build_top_levels(first_child, begin, middle);
+    build_top_levels(first_child + 1, middle, end);
+}
@@ -5,6 +5,7 @@
 #include "core/mesh.hpp"
 #include "core/material.hpp"
 #include "core/model.hpp"
+#include "core/thread_pool.hpp"
 
 #include "gfx/vulkan/context.hpp"
 #include "gfx/vulkan/pipeline.hpp"
@@ -24,6 +25,10 @@
 #include "editor_camera.hpp"
 
 #include "bvh.hpp"
+#include "compressed_bvh.hpp"
+#include "bvh_cache.hpp"
+#include "bvh_stats.hpp"
+#include "cpu_renderer.hpp"
 #include "core/model.hpp"
 
 #include <glm/gtx/string_cast.hpp>
@@ -32,6 +37,9 @@
 #include <iostream>
 #include <algorithm>
 #include <chrono>
+#include <thread>
+#include <filesystem>
+#include <cstdio>
 
 int main(int argc, char **argv) {
 
@@ -39,9 +47,25 @@ int main(int argc, char **argv) {
     auto context = std::make_shared<gfx::vulkan::context_t>(window, 1, true);
     core::ImGui_init(window, context);
 
-    auto model = core::load_model_from_path("../../assets/models/cornell_box.obj");
-    std::vector<triangle_t> triangles;
-    {
+    // the mapped cache replaces both the assimp import and the build, it is keyed on the model files and the build config
+    const std::filesystem::path model_path = "../../assets/models/cornell_box.obj";
+    const build_config_t build_config{};
+    const uint64_t cache_key = bvh_cache_key(bvh_cache_sources(model_path), bvh_build_settings(build_config));
+    char cache_name[32];
+    std::snprintf(cache_name, sizeof(cache_name), "%016llx.bvh", static_cast<unsigned long long>(cache_key));
+    const std::filesystem::path cache_path = std::filesystem::path{ "cache" } / cache_name;
+
+    std::optional<mapped_bvh_cache_t> cache = mapped_bvh_cache_t::open(cache_path, cache_key);
+    std::vector<triangle_t> loaded_triangles;
+    bvh_t built_bvh;
+    std::span<const triangle_t> triangles;
+    bvh_view_t bvh;
+    if (cache) {
+        triangles = cache->triangles;
+        bvh = cache->bvh;
+        std::cout << "Mapped BVH cache " << cache_path << " with " << triangles.size() << " triangle(s), " << bvh.nodes.size() << " node(s)" << std::endl;
+    } else {
+        auto model = core::load_model_from_path(model_path);
         for (auto mesh : model.meshes) {
             assert(mesh.indices.size() % 3 == 0);
             for (uint32_t i = 0; i < mesh.indices.size(); i+=3) {
@@ -54,29 +78,42 @@ int main(int argc, char **argv) {
                 triangle.p1 = v1.position;
                 triangle.p2 = v2.position;
 
-                triangles.push_back(triangle);
+                loaded_triangles.push_back(triangle);
 
             }
         }
-    }
 
-    std::cout << "Loaded file with " << triangles.size() << " triangle(s)" << std::endl;
+        std::cout << "Loaded file with " << loaded_triangles.size() << " triangle(s)" << std::endl;
 
-    std::vector<aabb_t> aabbs(triangles.size());
-    std::vector<glm::vec3> centers(triangles.size());
+        std::vector<aabb_t> aabbs(loaded_triangles.size());
+        std::vector<glm::vec3> centers(loaded_triangles.size());
 
-    for (uint32_t i = 0; i < triangles.size(); i++) {
-        aabbs[i] = aabb_t{}.extend(triangles[i].p0).extend(triangles[i].p1).extend(triangles[i].p2);
-        centers[i] = (triangles[i].p0 + triangles[i].p1 + triangles[i].p2) / 3.0f;            
-    }
+        for (uint32_t i = 0; i < loaded_triangles.size(); i++) {
+            aabbs[i] = aabb_t{}.extend(loaded_triangles[i].p0).extend(loaded_triangles[i].p1).extend(loaded_triangles[i].p2);
+            centers[i] = (loaded_triangles[i].p0 + loaded_triangles[i].p1 + loaded_triangles[i].p2) / 3.0f;            
+        }
 
-    bvh_t bvh = bvh_t::build(aabbs.data(), centers.data(), triangles.size());
-    std::cout << "Built BVH with " << bvh.nodes.size() << " node(s), depth " << bvh.depth() << std::endl;
+        built_bvh = bvh_t::build(aabbs.data(), centers.data(), loaded_triangles.size(), std::thread::hardware_concurrency(), build_config);
+        std::cout << "Built BVH with " << built_bvh.nodes.size() << " node(s), depth " << built_bvh.depth() << std::endl;
+        if (cache_key != 0 && !write_bvh_cache(cache_path, cache_key, built_bvh, loaded_triangles))
+            std::cout << "Failed to write BVH cache " << cache_path << std::endl;
 
-    for (auto node : bvh.nodes) {
-        std::cout << glm::to_string(node.aabb.min) << " " << glm::to_string(node.aabb.max) << " " << node.primitive_count << " " << node.first_index << '\n';
+        triangles = loaded_triangles;
+        bvh = built_bvh.view();
     }
 
+    compressed_bvh_t compressed_bvh = compressed_bvh_t::compress(bvh4_t::collapse(bvh));
+    std::cout << "Compressed BVH to " << compressed_bvh.nodes.size() << " node(s), " 
+              << compressed_bvh.nodes.size() * sizeof(compressed_node_t) << " byte(s) vs " << bvh.nodes.size() * sizeof(node_t) << " byte(s)" << std::endl;
+    // the shader stack only covers max_gpu_depth, a deeper tree would drop subtrees
+    const bool compressed_bvh_fits = compressed_bvh.depth() <= compressed_bvh_t::max_gpu_depth;
+    if (!compressed_bvh_fits)
+        std::cout << "Compressed BVH depth " << compressed_bvh.depth() << " exceeds the shader stack, the compressed path is disabled" << std::endl;
+
+    // epo is left out, it clips every triangle against the boxes and takes long on big models, bvh_raycast --report has it
+    bvh_stats_t::compute(bvh).write_json(std::cout);
+    std::cout << std::endl;
+
     struct aabb_vis_vertex_t {
         glm::vec3 vertex;
     };
@@ -126,6 +163,7 @@ int main(int argc, char **argv) {
         .addLayoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
         .addLayoutBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
         .addLayoutBinding(3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .addLayoutBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
         .build(context);
 
     auto rt_ds = rt_dsl->new_descriptor_set();
@@ -136,6 +174,9 @@ int main(int argc, char **argv) {
     auto nodes_buffer = gfx::vulkan::buffer_builder_t{}
         .build(context, bvh.nodes.size() * sizeof(node_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
+    auto compressed_nodes_buffer = gfx::vulkan::buffer_builder_t{}
+        .build(context, compressed_bvh.nodes.size() * sizeof(compressed_node_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
     auto indices_buffer = gfx::vulkan::buffer_builder_t{}
         .build(context, bvh.primitive_indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
@@ -149,6 +190,7 @@ int main(int argc, char **argv) {
         glm::vec3 dir;
         glm::vec3 up;
         glm::vec3 right;
+        int use_compressed_bvh;
     };
 
     auto ubo_buffer = gfx::vulkan::buffer_builder_t{}
@@ -159,10 +201,12 @@ int main(int argc, char **argv) {
         .pushBufferInfo(1, 1, nodes_buffer->descriptor_info(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
         .pushBufferInfo(2, 1, indices_buffer->descriptor_info(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
         .pushBufferInfo(3, 1, ubo_buffer->descriptor_info())
+        .pushBufferInfo(4, 1, compressed_nodes_buffer->descriptor_info(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
         .update();
 
     std::memcpy(triangles_buffer->map(), triangles.data(), triangles.size() * sizeof(triangle_t));
     std::memcpy(nodes_buffer->map(), bvh.nodes.data(), bvh.nodes.size() * sizeof(node_t));
+    std::memcpy(compressed_nodes_buffer->map(), compressed_bvh.nodes.data(), compressed_bvh.nodes.size() * sizeof(compressed_node_t));
     std::memcpy(indices_buffer->map(), bvh.primitive_indices.data(), bvh.primitive_indices.size() * sizeof(uint32_t));
     auto ubo = reinterpret_cast<ubo_t *>(ubo_buffer->map());
 
@@ -183,6 +227,35 @@ int main(int argc, char **argv) {
         .pushImageInfo(0, 1, rt_image->descriptor_info(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL))
         .update();
 
+    // cpu path tracer, replaces the rt image in the view window while enabled
+    // samples render on the pool while the frames keep showing the last finished one, at least one worker so a sample
+    // makes progress without the frame loop waiting on it
+    core::thread_pool_t cpu_thread_pool{ std::max(std::thread::hardware_concurrency(), 2u) };
+    cpu_renderer_t cpu_renderer{ bvh, triangles, cpu_thread_pool };
+    cpu_renderer.resize(width, height);
+    cpu_renderer_t::render_stats_t cpu_render_stats{};
+    bool use_cpu_renderer = false;
+    bool cpu_render_pending = false;
+
+    auto cpu_image = gfx::vulkan::image_builder_t{}
+        .build2D(context, width, height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    cpu_image->transition_layout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // a sample resolves into one staging buffer while the other one is copied to cpu_image
+    core::ref<gfx::vulkan::buffer_t> cpu_staging_buffers[2];
+    uint8_t *cpu_pixels[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        cpu_staging_buffers[i] = gfx::vulkan::buffer_builder_t{}
+            .build(context, width * height * 4, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        cpu_pixels[i] = reinterpret_cast<uint8_t *>(cpu_staging_buffers[i]->map());
+    }
+    uint32_t cpu_staging_index = 0;
+
+    auto cpu_ds = imgui_dsl->new_descriptor_set();
+    cpu_ds->write()
+        .pushImageInfo(0, 1, cpu_image->descriptor_info(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL))
+        .update();
+
         
     glm::vec3 eye{ 0, 1, 3 };
     glm::vec3 dir{ 0, 0, -1 };
@@ -192,6 +265,10 @@ int main(int argc, char **argv) {
     auto right = glm::normalize(glm::cross(dir, up));
     up = glm::cross(right, dir);
 
+    bool use_compressed_bvh = false;
+    // node order of the nodes_ssbo upload, the rt timer compares how the shader traverses each
+    int node_layout = static_cast<int>(node_layout_t::depth_first);
+
     float target_FPS = 1000.f;
     auto last_time = std::chrono::system_clock::now();
     while (!window->should_close()) {
@@ -215,6 +292,7 @@ int main(int argc, char **argv) {
         ubo->up = up;
         ubo->right = right;
         ubo->num_tris = triangles.size();
+        ubo->use_compressed_bvh = use_compressed_bvh;
 
         if (auto start_frame = context->start_frame()) {
             auto [commandbuffer, current_index] = *start_frame;
@@ -235,6 +313,33 @@ int main(int argc, char **argv) {
             swapchain_scissor.offset = {0, 0};
             swapchain_scissor.extent = context->swapchain_extent();
 
+            // a finished sample is copied from the buffer it resolved into and the next one starts on the other buffer, which
+            // was last copied from in an earlier frame, and the single frame in flight has finished that copy by now
+            if (cpu_render_pending && cpu_renderer.async_done()) {
+                cpu_render_stats = cpu_renderer.async_wait();
+                cpu_render_pending = false;
+                cpu_image->transition_layout(commandbuffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+                gfx::vulkan::image_t::copy_buffer_to_image(commandbuffer, *cpu_staging_buffers[cpu_staging_index], *cpu_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VkBufferImageCopy{
+                    .bufferOffset = 0,
+                    .bufferRowLength = 0,
+                    .bufferImageHeight = 0,
+                    .imageSubresource = {
+                        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                        .mipLevel = 0,
+                        .baseArrayLayer = 0,
+                        .layerCount = 1,
+                    },
+                    .imageOffset = {0, 0, 0},
+                    .imageExtent = {cpu_renderer.width(), cpu_renderer.height(), 1}
+                });
+                cpu_image->transition_layout(commandbuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                cpu_staging_index ^= 1;
+            }
+            if (use_cpu_renderer && !cpu_render_pending) {
+                cpu_renderer.render_async(ubo->inverse_view, ubo->inverse_projection, cpu_pixels[cpu_staging_index]);
+                cpu_render_pending = true;
+            }
+
             rt_timer->begin(commandbuffer);
             rt_renderpass->begin(commandbuffer, rt_framebuffer->framebuffer(), VkRect2D{
                 .offset = {0, 0},
@@ -260,11 +365,37 @@ int main(int argc, char **argv) {
             core::ImGui_newframe();
 
             ImGui::Begin("view");
-            ImGui::Image(reinterpret_cast<ImTextureID>(reinterpret_cast<void *>(imgui_ds->descriptor_set())), ImGui::GetContentRegionAvail(), {0, 1}, {1, 0});
+            auto& view_ds = use_cpu_renderer ? cpu_ds : imgui_ds;
+            ImGui::Image(reinterpret_cast<ImTextureID>(reinterpret_cast<void *>(view_ds->descriptor_set())), ImGui::GetContentRegionAvail(), {0, 1}, {1, 0});
             ImGui::End();
 
             ImGui::Begin("debug");
             ImGui::Text("%f", ImGui::GetIO().Framerate);
+            if (auto t = rt_timer->get_time()) {
+                ImGui::Text("rt: %f ms", *t);
+            } else {
+                ImGui::Text("rt: undefined");
+            }
+            if (compressed_bvh_fits)
+                ImGui::Checkbox("compressed bvh", &use_compressed_bvh);
+            else
+                ImGui::Text("compressed bvh: too deep for the shader");
+            if (ImGui::Combo("node layout", &node_layout, "depth first\0breadth first\0van emde boas\0")) {
+                // same node count in every layout, the frame using the buffer has not been submitted yet
+                bvh_t laid_out_bvh{};
+                laid_out_bvh.nodes.assign(bvh.nodes.begin(), bvh.nodes.end());
+                laid_out_bvh.relayout(static_cast<node_layout_t>(node_layout));
+                std::memcpy(nodes_buffer->map(), laid_out_bvh.nodes.data(), laid_out_bvh.nodes.size() * sizeof(node_t));
+            }
+            ImGui::Checkbox("cpu renderer", &use_cpu_renderer);
+            if (use_cpu_renderer) {
+                ImGui::Text("cpu: %u sample(s), %f ms, %.1f%% utilization", cpu_render_stats.sample_count, cpu_render_stats.render_ms, cpu_render_stats.utilization() * 100.0);
+                for (uint32_t i = 0; i < cpu_render_stats.threads.size(); i++) {
+                    auto& thread = cpu_render_stats.threads[i];
+                    ImGui::Text("thread %u: %u tile(s), %llu steal(s), %.1f%% busy", i, thread.tiles, static_cast<unsigned long long>(thread.stolen),
+                                cpu_render_stats.render_ms > 0 ? thread.busy_ms / cpu_render_stats.render_ms * 100.0 : 0.0);
+                }
+            }
             ImGui::End();
 
             core::ImGui_endframe(commandbuffer);
@@ -316,6 +447,8 @@ int main(int argc, char **argv) {
     // std::cout << "Image saved as " << "out.ppm" << std::endl;
 
 
+    // the sample still rendering writes into a staging buffer
+    cpu_renderer.async_wait();
     context->wait_idle();
 
     core::ImGui_shutdown();
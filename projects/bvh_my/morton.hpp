@@ -0,0 +1,90 @@
+#ifndef morton_hpp
+#define morton_hpp
+
+#include "core/thread_pool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// spreads the low 10 bits of x so two zero bits sit between each of them
+inline uint32_t expand_bits(uint32_t x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// same for the low 21 bits
+inline uint64_t expand_bits(uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | (x << 32)) & 0x001f00000000ffff;
+    x = (x | (x << 16)) & 0x001f0000ff0000ff;
+    x = (x | (x << 8)) & 0x100f00f00f00f00f;
+    x = (x | (x << 4)) & 0x10c30c30c30c30c3;
+    x = (x | (x << 2)) & 0x1249249249249249;
+    return x;
+}
+
+// point has to be normalized to the unit cube, 30 bit codes for uint32_t and 63 bit codes for uint64_t
+template <typename key_t>
+key_t morton_code(const glm::vec3& point) {
+    constexpr float scale = sizeof(key_t) == 4 ? 1023.0f : 2097151.0f;
+    glm::vec3 p = glm::clamp(point * scale, 0.0f, scale);
+    return (expand_bits(static_cast<key_t>(p.x)) << 2) | (expand_bits(static_cast<key_t>(p.y)) << 1) | expand_bits(static_cast<key_t>(p.z));
+}
+
+// stable lsd radix sort of keys carrying values along, 8 bits per pass with chunks of grain_size spread over the pool
+template <typename key_t>
+void radix_sort(core::thread_pool_t& thread_pool, uint32_t grain_size, std::vector<key_t>& keys, std::vector<uint32_t>& values) {
+    constexpr uint32_t radix = 256;
+    const uint32_t count = keys.size();
+    const uint32_t chunk_count = (count + grain_size - 1) / grain_size;
+
+    std::vector<key_t> sorted_keys(count);
+    std::vector<uint32_t> sorted_values(count);
+    // per chunk histograms, turned into per chunk scatter offsets
+    std::vector<uint32_t> offsets(chunk_count * radix);
+
+    for (uint32_t shift = 0; shift < sizeof(key_t) * 8; shift += 8) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        thread_pool.parallel_for(0, count, grain_size, [&](uint32_t begin, uint32_t end) {
+            uint32_t *histogram = offsets.data() + begin / grain_size * radix;
+            for (uint32_t i = begin; i < end; i++)
+                histogram[(keys[i] >> shift) & (radix - 1)]++;
+        });
+
+        // digit major prefix sum, earlier chunks scatter first so the pass is stable
+        bool single_digit = false;
+        uint32_t sum = 0;
+        for (uint32_t digit = 0; digit < radix; digit++) {
+            uint32_t digit_count = 0;
+            for (uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+                uint32_t& offset = offsets[chunk * radix + digit];
+                digit_count += offset;
+                std::swap(offset, sum);
+                sum += offset;
+            }
+            single_digit |= digit_count == count;
+        }
+        // every key has the same digit, the pass would not move anything
+        if (single_digit)
+            continue;
+
+        thread_pool.parallel_for(0, count, grain_size, [&](uint32_t begin, uint32_t end) {
+            uint32_t *offset = offsets.data() + begin / grain_size * radix;
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t j = offset[(keys[i] >> shift) & (radix - 1)]++;
+                sorted_keys[j] = keys[i];
+                sorted_values[j] = values[i];
+            }
+        });
+        keys.swap(sorted_keys);
+        values.swap(sorted_values);
+    }
+}
+
+#endif
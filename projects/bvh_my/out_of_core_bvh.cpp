@@ -0,0 +1,438 @@
+#include "out_of_core_bvh.hpp"
+
+#include "morton.hpp"
+
+#include <cstring>
+#include <list>
+#include <mutex>
+
+namespace {
+
+// levels of the morton grid the partitions are cut from, 2^18 cells
+constexpr uint32_t grid_bits = 18;
+
+// a triangle on its way to its partition, with its index in the source
+struct record_t {
+    triangle_t triangle;
+    uint32_t id;
+};
+
+uint64_t align_up(uint64_t offset) {
+    return (offset + out_of_core_header_t::alignment - 1) / out_of_core_header_t::alignment * out_of_core_header_t::alignment;
+}
+
+glm::vec3 center(const triangle_t& triangle) {
+    return (triangle.p0 + triangle.p1 + triangle.p2) * (1.0f / 3.0f);
+}
+
+// calls fn(index, triangle) for every triangle of the source in order
+template <typename fn_t>
+uint64_t stream(const triangle_source_t& source, uint32_t read_chunk, const fn_t& fn) {
+    std::vector<triangle_t> chunk(read_chunk);
+    uint64_t first = 0;
+    while (true) {
+        uint32_t count = source(first, chunk);
+        for (uint32_t i = 0; i < count; i++)
+            fn(first + i, chunk[i]);
+        first += count;
+        if (count < read_chunk)
+            return first;
+    }
+}
+
+// memory a resident partition takes
+uint64_t size_bytes(const out_of_core_partition_t& partition) {
+    return partition.node_count * sizeof(node_t) + partition.triangle_count * (sizeof(triangle_t) + sizeof(uint32_t));
+}
+
+template <typename element_t>
+bool read_array(std::ifstream& file, uint64_t offset, std::vector<element_t>& elements, uint64_t count) {
+    elements.resize(count);
+    file.seekg(offset);
+    file.read(reinterpret_cast<char *>(elements.data()), count * sizeof(element_t));
+    return static_cast<bool>(file);
+}
+
+// the file is only trusted as far as its array bounds, a corrupt node could still point a leaf past the partition's
+// triangles or an internal node back up the tree, where the traversal would loop
+bool valid_nodes(const std::vector<node_t>& nodes, uint64_t triangle_count) {
+    for (uint64_t i = 0; i < nodes.size(); i++) {
+        const node_t& node = nodes[i];
+        bool valid = node.is_leaf()
+            ? node.first_index <= triangle_count && node.primitive_count <= triangle_count - node.first_index
+            : node.first_index > i && node.first_index < nodes.size() - 1;
+        if (!valid)
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+struct out_of_core_bvh_t::cache_t {
+    std::mutex mutex;
+    uint64_t memory_budget;
+    std::vector<std::shared_ptr<const partition_data_t>> resident;
+    // front is the most recently used, positions[i] is valid while partition i is resident
+    std::list<uint32_t> lru;
+    std::vector<std::list<uint32_t>::iterator> positions;
+    out_of_core_stats_t stats{};
+};
+
+bool out_of_core_bvh_t::build(const std::filesystem::path& file_path, const triangle_source_t& source, const out_of_core_config_t& config) {
+    // centroid bounds, the grid spans them
+    aabb_t bounds = aabb_t::empty();
+    const uint64_t triangle_count = stream(source, config.read_chunk, [&](uint64_t, const triangle_t& triangle) { bounds.extend(center(triangle)); });
+    // ids are 32 bit like every primitive index
+    if (triangle_count == 0 || triangle_count > std::numeric_limits<uint32_t>::max())
+        return false;
+    const glm::vec3 extent = bounds.max - bounds.min;
+    const glm::vec3 scale{ extent.x > 0 ? 1.0f / extent.x : 0.0f, extent.y > 0 ? 1.0f / extent.y : 0.0f, extent.z > 0 ? 1.0f / extent.z : 0.0f };
+    auto cell = [&](const triangle_t& triangle) { return morton_code<uint32_t>((center(triangle) - bounds.min) * scale) >> (30 - grid_bits); };
+
+    // consecutive cells in morton order are close in space, so cutting the histogram into runs of about
+    // partition_triangles gives compact partitions without holding the triangles
+    std::vector<uint32_t> cell_counts(1u << grid_bits, 0);
+    stream(source, config.read_chunk, [&](uint64_t, const triangle_t& triangle) { cell_counts[cell(triangle)]++; });
+    std::vector<uint32_t> cell_partitions(cell_counts.size());
+    // first record of every partition in the temporary file, one past the end at the back
+    std::vector<uint64_t> partition_firsts{ 0 };
+    uint64_t partition_size = 0;
+    for (uint32_t i = 0; i < cell_counts.size(); i++) {
+        if (partition_size != 0 && partition_size + cell_counts[i] > config.partition_triangles) {
+            partition_firsts.push_back(partition_firsts.back() + partition_size);
+            partition_size = 0;
+        }
+        cell_partitions[i] = partition_firsts.size() - 1;
+        partition_size += cell_counts[i];
+    }
+    partition_firsts.push_back(triangle_count);
+    const uint32_t partition_count = partition_firsts.size() - 1;
+
+    std::error_code error;
+    if (file_path.has_parent_path())
+        std::filesystem::create_directories(file_path.parent_path(), error);
+    std::filesystem::path records_path = file_path, temporary_path = file_path;
+    records_path += ".records";
+    temporary_path += ".tmp";
+    auto fail = [&]() {
+        std::filesystem::remove(records_path, error);
+        std::filesystem::remove(temporary_path, error);
+        return false;
+    };
+
+    // every partition buffers a few records and writes them to its range of the records file when full
+    {
+        constexpr uint32_t buffer_size = 1024;
+        std::ofstream records{ records_path, std::ios::binary | std::ios::trunc };
+        if (!records)
+            return fail();
+        std::vector<record_t> buffers(static_cast<size_t>(partition_count) * buffer_size);
+        std::vector<uint32_t> buffered(partition_count, 0);
+        std::vector<uint64_t> written(partition_firsts.begin(), partition_firsts.end() - 1);
+        auto flush = [&](uint32_t partition_index) {
+            records.seekp(written[partition_index] * sizeof(record_t));
+            records.write(reinterpret_cast<const char *>(&buffers[static_cast<size_t>(partition_index) * buffer_size]), buffered[partition_index] * sizeof(record_t));
+            written[partition_index] += buffered[partition_index];
+            buffered[partition_index] = 0;
+        };
+        stream(source, config.read_chunk, [&](uint64_t index, const triangle_t& triangle) {
+            uint32_t partition_index = cell_partitions[cell(triangle)];
+            buffers[static_cast<size_t>(partition_index) * buffer_size + buffered[partition_index]++] = { triangle, static_cast<uint32_t>(index) };
+            if (buffered[partition_index] == buffer_size)
+                flush(partition_index);
+        });
+        for (uint32_t i = 0; i < partition_count; i++)
+            flush(i);
+        if (!records)
+            return fail();
+    }
+
+    // one partition in memory at a time, built, put in leaf order and appended
+    out_of_core_header_t header{};
+    std::memcpy(header.magic, out_of_core_header_t::magic_value, sizeof(header.magic));
+    header.version = out_of_core_header_t::current_version;
+    header.node_size = sizeof(node_t);
+    header.triangle_size = sizeof(triangle_t);
+    header.partition_count = partition_count;
+    header.triangle_count = triangle_count;
+    header.partitions_offset = align_up(sizeof(out_of_core_header_t));
+    std::vector<out_of_core_partition_t> partitions(partition_count);
+
+    {
+        std::ifstream records{ records_path, std::ios::binary };
+        std::ofstream file{ temporary_path, std::ios::binary | std::ios::trunc };
+        if (!records || !file)
+            return fail();
+        uint64_t offset = align_up(header.partitions_offset + partition_count * sizeof(out_of_core_partition_t));
+        auto append = [&](const void *data, uint64_t size) {
+            static constexpr char zeros[out_of_core_header_t::alignment]{};
+            file.seekp(offset);
+            file.write(reinterpret_cast<const char *>(data), size);
+            uint64_t start = offset;
+            offset = align_up(offset + size);
+            file.write(zeros, offset - start - size);
+            return start;
+        };
+
+        std::vector<record_t> partition_records;
+        std::vector<aabb_t> aabbs;
+        std::vector<glm::vec3> centers;
+        std::vector<triangle_t> triangles;
+        std::vector<uint32_t> ids;
+        for (uint32_t partition_index = 0; partition_index < partition_count; partition_index++) {
+            const uint64_t first = partition_firsts[partition_index];
+            const uint32_t count = partition_firsts[partition_index + 1] - first;
+            out_of_core_partition_t& partition = partitions[partition_index];
+            // a partition is only cut off in front of a cell with triangles in it, so none is empty
+            assert(count != 0);
+            if (!read_array(records, first * sizeof(record_t), partition_records, count))
+                return fail();
+
+            aabbs.resize(count);
+            centers.resize(count);
+            for (uint32_t i = 0; i < count; i++) {
+                const triangle_t& triangle = partition_records[i].triangle;
+                aabbs[i] = aabb_t::empty();
+                aabbs[i].extend(triangle.p0).extend(triangle.p1).extend(triangle.p2);
+                centers[i] = center(triangle);
+            }
+            bvh_t bvh = bvh_t::build(aabbs.data(), centers.data(), count, config.thread_count);
+            triangles.resize(count);
+            ids.resize(count);
+            for (uint32_t i = 0; i < count; i++) {
+                triangles[i] = partition_records[bvh.primitive_indices[i]].triangle;
+                ids[i] = partition_records[bvh.primitive_indices[i]].id;
+            }
+
+            partition.aabb = bvh.nodes[0].aabb;
+            partition.node_count = bvh.nodes.size();
+            partition.triangle_count = count;
+            partition.nodes_offset = append(bvh.nodes.data(), bvh.nodes.size() * sizeof(node_t));
+            partition.triangles_offset = append(triangles.data(), count * sizeof(triangle_t));
+            partition.ids_offset = append(ids.data(), count * sizeof(uint32_t));
+        }
+
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.seekp(header.partitions_offset);
+        file.write(reinterpret_cast<const char *>(partitions.data()), partition_count * sizeof(out_of_core_partition_t));
+        if (!file)
+            return fail();
+    }
+
+    std::filesystem::remove(records_path, error);
+    std::filesystem::rename(temporary_path, file_path, error);
+    if (error)
+        return fail();
+    return true;
+}
+
+std::optional<out_of_core_bvh_t> out_of_core_bvh_t::open(const std::filesystem::path& file_path, uint64_t memory_budget) {
+    std::ifstream file{ file_path, std::ios::binary };
+    if (!file)
+        return std::nullopt;
+    file.seekg(0, std::ios::end);
+    const uint64_t size = file.tellg();
+    file.seekg(0);
+
+    out_of_core_header_t header;
+    if (size < sizeof(header) || !file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return std::nullopt;
+    if (std::memcmp(header.magic, out_of_core_header_t::magic_value, sizeof(header.magic)) != 0 ||
+        header.version != out_of_core_header_t::current_version ||
+        header.node_size != sizeof(node_t) ||
+        header.triangle_size != sizeof(triangle_t) ||
+        header.partition_count == 0)
+        return std::nullopt;
+
+    // every array has to lie inside the file, the counts are checked first so the products below cannot overflow
+    auto fits = [&](uint64_t offset, uint64_t count, uint64_t element_size) {
+        return offset % out_of_core_header_t::alignment == 0 && offset <= size && count <= (size - offset) / element_size;
+    };
+    out_of_core_bvh_t bvh;
+    bvh.file_path = file_path;
+    bvh.header = header;
+    if (!fits(header.partitions_offset, header.partition_count, sizeof(out_of_core_partition_t)) ||
+        !read_array(file, header.partitions_offset, bvh.partitions, header.partition_count))
+        return std::nullopt;
+    std::vector<aabb_t> aabbs(header.partition_count);
+    std::vector<glm::vec3> centers(header.partition_count);
+    for (uint32_t i = 0; i < header.partition_count; i++) {
+        const out_of_core_partition_t& partition = bvh.partitions[i];
+        if (partition.node_count == 0 ||
+            !fits(partition.nodes_offset, partition.node_count, sizeof(node_t)) ||
+            !fits(partition.triangles_offset, partition.triangle_count, sizeof(triangle_t)) ||
+            !fits(partition.ids_offset, partition.triangle_count, sizeof(uint32_t)))
+            return std::nullopt;
+        aabbs[i] = partition.aabb;
+        centers[i] = 0.5f * (partition.aabb.min + partition.aabb.max);
+    }
+    bvh.top_level = bvh_t::build(aabbs.data(), centers.data(), header.partition_count);
+
+    bvh.cache = std::make_shared<cache_t>();
+    bvh.cache->memory_budget = memory_budget;
+    bvh.cache->resident.resize(header.partition_count);
+    bvh.cache->positions.resize(header.partition_count);
+    return bvh;
+}
+
+out_of_core_stats_t out_of_core_bvh_t::stats() const {
+    std::lock_guard lock{ cache->mutex };
+    return cache->stats;
+}
+
+std::shared_ptr<const out_of_core_bvh_t::partition_data_t> out_of_core_bvh_t::acquire(uint32_t partition_index) const {
+    {
+        std::lock_guard lock{ cache->mutex };
+        if (cache->resident[partition_index]) {
+            cache->lru.splice(cache->lru.begin(), cache->lru, cache->positions[partition_index]);
+            return cache->resident[partition_index];
+        }
+    }
+
+    // read without the lock so other threads keep tracing through resident partitions, two threads missing on the same
+    // partition both read it and the second one drops its copy
+    const out_of_core_partition_t& partition = partitions[partition_index];
+    auto data = std::make_shared<partition_data_t>();
+    std::ifstream file{ file_path, std::ios::binary };
+    if (!read_array(file, partition.nodes_offset, data->nodes, partition.node_count) ||
+        !read_array(file, partition.triangles_offset, data->triangles, partition.triangle_count) ||
+        !read_array(file, partition.ids_offset, data->ids, partition.triangle_count) ||
+        !valid_nodes(data->nodes, partition.triangle_count))
+        return nullptr;
+
+    std::lock_guard lock{ cache->mutex };
+    out_of_core_stats_t& stats = cache->stats;
+    stats.loads++;
+    stats.loaded_bytes += size_bytes(partition);
+    if (cache->resident[partition_index]) {
+        cache->lru.splice(cache->lru.begin(), cache->lru, cache->positions[partition_index]);
+        return cache->resident[partition_index];
+    }
+    cache->resident[partition_index] = data;
+    cache->lru.push_front(partition_index);
+    cache->positions[partition_index] = cache->lru.begin();
+    stats.resident_bytes += size_bytes(partition);
+
+    // the partition just read stays even when it alone is over the budget, rays still holding an evicted partition keep it
+    // alive until they leave it
+    while (stats.resident_bytes > cache->memory_budget && cache->lru.size() > 1) {
+        uint32_t evicted = cache->lru.back();
+        cache->lru.pop_back();
+        cache->resident[evicted] = nullptr;
+        stats.resident_bytes -= size_bytes(partitions[evicted]);
+        stats.evictions++;
+    }
+    stats.peak_resident_bytes = std::max(stats.peak_resident_bytes, stats.resident_bytes);
+    return data;
+}
+
+void out_of_core_bvh_t::trace(std::span<ray_t> rays, hit_t *hits, bool any_hit) const {
+    struct candidate_t {
+        float distance;
+        uint32_t partition_index;
+    };
+
+    // every partition box a ray enters, nearest first, ray_candidates[i] to ray_candidates[i + 1] in candidates
+    std::vector<candidate_t> candidates;
+    std::vector<uint32_t> ray_candidates{ 0 };
+    ray_candidates.reserve(rays.size() + 1);
+    for (auto& ray : rays) {
+        const ray_data_t ray_data{ ray };
+        const uint32_t first = candidates.size();
+        ray_t probe = ray;
+        top_level.traverse_ordered<false>(probe, [&](uint32_t partition_index, ray_t&) {
+            float distance = node_t{ .aabb = partitions[partition_index].aabb }.intersect(ray_data, ray.tmin, ray.tmax);
+            if (distance != node_t::miss)
+                candidates.push_back({ distance, partition_index });
+            return false;
+        });
+        std::sort(candidates.begin() + first, candidates.end(), [](const candidate_t& a, const candidate_t& b) { return a.distance < b.distance; });
+        ray_candidates.push_back(candidates.size());
+    }
+
+    // every candidate grouped by partition, so a partition is read once and serves every ray that still reaches it
+    std::vector<uint32_t> partition_candidates(partitions.size() + 1, 0);
+    for (const candidate_t& candidate : candidates)
+        partition_candidates[candidate.partition_index + 1]++;
+    for (uint32_t i = 0; i < partitions.size(); i++)
+        partition_candidates[i + 1] += partition_candidates[i];
+    std::vector<uint32_t> candidate_rays(candidates.size()), candidate_indices(candidates.size());
+    {
+        std::vector<uint32_t> offsets(partition_candidates.begin(), partition_candidates.end() - 1);
+        for (uint32_t i = 0; i < rays.size(); i++) {
+            for (uint32_t c = ray_candidates[i]; c < ray_candidates[i + 1]; c++) {
+                uint32_t& offset = offsets[candidates[c].partition_index];
+                candidate_rays[offset] = i;
+                candidate_indices[offset] = c;
+                offset++;
+            }
+        }
+    }
+
+    // the front of a ray is its nearest candidate whose partition is not done yet, the partition in front of the most rays
+    // goes next so most rays still meet their partitions front to back and get culled by their closest hit early, the rest
+    // are traced out of order, which only costs their tmax shrinking later
+    // a ray whose front starts behind its closest hit so far, or that found any hit, is finished
+    constexpr uint32_t finished = static_cast<uint32_t>(-1);
+    std::vector<uint32_t> fronts(rays.size(), finished);
+    std::vector<uint32_t> front_counts(partitions.size(), 0);
+    std::vector<bool> done(partitions.size(), false);
+    auto advance = [&](uint32_t i) {
+        uint32_t c = fronts[i] == finished ? ray_candidates[i] : fronts[i];
+        if (fronts[i] != finished)
+            front_counts[candidates[c].partition_index]--;
+        while (c != ray_candidates[i + 1] && done[candidates[c].partition_index])
+            c++;
+        fronts[i] = c != ray_candidates[i + 1] && candidates[c].distance <= rays[i].tmax ? c : finished;
+        if (fronts[i] != finished)
+            front_counts[candidates[c].partition_index]++;
+    };
+    for (uint32_t i = 0; i < rays.size(); i++) {
+        hits[i] = hit_t::none();
+        advance(i);
+    }
+
+    // resident partitions first since they cost nothing, then the one in front of the most rays, every partition is read
+    // at most once per call
+    while (true) {
+        uint32_t partition_index = 0;
+        std::pair<bool, uint32_t> best{ false, 0 };
+        {
+            std::lock_guard lock{ cache->mutex };
+            for (uint32_t i = 0; i < partitions.size(); i++) {
+                std::pair<bool, uint32_t> priority{ cache->resident[i] != nullptr, front_counts[i] };
+                if (front_counts[i] != 0 && priority > best) {
+                    partition_index = i;
+                    best = priority;
+                }
+            }
+        }
+        if (best.second == 0)
+            break;
+
+        std::shared_ptr<const partition_data_t> partition = acquire(partition_index);
+        done[partition_index] = true;
+        for (uint32_t k = partition_candidates[partition_index]; k < partition_candidates[partition_index + 1]; k++) {
+            const uint32_t i = candidate_rays[k];
+            ray_t& ray = rays[i];
+            if (fronts[i] == finished || candidates[candidate_indices[k]].distance > ray.tmax)
+                continue;
+            hit_t hit = hit_t::none();
+            if (partition)
+                hit = any_hit ? traverse<true>(*partition, ray) : traverse<false>(*partition, ray);
+            if (hit) {
+                hits[i] = hit;
+                if (any_hit) {
+                    front_counts[candidates[fronts[i]].partition_index]--;
+                    fronts[i] = finished;
+                    continue;
+                }
+            }
+            // moves the front off this partition, or finishes the ray when the hit closed off everything in front of it
+            if (candidates[fronts[i]].partition_index == partition_index || hit)
+                advance(i);
+        }
+    }
+}
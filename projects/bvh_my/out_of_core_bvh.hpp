@@ -0,0 +1,142 @@
+#ifndef out_of_core_bvh_hpp
+#define out_of_core_bvh_hpp
+
+#include "bvh.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+
+// fills triangles with the mesh starting at triangle first and returns how many it wrote, fewer than triangles.size() only
+// at the end of the mesh, the build reads the mesh three times so the source has to hand out the same triangles every time
+using triangle_source_t = std::function<uint32_t(uint64_t first, std::span<triangle_t> triangles)>;
+
+// tuning of out_of_core_bvh_t::build
+struct out_of_core_config_t {
+    // triangles per partition, a partition is built, stored and paged in as a whole, so this bounds the memory of the build
+    // and the granularity of the traversal budget, a single cell of the partitioning grid can exceed it
+    uint32_t partition_triangles = 1 << 18;
+    // triangles read from the source per call
+    uint32_t read_chunk = 1 << 16;
+    // threads for the sub-bvh builds
+    uint32_t thread_count = 1;
+};
+
+// on disk layout, the partition table follows the header and every array starts on a cache line like bvh_cache_header_t
+struct out_of_core_header_t {
+    static constexpr char magic_value[8] = { 'B', 'V', 'H', 'O', 'O', 'C', 0, 0 };
+    static constexpr uint32_t current_version = 1;
+    static constexpr uint64_t alignment = 64;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint32_t triangle_size;
+    uint32_t partition_count;
+    uint64_t triangle_count;
+    // byte offset from the start of the file
+    uint64_t partitions_offset;
+};
+
+struct out_of_core_partition_t {
+    aabb_t aabb;
+    uint32_t node_count;
+    uint32_t triangle_count;
+    // byte offsets from the start of the file, the triangles are in leaf order so leaves index them directly and ids holds
+    // the index of every triangle in the source
+    uint64_t nodes_offset;
+    uint64_t triangles_offset;
+    uint64_t ids_offset;
+};
+
+struct out_of_core_stats_t {
+    uint64_t loads;
+    uint64_t evictions;
+    uint64_t loaded_bytes;
+    uint64_t resident_bytes;
+    uint64_t peak_resident_bytes;
+};
+
+// bvh over a mesh that does not fit in memory, a top level bvh over spatially compact partitions that each have their own
+// bvh and triangles in one file, the top level stays resident and partitions are read in when a ray reaches them and
+// dropped least recently used first once the resident partitions exceed the memory budget
+// partitions are read with plain file reads instead of mapped, so the budget bounds the resident memory instead of the os
+struct out_of_core_bvh_t {
+    // streams the source three times, for the centroid bounds, a histogram over a morton grid that the partitions are cut
+    // from in morton order and to sort the triangles into their partitions in a temporary file next to file_path
+    // then builds every partition with bvh_t::build, false when a file cannot be written
+    static bool build(const std::filesystem::path& file_path, const triangle_source_t& source, const out_of_core_config_t& config = {});
+
+    // nullopt when the file is missing, truncated or from another version, memory_budget is in bytes
+    static std::optional<out_of_core_bvh_t> open(const std::filesystem::path& file_path, uint64_t memory_budget);
+
+    // primitive_index of the hits is the index of the triangle in the source, safe to call from several threads
+    hit_t closest_hit(ray_t& ray) const { return traverse<false>(ray); }
+    hit_t any_hit(ray_t& ray) const { return traverse<true>(ray); }
+
+    // the same hits for a whole batch, every partition is read at most once per call for all rays that reach it, instead
+    // of once per ray when rays cross more partitions than fit in the budget, the closest hit is the same as closest_hit
+    // but any_hit can report another hit than any_hit(ray) does
+    void trace(std::span<ray_t> rays, hit_t *hits, bool any_hit = false) const;
+
+    out_of_core_stats_t stats() const;
+    uint64_t triangle_count() const { return header.triangle_count; }
+    const aabb_t& bounds() const { return top_level.nodes[0].aabb; }
+
+private:
+    struct partition_data_t {
+        std::vector<node_t> nodes;
+        std::vector<triangle_t> triangles;
+        std::vector<uint32_t> ids;
+    };
+    struct cache_t;
+
+    template <bool any_hit>
+    hit_t traverse(ray_t& ray) const;
+    template <bool any_hit>
+    static hit_t traverse(const partition_data_t& partition, ray_t& ray);
+    // resident data of the partition, read from the file when it is not, nullptr when the read fails or the nodes do not
+    // fit the partition
+    std::shared_ptr<const partition_data_t> acquire(uint32_t partition_index) const;
+
+    std::filesystem::path file_path;
+    out_of_core_header_t header;
+    std::vector<out_of_core_partition_t> partitions;
+    // over the partition bounds, rebuilt on open since it is tiny
+    bvh_t top_level;
+    // behind a pointer so the object stays movable with its mutex
+    std::shared_ptr<cache_t> cache;
+};
+
+template <bool any_hit>
+hit_t out_of_core_bvh_t::traverse(ray_t& ray) const {
+    hit_t hit = hit_t::none();
+    top_level.traverse_ordered<any_hit>(ray, [&](uint32_t partition_index, ray_t& ray) {
+        std::shared_ptr<const partition_data_t> partition = acquire(partition_index);
+        if (!partition)
+            return false;
+        hit_t partition_hit = traverse<any_hit>(*partition, ray);
+        if (partition_hit)
+            hit = partition_hit;
+        return static_cast<bool>(partition_hit);
+    });
+    return hit;
+}
+
+template <bool any_hit>
+hit_t out_of_core_bvh_t::traverse(const partition_data_t& partition, ray_t& ray) {
+    const bvh_view_t bvh{ partition.nodes, {} };
+    return bvh.traverse_leaves<any_hit>(ray, [&](uint32_t, const node_t& leaf, ray_t& ray) {
+        hit_t leaf_hit = hit_t::none();
+        for (uint32_t i = leaf.first_index; i < leaf.first_index + leaf.primitive_count; i++) {
+            if (partition.triangles[i].intersect(ray)) {
+                leaf_hit.primitive_index = partition.ids[i];
+                if constexpr (any_hit)
+                    break;
+            }
+        }
+        return leaf_hit;
+    });
+}
+
+#endif
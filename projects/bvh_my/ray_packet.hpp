@@ -0,0 +1,273 @@
+#ifndef ray_packet_hpp
+#define ray_packet_hpp
+
+#include "bvh.hpp"
+#include "simd.hpp"
+
+#include <bit>
+
+// size coherent rays stored SoA, processed float8_t::lanes at a time
+// bit i of active is set when lane i holds a ray, lanes past the end of a partial packet stay inactive
+template <uint32_t size>
+struct ray_packet_t {
+    static_assert(size % float8_t::lanes == 0 && size <= 32, "packet size has to be a multiple of 8 and fit a 32 bit mask");
+
+    static constexpr uint32_t blocks = size / float8_t::lanes;
+
+    ray_packet_t(const ray_t *rays, uint32_t count) {
+        assert(count <= size);
+        active = count == 32 ? ~0u : (1u << count) - 1;
+        for (uint32_t i = 0; i < size; i++) {
+            // inactive lanes get a harmless ray so the math on them stays finite
+            const ray_t& ray = rays[i < count ? i : 0];
+            glm::vec3 inverse_direction = ray.inverse_direction();
+            for (int axis = 0; axis < 3; axis++) {
+                origin[axis][i] = ray.origin[axis];
+                direction[axis][i] = ray.direction[axis];
+                this->inverse_direction[axis][i] = inverse_direction[axis];
+            }
+            tmin[i] = ray.tmin;
+            tmax[i] = ray.tmax;
+        }
+    }
+
+    vec3x8_t load(const float (&v)[3][size], uint32_t block) const {
+        return { float8_t::load(v[0] + block * float8_t::lanes), float8_t::load(v[1] + block * float8_t::lanes), float8_t::load(v[2] + block * float8_t::lanes) };
+    }
+
+    uint32_t block_mask(uint32_t mask, uint32_t block) const { return (mask >> (block * float8_t::lanes)) & float8_t::all; }
+
+    alignas(32) float origin[3][size];
+    alignas(32) float direction[3][size];
+    alignas(32) float inverse_direction[3][size];
+    alignas(32) float tmin[size];
+    alignas(32) float tmax[size];
+    uint32_t active;
+};
+
+// returns the active lanes whose ray enters the node before its current tmax
+template <uint32_t size>
+uint32_t intersect(const node_t& node, const ray_packet_t<size>& packet) {
+    uint32_t mask = 0;
+    vec3x8_t aabb_min = vec3x8_t::broadcast(node.aabb.min);
+    vec3x8_t aabb_max = vec3x8_t::broadcast(node.aabb.max);
+    for (uint32_t block = 0; block < packet.blocks; block++) {
+        if (!packet.block_mask(packet.active, block))
+            continue;
+        vec3x8_t origin = packet.load(packet.origin, block);
+        vec3x8_t inverse_direction = packet.load(packet.inverse_direction, block);
+
+        vec3x8_t t0 = aabb_min - origin;
+        vec3x8_t t1 = aabb_max - origin;
+        t0 = { t0.x * inverse_direction.x, t0.y * inverse_direction.y, t0.z * inverse_direction.z };
+        t1 = { t1.x * inverse_direction.x, t1.y * inverse_direction.y, t1.z * inverse_direction.z };
+
+        float8_t tnear = max(max(min(t0.x, t1.x), min(t0.y, t1.y)), max(min(t0.z, t1.z), float8_t::load(packet.tmin + block * float8_t::lanes)));
+        float8_t tfar = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), min(max(t0.z, t1.z), float8_t::load(packet.tmax + block * float8_t::lanes)));
+        mask |= (tnear <= tfar) << (block * float8_t::lanes);
+    }
+    return mask & packet.active;
+}
+
+// same math as triangle_t::intersect on every lane in mask, shrinks tmax of the lanes that hit and returns them
+template <uint32_t size>
+uint32_t intersect(const triangle_t& triangle, ray_packet_t<size>& packet, uint32_t mask) {
+    glm::vec3 e1 = triangle.p0 - triangle.p1;
+    glm::vec3 e2 = triangle.p2 - triangle.p0;
+    glm::vec3 n = glm::cross(e1, e2);
+
+    vec3x8_t p0x8 = vec3x8_t::broadcast(triangle.p0);
+    vec3x8_t e1x8 = vec3x8_t::broadcast(e1);
+    vec3x8_t e2x8 = vec3x8_t::broadcast(e2);
+    vec3x8_t nx8 = vec3x8_t::broadcast(n);
+    const float8_t zero = float8_t::broadcast(0);
+    const float8_t one = float8_t::broadcast(1);
+
+    uint32_t hit_mask = 0;
+    alignas(32) float t_lanes[float8_t::lanes];
+    for (uint32_t block = 0; block < packet.blocks; block++) {
+        uint32_t lanes = packet.block_mask(mask, block);
+        if (!lanes)
+            continue;
+        vec3x8_t origin = packet.load(packet.origin, block);
+        vec3x8_t direction = packet.load(packet.direction, block);
+
+        vec3x8_t c = p0x8 - origin;
+        vec3x8_t r = cross(direction, c);
+        float8_t inverse_det = one / dot(nx8, direction);
+
+        float8_t u = dot(r, e2x8) * inverse_det;
+        float8_t v = dot(r, e1x8) * inverse_det;
+        float8_t w = one - u - v;
+        float8_t t = dot(nx8, c) * inverse_det;
+
+        lanes &= (u >= zero) & (v >= zero) & (w >= zero) &
+                 (t >= float8_t::load(packet.tmin + block * float8_t::lanes)) &
+                 (t <= float8_t::load(packet.tmax + block * float8_t::lanes));
+        if (!lanes)
+            continue;
+
+        t.store(t_lanes);
+        hit_mask |= lanes << (block * float8_t::lanes);
+        while (lanes) {
+            uint32_t lane = std::countr_zero(lanes);
+            lanes &= lanes - 1;
+            packet.tmax[block * float8_t::lanes + lane] = t_lanes[lane];
+        }
+    }
+    return hit_mask;
+}
+
+// closest hit for every ray of the packet, hits has to hold size entries
+template <uint32_t size, typename primitive>
+void traverse_packet(const bvh_t& bvh, ray_packet_t<size>& packet, const std::vector<primitive>& primitives, hit_t *hits) {
+    for (uint32_t i = 0; i < size; i++)
+        hits[i] = hit_t::none();
+
+    // binary tree, each level leaves at most one sibling behind
+    traversal_stack_t<uint32_t, bvh_view_t::max_stack_size + 1> stack;
+    stack.push(0);
+
+    while (!stack.empty()) {
+        const node_t& node = bvh.nodes[stack.pop()];
+        uint32_t mask = intersect(node, packet);
+        if (!mask)
+            continue;
+
+        if (node.is_leaf()) {
+            for (uint32_t i = 0; i < node.primitive_count; i++) {
+                uint32_t primitive_index = bvh.primitive_indices[node.first_index + i];
+                uint32_t hit_mask = intersect(primitives[primitive_index], packet, mask);
+                while (hit_mask) {
+                    uint32_t lane = std::countr_zero(hit_mask);
+                    hit_mask &= hit_mask - 1;
+                    hits[lane].primitive_index = primitive_index;
+                }
+            }
+        } else {
+            // order the children by the first active ray, the packet is coherent so it speaks for the rest
+            uint32_t lane = std::countr_zero(mask);
+            glm::vec3 direction{ packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane] };
+            const node_t& left = bvh.nodes[node.first_index];
+            const node_t& right = bvh.nodes[node.first_index + 1];
+            bool left_first = glm::dot((left.aabb.min + left.aabb.max) - (right.aabb.min + right.aabb.max), direction) <= 0;
+            stack.push(left_first ? node.first_index + 1 : node.first_index);
+            stack.push(left_first ? node.first_index : node.first_index + 1);
+        }
+    }
+}
+
+// packs consecutive rays into packets, callers should order rays so neighbours are coherent (screen tiles)
+template <uint32_t size, typename primitive>
+void traverse_packets(const bvh_t& bvh, ray_t *rays, hit_t *hits, uint32_t ray_count, const std::vector<primitive>& primitives) {
+    for (uint32_t first = 0; first < ray_count; first += size) {
+        uint32_t count = std::min(size, ray_count - first);
+        ray_packet_t<size> packet{ rays + first, count };
+        hit_t packet_hits[size];
+        traverse_packet(bvh, packet, primitives, packet_hits);
+        for (uint32_t i = 0; i < count; i++) {
+            hits[first + i] = packet_hits[i];
+            rays[first + i].tmax = packet.tmax[i];
+        }
+    }
+}
+
+// filters the whole batch through the tree depth first, each node is fetched once per batch instead of once per ray and
+// tested against float8_t::lanes rays at a time
+// the ids of the rays that hit a node at depth d are compacted into ray_ids[d + 1], both children read them from there and
+// a level is only overwritten once the subtrees below it are done, so the buffers are reused across the whole traversal
+// depth first rather than level by level on purpose: a breadth first pass keeps a filtered id list for every node of a
+// level alive at once, up to ray_count ids per node, where this needs one list per depth, the ids of a subtree are
+// filtered while they are still in cache, and leaves hit early shrink tmax before the rest of the tree is filtered
+template <typename primitive>
+void traverse_stream(const bvh_t& bvh, ray_t *rays, hit_t *hits, uint32_t ray_count, const std::vector<primitive>& primitives) {
+    struct entry_t {
+        uint32_t node_index;
+        // ray_ids[depth] holds the rays that hit the parent
+        uint32_t depth;
+    };
+
+    // SoA copy of the batch the node test gathers from, tmax is written back whenever a leaf shrinks it
+    std::vector<float> origins[3], inverse_directions[3], tmins(ray_count), tmaxs(ray_count);
+    for (int axis = 0; axis < 3; axis++) {
+        origins[axis].resize(ray_count);
+        inverse_directions[axis].resize(ray_count);
+    }
+    // every level is padded to whole blocks, lanes past the end hold stale but valid ray ids
+    auto padded = [](uint32_t count) { return (count + float8_t::lanes - 1) / float8_t::lanes * float8_t::lanes; };
+    std::vector<std::vector<uint32_t>> ray_ids(1, std::vector<uint32_t>(padded(ray_count)));
+    for (uint32_t i = 0; i < ray_count; i++) {
+        glm::vec3 inverse_direction = rays[i].inverse_direction();
+        for (int axis = 0; axis < 3; axis++) {
+            origins[axis][i] = rays[i].origin[axis];
+            inverse_directions[axis][i] = inverse_direction[axis];
+        }
+        tmins[i] = rays[i].tmin;
+        tmaxs[i] = rays[i].tmax;
+        ray_ids[0][i] = i;
+        hits[i] = hit_t::none();
+    }
+    std::vector<uint32_t> counts(1, ray_count);
+
+    traversal_stack_t<entry_t, bvh_view_t::max_stack_size + 1> stack;
+    stack.push({ 0, 0 });
+    while (!stack.empty()) {
+        entry_t entry = stack.pop();
+        const node_t& node = bvh.nodes[entry.node_index];
+        if (ray_ids.size() == entry.depth + 1) {
+            ray_ids.emplace_back();
+            counts.push_back(0);
+        }
+        const uint32_t *in = ray_ids[entry.depth].data();
+        const uint32_t in_count = counts[entry.depth];
+        std::vector<uint32_t>& out = ray_ids[entry.depth + 1];
+        if (out.size() < padded(in_count))
+            out.resize(padded(in_count));
+        uint32_t out_count = 0;
+
+        vec3x8_t aabb_min = vec3x8_t::broadcast(node.aabb.min);
+        vec3x8_t aabb_max = vec3x8_t::broadcast(node.aabb.max);
+        for (uint32_t first = 0; first < in_count; first += float8_t::lanes) {
+            const uint32_t *ids = in + first;
+            vec3x8_t origin{ float8_t::gather(origins[0].data(), ids), float8_t::gather(origins[1].data(), ids), float8_t::gather(origins[2].data(), ids) };
+            vec3x8_t inverse_direction{ float8_t::gather(inverse_directions[0].data(), ids), float8_t::gather(inverse_directions[1].data(), ids), float8_t::gather(inverse_directions[2].data(), ids) };
+
+            vec3x8_t t0 = aabb_min - origin;
+            vec3x8_t t1 = aabb_max - origin;
+            t0 = { t0.x * inverse_direction.x, t0.y * inverse_direction.y, t0.z * inverse_direction.z };
+            t1 = { t1.x * inverse_direction.x, t1.y * inverse_direction.y, t1.z * inverse_direction.z };
+
+            float8_t tnear = max(max(min(t0.x, t1.x), min(t0.y, t1.y)), max(min(t0.z, t1.z), float8_t::gather(tmins.data(), ids)));
+            float8_t tfar = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), min(max(t0.z, t1.z), float8_t::gather(tmaxs.data(), ids)));
+            uint32_t lanes = tnear <= tfar;
+            if (in_count - first < float8_t::lanes)
+                lanes &= (1u << (in_count - first)) - 1;
+            while (lanes) {
+                uint32_t lane = std::countr_zero(lanes);
+                lanes &= lanes - 1;
+                out[out_count++] = ids[lane];
+            }
+        }
+        counts[entry.depth + 1] = out_count;
+        if (!out_count)
+            continue;
+
+        if (node.is_leaf()) {
+            for (uint32_t i = 0; i < node.primitive_count; i++) {
+                uint32_t primitive_index = bvh.primitive_indices[node.first_index + i];
+                for (uint32_t j = 0; j < out_count; j++) {
+                    uint32_t ray_id = out[j];
+                    if (primitives[primitive_index].intersect(rays[ray_id])) {
+                        hits[ray_id].primitive_index = primitive_index;
+                        tmaxs[ray_id] = rays[ray_id].tmax;
+                    }
+                }
+            }
+        } else {
+            stack.push({ node.first_index + 1, entry.depth + 1 });
+            stack.push({ node.first_index, entry.depth + 1 });
+        }
+    }
+}
+
+#endif
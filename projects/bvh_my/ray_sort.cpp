@@ -0,0 +1,46 @@
+#include "ray_sort.hpp"
+
+#include "morton.hpp"
+
+#include "core/thread_pool.hpp"
+
+ray_sorter_t::ray_sorter_t(core::thread_pool_t& thread_pool, const ray_sort_config_t& config)
+  : config(config), thread_pool(thread_pool) {}
+
+void ray_sorter_t::sort(std::span<const ray_t> rays, const aabb_t& bounds) {
+    const uint32_t count = rays.size();
+    const glm::vec3 extent = bounds.max - bounds.min;
+    const glm::vec3 scale{ extent.x > 0 ? 1.0f / extent.x : 0.0f, extent.y > 0 ? 1.0f / extent.y : 0.0f, extent.z > 0 ? 1.0f / extent.z : 0.0f };
+
+    keys.resize(count);
+    indices.resize(count);
+    thread_pool.parallel_for(0, count, config.parallel_grain_size, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            const ray_t& ray = rays[i];
+            // 9 bits per axis leaves room for the octant in a 32 bit key, so the sort stays at 4 passes
+            uint32_t origin = morton_code<uint32_t>((ray.origin - bounds.min) * scale) >> 3;
+            uint32_t octant = (ray.direction.x < 0 ? 4 : 0) | (ray.direction.y < 0 ? 2 : 0) | (ray.direction.z < 0 ? 1 : 0);
+            keys[i] = config.direction_major ? (octant << 27) | origin : (origin << 3) | octant;
+            indices[i] = i;
+        }
+    });
+    radix_sort(thread_pool, config.parallel_grain_size, keys, indices);
+}
+
+void ray_sorter_t::gather(std::span<const ray_t> rays) {
+    sorted_rays.resize(rays.size());
+    sorted_hits.resize(rays.size());
+    thread_pool.parallel_for(0, rays.size(), config.parallel_grain_size, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++)
+            sorted_rays[i] = rays[indices[i]];
+    });
+}
+
+void ray_sorter_t::scatter(std::span<ray_t> rays, hit_t *hits) const {
+    thread_pool.parallel_for(0, rays.size(), config.parallel_grain_size, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            hits[indices[i]] = sorted_hits[i];
+            rays[indices[i]].tmax = sorted_rays[i].tmax;
+        }
+    });
+}
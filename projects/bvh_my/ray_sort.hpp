@@ -0,0 +1,51 @@
+#ifndef ray_sort_hpp
+#define ray_sort_hpp
+
+#include "bvh.hpp"
+
+// tuning of ray_sorter_t
+struct ray_sort_config_t {
+    // direction octant above the origin morton code in the key, rays are grouped by where they go before where they start
+    // false puts the octant in the low bits, which suits batches whose origins are spread far apart
+    bool direction_major = true;
+    uint32_t parallel_grain_size = 16384;
+};
+
+// reorders batches of incoherent rays (diffuse bounces, ambient occlusion) so neighbours in the batch start close to each other
+// and head into the same octant, then traces them in that order with any single ray or packet traversal
+// the key is a 27 bit morton code of the origin and the 3 sign bits of the direction, sorted with a parallel radix sort
+struct ray_sorter_t {
+    // the pool is referenced and has to outlive the sorter
+    ray_sorter_t(core::thread_pool_t& thread_pool, const ray_sort_config_t& config = {});
+
+    // fills order() with ray indices in coherent order, bounds should contain every origin, origins outside are clamped
+    void sort(std::span<const ray_t> rays, const aabb_t& bounds);
+    const std::vector<uint32_t>& order() const { return indices; }
+
+    // sorts the batch, hands trace(ray_t *rays, hit_t *hits, uint32_t count) the rays gathered in coherent order
+    // and scatters the hits and shrunk tmax back, so hits[i] and rays[i] end up as if rays were traced as given
+    template <typename trace_fn_t>
+    void trace(std::span<ray_t> rays, hit_t *hits, const aabb_t& bounds, const trace_fn_t& trace);
+
+private:
+    void gather(std::span<const ray_t> rays);
+    void scatter(std::span<ray_t> rays, hit_t *hits) const;
+
+    ray_sort_config_t config;
+    core::thread_pool_t& thread_pool;
+    // scratch kept between batches so a frame of bounces does not reallocate
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> indices;
+    std::vector<ray_t> sorted_rays;
+    std::vector<hit_t> sorted_hits;
+};
+
+template <typename trace_fn_t>
+void ray_sorter_t::trace(std::span<ray_t> rays, hit_t *hits, const aabb_t& bounds, const trace_fn_t& trace) {
+    sort(rays, bounds);
+    gather(rays);
+    trace(sorted_rays.data(), sorted_hits.data(), static_cast<uint32_t>(sorted_rays.size()));
+    scatter(rays, hits);
+}
+
+#endif
@@ -0,0 +1,326 @@
+#include "bvh.hpp"
+
+
+static aabb_t intersection(const aabb_t& a, const aabb_t& b) {
+    return { glm::max(a.min, b.min), glm::min(a.max, b.max) };
+}
+
+static bool is_empty(const aabb_t& aabb) {
+    return aabb.min.x > aabb.max.x || aabb.min.y > aabb.max.y || aabb.min.z > aabb.max.z;
+}
+
+// half area that is 0 for empty boxes instead of the garbage half_area() gives for them
+static float safe_half_area(const aabb_t& aabb) {
+    return is_empty(aabb) ? 0.0f : aabb.half_area();
+}
+
+struct bvh_t::spatial_builder_t {
+
+    // a primitive, or the part of it that ended up on one side of a spatial split
+    struct reference_t {
+        glm::vec3 center() const { return (aabb.min + aabb.max) * 0.5f; }
+
+        uint32_t primitive_index;
+        aabb_t aabb;
+    };
+
+    struct object_split_t {
+        float cost = std::numeric_limits<float>::max();
+        split_t split{};
+        aabb_t left_aabb = aabb_t::empty(), right_aabb = aabb_t::empty();
+    };
+
+    struct spatial_split_t {
+        float cost = std::numeric_limits<float>::max();
+        int axis = 0;
+        float position = 0;
+        aabb_t left_aabb = aabb_t::empty(), right_aabb = aabb_t::empty();
+        uint32_t left_count = 0, right_count = 0;
+    };
+
+    bvh_t& bvh;
+    const triangle_t *triangles;
+    const spatial_split_config_t& config;
+    float root_area;
+    uint32_t reference_count;
+    uint32_t max_reference_count;
+
+    void build_recursive(uint32_t node_index, std::vector<reference_t>& references);
+    object_split_t find_object_split(const node_t& node, const std::vector<reference_t>& references) const;
+    spatial_split_t find_spatial_split(const node_t& node, const std::vector<reference_t>& references) const;
+    void partition_spatial(const spatial_split_t& split, std::vector<reference_t>& references, std::vector<reference_t>& left, std::vector<reference_t>& right);
+    // clips the triangle behind the reference at position on axis, both halves are clamped to the reference bounds
+    void split_reference(const reference_t& reference, int axis, float position, reference_t& left, reference_t& right) const;
+    void make_leaf(node_t& node, const std::vector<reference_t>& references);
+};
+
+
+bvh_t bvh_t::build_spatial(const triangle_t *triangles, uint32_t primitive_count, const spatial_split_config_t& config) {
+    bvh_t bvh{};
+    spatial_split_config_t checked = config;
+    checked.build = checked_config(config.build, "bvh_t::build_spatial");
+
+    std::vector<spatial_builder_t::reference_t> references(primitive_count);
+    aabb_t root_aabb = aabb_t::empty();
+    for (uint32_t i = 0; i < primitive_count; i++) {
+        references[i].primitive_index = i;
+        references[i].aabb = aabb_t::empty();
+        references[i].aabb.extend(triangles[i].p0).extend(triangles[i].p1).extend(triangles[i].p2);
+        root_aabb.extend(references[i].aabb);
+    }
+
+    spatial_builder_t builder{
+        .bvh = bvh,
+        .triangles = triangles,
+        .config = checked,
+        .root_area = root_aabb.half_area(),
+        .reference_count = primitive_count,
+        .max_reference_count = primitive_count + static_cast<uint32_t>(config.duplication_budget * primitive_count),
+    };
+
+    bvh.primitive_indices.reserve(builder.max_reference_count);
+    bvh.nodes.reserve(2 * builder.max_reference_count - 1);
+    bvh.nodes.emplace_back();
+    builder.build_recursive(0, references);
+    return bvh;
+}
+
+void bvh_t::spatial_builder_t::build_recursive(uint32_t node_index, std::vector<reference_t>& references) {
+    node_t& node = bvh.nodes[node_index];
+    node.aabb = aabb_t::empty();
+    for (auto& reference : references)
+        node.aabb.extend(reference.aabb);
+    node.primitive_count = references.size();
+
+    if (references.size() <= config.build.min_primitives) {
+        make_leaf(node, references);
+        return;
+    }
+
+    object_split_t object_split = find_object_split(node, references);
+
+    spatial_split_t spatial_split{};
+    // spatial splits only help where the object split children overlap, and only while there is budget to duplicate
+    float overlap = safe_half_area(intersection(object_split.left_aabb, object_split.right_aabb));
+    if (reference_count < max_reference_count && overlap > config.overlap_threshold * root_area)
+        spatial_split = find_spatial_split(node, references);
+
+    float leaf_cost = node.aabb.half_area() * (references.size() - config.build.traversal_cost);
+    float min_cost = std::min(object_split.cost, spatial_split.cost);
+
+    std::vector<reference_t> left, right;
+    if (min_cost < leaf_cost && spatial_split.cost < object_split.cost) {
+        partition_spatial(spatial_split, references, left, right);
+    } else if (min_cost < leaf_cost && object_split.split) {
+        for (auto& reference : references) {
+            if (bin_t::bin_index(object_split.split.axis, node.aabb, reference.center(), config.build.bin_count) < object_split.split.right_bin)
+                left.push_back(reference);
+            else
+                right.push_back(reference);
+        }
+    }
+
+    // no split worth taking, or unsplitting moved every reference to one side
+    if (left.empty() || right.empty()) {
+        if (references.size() <= config.build.max_primitives) {
+            make_leaf(bvh.nodes[node_index], references);
+            return;
+        }
+        // too many primitives for a leaf, fall back to a median split like partition does
+        int axis = node.aabb.largest_axis();
+        std::sort(references.begin(), references.end(), [&](const reference_t& a, const reference_t& b) { return a.center()[axis] < b.center()[axis]; });
+        left.assign(references.begin(), references.begin() + references.size() / 2);
+        right.assign(references.begin() + references.size() / 2, references.end());
+    }
+    references.clear();
+    references.shrink_to_fit();
+
+    uint32_t first_child = bvh.nodes.size();
+    bvh.nodes.emplace_back();
+    bvh.nodes.emplace_back();
+    // emplace_back may have moved the nodes
+    bvh.nodes[node_index].first_index = first_child;
+    bvh.nodes[node_index].primitive_count = 0;
+
+    build_recursive(first_child, left);
+    build_recursive(first_child + 1, right);
+}
+
+bvh_t::spatial_builder_t::object_split_t bvh_t::spatial_builder_t::find_object_split(const node_t& node, const std::vector<reference_t>& references) const {
+    object_split_t object_split{};
+
+    std::vector<bin_t> bins(config.build.bin_count);
+    for (int axis = 0; axis < 3; axis++) {
+        if (node.aabb.max[axis] <= node.aabb.min[axis])
+            continue;
+        std::fill(bins.begin(), bins.end(), bin_t{});
+        for (auto& reference : references) {
+            bin_t& bin = bins[bin_t::bin_index(axis, node.aabb, reference.center(), config.build.bin_count)];
+            bin.aabb.extend(reference.aabb);
+            bin.primitive_count++;
+        }
+        split_t split = split_t::find_best_split(axis, bins.data(), config.build);
+        if (split < object_split.split)
+            object_split.split = split;
+    }
+    if (!object_split.split)
+        return object_split;
+
+    object_split.cost = object_split.split.cost;
+    for (auto& reference : references) {
+        if (bin_t::bin_index(object_split.split.axis, node.aabb, reference.center(), config.build.bin_count) < object_split.split.right_bin)
+            object_split.left_aabb.extend(reference.aabb);
+        else
+            object_split.right_aabb.extend(reference.aabb);
+    }
+    return object_split;
+}
+
+bvh_t::spatial_builder_t::spatial_split_t bvh_t::spatial_builder_t::find_spatial_split(const node_t& node, const std::vector<reference_t>& references) const {
+    struct spatial_bin_t {
+        aabb_t aabb = aabb_t::empty();
+        uint32_t entries = 0;
+        uint32_t exits = 0;
+    };
+
+    spatial_split_t best{};
+    std::vector<spatial_bin_t> bins(config.bin_count);
+    std::vector<aabb_t> right_aabbs(config.bin_count);
+    std::vector<uint32_t> right_counts(config.bin_count);
+
+    for (int axis = 0; axis < 3; axis++) {
+        const float origin = node.aabb.min[axis];
+        const float extent = node.aabb.max[axis] - origin;
+        if (extent <= 0)
+            continue;
+        const float bin_size = extent / config.bin_count;
+        auto bin_of = [&](float position) {
+            return std::min(config.bin_count - 1, static_cast<uint32_t>(std::max(0.0f, (position - origin) / bin_size)));
+        };
+
+        std::fill(bins.begin(), bins.end(), spatial_bin_t{});
+        for (auto& reference : references) {
+            uint32_t first_bin = bin_of(reference.aabb.min[axis]);
+            uint32_t last_bin = bin_of(reference.aabb.max[axis]);
+
+            // chop the reference at every bin boundary it crosses
+            reference_t current = reference;
+            for (uint32_t bin = first_bin; bin < last_bin; bin++) {
+                reference_t left, right;
+                split_reference(current, axis, origin + (bin + 1) * bin_size, left, right);
+                bins[bin].aabb.extend(left.aabb);
+                current = right;
+            }
+            bins[last_bin].aabb.extend(current.aabb);
+            bins[first_bin].entries++;
+            bins[last_bin].exits++;
+        }
+
+        aabb_t right_aabb = aabb_t::empty();
+        uint32_t right_count = 0;
+        for (uint32_t i = config.bin_count - 1; i > 0; i--) {
+            right_aabb.extend(bins[i].aabb);
+            right_count += bins[i].exits;
+            right_aabbs[i] = right_aabb;
+            right_counts[i] = right_count;
+        }
+
+        aabb_t left_aabb = aabb_t::empty();
+        uint32_t left_count = 0;
+        for (uint32_t i = 1; i < config.bin_count; i++) {
+            left_aabb.extend(bins[i - 1].aabb);
+            left_count += bins[i - 1].entries;
+            if (!left_count || !right_counts[i])
+                continue;
+            float cost = safe_half_area(left_aabb) * left_count + safe_half_area(right_aabbs[i]) * right_counts[i];
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.position = origin + i * bin_size;
+                best.left_aabb = left_aabb;
+                best.right_aabb = right_aabbs[i];
+                best.left_count = left_count;
+                best.right_count = right_counts[i];
+            }
+        }
+    }
+    return best;
+}
+
+void bvh_t::spatial_builder_t::partition_spatial(const spatial_split_t& split, std::vector<reference_t>& references, std::vector<reference_t>& left, std::vector<reference_t>& right) {
+    aabb_t left_aabb = split.left_aabb, right_aabb = split.right_aabb;
+    uint32_t left_count = split.left_count, right_count = split.right_count;
+
+    for (auto& reference : references) {
+        if (reference.aabb.max[split.axis] <= split.position) {
+            left.push_back(reference);
+            continue;
+        }
+        if (reference.aabb.min[split.axis] >= split.position) {
+            right.push_back(reference);
+            continue;
+        }
+
+        // reference unsplitting, moving a straddling reference wholly to one side can be cheaper than duplicating it
+        aabb_t left_with = left_aabb, right_with = right_aabb;
+        left_with.extend(reference.aabb);
+        right_with.extend(reference.aabb);
+        float duplicate_cost = safe_half_area(left_aabb) * left_count + safe_half_area(right_aabb) * right_count;
+        float left_cost = safe_half_area(left_with) * left_count + safe_half_area(right_aabb) * (right_count - 1);
+        float right_cost = safe_half_area(left_aabb) * (left_count - 1) + safe_half_area(right_with) * right_count;
+
+        bool can_duplicate = reference_count < max_reference_count;
+        if (can_duplicate && duplicate_cost < left_cost && duplicate_cost < right_cost) {
+            reference_t left_part, right_part;
+            split_reference(reference, split.axis, split.position, left_part, right_part);
+            if (!is_empty(left_part.aabb))
+                left.push_back(left_part);
+            if (!is_empty(right_part.aabb))
+                right.push_back(right_part);
+            if (!is_empty(left_part.aabb) && !is_empty(right_part.aabb))
+                reference_count++;
+        } else if (left_cost < right_cost) {
+            left.push_back(reference);
+            left_aabb = left_with;
+            right_count--;
+        } else {
+            right.push_back(reference);
+            right_aabb = right_with;
+            left_count--;
+        }
+    }
+}
+
+void bvh_t::spatial_builder_t::split_reference(const reference_t& reference, int axis, float position, reference_t& left, reference_t& right) const {
+    left.primitive_index = right.primitive_index = reference.primitive_index;
+    left.aabb = aabb_t::empty();
+    right.aabb = aabb_t::empty();
+
+    const triangle_t& triangle = triangles[reference.primitive_index];
+    const glm::vec3 vertices[3] = { triangle.p0, triangle.p1, triangle.p2 };
+    for (int i = 0; i < 3; i++) {
+        const glm::vec3& v0 = vertices[i];
+        const glm::vec3& v1 = vertices[(i + 1) % 3];
+        if (v0[axis] <= position) left.aabb.extend(v0);
+        if (v0[axis] >= position) right.aabb.extend(v0);
+        // the edge crosses the plane, its intersection belongs to both sides
+        if ((v0[axis] < position && v1[axis] > position) || (v0[axis] > position && v1[axis] < position)) {
+            glm::vec3 point = glm::mix(v0, v1, (position - v0[axis]) / (v1[axis] - v0[axis]));
+            point[axis] = position;
+            left.aabb.extend(point);
+            right.aabb.extend(point);
+        }
+    }
+
+    left.aabb.max[axis] = std::min(left.aabb.max[axis], position);
+    right.aabb.min[axis] = std::max(right.aabb.min[axis], position);
+    left.aabb = intersection(left.aabb, reference.aabb);
+    right.aabb = intersection(right.aabb, reference.aabb);
+}
+
+void bvh_t::spatial_builder_t::make_leaf(node_t& node, const std::vector<reference_t>& references) {
+    node.first_index = bvh.primitive_indices.size();
+    node.primitive_count = references.size();
+    for (auto& reference : references)
+        bvh.primitive_indices.push_back(reference.primitive_index);
+}
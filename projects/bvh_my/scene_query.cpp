@@ -0,0 +1,219 @@
+#include "scene_query.hpp"
+
+#include "core/thread_pool.hpp"
+
+namespace {
+
+float squared_distance(const aabb_t& aabb, const glm::vec3& point) {
+    glm::vec3 d = point - glm::clamp(point, aabb.min, aabb.max);
+    return glm::dot(d, d);
+}
+
+bool overlaps(const aabb_t& a, const aabb_t& b) {
+    return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::lessThanEqual(b.min, a.max));
+}
+
+// closest point on the triangle by the voronoi region of the point (Ericson, Real-Time Collision Detection 5.1.5)
+glm::vec3 closest_point(const triangle_t& triangle, const glm::vec3& p) {
+    const glm::vec3& a = triangle.p0, &b = triangle.p1, &c = triangle.p2;
+    const glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0)
+        return a;
+
+    const glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3)
+        return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+        return a + ab * (d1 / (d1 - d3));
+
+    const glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6)
+        return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+        return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// separating axis test with the 3 box axes, the triangle normal and the 9 edge cross products (Akenine-Moller)
+bool overlaps(const triangle_t& triangle, const aabb_t& aabb) {
+    const glm::vec3 center = 0.5f * (aabb.min + aabb.max), half = 0.5f * (aabb.max - aabb.min);
+    const glm::vec3 v[3] = { triangle.p0 - center, triangle.p1 - center, triangle.p2 - center };
+    auto separated = [&](const glm::vec3& axis) {
+        float p0 = glm::dot(v[0], axis), p1 = glm::dot(v[1], axis), p2 = glm::dot(v[2], axis);
+        float r = glm::dot(half, glm::abs(axis));
+        return std::max({ p0, p1, p2 }) < -r || std::min({ p0, p1, p2 }) > r;
+    };
+
+    for (int axis = 0; axis < 3; axis++) {
+        glm::vec3 unit{ 0 };
+        unit[axis] = 1;
+        if (separated(unit))
+            return false;
+    }
+    const glm::vec3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+    if (separated(glm::cross(edges[0], edges[1])))
+        return false;
+    for (auto& edge : edges) {
+        for (int axis = 0; axis < 3; axis++) {
+            glm::vec3 unit{ 0 };
+            unit[axis] = 1;
+            if (separated(glm::cross(unit, edge)))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool overlaps(const triangle_t& triangle, const glm::vec3& center, float radius) {
+    glm::vec3 d = closest_point(triangle, center) - center;
+    return glm::dot(d, d) <= radius * radius;
+}
+
+} // namespace
+
+scene_query_t::scene_query_t(const bvh_view_t& bvh, std::span<const triangle_t> triangles, core::thread_pool_t& thread_pool, const scene_query_config_t& config)
+  : bvh(bvh), triangles(triangles), config(config), thread_pool(thread_pool) {}
+
+uint32_t scene_query_t::execute(std::span<const query_t> queries, std::span<query_result_t> results, std::span<uint32_t> overlaps) {
+    assert(results.size() >= queries.size());
+    std::atomic<uint32_t> overlap_count = 0;
+    thread_pool.parallel_for(0, queries.size(), config.grain_size, [&](uint32_t begin, uint32_t end) {
+        // a query only claims its range of overlaps once it is complete, so the atomic is touched once per overlap query
+        std::vector<uint32_t> scratch;
+        for (uint32_t i = begin; i < end; i++) {
+            const query_t& query = queries[i];
+            if (query.type != query_type_t::aabb_overlap && query.type != query_type_t::sphere_overlap) {
+                results[i] = find(query);
+                continue;
+            }
+
+            scratch.clear();
+            overlap(query, [&](uint32_t primitive_index) { scratch.push_back(primitive_index); return true; });
+            query_result_t& result = results[i];
+            result = { .hit = hit_t::none(), .distance = 0, .point = {}, .first_overlap = 0, .overlap_count = 0, .truncated = false };
+            if (scratch.empty())
+                continue;
+            uint32_t first = overlap_count.fetch_add(scratch.size(), std::memory_order_relaxed);
+            uint32_t count = first < overlaps.size() ? std::min<uint32_t>(scratch.size(), overlaps.size() - first) : 0;
+            std::copy(scratch.begin(), scratch.begin() + count, overlaps.begin() + std::min<size_t>(first, overlaps.size()));
+            result.first_overlap = std::min<size_t>(first, overlaps.size());
+            result.overlap_count = count;
+            result.truncated = count < scratch.size();
+        }
+    });
+    return std::min<size_t>(overlap_count, overlaps.size());
+}
+
+query_result_t scene_query_t::execute(const query_t& query, std::span<uint32_t> overlaps) const {
+    if (query.type != query_type_t::aabb_overlap && query.type != query_type_t::sphere_overlap)
+        return find(query);
+
+    query_result_t result{ .hit = hit_t::none(), .distance = 0, .point = {}, .first_overlap = 0, .overlap_count = 0, .truncated = false };
+    overlap(query, [&](uint32_t primitive_index) {
+        if (result.overlap_count == overlaps.size()) {
+            result.truncated = true;
+            return false;
+        }
+        overlaps[result.overlap_count++] = primitive_index;
+        return true;
+    });
+    return result;
+}
+
+query_result_t scene_query_t::find(const query_t& query) const {
+    query_result_t result{ .hit = hit_t::none(), .distance = std::numeric_limits<float>::infinity(), .point = {}, .first_overlap = 0, .overlap_count = 0, .truncated = false };
+    if (query.type == query_type_t::closest_hit || query.type == query_type_t::any_hit) {
+        ray_t ray = query.ray;
+        result.hit = query.type == query_type_t::closest_hit ? bvh.closest_hit(ray, triangles) : bvh.any_hit(ray, triangles);
+        if (result.hit) {
+            result.distance = ray.tmax;
+            result.point = ray.origin + ray.direction * ray.tmax;
+        }
+        return result;
+    }
+
+    // closest point, nearer children first and subtrees dropped once their box is further away than the best point so far
+    struct entry_t {
+        uint32_t node_index;
+        float squared_distance;
+    };
+    // both children may be pushed, so a level can leave one more entry than the ordered ray traversal
+    traversal_stack_t<entry_t, bvh_view_t::max_stack_size + 1> stack;
+    const glm::vec3 point = query.center;
+    float best = query.radius * query.radius;
+    if (squared_distance(bvh.nodes[0].aabb, point) <= best)
+        stack.push({ 0, 0 });
+    while (!stack.empty()) {
+        entry_t entry = stack.pop();
+        if (entry.squared_distance > best)
+            continue;
+        const node_t& node = bvh.nodes[entry.node_index];
+        if (node.is_leaf()) {
+            for (uint32_t i = 0; i < node.primitive_count; i++) {
+                uint32_t primitive_index = bvh.primitive_indices[node.first_index + i];
+                glm::vec3 closest = closest_point(triangles[primitive_index], point);
+                glm::vec3 d = closest - point;
+                if (glm::dot(d, d) <= best) {
+                    best = glm::dot(d, d);
+                    result.hit.primitive_index = primitive_index;
+                    result.point = closest;
+                }
+            }
+            continue;
+        }
+
+        entry_t near = { node.first_index, squared_distance(bvh.nodes[node.first_index].aabb, point) };
+        entry_t far = { node.first_index + 1, squared_distance(bvh.nodes[node.first_index + 1].aabb, point) };
+        if (near.squared_distance > far.squared_distance)
+            std::swap(near, far);
+        if (far.squared_distance <= best)
+            stack.push(far);
+        if (near.squared_distance <= best)
+            stack.push(near);
+    }
+    if (result.hit)
+        result.distance = std::sqrt(best);
+    return result;
+}
+
+template <typename visit_t>
+void scene_query_t::overlap(const query_t& query, const visit_t& visit) const {
+    const bool sphere = query.type == query_type_t::sphere_overlap;
+    auto node_overlaps = [&](const aabb_t& aabb) {
+        return sphere ? squared_distance(aabb, query.center) <= query.radius * query.radius : overlaps(aabb, query.aabb);
+    };
+
+    traversal_stack_t<uint32_t, bvh_view_t::max_stack_size + 1> stack;
+    if (node_overlaps(bvh.nodes[0].aabb))
+        stack.push(0);
+    while (!stack.empty()) {
+        const node_t& node = bvh.nodes[stack.pop()];
+        if (node.is_leaf()) {
+            for (uint32_t i = 0; i < node.primitive_count; i++) {
+                uint32_t primitive_index = bvh.primitive_indices[node.first_index + i];
+                const triangle_t& triangle = triangles[primitive_index];
+                bool hit = sphere ? overlaps(triangle, query.center, query.radius) : overlaps(triangle, query.aabb);
+                if (hit && !visit(primitive_index))
+                    return;
+            }
+            continue;
+        }
+
+        for (uint32_t child = node.first_index; child < node.first_index + 2; child++)
+            if (node_overlaps(bvh.nodes[child].aabb))
+                stack.push(child);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef scene_query_hpp
+#define scene_query_hpp
+
+#include "bvh.hpp"
+
+enum class query_type_t : uint32_t {
+    closest_hit,
+    any_hit,
+    aabb_overlap,
+    sphere_overlap,
+    closest_point,
+};
+
+// one spatial query against the triangles of a scene, made with the named constructors
+struct query_t {
+    static query_t closest_hit(const ray_t& ray) { return { .type = query_type_t::closest_hit, .ray = ray }; }
+    static query_t any_hit(const ray_t& ray) { return { .type = query_type_t::any_hit, .ray = ray }; }
+    static query_t aabb_overlap(const aabb_t& aabb) { return { .type = query_type_t::aabb_overlap, .aabb = aabb }; }
+    static query_t sphere_overlap(const glm::vec3& center, float radius) { return { .type = query_type_t::sphere_overlap, .center = center, .radius = radius }; }
+    // radius bounds the search, nothing further away is reported
+    static query_t closest_point(const glm::vec3& point, float radius = std::numeric_limits<float>::infinity()) {
+        return { .type = query_type_t::closest_point, .center = point, .radius = radius };
+    }
+
+    query_type_t type;
+    ray_t ray{};
+    aabb_t aabb{};
+    glm::vec3 center{};
+    float radius = 0;
+};
+
+struct query_result_t {
+    // ray queries and closest_point, none() when nothing was found
+    hit_t hit;
+    // distance along the ray or from the query point
+    float distance;
+    // hit position or closest point on the mesh
+    glm::vec3 point;
+    // overlap queries, the overlapping primitives are overlaps[first_overlap, first_overlap + overlap_count)
+    uint32_t first_overlap;
+    uint32_t overlap_count;
+    // the overlaps span ran out, overlap_count only holds the primitives that were written
+    bool truncated;
+};
+
+// tuning of scene_query_t
+struct scene_query_config_t {
+    // queries per task, small enough that a batch of a few hundred picks and probes still spreads over the pool
+    uint32_t grain_size = 64;
+};
+
+// answers batches of mixed queries (picking, physics probes, audio occlusion) against a triangle soup indexed by a bvh
+// one batch is one parallel_for over the pool, so the scheduling cost is paid per batch instead of per query
+// bvh, triangles and the pool have to outlive the service
+struct scene_query_t {
+    scene_query_t(const bvh_view_t& bvh, std::span<const triangle_t> triangles, core::thread_pool_t& thread_pool, const scene_query_config_t& config = {});
+
+    // results[i] answers queries[i], overlap queries append their primitives to overlaps in no particular order between
+    // queries, returns the number of overlaps written
+    uint32_t execute(std::span<const query_t> queries, std::span<query_result_t> results, std::span<uint32_t> overlaps = {});
+
+    // a single query on the calling thread, overlaps receives at most overlaps.size() primitives
+    query_result_t execute(const query_t& query, std::span<uint32_t> overlaps = {}) const;
+
+private:
+    // closest_hit, any_hit and closest_point
+    query_result_t find(const query_t& query) const;
+    // calls visit(primitive_index) for every primitive overlapping the box or sphere of query
+    template <typename visit_t>
+    void overlap(const query_t& query, const visit_t& visit) const;
+
+    bvh_view_t bvh;
+    std::span<const triangle_t> triangles;
+    scene_query_config_t config;
+    core::thread_pool_t& thread_pool;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef simd_hpp
+#define simd_hpp
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define SIMD_SSE
+#endif
+
+#if defined(__AVX__)
+#define SIMD_AVX
+#endif
+
+// 8 float lanes, avx when available and a plain array the compiler can vectorize otherwise
+// comparisons return a bitmask with bit i set for lane i, lane updates are done on the mask
+struct float8_t {
+    static constexpr uint32_t lanes = 8;
+    static constexpr uint32_t all = 0xff;
+
+#if defined(SIMD_AVX)
+    __m256 v;
+
+    static float8_t load(const float *p) { return { _mm256_loadu_ps(p) }; }
+    static float8_t broadcast(float x) { return { _mm256_set1_ps(x) }; }
+#if defined(__AVX2__)
+    static float8_t gather(const float *p, const uint32_t *indices) {
+        return { _mm256_i32gather_ps(p, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indices)), 4) };
+    }
+#else
+    static float8_t gather(const float *p, const uint32_t *indices) {
+        return { _mm256_setr_ps(p[indices[0]], p[indices[1]], p[indices[2]], p[indices[3]], p[indices[4]], p[indices[5]], p[indices[6]], p[indices[7]]) };
+    }
+#endif
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    friend float8_t operator + (float8_t a, float8_t b) { return { _mm256_add_ps(a.v, b.v) }; }
+    friend float8_t operator - (float8_t a, float8_t b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    friend float8_t operator * (float8_t a, float8_t b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    friend float8_t operator / (float8_t a, float8_t b) { return { _mm256_div_ps(a.v, b.v) }; }
+    friend float8_t min(float8_t a, float8_t b) { return { _mm256_min_ps(a.v, b.v) }; }
+    friend float8_t max(float8_t a, float8_t b) { return { _mm256_max_ps(a.v, b.v) }; }
+    friend uint32_t operator <= (float8_t a, float8_t b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+    friend uint32_t operator >= (float8_t a, float8_t b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)); }
+#else
+    float v[lanes];
+
+    static float8_t load(const float *p) { float8_t r; std::copy(p, p + lanes, r.v); return r; }
+    static float8_t broadcast(float x) { float8_t r; std::fill(r.v, r.v + lanes, x); return r; }
+    static float8_t gather(const float *p, const uint32_t *indices) { float8_t r; for (uint32_t i = 0; i < lanes; i++) r.v[i] = p[indices[i]]; return r; }
+    void store(float *p) const { std::copy(v, v + lanes, p); }
+
+    template <typename op_t>
+    static float8_t apply(float8_t a, float8_t b, op_t op) { float8_t r; for (uint32_t i = 0; i < lanes; i++) r.v[i] = op(a.v[i], b.v[i]); return r; }
+    template <typename op_t>
+    static uint32_t compare(float8_t a, float8_t b, op_t op) { uint32_t r = 0; for (uint32_t i = 0; i < lanes; i++) r |= static_cast<uint32_t>(op(a.v[i], b.v[i])) << i; return r; }
+
+    friend float8_t operator + (float8_t a, float8_t b) { return apply(a, b, [](float x, float y) { return x + y; }); }
+    friend float8_t operator - (float8_t a, float8_t b) { return apply(a, b, [](float x, float y) { return x - y; }); }
+    friend float8_t operator * (float8_t a, float8_t b) { return apply(a, b, [](float x, float y) { return x * y; }); }
+    friend float8_t operator / (float8_t a, float8_t b) { return apply(a, b, [](float x, float y) { return x / y; }); }
+    friend float8_t min(float8_t a, float8_t b) { return apply(a, b, [](float x, float y) { return x < y ? x : y; }); }
+    friend float8_t max(float8_t a, float8_t b) { return apply(a, b, [](float x, float y) { return x > y ? x : y; }); }
+    friend uint32_t operator <= (float8_t a, float8_t b) { return compare(a, b, [](float x, float y) { return x <= y; }); }
+    friend uint32_t operator >= (float8_t a, float8_t b) { return compare(a, b, [](float x, float y) { return x >= y; }); }
+#endif
+};
+
+// 4 float lanes, same interface as float8_t, for data that comes in fours like 4 wide triangle blocks
+struct float4_t {
+    static constexpr uint32_t lanes = 4;
+    static constexpr uint32_t all = 0xf;
+
+#if defined(SIMD_SSE)
+    __m128 v;
+
+    static float4_t load(const float *p) { return { _mm_loadu_ps(p) }; }
+    static float4_t broadcast(float x) { return { _mm_set1_ps(x) }; }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend float4_t operator + (float4_t a, float4_t b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend float4_t operator - (float4_t a, float4_t b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend float4_t operator * (float4_t a, float4_t b) { return { _mm_mul_ps(a.v, b.v) }; }
+    friend float4_t operator / (float4_t a, float4_t b) { return { _mm_div_ps(a.v, b.v) }; }
+    friend float4_t min(float4_t a, float4_t b) { return { _mm_min_ps(a.v, b.v) }; }
+    friend float4_t max(float4_t a, float4_t b) { return { _mm_max_ps(a.v, b.v) }; }
+    friend uint32_t operator <= (float4_t a, float4_t b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+    friend uint32_t operator >= (float4_t a, float4_t b) { return _mm_movemask_ps(_mm_cmpge_ps(a.v, b.v)); }
+#else
+    float v[lanes];
+
+    static float4_t load(const float *p) { float4_t r; std::copy(p, p + lanes, r.v); return r; }
+    static float4_t broadcast(float x) { float4_t r; std::fill(r.v, r.v + lanes, x); return r; }
+    void store(float *p) const { std::copy(v, v + lanes, p); }
+
+    template <typename op_t>
+    static float4_t apply(float4_t a, float4_t b, op_t op) { float4_t r; for (uint32_t i = 0; i < lanes; i++) r.v[i] = op(a.v[i], b.v[i]); return r; }
+    template <typename op_t>
+    static uint32_t compare(float4_t a, float4_t b, op_t op) { uint32_t r = 0; for (uint32_t i = 0; i < lanes; i++) r |= static_cast<uint32_t>(op(a.v[i], b.v[i])) << i; return r; }
+
+    friend float4_t operator + (float4_t a, float4_t b) { return apply(a, b, [](float x, float y) { return x + y; }); }
+    friend float4_t operator - (float4_t a, float4_t b) { return apply(a, b, [](float x, float y) { return x - y; }); }
+    friend float4_t operator * (float4_t a, float4_t b) { return apply(a, b, [](float x, float y) { return x * y; }); }
+    friend float4_t operator / (float4_t a, float4_t b) { return apply(a, b, [](float x, float y) { return x / y; }); }
+    friend float4_t min(float4_t a, float4_t b) { return apply(a, b, [](float x, float y) { return x < y ? x : y; }); }
+    friend float4_t max(float4_t a, float4_t b) { return apply(a, b, [](float x, float y) { return x > y ? x : y; }); }
+    friend uint32_t operator <= (float4_t a, float4_t b) { return compare(a, b, [](float x, float y) { return x <= y; }); }
+    friend uint32_t operator >= (float4_t a, float4_t b) { return compare(a, b, [](float x, float y) { return x >= y; }); }
+#endif
+};
+
+template <typename floatn_t>
+struct vec3xn_t {
+    floatn_t x, y, z;
+
+    static vec3xn_t broadcast(const glm::vec3& v) { return { floatn_t::broadcast(v.x), floatn_t::broadcast(v.y), floatn_t::broadcast(v.z) }; }
+
+    friend vec3xn_t operator - (const vec3xn_t& a, const vec3xn_t& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+};
+
+using vec3x4_t = vec3xn_t<float4_t>;
+using vec3x8_t = vec3xn_t<float8_t>;
+
+template <typename floatn_t>
+inline floatn_t dot(const vec3xn_t<floatn_t>& a, const vec3xn_t<floatn_t>& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+template <typename floatn_t>
+inline vec3xn_t<floatn_t> cross(const vec3xn_t<floatn_t>& a, const vec3xn_t<floatn_t>& b) {
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+#endif
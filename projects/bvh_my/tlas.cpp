@@ -0,0 +1,50 @@
+#include "tlas.hpp"
+
+
+blas_t blas_t::build(std::vector<triangle_t> triangles, uint32_t thread_count) {
+    std::vector<aabb_t> aabbs(triangles.size());
+    std::vector<glm::vec3> centers(triangles.size());
+    for (uint32_t i = 0; i < triangles.size(); i++) {
+        aabbs[i] = aabb_t::empty();
+        aabbs[i].extend(triangles[i].p0).extend(triangles[i].p1).extend(triangles[i].p2);
+        centers[i] = (triangles[i].p0 + triangles[i].p1 + triangles[i].p2) / 3.0f;
+    }
+
+    blas_t blas{};
+    blas.bvh = bvh_t::build(aabbs.data(), centers.data(), triangles.size(), thread_count);
+    blas.triangles = std::move(triangles);
+    return blas;
+}
+
+tlas_t tlas_t::build(const std::vector<blas_t>& blases, std::vector<instance_t> instances, uint32_t thread_count) {
+    tlas_t tlas{};
+    tlas.blases = &blases;
+    tlas.instances = std::move(instances);
+    tlas.inverse_transforms.resize(tlas.instances.size());
+    tlas.aabbs.resize(tlas.instances.size());
+    tlas.centers.resize(tlas.instances.size());
+    for (uint32_t i = 0; i < tlas.instances.size(); i++)
+        tlas.set_transform(i, tlas.instances[i].transform);
+    tlas.rebuild(thread_count);
+    return tlas;
+}
+
+void tlas_t::set_transform(uint32_t instance_index, const glm::mat4& transform) {
+    instance_t& instance = instances[instance_index];
+    instance.transform = transform;
+    inverse_transforms[instance_index] = glm::inverse(transform);
+
+    // world bounds of the transformed mesh bounds, looser than transforming every vertex but independent of the mesh size
+    const aabb_t& mesh_aabb = (*blases)[instance.blas_index].bvh.nodes[0].aabb;
+    aabb_t& aabb = aabbs[instance_index];
+    aabb = aabb_t::empty();
+    for (uint32_t corner = 0; corner < 8; corner++) {
+        glm::vec3 point{ corner & 1 ? mesh_aabb.max.x : mesh_aabb.min.x, corner & 2 ? mesh_aabb.max.y : mesh_aabb.min.y, corner & 4 ? mesh_aabb.max.z : mesh_aabb.min.z };
+        aabb.extend(glm::vec3{ transform * glm::vec4{ point, 1.0f } });
+    }
+    centers[instance_index] = (aabb.min + aabb.max) * 0.5f;
+}
+
+void tlas_t::rebuild(uint32_t thread_count) {
+    bvh = bvh_t::build(aabbs.data(), centers.data(), instances.size(), thread_count);
+}
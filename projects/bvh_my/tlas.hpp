@@ -0,0 +1,80 @@
+#ifndef tlas_hpp
+#define tlas_hpp
+
+#include "bvh.hpp"
+
+// bottom level structure, one per mesh, the triangles stay in mesh space and are shared by every instance of the mesh
+struct blas_t {
+    static blas_t build(std::vector<triangle_t> triangles, uint32_t thread_count = 1);
+
+    std::vector<triangle_t> triangles;
+    bvh_t bvh;
+};
+
+// placement of a blas in the world, mirrors VkAccelerationStructureInstanceKHR
+struct instance_t {
+    // mesh space to world space
+    glm::mat4 transform;
+    uint32_t blas_index;
+    // handed back with hits like instanceCustomIndex, e.g. the first primitive of the mesh in a flattened material table
+    uint32_t custom_index;
+};
+
+struct instance_hit_t {
+    uint32_t instance_index;
+    uint32_t custom_index;
+    // index into the triangles of the instance's blas
+    uint32_t primitive_index;
+    operator bool() const { return instance_index != static_cast<uint32_t>(-1); }
+    static instance_hit_t none() { return { static_cast<uint32_t>(-1), 0, static_cast<uint32_t>(-1) }; }
+};
+
+// top level structure, a bvh over the world space bounds of the instances
+// rays are moved into mesh space for every instance they reach, so moving an instance only rebuilds this level
+// blases has to outlive the tlas and must not be resized while it is in use
+struct tlas_t {
+    static tlas_t build(const std::vector<blas_t>& blases, std::vector<instance_t> instances, uint32_t thread_count = 1);
+
+    // takes effect on the next rebuild
+    void set_transform(uint32_t instance_index, const glm::mat4& transform);
+    // rebuilds the instance bvh from the current transforms, cheap as long as the instance count is
+    void rebuild(uint32_t thread_count = 1);
+
+    instance_hit_t closest_hit(ray_t& ray) const { return traverse<false>(ray); }
+    instance_hit_t any_hit(ray_t& ray) const { return traverse<true>(ray); }
+
+    const std::vector<blas_t> *blases;
+    std::vector<instance_t> instances;
+    // world to mesh space of every instance
+    std::vector<glm::mat4> inverse_transforms;
+    std::vector<aabb_t> aabbs;
+    std::vector<glm::vec3> centers;
+    bvh_t bvh;
+
+private:
+    template <bool any_hit>
+    instance_hit_t traverse(ray_t& ray) const {
+        instance_hit_t instance_hit = instance_hit_t::none();
+        hit_t hit = bvh.traverse_ordered<any_hit>(ray, [&](uint32_t instance_index, ray_t& ray) {
+            const instance_t& instance = instances[instance_index];
+            const blas_t& blas = (*blases)[instance.blas_index];
+            const glm::mat4& inverse_transform = inverse_transforms[instance_index];
+
+            // the direction is not renormalized, so distances along the ray are the same in both spaces
+            ray_t mesh_ray = ray;
+            mesh_ray.origin = glm::vec3{ inverse_transform * glm::vec4{ ray.origin, 1.0f } };
+            mesh_ray.direction = glm::vec3{ inverse_transform * glm::vec4{ ray.direction, 0.0f } };
+            hit_t mesh_hit = any_hit ? blas.bvh.any_hit(mesh_ray, blas.triangles) : blas.bvh.closest_hit(mesh_ray, blas.triangles);
+            if (!mesh_hit)
+                return false;
+            ray.tmax = mesh_ray.tmax;
+            instance_hit.custom_index = instance.custom_index;
+            instance_hit.primitive_index = mesh_hit.primitive_index;
+            return true;
+        });
+        instance_hit.instance_index = hit.primitive_index;
+        return instance_hit;
+    }
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "bvh.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <bit>
+#include <chrono>
+#include <iostream>
+
+struct bvh_t::treelet_optimizer_t {
+
+    // restructuring moves subtrees between nodes that are not siblings in bvh_t::nodes, so it works on a pointer based copy
+    struct tree_node_t {
+        bool is_leaf() const { return primitive_count != 0; }
+
+        aabb_t aabb;
+        // internal nodes only
+        uint32_t children[2];
+        // leaves only, their range in the primitive_indices of the input
+        uint32_t first_index;
+        uint32_t primitive_count;
+        // primitives below the node, decides which subtrees are worth a task
+        uint32_t subtree_primitive_count;
+        // sah of the subtree without the division by its area, the same weights as bvh_t::sah_cost
+        double cost;
+    };
+
+    static constexpr uint32_t max_treelet_leaves = treelet_config_t::max_treelet_leaves;
+
+    // config with treelet_leaves clamped to [3, max_treelet_leaves], leaves[] and the subset tables are sized for at
+    // most max_treelet_leaves, a clamp is reported on std::cerr
+    static treelet_config_t checked_config(const treelet_config_t& config);
+
+    const treelet_config_t config;
+    core::thread_pool_t& thread_pool;
+    std::chrono::high_resolution_clock::time_point deadline;
+    std::atomic<bool> out_of_time = false;
+    std::vector<tree_node_t> tree;
+
+    uint32_t copy(const bvh_t& bvh, uint32_t node_index);
+    void optimize(uint32_t tree_index);
+    void restructure(uint32_t tree_index);
+    void emit(bvh_t& bvh) const;
+};
+
+uint32_t bvh_t::optimize(uint32_t thread_count, const treelet_config_t& config) {
+    core::thread_pool_t thread_pool{ std::max(thread_count, 1u) };
+    return optimize(thread_pool, config);
+}
+
+uint32_t bvh_t::optimize(core::thread_pool_t& thread_pool, const treelet_config_t& config) {
+    // a single leaf or a root with two leaves has nothing to rearrange
+    if (nodes.size() < 5)
+        return 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    treelet_optimizer_t optimizer{ .config = treelet_optimizer_t::checked_config(config), .thread_pool = thread_pool };
+    optimizer.deadline = start + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double, std::milli>(config.time_budget_ms));
+    optimizer.tree.reserve(nodes.size());
+    optimizer.copy(*this, 0);
+
+    uint32_t pass = 0;
+    while (pass < config.max_passes && !optimizer.out_of_time) {
+        double cost = optimizer.tree[0].cost;
+        optimizer.optimize(0);
+        pass++;
+        if (optimizer.tree[0].cost > cost * (1.0 - config.min_improvement))
+            break;
+    }
+    optimizer.emit(*this);
+    return pass;
+}
+
+treelet_config_t bvh_t::treelet_optimizer_t::checked_config(const treelet_config_t& config) {
+    treelet_config_t checked = config;
+    checked.treelet_leaves = std::clamp(config.treelet_leaves, 3u, max_treelet_leaves);
+    if (checked.treelet_leaves != config.treelet_leaves)
+        std::cerr << "bvh_t::optimize: treelet_leaves " << config.treelet_leaves << " clamped to " << checked.treelet_leaves << '\n';
+    return checked;
+}
+
+uint32_t bvh_t::treelet_optimizer_t::copy(const bvh_t& bvh, uint32_t node_index) {
+    const node_t& node = bvh.nodes[node_index];
+    uint32_t tree_index = tree.size();
+    tree.push_back({ .aabb = node.aabb, .children = { 0, 0 }, .first_index = node.first_index, .primitive_count = node.primitive_count });
+    if (node.is_leaf()) {
+        tree[tree_index].subtree_primitive_count = node.primitive_count;
+        tree[tree_index].cost = static_cast<double>(node.aabb.half_area()) * node.primitive_count;
+    } else {
+        uint32_t left = copy(bvh, node.first_index);
+        uint32_t right = copy(bvh, node.first_index + 1);
+        tree_node_t& tree_node = tree[tree_index];
+        tree_node.children[0] = left;
+        tree_node.children[1] = right;
+        tree_node.subtree_primitive_count = tree[left].subtree_primitive_count + tree[right].subtree_primitive_count;
+        tree_node.cost = static_cast<double>(node.aabb.half_area()) * config.build.traversal_cost + tree[left].cost + tree[right].cost;
+    }
+    return tree_index;
+}
+
+void bvh_t::treelet_optimizer_t::optimize(uint32_t tree_index) {
+    if (tree[tree_index].is_leaf())
+        return;
+    if (std::chrono::high_resolution_clock::now() > deadline)
+        out_of_time = true;
+    if (out_of_time)
+        return;
+
+    // disjoint subtrees restructure independently, large ones go to the pool
+    const uint32_t left = tree[tree_index].children[0], right = tree[tree_index].children[1];
+    if (tree[tree_index].subtree_primitive_count > config.build.parallel_task_threshold) {
+        core::task_group_t task_group{};
+        thread_pool.run(task_group, [this, left]() { optimize(left); });
+        optimize(right);
+        thread_pool.wait(task_group);
+    } else {
+        optimize(left);
+        optimize(right);
+    }
+
+    tree_node_t& node = tree[tree_index];
+    node.cost = static_cast<double>(node.aabb.half_area()) * config.build.traversal_cost + tree[left].cost + tree[right].cost;
+    restructure(tree_index);
+}
+
+void bvh_t::treelet_optimizer_t::restructure(uint32_t tree_index) {
+    // grow the treelet by opening the leaf with the largest area, that is where a better topology saves the most
+    uint32_t leaves[max_treelet_leaves];
+    uint32_t internals[max_treelet_leaves - 1];
+    uint32_t leaf_count = 2, internal_count = 1;
+    leaves[0] = tree[tree_index].children[0];
+    leaves[1] = tree[tree_index].children[1];
+    internals[0] = tree_index;
+    while (leaf_count < config.treelet_leaves) {
+        uint32_t largest = leaf_count;
+        float largest_area = -1;
+        for (uint32_t i = 0; i < leaf_count; i++) {
+            const tree_node_t& leaf = tree[leaves[i]];
+            if (!leaf.is_leaf() && leaf.aabb.half_area() > largest_area) {
+                largest = i;
+                largest_area = leaf.aabb.half_area();
+            }
+        }
+        if (largest == leaf_count)
+            break;
+        const tree_node_t& opened = tree[leaves[largest]];
+        internals[internal_count++] = leaves[largest];
+        leaves[largest] = opened.children[0];
+        leaves[leaf_count++] = opened.children[1];
+    }
+    if (leaf_count < 3)
+        return;
+
+    // best cost of every subset of the leaves as a subtree, proper subsets of a set are smaller numbers so increasing order
+    // has every partition ready, partitions[set] is one side of the best split of set
+    constexpr uint32_t max_set_count = 1u << max_treelet_leaves;
+    const uint32_t set_count = 1u << leaf_count;
+    aabb_t aabbs[max_set_count];
+    double costs[max_set_count];
+    uint32_t partitions[max_set_count];
+    for (uint32_t set = 1; set < set_count; set++) {
+        const uint32_t lowest = set & (0u - set);
+        const tree_node_t& leaf = tree[leaves[std::countr_zero(lowest)]];
+        if (set == lowest) {
+            aabbs[set] = leaf.aabb;
+            costs[set] = leaf.cost;
+            continue;
+        }
+        aabbs[set] = aabbs[set ^ lowest];
+        aabbs[set].extend(leaf.aabb);
+
+        // only the side holding the lowest leaf, the other side would visit every split twice
+        double best_cost = std::numeric_limits<double>::max();
+        uint32_t best_partition = 0;
+        for (uint32_t partition = (set - 1) & set; partition != 0; partition = (partition - 1) & set) {
+            if (!(partition & lowest))
+                continue;
+            double cost = costs[partition] + costs[set ^ partition];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_partition = partition;
+            }
+        }
+        costs[set] = static_cast<double>(aabbs[set].half_area()) * config.build.traversal_cost + best_cost;
+        partitions[set] = best_partition;
+    }
+
+    // the summation order differs from the current tree, ignore differences that are only rounding
+    const uint32_t all = set_count - 1;
+    if (costs[all] >= tree[tree_index].cost * (1.0 - 1e-9))
+        return;
+
+    // the internal nodes of the treelet are reused for the new topology, the root keeps its index
+    uint32_t next_internal = 1;
+    auto rebuild = [&](auto& self, uint32_t node_index, uint32_t set) -> void {
+        const uint32_t sides[2] = { partitions[set], set ^ partitions[set] };
+        tree_node_t& node = tree[node_index];
+        for (uint32_t i = 0; i < 2; i++) {
+            if (std::has_single_bit(sides[i])) {
+                node.children[i] = leaves[std::countr_zero(sides[i])];
+            } else {
+                node.children[i] = internals[next_internal++];
+                self(self, node.children[i], sides[i]);
+            }
+        }
+        node.aabb = aabbs[set];
+        node.cost = costs[set];
+        node.subtree_primitive_count = tree[node.children[0]].subtree_primitive_count + tree[node.children[1]].subtree_primitive_count;
+    };
+    rebuild(rebuild, tree_index, all);
+    assert(next_internal == internal_count);
+}
+
+void bvh_t::treelet_optimizer_t::emit(bvh_t& bvh) const {
+    std::vector<node_t> nodes;
+    std::vector<uint32_t> primitive_indices;
+    nodes.reserve(bvh.nodes.size());
+    primitive_indices.reserve(bvh.primitive_indices.size());
+    nodes.push_back({ .aabb = tree[0].aabb });
+
+    // (tree index, node index), same order as reorder_depth_first, leaves are reached left to right so every subtree
+    // gets a contiguous range of primitive_indices again
+    std::stack<std::pair<uint32_t, uint32_t>> stack;
+    stack.push({ 0, 0 });
+    while (!stack.empty()) {
+        auto [tree_index, node_index] = stack.top();
+        stack.pop();
+        const tree_node_t& tree_node = tree[tree_index];
+        if (tree_node.is_leaf()) {
+            nodes[node_index].primitive_count = tree_node.primitive_count;
+            nodes[node_index].first_index = primitive_indices.size();
+            primitive_indices.insert(primitive_indices.end(), bvh.primitive_indices.begin() + tree_node.first_index,
+                                     bvh.primitive_indices.begin() + tree_node.first_index + tree_node.primitive_count);
+            continue;
+        }
+
+        uint32_t first_child = nodes.size();
+        nodes[node_index].first_index = first_child;
+        nodes.push_back({ .aabb = tree[tree_node.children[0]].aabb });
+        nodes.push_back({ .aabb = tree[tree_node.children[1]].aabb });
+        stack.push({ tree_node.children[1], first_child + 1 });
+        stack.push({ tree_node.children[0], first_child });
+    }
+    bvh.nodes = std::move(nodes);
+    bvh.primitive_indices = std::move(primitive_indices);
+}
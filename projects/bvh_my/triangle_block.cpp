@@ -0,0 +1,38 @@
+#include "triangle_block.hpp"
+
+
+template <uint32_t width>
+leaf_triangles_t<width> leaf_triangles_t<width>::build(const bvh_view_t& bvh, std::span<const triangle_t> triangles) {
+    leaf_triangles_t leaf_triangles{};
+    leaf_triangles.first_block.resize(bvh.nodes.size(), static_cast<uint32_t>(-1));
+
+    // leaves in node order, for depth first trees that is also the order the traversal tends to reach them in
+    for (uint32_t node_index = 0; node_index < bvh.nodes.size(); node_index++) {
+        const node_t& node = bvh.nodes[node_index];
+        if (!node.is_leaf())
+            continue;
+
+        leaf_triangles.first_block[node_index] = leaf_triangles.blocks.size();
+        for (uint32_t first = 0; first < node.primitive_count; first += width) {
+            block_t& block = leaf_triangles.blocks.emplace_back();
+            for (uint32_t lane = 0; lane < width && first + lane < node.primitive_count; lane++) {
+                uint32_t primitive_index = bvh.primitive_indices[node.first_index + first + lane];
+                const triangle_t& triangle = triangles[primitive_index];
+                glm::vec3 e1 = triangle.p0 - triangle.p1;
+                glm::vec3 e2 = triangle.p2 - triangle.p0;
+                glm::vec3 n = glm::cross(e1, e2);
+                for (int axis = 0; axis < 3; axis++) {
+                    block.p0[axis][lane] = triangle.p0[axis];
+                    block.e1[axis][lane] = e1[axis];
+                    block.e2[axis][lane] = e2[axis];
+                    block.n[axis][lane] = n[axis];
+                }
+                block.primitive_index[lane] = primitive_index;
+            }
+        }
+    }
+    return leaf_triangles;
+}
+
+template struct leaf_triangles_t<4>;
+template struct leaf_triangles_t<8>;
@@ -0,0 +1,106 @@
+#ifndef triangle_block_hpp
+#define triangle_block_hpp
+
+#include "bvh.hpp"
+#include "simd.hpp"
+
+#include <bit>
+#include <type_traits>
+
+// up to width triangles of one leaf stored SoA, with the edges and normal triangle_t::intersect recomputes for every ray
+// lanes past the end of the leaf are zero and masked out with the leaf's primitive count
+template <uint32_t width>
+struct alignas(32) triangle_block_t {
+    static_assert(width == 4 || width == 8, "only 4 and 8 wide triangle blocks are supported");
+
+    using floatn_t = std::conditional_t<width == 4, float4_t, float8_t>;
+    static constexpr uint32_t invalid_lane = static_cast<uint32_t>(-1);
+
+    float p0[3][width];
+    // p0 - p1 and p2 - p0
+    float e1[3][width];
+    float e2[3][width];
+    // cross(e1, e2), not normalized
+    float n[3][width];
+    // index into the source triangles, handed back in hit_t
+    uint32_t primitive_index[width];
+};
+
+// same math as triangle_t::intersect on the first count lanes at once
+// returns the lane of the closest hit and shrinks ray.tmax, invalid_lane on a miss
+template <uint32_t width>
+uint32_t intersect(const triangle_block_t<width>& block, uint32_t count, ray_t& ray) {
+    using floatn_t = typename triangle_block_t<width>::floatn_t;
+    using vec3_t = vec3xn_t<floatn_t>;
+    auto load = [](const float (&v)[3][width]) { return vec3_t{ floatn_t::load(v[0]), floatn_t::load(v[1]), floatn_t::load(v[2]) }; };
+
+    const floatn_t zero = floatn_t::broadcast(0);
+    const floatn_t one = floatn_t::broadcast(1);
+    vec3_t e1 = load(block.e1), e2 = load(block.e2), n = load(block.n);
+
+    vec3_t c = load(block.p0) - vec3_t::broadcast(ray.origin);
+    vec3_t r = cross(vec3_t::broadcast(ray.direction), c);
+    floatn_t inverse_det = one / dot(n, vec3_t::broadcast(ray.direction));
+
+    floatn_t u = dot(r, e2) * inverse_det;
+    floatn_t v = dot(r, e1) * inverse_det;
+    floatn_t w = one - u - v;
+    floatn_t t = dot(n, c) * inverse_det;
+
+    uint32_t mask = (u >= zero) & (v >= zero) & (w >= zero) &
+                    (t >= floatn_t::broadcast(ray.tmin)) & (t <= floatn_t::broadcast(ray.tmax)) & ((1u << count) - 1);
+    if (!mask)
+        return triangle_block_t<width>::invalid_lane;
+
+    alignas(32) float t_lanes[width];
+    t.store(t_lanes);
+    uint32_t closest = std::countr_zero(mask);
+    for (mask &= mask - 1; mask; mask &= mask - 1) {
+        uint32_t lane = std::countr_zero(mask);
+        if (t_lanes[lane] < t_lanes[closest])
+            closest = lane;
+    }
+    ray.tmax = t_lanes[closest];
+    return closest;
+}
+
+// the triangles of every leaf of a bvh packed into blocks in leaf order, so leaf tests skip primitive_indices and the
+// per ray edge setup, only valid together with the bvh it was built from
+template <uint32_t width>
+struct leaf_triangles_t {
+    using block_t = triangle_block_t<width>;
+
+    static leaf_triangles_t build(const bvh_view_t& bvh, std::span<const triangle_t> triangles);
+
+    template <bool any_hit>
+    hit_t traverse(const bvh_view_t& bvh, ray_t& ray) const {
+        return bvh.traverse_leaves<any_hit>(ray, [&](uint32_t node_index, const node_t& leaf, ray_t& ray) {
+            hit_t hit = hit_t::none();
+            const block_t *block = &blocks[first_block[node_index]];
+            for (uint32_t first = 0; first < leaf.primitive_count; first += width, block++) {
+                uint32_t lane = intersect(*block, std::min(leaf.primitive_count - first, width), ray);
+                if (lane != block_t::invalid_lane) {
+                    hit.primitive_index = block->primitive_index[lane];
+                    if constexpr (any_hit)
+                        break;
+                }
+            }
+            return hit;
+        });
+    }
+
+    hit_t closest_hit(const bvh_view_t& bvh, ray_t& ray) const { return traverse<false>(bvh, ray); }
+    hit_t any_hit(const bvh_view_t& bvh, ray_t& ray) const { return traverse<true>(bvh, ray); }
+
+    std::vector<block_t> blocks;
+    // first block of every leaf, indexed by node, the blocks of a leaf are consecutive
+    std::vector<uint32_t> first_block;
+};
+
+using leaf_triangles4_t = leaf_triangles_t<4>;
+using leaf_triangles8_t = leaf_triangles_t<8>;
+
+extern template struct leaf_triangles_t<4>;
+extern template struct leaf_triangles_t<8>;
+
+#endif
@@ -0,0 +1,97 @@
+#include "wide_bvh.hpp"
+
+
+template <uint32_t width>
+wide_bvh_t<width> wide_bvh_t<width>::collapse(const bvh_view_t& bvh) {
+    wide_bvh_t wide_bvh{};
+    wide_bvh.primitive_indices.assign(bvh.primitive_indices.begin(), bvh.primitive_indices.end());
+    // a full wide tree over n binary leaves needs about n / (width - 1) nodes
+    wide_bvh.nodes.reserve(bvh.nodes.size() / (width - 1) + 1);
+    wide_bvh.nodes.emplace_back();
+    collapse_recursive(bvh, 0, wide_bvh, 0);
+    return wide_bvh;
+}
+
+template <uint32_t width>
+uint32_t wide_bvh_t<width>::depth(uint32_t node_index) const {
+    const node_t& node = nodes[node_index];
+    uint32_t child_depth = 0;
+    for (uint32_t slot = 0; slot < width; slot++) {
+        if (!node.is_empty(slot) && !node.is_leaf(slot))
+            child_depth = std::max(child_depth, depth(node.child[slot]));
+    }
+    return 1 + child_depth;
+}
+
+template <uint32_t width>
+void wide_bvh_t<width>::collapse_recursive(const bvh_view_t& bvh, uint32_t binary_node_index, wide_bvh_t& wide_bvh, uint32_t node_index) {
+    uint32_t children[width];
+    uint32_t child_count = 0;
+
+    const ::node_t& binary_node = bvh.nodes[binary_node_index];
+    if (binary_node.is_leaf()) {
+        // only happens for a root that is a leaf
+        children[child_count++] = binary_node_index;
+    } else {
+        children[child_count++] = binary_node.first_index;
+        children[child_count++] = binary_node.first_index + 1;
+    }
+
+    // pull grandchildren up into this node, largest surface area first
+    while (child_count < width) {
+        int largest = -1;
+        float largest_area = -1.0f;
+        for (uint32_t i = 0; i < child_count; i++) {
+            const ::node_t& child = bvh.nodes[children[i]];
+            if (!child.is_leaf() && child.aabb.half_area() > largest_area) {
+                largest = i;
+                largest_area = child.aabb.half_area();
+            }
+        }
+        if (largest == -1)
+            break;
+
+        uint32_t first_grandchild = bvh.nodes[children[largest]].first_index;
+        children[largest] = first_grandchild;
+        children[child_count++] = first_grandchild + 1;
+    }
+
+    uint32_t internal_children[width];
+    uint32_t internal_child_count = 0;
+
+    // no references into wide_bvh.nodes here, emplace_back below may reallocate
+    for (uint32_t slot = 0; slot < width; slot++) {
+        aabb_t aabb = aabb_t::empty();
+        uint32_t child = node_t::invalid_child;
+        uint32_t primitive_count = 0;
+
+        if (slot < child_count) {
+            const ::node_t& binary_child = bvh.nodes[children[slot]];
+            aabb = binary_child.aabb;
+            if (binary_child.is_leaf()) {
+                child = binary_child.first_index;
+                primitive_count = binary_child.primitive_count;
+            } else {
+                child = wide_bvh.nodes.size();
+                wide_bvh.nodes.emplace_back();
+                internal_children[internal_child_count++] = slot;
+            }
+        }
+
+        node_t& node = wide_bvh.nodes[node_index];
+        for (int axis = 0; axis < 3; axis++) {
+            node.bounds[axis][slot] = aabb.min[axis];
+            node.bounds[3 + axis][slot] = aabb.max[axis];
+        }
+        node.child[slot] = child;
+        node.primitive_count[slot] = primitive_count;
+    }
+
+    for (uint32_t i = 0; i < internal_child_count; i++) {
+        uint32_t slot = internal_children[i];
+        collapse_recursive(bvh, children[slot], wide_bvh, wide_bvh.nodes[node_index].child[slot]);
+    }
+}
+
+template struct wide_bvh_t<4>;
+template struct wide_bvh_t<8>;
@@ -0,0 +1,200 @@
+#ifndef wide_bvh_hpp
+#define wide_bvh_hpp
+
+#include "bvh.hpp"
+
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define WIDE_BVH_SSE
+#endif
+
+#if defined(__AVX__)
+#define WIDE_BVH_AVX
+#endif
+
+// n-ary bvh collapsed from a binary bvh_t, children bounds are stored SoA so one node test covers all of them
+template <uint32_t width>
+struct alignas(64) wide_node_t {
+    static_assert(width == 4 || width == 8, "only 4 and 8 wide nodes are supported");
+
+    static constexpr uint32_t invalid_child = static_cast<uint32_t>(-1);
+
+    // bounds[axis] are the min planes, bounds[3 + axis] the max planes, unused slots hold an empty aabb and never hit
+    float bounds[6][width];
+    // internal child: index of the wide node, leaf child: first index into primitive_indices
+    uint32_t child[width];
+    // 0 for internal children
+    uint32_t primitive_count[width];
+
+    bool is_empty(uint32_t slot) const { return child[slot] == invalid_child; }
+    bool is_leaf(uint32_t slot) const { return primitive_count[slot] != 0; }
+};
+
+// ray data shared by every node test, near planes are picked per octant so no min/max swap is needed
+struct wide_ray_t {
+    wide_ray_t(const ray_t& ray) {
+        glm::vec3 inverse_direction = ray.inverse_direction();
+        for (int axis = 0; axis < 3; axis++) {
+            this->inverse_direction[axis] = inverse_direction[axis];
+            scaled_origin[axis] = -ray.origin[axis] * inverse_direction[axis];
+            near[axis] = inverse_direction[axis] >= 0 ? axis : 3 + axis;
+            far[axis] = inverse_direction[axis] >= 0 ? 3 + axis : axis;
+        }
+    }
+
+    float inverse_direction[3];
+    float scaled_origin[3];
+    int near[3];
+    int far[3];
+};
+
+// tests 4 children against the ray, planes point at the 4 consecutive floats of each slab plane
+// writes the entry distance of every child and returns a bitmask of the children the ray hits
+inline uint32_t intersect4(const float *const *near_planes, const float *const *far_planes, const wide_ray_t& ray, float tmin, float tmax, float *distances) {
+#if defined(WIDE_BVH_SSE)
+    __m128 tnear = _mm_set1_ps(tmin);
+    __m128 tfar = _mm_set1_ps(tmax);
+    for (int axis = 0; axis < 3; axis++) {
+        __m128 inverse_direction = _mm_set1_ps(ray.inverse_direction[axis]);
+        __m128 scaled_origin = _mm_set1_ps(ray.scaled_origin[axis]);
+        tnear = _mm_max_ps(tnear, _mm_add_ps(_mm_mul_ps(_mm_load_ps(near_planes[axis]), inverse_direction), scaled_origin));
+        tfar = _mm_min_ps(tfar, _mm_add_ps(_mm_mul_ps(_mm_load_ps(far_planes[axis]), inverse_direction), scaled_origin));
+    }
+    _mm_storeu_ps(distances, tnear);
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tnear, tfar)));
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        float tnear = tmin, tfar = tmax;
+        for (int axis = 0; axis < 3; axis++) {
+            tnear = robust_max(tnear, near_planes[axis][i] * ray.inverse_direction[axis] + ray.scaled_origin[axis]);
+            tfar = robust_min(tfar, far_planes[axis][i] * ray.inverse_direction[axis] + ray.scaled_origin[axis]);
+        }
+        distances[i] = tnear;
+        mask |= static_cast<uint32_t>(tnear <= tfar) << i;
+    }
+    return mask;
+#endif
+}
+
+inline uint32_t intersect(const wide_node_t<4>& node, const wide_ray_t& ray, float tmin, float tmax, float *distances) {
+    const float *near_planes[3] = { node.bounds[ray.near[0]], node.bounds[ray.near[1]], node.bounds[ray.near[2]] };
+    const float *far_planes[3] = { node.bounds[ray.far[0]], node.bounds[ray.far[1]], node.bounds[ray.far[2]] };
+    return intersect4(near_planes, far_planes, ray, tmin, tmax, distances);
+}
+
+inline uint32_t intersect(const wide_node_t<8>& node, const wide_ray_t& ray, float tmin, float tmax, float *distances) {
+#if defined(WIDE_BVH_AVX)
+    __m256 tnear = _mm256_set1_ps(tmin);
+    __m256 tfar = _mm256_set1_ps(tmax);
+    for (int axis = 0; axis < 3; axis++) {
+        __m256 inverse_direction = _mm256_set1_ps(ray.inverse_direction[axis]);
+        __m256 scaled_origin = _mm256_set1_ps(ray.scaled_origin[axis]);
+        __m256 near_plane = _mm256_load_ps(node.bounds[ray.near[axis]]);
+        __m256 far_plane = _mm256_load_ps(node.bounds[ray.far[axis]]);
+#if defined(__FMA__)
+        tnear = _mm256_max_ps(tnear, _mm256_fmadd_ps(near_plane, inverse_direction, scaled_origin));
+        tfar = _mm256_min_ps(tfar, _mm256_fmadd_ps(far_plane, inverse_direction, scaled_origin));
+#else
+        tnear = _mm256_max_ps(tnear, _mm256_add_ps(_mm256_mul_ps(near_plane, inverse_direction), scaled_origin));
+        tfar = _mm256_min_ps(tfar, _mm256_add_ps(_mm256_mul_ps(far_plane, inverse_direction), scaled_origin));
+#endif
+    }
+    _mm256_storeu_ps(distances, tnear);
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tnear, tfar, _CMP_LE_OQ)));
+#else
+    // no avx, test the node as two 4 wide halves
+    const float *near_planes[3] = { node.bounds[ray.near[0]], node.bounds[ray.near[1]], node.bounds[ray.near[2]] };
+    const float *far_planes[3] = { node.bounds[ray.far[0]], node.bounds[ray.far[1]], node.bounds[ray.far[2]] };
+    uint32_t mask = intersect4(near_planes, far_planes, ray, tmin, tmax, distances);
+    for (int axis = 0; axis < 3; axis++) {
+        near_planes[axis] += 4;
+        far_planes[axis] += 4;
+    }
+    return mask | (intersect4(near_planes, far_planes, ray, tmin, tmax, distances + 4) << 4);
+#endif
+}
+
+template <uint32_t width>
+struct wide_bvh_t {
+
+    using node_t = wide_node_t<width>;
+
+    // greedily opens the largest internal child until every wide node has up to width children
+    static wide_bvh_t collapse(const bvh_view_t& bvh);
+    static wide_bvh_t collapse(const bvh_t& bvh) { return collapse(bvh.view()); }
+
+    uint32_t depth(uint32_t node_index = 0) const;
+
+    template <typename primitive>
+    hit_t traverse(ray_t& ray, const std::vector<primitive>& primitives) const {
+        struct entry_t {
+            uint32_t index;
+            uint32_t primitive_count;
+            float distance;
+        };
+
+        hit_t hit = hit_t::none();
+        wide_ray_t wide_ray{ ray };
+
+        // every visited node pushes at most width - 1 entries on top of the one it popped
+        traversal_stack_t<entry_t, max_depth * (width - 1) + 1> stack;
+        stack.push({ 0, 0, ray.tmin });
+
+        alignas(32) float distances[width];
+        while (!stack.empty()) {
+            entry_t entry = stack.pop();
+            // the closest hit might have moved past this entry since it was pushed
+            if (entry.distance > ray.tmax)
+                continue;
+
+            if (entry.primitive_count != 0) {
+                for (uint32_t i = 0; i < entry.primitive_count; i++) {
+                    uint32_t primitive_index = primitive_indices[entry.index + i];
+                    if (primitives[primitive_index].intersect(ray))
+                        hit.primitive_index = primitive_index;
+                }
+                continue;
+            }
+
+            const node_t& node = nodes[entry.index];
+            uint32_t mask = intersect(node, wide_ray, ray.tmin, ray.tmax, distances);
+            if (!mask)
+                continue;
+
+            // push hit children far to near so the nearest one is popped first
+            uint32_t first = stack.size();
+            while (mask) {
+                uint32_t slot = std::countr_zero(mask);
+                mask &= mask - 1;
+                entry_t child{ node.child[slot], node.primitive_count[slot], distances[slot] };
+                stack.push(child);
+                uint32_t i = stack.size() - 1;
+                for (; i > first && stack[i - 1].distance < child.distance; i--)
+                    stack[i] = stack[i - 1];
+                stack[i] = child;
+            }
+        }
+        return hit;
+    }
+
+    // depth the inline traversal stack is sized for, collapsing never makes the tree deeper than the binary bvh it came
+    // from so this matches bvh_view_t::max_stack_size, deeper trees still traverse with a heap stack
+    static constexpr uint32_t max_depth = bvh_view_t::max_stack_size;
+
+    std::vector<node_t> nodes;
+    std::vector<uint32_t> primitive_indices;
+
+private:
+    static void collapse_recursive(const bvh_view_t& bvh, uint32_t binary_node_index, wide_bvh_t& wide_bvh, uint32_t node_index);
+};
+
+using bvh4_t = wide_bvh_t<4>;
+using bvh8_t = wide_bvh_t<8>;
+
+extern template struct wide_bvh_t<4>;
+extern template struct wide_bvh_t<8>;
+
+#endif
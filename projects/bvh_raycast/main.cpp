@@ -0,0 +1,301 @@
+#include "bvh.hpp"
+#include "bvh_stats.hpp"
+#include "cpu_renderer.hpp"
+
+#include "core/model.hpp"
+#include "core/thread_pool.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+
+// headless ray casting over bvh_t, no window or gpu so it runs on any ci machine
+// bvh_raycast [model] [--width n] [--height n] [--threads n] [--image file.ppm] [--render samples] [--report file.json] [--heatmap file.ppm]
+
+struct camera_t {
+    glm::vec3 eye, dir, up, right;
+
+    static camera_t look_at(const glm::vec3& eye, const glm::vec3& target) {
+        camera_t camera{};
+        camera.eye = eye;
+        camera.dir = glm::normalize(target - eye);
+        glm::vec3 up = std::abs(camera.dir.y) > 0.99f ? glm::vec3{ 0, 0, 1 } : glm::vec3{ 0, 1, 0 };
+        camera.right = glm::normalize(glm::cross(camera.dir, up));
+        camera.up = glm::cross(camera.right, camera.dir);
+        return camera;
+    }
+};
+
+struct ray_set_t {
+    const char *name;
+    bool any_hit;
+    std::vector<ray_t> rays;
+};
+
+// one camera in the middle of the scene and four orbiting it from outside, all looking at the center
+static std::vector<camera_t> scripted_cameras(const aabb_t& bounds) {
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const glm::vec3 diagonal = bounds.diagonal();
+    const float distance = 0.75f * glm::length(diagonal);
+
+    std::vector<camera_t> cameras;
+    cameras.push_back(camera_t::look_at(center, center - glm::vec3{ 0, 0, 1 }));
+    for (uint32_t i = 0; i < 4; i++) {
+        float angle = 0.25f * 3.14159265f + i * 0.5f * 3.14159265f;
+        glm::vec3 eye = center + glm::vec3{ std::cos(angle) * distance, 0.2f * diagonal.y, std::sin(angle) * distance };
+        cameras.push_back(camera_t::look_at(eye, center));
+    }
+    return cameras;
+}
+
+static void write_ppm(const std::filesystem::path& file_path, const std::vector<uint8_t>& image, uint32_t width, uint32_t height) {
+    std::ofstream out(file_path, std::ofstream::binary);
+    out << "P6 " << width << " " << height << " " << 255 << "\n";
+    // rows are traced bottom up
+    for (uint32_t j = height; j > 0; --j)
+        out.write(reinterpret_cast<const char *>(image.data() + (j - 1) * 3 * width), 3 * width);
+}
+
+// as a quoted json string, file names may contain quotes, backslashes or control characters
+static void write_json_string(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[7];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+template <typename fn_t>
+static double time_ms(const fn_t& fn) {
+    auto start = std::chrono::high_resolution_clock::now();
+    fn();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char **argv) {
+    std::filesystem::path model_path = "../../assets/models/cornell_box.obj";
+    std::filesystem::path image_path;
+    // bvh_stats_t and ray_stats_t of every ray set as json, for comparing builds in ci
+    std::filesystem::path report_path;
+    // nodes visited per primary ray of the first camera
+    std::filesystem::path heatmap_path;
+    uint32_t width = 512, height = 512;
+    uint32_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    // path traced samples of the first camera with cpu_renderer_t, replaces the lambert --image when set
+    uint32_t render_samples = 0;
+
+    for (int i = 1; i < argc; i++) {
+        auto value = [&]() -> const char * {
+            if (i + 1 == argc) {
+                std::cerr << argv[i] << " needs a value" << std::endl;
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if (!std::strcmp(argv[i], "--width"))
+            width = std::max(1, std::atoi(value()));
+        else if (!std::strcmp(argv[i], "--height"))
+            height = std::max(1, std::atoi(value()));
+        else if (!std::strcmp(argv[i], "--threads"))
+            thread_count = std::max(1, std::atoi(value()));
+        else if (!std::strcmp(argv[i], "--image"))
+            image_path = value();
+        else if (!std::strcmp(argv[i], "--report"))
+            report_path = value();
+        else if (!std::strcmp(argv[i], "--heatmap"))
+            heatmap_path = value();
+        else if (!std::strcmp(argv[i], "--render"))
+            render_samples = std::max(0, std::atoi(value()));
+        else if (argv[i][0] == '-') {
+            std::cerr << "usage: bvh_raycast [model] [--width n] [--height n] [--threads n] [--image file.ppm] [--render samples] [--report file.json] [--heatmap file.ppm]" << std::endl;
+            return 1;
+        } else
+            model_path = argv[i];
+    }
+
+    std::vector<triangle_t> triangles;
+    auto model = core::load_model_from_path(model_path);
+    for (auto& mesh : model.meshes) {
+        assert(mesh.indices.size() % 3 == 0);
+        for (uint32_t i = 0; i < mesh.indices.size(); i += 3) {
+            triangle_t triangle{};
+            triangle.p0 = mesh.vertices[mesh.indices[i + 0]].position;
+            triangle.p1 = mesh.vertices[mesh.indices[i + 1]].position;
+            triangle.p2 = mesh.vertices[mesh.indices[i + 2]].position;
+            triangles.push_back(triangle);
+        }
+    }
+    if (triangles.empty()) {
+        std::cerr << "no triangles in " << model_path << std::endl;
+        return 1;
+    }
+    std::cout << "model: " << model_path.filename().string() << ", " << triangles.size() << " triangle(s)\n";
+
+    std::vector<aabb_t> aabbs(triangles.size());
+    std::vector<glm::vec3> centers(triangles.size());
+    aabb_t bounds = aabb_t::empty();
+    for (uint32_t i = 0; i < triangles.size(); i++) {
+        aabbs[i] = aabb_t::empty();
+        aabbs[i].extend(triangles[i].p0).extend(triangles[i].p1).extend(triangles[i].p2);
+        centers[i] = (triangles[i].p0 + triangles[i].p1 + triangles[i].p2) / 3.0f;
+        bounds.extend(aabbs[i]);
+    }
+
+    bvh_t bvh;
+    double build_time = time_ms([&]() { bvh = bvh_t::build(aabbs.data(), centers.data(), triangles.size(), thread_count); });
+    std::cout << "build: " << build_time << " ms (" << thread_count << " thread(s)), " << bvh.nodes.size() << " node(s), depth " << bvh.depth() << '\n';
+
+    // primary rays first, the shadow and diffuse rays start where they hit
+    std::vector<camera_t> cameras = scripted_cameras(bounds);
+    ray_set_t ray_sets[] = { { "primary", false, {} }, { "shadow", true, {} }, { "diffuse", false, {} } };
+    std::vector<ray_t>& primary_rays = ray_sets[0].rays;
+    const float aspect = static_cast<float>(width) / static_cast<float>(height);
+    for (auto& camera : cameras) {
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                float u = 2.0f * (static_cast<float>(x) + 0.5f) / static_cast<float>(width) - 1.0f;
+                float v = 2.0f * (static_cast<float>(y) + 0.5f) / static_cast<float>(height) - 1.0f;
+                ray_t ray{};
+                ray.origin = camera.eye;
+                ray.direction = camera.dir + u * aspect * camera.right + v * camera.up;
+                ray.tmin = 0;
+                ray.tmax = std::numeric_limits<float>::max();
+                primary_rays.push_back(ray);
+            }
+        }
+    }
+
+    glm::vec3 light = (bounds.min + bounds.max) * 0.5f;
+    light.y = bounds.min.y + bounds.diagonal().y * 0.9f;
+    const float epsilon = 1e-4f * glm::length(bounds.diagonal());
+
+    // shading of the first camera for --image, lambert from the light, 0 when shadowed
+    std::vector<uint8_t> image(3 * width * height, 0);
+    std::mt19937 rng{ 0 };
+    std::uniform_real_distribution<float> distribution{ 0, 1 };
+    for (uint32_t i = 0; i < primary_rays.size(); i++) {
+        ray_t ray = primary_rays[i];
+        hit_t hit = bvh.closest_hit(ray, triangles);
+        if (!hit)
+            continue;
+
+        const triangle_t& triangle = triangles[hit.primitive_index];
+        glm::vec3 normal = glm::normalize(glm::cross(triangle.p1 - triangle.p0, triangle.p2 - triangle.p0));
+        if (glm::dot(normal, ray.direction) > 0)
+            normal = -normal;
+        glm::vec3 origin = ray.origin + ray.direction * ray.tmax + normal * epsilon;
+
+        ray_t shadow_ray{};
+        shadow_ray.origin = origin;
+        shadow_ray.direction = light - origin;
+        shadow_ray.tmin = 0;
+        shadow_ray.tmax = 1.0f;
+        ray_sets[1].rays.push_back(shadow_ray);
+
+        // cosine weighted around the normal
+        float phi = 2.0f * 3.14159265f * distribution(rng);
+        float r2 = distribution(rng);
+        glm::vec3 tangent = glm::normalize(glm::cross(std::abs(normal.x) > 0.5f ? glm::vec3{ 0, 1, 0 } : glm::vec3{ 1, 0, 0 }, normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        ray_t diffuse_ray{};
+        diffuse_ray.origin = origin;
+        diffuse_ray.direction = std::sqrt(r2) * (std::cos(phi) * tangent + std::sin(phi) * bitangent) + std::sqrt(1.0f - r2) * normal;
+        diffuse_ray.tmin = 0;
+        diffuse_ray.tmax = std::numeric_limits<float>::max();
+        ray_sets[2].rays.push_back(diffuse_ray);
+
+        if (!image_path.empty() && i < width * height) {
+            ray_t occlusion_ray = shadow_ray;
+            float shade = bvh.any_hit(occlusion_ray, triangles) ? 0.0f : std::max(0.0f, glm::dot(normal, glm::normalize(shadow_ray.direction)));
+            uint8_t value = static_cast<uint8_t>(std::min(255.0f, 32.0f + 223.0f * shade));
+            image[3 * i + 0] = image[3 * i + 1] = image[3 * i + 2] = value;
+        }
+    }
+
+    std::cout << "cameras: " << cameras.size() << ", " << width << "x" << height << '\n';
+    std::vector<ray_stats_t> ray_stats;
+    for (auto& [name, any_hit, rays] : ray_sets) {
+        // best of 3 single threaded runs, every run traces copies since traversal shrinks tmax
+        double best = std::numeric_limits<double>::max();
+        for (uint32_t run = 0; run < 3; run++) {
+            best = std::min(best, time_ms([&]() {
+                for (auto ray : rays) {
+                    if (any_hit)
+                        bvh.any_hit(ray, triangles);
+                    else
+                        bvh.closest_hit(ray, triangles);
+                }
+            }));
+        }
+
+        // counted in a separate pass so the counters do not slow down the timed one
+        ray_stats_t stats = ray_stats_t::trace(bvh.view(), rays, triangles, any_hit, thread_count);
+        std::cout << name << ": " << rays.size() << " ray(s), " << rays.size() / (best * 1000.0) << " Mrays/s, " << stats.nodes().mean << " node(s)/ray, "
+                  << stats.leaves().mean << " leaf(s)/ray, " << stats.primitives().mean << " triangle(s)/ray\n";
+        if (!heatmap_path.empty() && &rays == &primary_rays) {
+            write_ppm(heatmap_path, stats.heatmap(width, height), width, height);
+            std::cout << "heatmap: " << heatmap_path.string() << '\n';
+        }
+        ray_stats.push_back(std::move(stats));
+    }
+
+    if (!report_path.empty()) {
+        std::ofstream out(report_path);
+        out << "{ \"model\": ";
+        write_json_string(out, model_path.filename().string());
+        out << ", \"triangles\": " << triangles.size() << ", \"build_ms\": " << build_time
+            << ", \"threads\": " << thread_count << ", \"bvh\": ";
+        bvh_stats_t::compute(bvh.view(), triangles, thread_count).write_json(out);
+        out << ", \"rays\": { ";
+        for (uint32_t i = 0; i < ray_stats.size(); i++) {
+            out << (i ? ", " : "") << '"' << ray_sets[i].name << "\": ";
+            ray_stats[i].write_json(out);
+        }
+        out << " } }\n";
+        std::cout << "report: " << report_path.string() << '\n';
+    }
+
+    if (render_samples) {
+        const camera_t& camera = cameras[0];
+        glm::mat4 inverse_view = glm::inverse(glm::lookAt(camera.eye, camera.eye + camera.dir, camera.up));
+        glm::mat4 inverse_projection = glm::inverse(glm::perspective(glm::radians(90.0f), aspect, 0.01f, 1000.0f));
+        core::thread_pool_t thread_pool{ thread_count };
+        cpu_renderer_t renderer{ bvh.view(), triangles, thread_pool };
+        renderer.resize(width, height);
+
+        double render_time = 0, utilization = 0;
+        for (uint32_t sample = 0; sample < render_samples; sample++) {
+            cpu_renderer_t::render_stats_t stats = renderer.render(inverse_view, inverse_projection);
+            render_time += stats.render_ms;
+            utilization += stats.utilization() / render_samples;
+        }
+        std::cout << "render: " << render_samples << " sample(s), " << render_time / render_samples << " ms/sample (" << thread_count
+                  << " thread(s)), utilization " << utilization * 100.0 << "%\n";
+
+        std::vector<uint8_t> rgba(4 * width * height);
+        renderer.resolve(rgba.data());
+        for (uint32_t i = 0; i < width * height; i++)
+            std::memcpy(image.data() + 3 * i, rgba.data() + 4 * i, 3);
+    }
+
+    if (!image_path.empty()) {
+        write_ppm(image_path, image, width, height);
+        std::cout << "image: " << image_path.string() << '\n';
+    }
+    return 0;
+}
@@ -5,6 +5,9 @@
 #include "core/mesh.hpp"
 #include "core/material.hpp"
 #include "core/model.hpp"
+#include "core/meshlet.hpp"
+#include "core/asset_pack.hpp"
+#include "core/packed_vertex.hpp"
 
 #include "renderer.hpp"
 
@@ -20,6 +23,8 @@
 #include <iostream>
 #include <algorithm>
 #include <chrono>
+#include <filesystem>
+#include <string_view>
 
 
 
@@ -28,7 +33,26 @@ int main(int argc, char **argv) {
     auto context = core::make_ref<gfx::vulkan::context_t>(window, 2, true);
     core::ImGui_init(window, context);
 
-    renderer_t renderer{ window, context }; 
+    // hiz [--no-mesh-optimization] [--float-positions] [--pack file.pack]
+    // run both ways with and without --no-mesh-optimization to compare the gpu times of the passes with and without
+    // core::optimize_mesh, --float-positions keeps float positions in the vertex buffers instead of unorm16 for meshes
+    // whose shared edges crack, --pack loads an asset_pack_cli pack instead of importing the gltf, its meshes come
+    // optimized and its meshlets and textures cooked
+    bool optimize_meshes = true;
+    core::vertex_position_format_t position_format = core::vertex_position_format_t::e_unorm16;
+    std::filesystem::path pack_path;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--no-mesh-optimization") {
+            optimize_meshes = false;
+        } else if (arg == "--float-positions") {
+            position_format = core::vertex_position_format_t::e_float;
+        } else if (arg == "--pack" && i + 1 < argc) {
+            pack_path = argv[++i];
+        }
+    }
+
+    renderer_t renderer{ window, context, position_format }; 
 
     editor_camera_t editor_camera{ window };
 
@@ -39,83 +63,134 @@ int main(int argc, char **argv) {
         .loadFromPath(context, "../../assets/textures/default.png");
     loaded_images.push_back(default_missing_image);
 
-    auto model = core::load_model_from_path("../../assets/models/Sponza/glTF/Sponza.gltf");
-    {
-        for (auto mesh : model.meshes) {
-            gpu_mesh_t gpu_mesh{};
-            core::ref<gfx::vulkan::buffer_t> staging_buffer;
-
-            staging_buffer = gfx::vulkan::buffer_builder_t{}
-                .build(context,
-                       mesh.vertices.size() * sizeof(core::vertex_t),
-                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-                       );
-            gpu_mesh.vertex_buffer = gfx::vulkan::buffer_builder_t{}
-                .build(context,
-                       mesh.vertices.size() * sizeof(core::vertex_t),
-                       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
-                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-                       );
-                    
-            std::memcpy(staging_buffer->map(), mesh.vertices.data(), mesh.vertices.size() * sizeof(core::vertex_t));
-            staging_buffer->unmap();
-
-            gfx::vulkan::buffer_t::copy(context, *staging_buffer, *gpu_mesh.vertex_buffer, VkBufferCopy{
-                .size = mesh.vertices.size() * sizeof(core::vertex_t)
-            });
+    uint64_t vertex_bytes = 0, packed_vertex_bytes = 0;
+    uint64_t meshlet_count = 0;
+    // meshlet_mesh has to be over the indices as uploaded, the meshlets are ranges of the index buffer so it needs no reordering
+    auto add_mesh = [&](const core::mesh_t& mesh, core::ref<gfx::vulkan::image_t> diffuse_map, core::meshlet_mesh_t&& meshlet_mesh) {
+        gpu_mesh_t gpu_mesh{};
+        core::ref<gfx::vulkan::buffer_t> staging_buffer;
+
+        core::packed_mesh_t packed_mesh = core::pack_mesh(mesh, position_format);
+        vertex_bytes += mesh.vertices.size() * sizeof(core::vertex_t) + mesh.indices.size() * sizeof(uint32_t);
+        packed_vertex_bytes += packed_mesh.vertices.size() + packed_mesh.indices.size();
+
+        staging_buffer = gfx::vulkan::buffer_builder_t{}
+            .build(context,
+                   packed_mesh.vertices.size(),
+                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                   );
+        gpu_mesh.vertex_buffer = gfx::vulkan::buffer_builder_t{}
+            .build(context,
+                   packed_mesh.vertices.size(),
+                   VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+                   );
+                
+        std::memcpy(staging_buffer->map(), packed_mesh.vertices.data(), packed_mesh.vertices.size());
+        staging_buffer->unmap();
+
+        gfx::vulkan::buffer_t::copy(context, *staging_buffer, *gpu_mesh.vertex_buffer, VkBufferCopy{
+            .size = packed_mesh.vertices.size()
+        });
 
-            
-            
-            staging_buffer = gfx::vulkan::buffer_builder_t{}
-                .build(context,
-                       mesh.indices.size() * sizeof(uint32_t),
-                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-                       );
-            gpu_mesh.index_buffer = gfx::vulkan::buffer_builder_t{}
-                .build(context,
-                       mesh.indices.size() * sizeof(uint32_t),
-                       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-                       );
-                    
-            std::memcpy(staging_buffer->map(), mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
-            staging_buffer->unmap();
-
-            gfx::vulkan::buffer_t::copy(context, *staging_buffer, *gpu_mesh.index_buffer, VkBufferCopy{
-                .size = mesh.indices.size() * sizeof(uint32_t)
-            });
-
-            gpu_mesh.material_descriptor_set = renderer.get_material_descriptor_set()->new_descriptor_set();
+        
+        
+        staging_buffer = gfx::vulkan::buffer_builder_t{}
+            .build(context,
+                   packed_mesh.indices.size(),
+                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                   );
+        gpu_mesh.index_buffer = gfx::vulkan::buffer_builder_t{}
+            .build(context,
+                   packed_mesh.indices.size(),
+                   VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+                   );
+                
+        std::memcpy(staging_buffer->map(), packed_mesh.indices.data(), packed_mesh.indices.size());
+        staging_buffer->unmap();
+
+        gfx::vulkan::buffer_t::copy(context, *staging_buffer, *gpu_mesh.index_buffer, VkBufferCopy{
+            .size = packed_mesh.indices.size()
+        });
+        gpu_mesh.index_type = packed_mesh.index_size == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        gpu_mesh.position_offset = packed_mesh.position_offset;
+        gpu_mesh.position_scale = packed_mesh.position_scale;
+
+        gpu_mesh.material_descriptor_set = renderer.get_material_descriptor_set()->new_descriptor_set();
+        gpu_mesh.material_descriptor_set->write()
+            .pushImageInfo(0, 1, diffuse_map->descriptor_info(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL))
+            .update();
+
+        gpu_mesh.vertex_count = mesh.vertices.size();
+        gpu_mesh.index_count = mesh.indices.size();
+
+        draw_data_info_t draw_data_info;
+        draw_data_info.gpu_mesh = gpu_mesh;
+        draw_data_info.gpu_mesh.aabb = mesh.aabb;
+        draw_data_info.gpu_mesh.meshlet_mesh = core::make_ref<core::meshlet_mesh_t>(std::move(meshlet_mesh));
+        meshlet_count += draw_data_info.gpu_mesh.meshlet_mesh->meshlets.size();
+        draw_data_infos.push_back(draw_data_info);
+    };
+
+    if (!pack_path.empty()) {
+        auto asset_pack = core::asset_pack_t::open(pack_path);
+        if (!asset_pack) {
+            ERROR("Failed to open asset pack {}", pack_path.string());
+            std::terminate();
+        }
+        // materials share textures, each is uploaded once
+        std::vector<core::ref<gfx::vulkan::image_t>> pack_images(asset_pack->textures().size());
+        for (const core::pack_mesh_t& pack_mesh : asset_pack->meshes()) {
+            core::mesh_t mesh{};
+            auto vertices = asset_pack->vertices(pack_mesh);
+            auto indices = asset_pack->indices(pack_mesh);
+            mesh.vertices.assign(vertices.begin(), vertices.end());
+            mesh.indices.assign(indices.begin(), indices.end());
+            mesh.aabb = pack_mesh.aabb;
+
+            core::meshlet_mesh_t meshlet_mesh{};
+            auto meshlets = asset_pack->meshlets(pack_mesh);
+            auto meshlet_bounds = asset_pack->meshlet_bounds(pack_mesh);
+            auto meshlet_vertices = asset_pack->meshlet_vertices(pack_mesh);
+            auto meshlet_triangles = asset_pack->meshlet_triangles(pack_mesh);
+            meshlet_mesh.meshlets.assign(meshlets.begin(), meshlets.end());
+            meshlet_mesh.bounds.assign(meshlet_bounds.begin(), meshlet_bounds.end());
+            meshlet_mesh.vertices.assign(meshlet_vertices.begin(), meshlet_vertices.end());
+            meshlet_mesh.triangles.assign(meshlet_triangles.begin(), meshlet_triangles.end());
+
+            core::ref<gfx::vulkan::image_t> diffuse_map = default_missing_image;
+            const uint32_t texture_index = asset_pack->materials()[pack_mesh.material_index].diffuse_map;
+            if (texture_index != core::pack_material_t::no_texture) {
+                if (!pack_images[texture_index]) {
+                    const core::pack_texture_t& texture = asset_pack->textures()[texture_index];
+                    pack_images[texture_index] = gfx::vulkan::image_builder_t{}
+                        .loadFromPixels(context, asset_pack->pixels(texture).data(), texture.width, texture.height);
+                    loaded_images.push_back(pack_images[texture_index]);
+                }
+                diffuse_map = pack_images[texture_index];
+            }
+            add_mesh(mesh, diffuse_map, std::move(meshlet_mesh));
+        }
+    } else {
+        auto model = core::load_model_from_path("../../assets/models/Sponza/glTF/Sponza.gltf", std::thread::hardware_concurrency(), optimize_meshes);
+        for (auto& mesh : model.meshes) {
+            core::ref<gfx::vulkan::image_t> diffuse_map = default_missing_image;
             auto it = std::find_if(mesh.material_description.texture_infos.begin(), mesh.material_description.texture_infos.end(), [](const core::texture_info_t& texture_info) {
                 return texture_info.texture_type == core::texture_type_t::e_diffuse_map;
             });
             if (it != mesh.material_description.texture_infos.end()) {
-                auto image = gfx::vulkan::image_builder_t{}
+                diffuse_map = gfx::vulkan::image_builder_t{}
                     .loadFromPath(context, it->file_path);
-                loaded_images.push_back(image);
-                gpu_mesh.material_descriptor_set->write()
-                    .pushImageInfo(0, 1, image->descriptor_info(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL))
-                    .update();
-            } else {
-                gpu_mesh.material_descriptor_set->write()
-                    .pushImageInfo(0, 1, default_missing_image->descriptor_info(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL))
-                    .update();
+                loaded_images.push_back(diffuse_map);
             }
-
-
-            gpu_mesh.vertex_count = mesh.vertices.size();
-            gpu_mesh.index_count = mesh.indices.size();
-            
-            
-            // material
-            draw_data_info_t draw_data_info;
-            draw_data_info.gpu_mesh = gpu_mesh;
-            draw_data_info.gpu_mesh.aabb = mesh.aabb;
-            draw_data_infos.push_back(draw_data_info);
+            add_mesh(mesh, diffuse_map, core::build_meshlets(mesh));
         }
     }
+    INFO("vertex and index memory {} MB, {} MB packed", vertex_bytes / (1024 * 1024), packed_vertex_bytes / (1024 * 1024));
+    INFO("{} meshlet(s) in {} mesh(es)", meshlet_count, draw_data_infos.size());
 
     auto imgui_dsl = gfx::vulkan::descriptor_set_layout_builder_t{}
         .addLayoutBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
@@ -126,6 +201,9 @@ int main(int argc, char **argv) {
         .update();
     
     float target_FPS = 1000.f;
+    // last gpu times that were ready
+    float depth_pre_time = 0, deferred_time = 0;
+    bool cone_culling = false;
     auto last_time = std::chrono::system_clock::now();
     while (!window->should_close()) {
         window->poll_events();
@@ -176,6 +254,14 @@ int main(int argc, char **argv) {
 
             ImGui::Begin("debug");
             ImGui::Text("%f", ImGui::GetIO().Framerate);
+            ImGui::Text("meshes %s", !pack_path.empty() ? "from the pack" : optimize_meshes ? "optimized" : "as imported");
+            depth_pre_time = renderer.get_depth_pre_time().value_or(depth_pre_time);
+            deferred_time = renderer.get_deferred_time().value_or(deferred_time);
+            ImGui::Text("depth prepass %f ms", depth_pre_time);
+            ImGui::Text("deferred %f ms", deferred_time);
+            ImGui::Text("meshlets %u / %u", renderer.get_visible_meshlet_count(), renderer.get_meshlet_count());
+            ImGui::Checkbox("meshlet cone culling", &cone_culling);
+            renderer.set_cone_culling(cone_culling);
             ImGui::End();
 
             core::ImGui_endframe(commandbuffer);
@@ -1,6 +1,6 @@
 #include "renderer.hpp"
 
-#define MAX_INDIRECT_COMMANDS 100  // for now
+#define MAX_INDIRECT_COMMANDS (1 << 16)  // one per meshlet
 
 static core::ref<gfx::vulkan::descriptor_set_layout_t> s_material_descriptor_set_layout;
 
@@ -21,7 +21,7 @@ static uint32_t power_of_2_before(uint32_t value) {
     }
 }
 
-renderer_t::renderer_t(core::ref<core::window_t> window, core::ref<gfx::vulkan::context_t> context) 
+renderer_t::renderer_t(core::ref<core::window_t> window, core::ref<gfx::vulkan::context_t> context, core::vertex_position_format_t position_format) 
     : _window(window),
     _context(context) {
 
@@ -130,9 +130,9 @@ renderer_t::renderer_t(core::ref<core::window_t> window, core::ref<gfx::vulkan::
             .build(_context, sizeof(VkDrawIndexedIndirectCommand) * MAX_INDIRECT_COMMANDS, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
         _indirect_draws.push_back(indirect_draw);
 
-        auto aabbs = gfx::vulkan::buffer_builder_t{}
-            .build(_context, sizeof(core::aabb_t) * MAX_INDIRECT_COMMANDS, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-        _aabbs.push_back(aabbs);
+        auto meshlet_bounds = gfx::vulkan::buffer_builder_t{}
+            .build(_context, sizeof(core::meshlet_bounds_t) * MAX_INDIRECT_COMMANDS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        _meshlet_bounds.push_back(meshlet_bounds);
 
         auto culling_settings = gfx::vulkan::buffer_builder_t{}
             .build(_context, sizeof(culling_settings_t), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
@@ -141,21 +141,31 @@ renderer_t::renderer_t(core::ref<core::window_t> window, core::ref<gfx::vulkan::
         auto culling_descriptor_set = _culling_descriptor_set_layout->new_descriptor_set();
         culling_descriptor_set->write()
             .pushBufferInfo(0, 1, culling_settings->descriptor_info())
-            .pushBufferInfo(1, 1, aabbs->descriptor_info(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+            .pushBufferInfo(1, 1, meshlet_bounds->descriptor_info(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
             .pushBufferInfo(2, 1, indirect_draw->descriptor_info(), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
             .pushImageInfo(3, 1, _hiz_image->descriptor_info(VK_IMAGE_LAYOUT_GENERAL))
             .update();
         _culling_descriptor_sets.push_back(culling_descriptor_set);
     }
+    _submitted_meshlet_counts.resize(_context->MAX_FRAMES_IN_FLIGHT, 0);
+
+    // both formats read as vec4 positions in the shaders, only the stride, position format and attribute offsets differ
+    const bool float_positions = position_format == core::vertex_position_format_t::e_float;
+    const uint32_t vertex_stride = float_positions ? sizeof(core::packed_float_vertex_t) : sizeof(core::packed_vertex_t);
+    const VkFormat vertex_position_format = float_positions ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R16G16B16A16_UNORM;
+    const uint32_t normal_offset = float_positions ? offsetof(core::packed_float_vertex_t, normal) : offsetof(core::packed_vertex_t, normal);
+    const uint32_t tangent_offset = float_positions ? offsetof(core::packed_float_vertex_t, tangent) : offsetof(core::packed_vertex_t, tangent);
+    const uint32_t uv_offset = float_positions ? offsetof(core::packed_float_vertex_t, uv) : offsetof(core::packed_vertex_t, uv);
 
     _depth_pre_pipeline = gfx::vulkan::pipeline_builder_t{}
         .add_shader("../../assets/new_shaders/depth/glsl.vert")
         .add_shader("../../assets/new_shaders/depth/glsl.frag")
         .add_descriptor_set_layout(_camera_uniform_descriptor_set_layout)  // set 0
+        .add_push_constant_range(0, sizeof(mesh_push_constant_t), VK_SHADER_STAGE_VERTEX_BIT)
         .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR)
         .add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
-        .add_vertex_input_binding_description(0, sizeof(core::vertex_t), VK_VERTEX_INPUT_RATE_VERTEX)
-        .add_vertex_input_attribute_description(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(core::vertex_t, position))
+        .add_vertex_input_binding_description(0, vertex_stride, VK_VERTEX_INPUT_RATE_VERTEX)
+        .add_vertex_input_attribute_description(0, 0, vertex_position_format, 0)
         .build(_context, _depth_pre_renderpass->renderpass());
     
     _deferred_pipeline = gfx::vulkan::pipeline_builder_t{}
@@ -163,6 +173,7 @@ renderer_t::renderer_t(core::ref<core::window_t> window, core::ref<gfx::vulkan::
         .add_shader("../../assets/new_shaders/deferred/glsl.frag")
         .add_descriptor_set_layout(_camera_uniform_descriptor_set_layout)
         .add_descriptor_set_layout(get_material_descriptor_set())
+        .add_push_constant_range(0, sizeof(mesh_push_constant_t), VK_SHADER_STAGE_VERTEX_BIT)
         .add_default_color_blend_attachment_state()
         .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR)
         .add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
@@ -178,9 +189,11 @@ renderer_t::renderer_t(core::ref<core::window_t> window, core::ref<gfx::vulkan::
 			.minDepthBounds = 0,
 			.maxDepthBounds = 1,
 		})
-        .add_vertex_input_binding_description(0, sizeof(core::vertex_t), VK_VERTEX_INPUT_RATE_VERTEX)
-        .add_vertex_input_attribute_description(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(core::vertex_t, position))
-        .add_vertex_input_attribute_description(0, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(core::vertex_t, uv))
+        .add_vertex_input_binding_description(0, vertex_stride, VK_VERTEX_INPUT_RATE_VERTEX)
+        .add_vertex_input_attribute_description(0, 0, vertex_position_format, 0)
+        .add_vertex_input_attribute_description(0, 1, VK_FORMAT_R16G16_SNORM, normal_offset)
+        .add_vertex_input_attribute_description(0, 2, VK_FORMAT_R16G16_SFLOAT, uv_offset)
+        .add_vertex_input_attribute_description(0, 3, VK_FORMAT_R16G16_SNORM, tangent_offset)
         .build(context, _deferred_renderpass->renderpass());
 
     _copy_pipeline = gfx::vulkan::pipeline_builder_t{}
@@ -204,6 +217,17 @@ renderer_t::~renderer_t() {
         s_material_descriptor_set_layout.reset();
 }
 
+void renderer_t::draw_meshlets(VkCommandBuffer commandbuffer, uint32_t current_index, uint32_t first_command, uint32_t meshlet_count) {
+    const VkBuffer indirect_draw = _indirect_draws[current_index]->buffer();
+    if (_context->physical_device_features().multiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(commandbuffer, indirect_draw, first_command * sizeof(VkDrawIndexedIndirectCommand), meshlet_count, sizeof(VkDrawIndexedIndirectCommand));
+        return;
+    }
+    for (uint32_t i = 0; i < meshlet_count; i++) {
+        vkCmdDrawIndexedIndirect(commandbuffer, indirect_draw, (first_command + i) * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
 core::ref<gfx::vulkan::descriptor_set_layout_t> renderer_t::get_material_descriptor_set() {
     if (!s_material_descriptor_set_layout) {
         ERROR("material descriptor set layout not built");
@@ -217,10 +241,18 @@ void renderer_t::render(VkCommandBuffer commandbuffer, uint32_t current_index, c
     // potentially sort, cull and batch draw cmds
     // assuming the draws are sorted by material and meshes (only for now)
     auto final_draw_data_infos = draw_data_infos;
-    assert(final_draw_data_infos.size() < MAX_INDIRECT_COMMANDS);
 
-    if (final_draw_data_infos.size() >= MAX_INDIRECT_COMMANDS) {
-        ERROR("more than 100 indirect commands");
+    // one indirect command per meshlet, a mesh draws its meshlets with one multi draw starting at its first command
+    std::vector<uint32_t> first_commands(final_draw_data_infos.size());
+    uint32_t meshlet_count = 0;
+    for (int i = 0; i < final_draw_data_infos.size(); i++) {
+        first_commands[i] = meshlet_count;
+        meshlet_count += final_draw_data_infos[i].gpu_mesh.meshlet_mesh->meshlets.size();
+    }
+    assert(meshlet_count < MAX_INDIRECT_COMMANDS);
+
+    if (meshlet_count >= MAX_INDIRECT_COMMANDS) {
+        ERROR("more than {} indirect commands", MAX_INDIRECT_COMMANDS);
         std::terminate();
     }
 
@@ -228,18 +260,29 @@ void renderer_t::render(VkCommandBuffer commandbuffer, uint32_t current_index, c
     frustum_t frustum{editor_camera, float(width) / float(height), 1, editor_camera.near(), editor_camera.far()};
 
     auto indirect_draw = reinterpret_cast<VkDrawIndexedIndirectCommand *>(_indirect_draws[current_index]->map());
-    auto aabb_data = reinterpret_cast<core::aabb_t *>(_aabbs[current_index]->map());
+    auto meshlet_bounds_data = reinterpret_cast<core::meshlet_bounds_t *>(_meshlet_bounds[current_index]->map());
     auto culling_data = reinterpret_cast<culling_settings_t *>(_culling_settings[current_index]->map());
 
+    // the frame that last used these commands has finished, so the culling results can be read back
+    _visible_meshlet_count = 0;
+    for (uint32_t i = 0; i < _submitted_meshlet_counts[current_index]; i++) {
+        _visible_meshlet_count += indirect_draw[i].instanceCount != 0;
+    }
+    _submitted_meshlet_counts[current_index] = meshlet_count;
+    _meshlet_count = meshlet_count;
+
     for (int i = 0; i < final_draw_data_infos.size(); i++) {
-        auto& p = indirect_draw[i];
-        p.firstIndex = 0;
-        p.firstInstance = 0;
-        p.indexCount = final_draw_data_infos[i].gpu_mesh.index_count;
-        p.vertexOffset = 0;
-        p.instanceCount = 0;
-
-        aabb_data[i] = final_draw_data_infos[i].gpu_mesh.aabb;
+        const core::meshlet_mesh_t& meshlet_mesh = *final_draw_data_infos[i].gpu_mesh.meshlet_mesh;
+        for (uint32_t j = 0; j < meshlet_mesh.meshlets.size(); j++) {
+            auto& p = indirect_draw[first_commands[i] + j];
+            p.firstIndex = meshlet_mesh.meshlets[j].triangle_offset * 3;
+            p.firstInstance = 0;
+            p.indexCount = meshlet_mesh.meshlets[j].triangle_count * 3;
+            p.vertexOffset = 0;
+            p.instanceCount = 0;
+
+            meshlet_bounds_data[first_commands[i] + j] = meshlet_mesh.bounds[j];
+        }
     }    
 
     culling_data->bottom_face = frustum.bottom_face;
@@ -256,7 +299,10 @@ void renderer_t::render(VkCommandBuffer commandbuffer, uint32_t current_index, c
     culling_data->hiz_width = static_cast<float>(hiz_width);
     culling_data->hiz_height = static_cast<float>(hiz_height);
 
-    culling_data->size = final_draw_data_infos.size();
+    culling_data->camera_position = editor_camera.position();
+    culling_data->cone_culling = _cone_culling;
+
+    culling_data->size = meshlet_count;
 
     VkClearValue clear_color{};
     clear_color.color = {0, 0, 0, 0};    
@@ -326,7 +372,7 @@ void renderer_t::render(VkCommandBuffer commandbuffer, uint32_t current_index, c
 
     vkCmdBindDescriptorSets(commandbuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _culling_pipeline->pipeline_layout(), 0, 1, &_culling_descriptor_sets[current_index]->descriptor_set(), 0, 0);
     _culling_pipeline->bind(commandbuffer);
-    vkCmdDispatch(commandbuffer, (final_draw_data_infos.size() / 32) + 1, 1, 1);
+    vkCmdDispatch(commandbuffer, (meshlet_count / 32) + 1, 1, 1);
 
     VkBufferMemoryBarrier buffer_memory_barrier{};
     buffer_memory_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
@@ -363,10 +409,12 @@ void renderer_t::render(VkCommandBuffer commandbuffer, uint32_t current_index, c
     
     for (int i = 0; i < final_draw_data_infos.size(); i++) {
         auto& draw_data_info = final_draw_data_infos[i];
+        mesh_push_constant_t mesh_push_constant{ glm::vec4{ draw_data_info.gpu_mesh.position_offset, 0 }, glm::vec4{ draw_data_info.gpu_mesh.position_scale, 0 } };
+        vkCmdPushConstants(commandbuffer, _depth_pre_pipeline->pipeline_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mesh_push_constant), &mesh_push_constant);
         VkDeviceSize offsets{ 0 };
         vkCmdBindVertexBuffers(commandbuffer, 0, 1, &draw_data_info.gpu_mesh.vertex_buffer->buffer(), &offsets);
-        vkCmdBindIndexBuffer(commandbuffer, draw_data_info.gpu_mesh.index_buffer->buffer(), 0, VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexedIndirect(commandbuffer, _indirect_draws[current_index]->buffer(), i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+        vkCmdBindIndexBuffer(commandbuffer, draw_data_info.gpu_mesh.index_buffer->buffer(), 0, draw_data_info.gpu_mesh.index_type);
+        draw_meshlets(commandbuffer, current_index, first_commands[i], draw_data_info.gpu_mesh.meshlet_mesh->meshlets.size());
     }
 
     // // todo: change this
@@ -405,10 +453,12 @@ void renderer_t::render(VkCommandBuffer commandbuffer, uint32_t current_index, c
     for (int i = 0; i < final_draw_data_infos.size(); i++) {
         auto& draw_data_info = final_draw_data_infos[i];
         vkCmdBindDescriptorSets(commandbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _deferred_pipeline->pipeline_layout(), 1, 1, &draw_data_info.gpu_mesh.material_descriptor_set->descriptor_set(), 0, 0);
+        mesh_push_constant_t mesh_push_constant{ glm::vec4{ draw_data_info.gpu_mesh.position_offset, 0 }, glm::vec4{ draw_data_info.gpu_mesh.position_scale, 0 } };
+        vkCmdPushConstants(commandbuffer, _deferred_pipeline->pipeline_layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mesh_push_constant), &mesh_push_constant);
         VkDeviceSize offsets{ 0 };
         vkCmdBindVertexBuffers(commandbuffer, 0, 1, &draw_data_info.gpu_mesh.vertex_buffer->buffer(), &offsets);
-        vkCmdBindIndexBuffer(commandbuffer, draw_data_info.gpu_mesh.index_buffer->buffer(), 0, VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexedIndirect(commandbuffer, _indirect_draws[current_index]->buffer(), i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+        vkCmdBindIndexBuffer(commandbuffer, draw_data_info.gpu_mesh.index_buffer->buffer(), 0, draw_data_info.gpu_mesh.index_type);
+        draw_meshlets(commandbuffer, current_index, first_commands[i], draw_data_info.gpu_mesh.meshlet_mesh->meshlets.size());
     }
 
     // // todo: change this
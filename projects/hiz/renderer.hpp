@@ -11,6 +11,8 @@
 #include "gfx/vulkan/timer.hpp"
 
 #include "core/model.hpp"
+#include "core/meshlet.hpp"
+#include "core/packed_vertex.hpp"
 
 #include "editor_camera.hpp"
 
@@ -29,15 +31,27 @@ struct model_uniform_t {
     glm::mat4 inverse_model;
 };
 
+// per draw, decodes the positions of core::packed_mesh_t
+struct mesh_push_constant_t {
+    glm::vec4 position_offset;
+    glm::vec4 position_scale;
+};
+
 struct gpu_mesh_t {
+    // core::packed_vertex_t or core::packed_float_vertex_t, whichever the renderer was made for
     core::ref<gfx::vulkan::buffer_t> vertex_buffer;
     core::ref<gfx::vulkan::buffer_t> index_buffer;
+    VkIndexType index_type;
     uint32_t index_count;
     uint32_t vertex_count;
+    glm::vec3 position_offset;
+    glm::vec3 position_scale;
     // ideally seperate descriptor ser for model & inv model matrices etc and for material so u can sort materials and reduce bindings
     // but here no model and inv model, only mat with diffuse
     core::ref<gfx::vulkan::descriptor_set_t> material_descriptor_set;  
     core::aabb_t aabb;
+    // built over the index buffer, every meshlet is culled and drawn on its own, shared by all copies of the mesh
+    core::ref<core::meshlet_mesh_t> meshlet_mesh;
 };
 
 struct draw_data_info_t {
@@ -138,11 +152,15 @@ struct culling_settings_t {
     float far; 
     float hiz_width; 
     float hiz_height; 
+    glm::vec3 camera_position;
+    // the rasterizer culls nothing, so dropping backfacing meshlets hides the back of single sided geometry
+    uint cone_culling;
 };
 
 class renderer_t {
 public:
-    renderer_t(core::ref<core::window_t> window, core::ref<gfx::vulkan::context_t> context);
+    // every mesh drawn has to be packed with position_format, the pipelines bind its vertex layout
+    renderer_t(core::ref<core::window_t> window, core::ref<gfx::vulkan::context_t> context, core::vertex_position_format_t position_format = core::vertex_position_format_t::e_unorm16);
 
     ~renderer_t();
 
@@ -152,7 +170,21 @@ public:
 
     core::ref<gfx::vulkan::image_t> get_albedo() { return _gbuffer_albedo_image; }
 
+    // gpu time in ms of the passes of the last finished frame, nullopt while it is still in flight
+    std::optional<float> get_depth_pre_time() { return _depth_pre_gpu_timer->get_time(); }
+    std::optional<float> get_deferred_time() { return _deferred_gpu_timer->get_time(); }
+
+    // meshlets that passed culling the last time the current frame in flight was rendered, and all meshlets
+    uint32_t get_visible_meshlet_count() { return _visible_meshlet_count; }
+    uint32_t get_meshlet_count() { return _meshlet_count; }
+
+    void set_cone_culling(bool cone_culling) { _cone_culling = cone_culling; }
+
 private:    
+    // the indirect commands [first_command, first_command + meshlet_count) of the frame, in one multi draw when the
+    // device has multiDrawIndirect and one draw per meshlet otherwise
+    void draw_meshlets(VkCommandBuffer commandbuffer, uint32_t current_index, uint32_t first_command, uint32_t meshlet_count);
+
     core::ref<core::window_t> _window;
     core::ref<gfx::vulkan::context_t> _context;
 
@@ -176,7 +208,7 @@ private:
     std::vector<core::ref<gfx::vulkan::buffer_t>> _camera_uniforms;
     std::vector<core::ref<gfx::vulkan::buffer_t>> _indirect_draws;
     std::vector<core::ref<gfx::vulkan::buffer_t>> _culling_settings;
-    std::vector<core::ref<gfx::vulkan::buffer_t>> _aabbs;
+    std::vector<core::ref<gfx::vulkan::buffer_t>> _meshlet_bounds;
 
     std::vector<core::ref<gfx::vulkan::descriptor_set_t>> _camera_uniform_descriptor_sets;
     core::ref<gfx::vulkan::descriptor_set_t> _storage_sampler_image_copy_descriptor_set;    
@@ -189,6 +221,12 @@ private:
     core::ref<gfx::vulkan::pipeline_t> _gen_hiz_mips_pipeine;
     core::ref<gfx::vulkan::pipeline_t> _culling_pipeline;
 
+    // indirect commands written into each frame in flight
+    std::vector<uint32_t> _submitted_meshlet_counts;
+    uint32_t _visible_meshlet_count{ 0 };
+    uint32_t _meshlet_count{ 0 };
+    bool _cone_culling{ false };
+
 };
 
 #endif
\ No newline at end of file